@@ -15,21 +15,35 @@
  *  - **std::optional for Receive()**: Because the socket is non-blocking,
  *    a receive call may have nothing to return.  We use std::optional to
  *    express "maybe a message, maybe nothing".
+ *  - **Framing**: every message travels as a length-prefixed frame (see
+ *    frame.h), so messages that TCP glued together or split apart are
+ *    reassembled exactly as they were sent.
+ *  - **Outbound queue**: a non-blocking send may take only part of a
+ *    frame.  The rest is kept in an OutboundQueue, like on the server, and
+ *    sent before anything else by FlushPending(), so the stream never
+ *    carries a truncated frame.
  */
 
 #ifndef CHAT_CLIENT_H_
 #define CHAT_CLIENT_H_
 
 #include "SFML/Network/TcpSocket.hpp"
+#include <chrono>
 #include <optional>
-#include <string>
 #include <string_view>
 
+#include "frame.h"
+#include "outbound_queue.h"
+#include "shared_frame.h"
+
 /// Simple enum to track whether we are currently connected to a server.
-enum class ConnectionStatus { NOT_CONNECTED, CONNECTED };
+enum class ConnectionStatus { NOT_CONNECTED, CONNECTING, CONNECTED };
 
 class ChatClient {
  public:
+  /// Longest time Connect() waits for the server to answer.
+  static constexpr std::chrono::seconds kConnectTimeout{5};
+
   /**
    * @brief Resolve the host name and open a TCP connection to the server.
    * @return true on success, false on failure (address not found, refused, etc.)
@@ -37,16 +51,34 @@ class ChatClient {
   [[nodiscard]] bool Connect(std::string_view host, unsigned short port);
 
   /**
-   * @brief Send a text message to the server (up to MAX_MESSAGE_LENGTH bytes).
-   * @return true if the whole message was sent successfully.
+   * @brief Send an encoded message to the server (up to MAX_FRAME_PAYLOAD bytes).
+   *
+   * What the socket does not accept right away stays queued and goes out,
+   * in order, with the next Send() or FlushPending().
+   * @return false if the connection failed, in which case it is closed.
    */
   [[nodiscard]] bool Send(std::string_view message);
 
+  /**
+   * @brief Send as much of the queued frames as the socket accepts.
+   * @return false if the connection failed, in which case it is closed.
+   */
+  [[nodiscard]] bool FlushPending();
+
+  /// @return true if frames (or parts of one) still wait to be sent.
+  [[nodiscard]] bool HasPending() const;
+
   /**
    * @brief Try to receive a message from the server (non-blocking).
-   * @return The received string, or std::nullopt if nothing is available yet.
+   *
+   * Frames already buffered are returned first; the socket is only read
+   * when the buffer holds no complete frame, and then until a frame is
+   * complete or the socket has no more data.  std::nullopt therefore means
+   * the socket is drained, as edge-triggered pollers require.
+   * @return A view on the received message, valid until the next call to
+   *         Receive(), or std::nullopt if nothing is available yet.
    */
-  [[nodiscard]] std::optional<std::string> Receive();
+  [[nodiscard]] std::optional<std::string_view> Receive();
 
   /// @return true if we believe the connection is still alive.
   [[nodiscard]] bool IsConnected() const;
@@ -54,8 +86,14 @@ class ChatClient {
   /// Gracefully close the connection.
   void Disconnect();
 
+  /// The underlying socket, to watch it with a PollerInterface.
+  [[nodiscard]] sf::TcpSocket& GetSocket();
+
  private:
   sf::TcpSocket socket_;  ///< The underlying SFML TCP socket.
+  FrameReader reader_;    ///< Reassembles frames from the byte stream.
+  FramePool framePool_;   ///< Declared first: outlives outbound_'s frames.
+  OutboundQueue outbound_;  ///< Frames the socket did not accept yet.
   ConnectionStatus status_ = ConnectionStatus::NOT_CONNECTED;
 };
 
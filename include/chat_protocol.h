@@ -0,0 +1,153 @@
+/**
+ * @file chat_protocol.h
+ * @brief Messages exchanged by the chat client and server inside frames.
+ *
+ * Every frame payload (see frame.h) is one message, encoded by
+ * MessageSchema (see wire_schema.h) with all integers big-endian:
+ *
+ *     +---------+------+----------+----------+---------+--------+----------+
+ *     | version | type | encoding | delivery | room ID | sender | sequence |
+ *     | 1 byte  | 1    | 1        | 1        | 4       | 4      | 4        |
+ *     +---------+------+----------+----------+---------+--------+----------+
+ *     | timestamp, 8 bytes                                                 |
+ *     +--------------------------------------------------------------------+
+ *     | text (CHAT, HELLO, STATE, UDP_OPEN and STATE_*), up to the end of  |
+ *     | the payload                                                        |
+ *     +--------------------------------------------------------------------+
+ *
+ *  - JOIN_ROOM / LEAVE_ROOM (client -> server) subscribe the connection to
+ *    a room or unsubscribe it.
+ *  - CHAT (both ways) carries a line of text for one room.  The server
+ *    relays it only to the connections subscribed to that room, after
+ *    setting the sender ID to the one it gave the sending connection.
+ *  - HELLO (both ways), sent by the client right after connecting, lists
+ *    the text encodings it accepts, one byte each.  The server answers
+ *    with the one it will use, and from then on both sides may send CHAT
+ *    text in that encoding (see text_compressor.h).
+ *  - PING (both ways) asks the other side for a PONG.  The server pings
+ *    a client it has not heard from for a while and closes it if the
+ *    silence lasts, which catches connections that died without a word
+ *    (see TimeoutConfig in chat_server.h); clients must answer.
+ *  - STATE (both ways) carries game state for a room, e.g. positions sent
+ *    many times per second, relayed like CHAT but neither compressed,
+ *    logged nor replayed.  Its delivery class says what the sender needs:
+ *    over the UDP channel (see udp_channel.h) a lost packet then only
+ *    delays the messages that must be reliable and ordered, where on TCP
+ *    it delays every later one.  Without a UDP channel, STATE goes over
+ *    TCP like everything else.
+ *  - UDP_OPEN (server -> client) offers the UDP channel, once HELLO was
+ *    answered: its text is a UdpOffer.  The client then sends datagrams to
+ *    that port with that token, which identifies the connection.
+ *  - STATE_SET (client -> server) writes the sender's entries of the
+ *    shared state of a room, which the server replicates to the members
+ *    with STATE_DELTA (server -> client) once per tick; clients answer
+ *    each one with a STATE_ACK.  See replicated_state.h.
+ *  - The sequence number and timestamp are chosen by the sender (e.g. a
+ *    counter and its clock in microseconds) and relayed unchanged, so a
+ *    game can order moves or measure delays.
+ *
+ * A message whose version is not PROTOCOL_VERSION is rejected.  Game
+ * messages can be declared the same way as MessageView, with their own
+ * schema.
+ */
+
+#ifndef CHAT_PROTOCOL_H_
+#define CHAT_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "wire_schema.h"
+
+/// Identifies a chat room (or channel).
+using RoomId = std::uint32_t;
+
+/// Identifies a connection, as assigned by the server.
+using ClientId = std::uint32_t;
+
+/// The room every client joins when it connects.
+inline constexpr RoomId LOBBY_ROOM = 0;
+
+/// Sender ID of messages that were not relayed by the server.
+inline constexpr ClientId NO_CLIENT = 0;
+
+/// Version of the message layout below.  Bump it on any change.
+inline constexpr std::uint8_t PROTOCOL_VERSION = 4;
+
+enum class MessageType : std::uint8_t {
+  CHAT = 1,
+  JOIN_ROOM = 2,
+  LEAVE_ROOM = 3,
+  HELLO = 4,
+  PING = 5,
+  PONG = 6,
+  STATE = 7,
+  UDP_OPEN = 8,
+  STATE_SET = 9,
+  STATE_DELTA = 10,
+  STATE_ACK = 11
+};
+
+/// How the text of a message is encoded.
+enum class TextEncoding : std::uint8_t { PLAIN = 0, DEFLATE = 1 };
+
+/// What a message needs from the transport.  Everything on TCP is
+/// reliable and ordered anyway; the UDP channel honours each class.
+enum class Delivery : std::uint8_t {
+  /// At most once, in any order: lost packets are not sent again.
+  UNRELIABLE = 0,
+  /// At most once, and never after a newer one: stale packets are dropped.
+  SEQUENCED = 1,
+  /// Exactly once, in order: sent again until acknowledged.
+  RELIABLE = 2,
+};
+
+/// A message.  Once decoded, @c text points into the payload.
+struct MessageView {
+  std::uint8_t version = PROTOCOL_VERSION;
+  MessageType type = MessageType::CHAT;
+  TextEncoding encoding = TextEncoding::PLAIN;
+  Delivery delivery = Delivery::RELIABLE;
+  RoomId room = LOBBY_ROOM;
+  ClientId sender = NO_CLIENT;
+  std::uint32_t sequence = 0;
+  std::uint64_t timestampUs = 0;
+  std::string_view text;
+};
+
+using MessageSchema =
+    WireSchema<&MessageView::version, &MessageView::type,
+               &MessageView::encoding, &MessageView::delivery,
+               &MessageView::room,
+               &MessageView::sender, &MessageView::sequence,
+               &MessageView::timestampUs, &MessageView::text>;
+
+/// Bytes in front of the text.
+inline constexpr std::size_t MESSAGE_HEADER_SIZE = MessageSchema::kFixedSize;
+
+/// Text of a UDP_OPEN message.
+struct UdpOffer {
+  std::uint64_t token = 0;  ///< Put in every datagram of the connection.
+  std::uint16_t port = 0;   ///< The server's UDP port.
+};
+
+using UdpOfferSchema = WireSchema<&UdpOffer::token, &UdpOffer::port>;
+
+/**
+ * @brief Write a message into @p out.
+ * @return The number of bytes written, or 0 if @p out is too small.
+ */
+[[nodiscard]] std::size_t EncodeMessage(const MessageView& message,
+                                        std::span<char> out);
+
+/**
+ * @brief Parse a frame payload.
+ * @return The message, or std::nullopt if the payload is malformed or of
+ *         another protocol version.
+ */
+[[nodiscard]] std::optional<MessageView> DecodeMessage(std::string_view payload);
+
+#endif  // CHAT_PROTOCOL_H_
@@ -4,13 +4,70 @@
  *
  * Architecture overview:
  *  1. A **TcpListener** listens for incoming connections on a given port.
- *  2. Each accepted client gets its own **TcpSocket** stored in a vector.
- *  3. A **SocketSelector** efficiently monitors all connected sockets so we
- *     only try to read from sockets that actually have data ready.
- *  4. When a message arrives from any client, the server **broadcasts** it
- *     to every connected client (including the sender).
+ *  2. Each accepted client gets a **Session**: its TcpSocket plus a
+ *     FrameReader that reassembles the length-prefixed frames (see frame.h).
+ *  3. A **poller** (see poller_interface.h) monitors the listener and all
+ *     connected sockets and reports only the ones that are actually ready,
+ *     so we never touch idle sessions.  epoll is used on Linux, with
+ *     sf::SocketSelector as the portable fallback.  With io_uring (opt-in)
+ *     the poller also accepts, receives and sends itself, and the server
+ *     only handles what it did.
+ *  4. Clients join and leave **rooms** (see chat_protocol.h).  When a chat
+ *     message arrives, the server relays it to the members of its room
+ *     only (including the sender), found through a RoomIndex.  Relaying
+ *     only appends the frame to each member's OutboundQueue; all the queues
+ *     that received data are flushed once at the end of the tick, several
+ *     frames per system call, and a client whose socket is full simply
+ *     keeps its backlog until the socket becomes writable again.  That
+ *     backlog is bounded: past a high watermark the server drops its
+ *     oldest frames, stops reading the client, or closes it, depending on
+ *     the BackpressureConfig.
+ *     Optionally (SetFlushInterval()) the queues are held back over
+ *     several ticks, so that busy rooms send fewer, larger segments.
+ *     Relayed messages carry the sender ID the server gave their sender,
+ *     and can also be persisted in a MessageLog.  Clients may negotiate
+ *     compressed text; each message is then compressed once and the same
+ *     frame is sent to every member that accepts it.
+ *  5. The last frames of each room are kept in a **ReplayRing**.  A client
+ *     joining the room is sent that backlog first, a batch per tick, then
+ *     the live messages (see ReplayBacklogs()).  Only the kMaxReplayRooms
+ *     rooms that relayed a message last keep theirs.
+ *  6. Each session has a timer in a **TimingWheel** (see timing_wheel.h).
+ *     A client that stays silent is sent a PING, and closed if it still
+ *     says nothing, or if it never sent its first message: connections
+ *     that died without closing (a client whose network vanished) are
+ *     found without polling every socket.
  *
- * For a turn-based game you would replace the broadcast with game-specific
+ * Each server also keeps its own health metrics (see server_metrics.h),
+ * updated without synchronisation and published a few times per second
+ * for MetricsSnapshot() to read from any thread.
+ *
+ * Game state (STATE messages) can also travel over UDP (see StartUdp()
+ * and udp_channel.h): a single socket serves every client, each datagram
+ * naming its session by the token the client was given over TCP.  STATE
+ * messages are relayed to the room like chat, over each member's UDP
+ * channel when it has one, and are neither replayed nor logged.
+ *
+ * Rooms can also hold a shared game state (see replicated_state.h), which
+ * clients write with STATE_SET.  Besides the passes of its loop, the server
+ * runs **simulation ticks** at a fixed rate (see SetTickRate()); each
+ * one, every member whose copy is behind is sent
+ * the changes since the version it acknowledged, as one STATE_DELTA
+ * (over UDP when it can).  Rooms where nothing changed and every member
+ * is up to date cost nothing.
+ *
+ * A server can also hand its listener and its clients over to a new
+ * process, e.g. a new build, without closing any connection (see
+ * ExportState() and session_handoff.h).
+ *
+ * Several ChatServer instances can also run side by side on different
+ * threads as the shards of a ShardedChatServer (see sharded_chat_server.h):
+ * each one owns its own listener and sessions, and frames that must reach
+ * the clients of other shards are passed through lock-free queues.  The
+ * shared state of each room is decided by one of them, so that the copies
+ * of every shard agree.
+ *
+ * For a turn-based game you would replace the relay with game-specific
  * logic: validate the move, update the game state, then send the new state
  * (or a delta) to all players.
  */
@@ -18,49 +75,594 @@
 #ifndef CHAT_SERVER_H_
 #define CHAT_SERVER_H_
 
-#include <SFML/Network/SocketSelector.hpp>
-#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/IpAddress.hpp>
 #include <SFML/Network/TcpSocket.hpp>
-#include <optional>
+#include <SFML/Network/UdpSocket.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "chat_protocol.h"
+#include "frame.h"
+#include "message_log.h"
+#include "mpsc_queue.h"
+#include "outbound_queue.h"
+#include "poller_interface.h"
+#include "replay_ring.h"
+#include "replicated_state.h"
+#include "reuse_port_listener.h"
+#include "room_index.h"
+#include "server_metrics.h"
+#include "session_handoff.h"
+#include "shared_frame.h"
+#include "slot_map.h"
+#include "text_compressor.h"
+#include "timing_wheel.h"
+#include "udp_channel.h"
+#include "waker.h"
+
+/// What the server does with a client whose queue passes the high watermark.
+enum class SlowConsumerPolicy : std::uint8_t {
+  /// Discard its oldest chat frames, down to the low watermark.  It misses
+  /// messages but stays connected.
+  DROP_OLDEST,
+  /// Stop reading its socket until its queue is back under the low
+  /// watermark: TCP then slows down its sending in turn.
+  PAUSE_READING,
+  /// Close it if its queue is still over the low watermark after the grace
+  /// period.
+  DISCONNECT,
+};
+
+/// Bounds on the bytes queued for each client (see ChatServer).
+struct BackpressureConfig {
+  std::size_t highWatermark = 1024 * 1024;  ///< The policy applies above.
+  std::size_t lowWatermark = 256 * 1024;    ///< Back to normal below.
+  /// Frames that would grow a queue past this are discarded and the client
+  /// is closed at the end of the tick, whatever the policy.
+  std::size_t hardLimit = 8 * 1024 * 1024;
+  SlowConsumerPolicy policy = SlowConsumerPolicy::DISCONNECT;
+  std::chrono::milliseconds gracePeriod{5000};
+};
+
+/// How long the server waits for a client that says nothing.
+struct TimeoutConfig {
+  /// A new connection must send its first message within this.
+  std::chrono::milliseconds handshake{10000};
+  /// A client silent for this long is sent a PING.
+  std::chrono::milliseconds ping{15000};
+  /// A client silent for this long, despite the PING, is closed.
+  std::chrono::milliseconds idle{45000};
+};
+
 class ChatServer {
  public:
+  /// Simulation ticks per second until SetTickRate() is called.
+  static constexpr unsigned kDefaultTickRate = 20;
+
+  /**
+   * @brief Create a server that waits for socket readiness with @p backend.
+   * @param framePool Pool for the frames this server makes, only used by
+   *        its thread.  It must outlive the frames, including those passed
+   *        to other shards, so a group keeps the pools of all its shards
+   *        until every shard is gone; a standalone server creates its own
+   *        when none is given.
+   */
+  explicit ChatServer(PollerBackend backend = DefaultPollerBackend(),
+                      std::shared_ptr<FramePool> framePool = nullptr);
+
   /**
    * @brief Start listening for incoming connections on @p port.
+   * @param reusePort Share the port with other servers (SO_REUSEPORT) so
+   *        the kernel balances new connections between them.
    * @return true if the listener was set up successfully.
    */
-  [[nodiscard]] bool Start(unsigned short port);
+  [[nodiscard]] bool Start(unsigned short port, bool reusePort = false);
+
+  /// @return The port listened to, e.g. the one picked by the system when
+  ///         Start() was given sf::Socket::AnyPort.
+  [[nodiscard]] unsigned short Port() const;
 
   /**
-   * @brief Run one server tick: clean up, accept new clients, relay messages.
+   * @brief Offer a UDP channel for game state on @p port (see
+   *        udp_channel.h).
    *
-   * This is called in an infinite loop from main().  In a game you would
-   * also update the game simulation here.
+   * Clients are offered it once they sent their HELLO; those that already
+   * did (e.g. after ImportState()) are offered it at once.
+   * @return false if the port cannot be bound.
+   */
+  [[nodiscard]] bool StartUdp(unsigned short port);
+
+  /**
+   * @brief Make this server one shard of a group.
+   *
+   * Frames received by this server are then also forwarded to every server
+   * in @p peers, and frames forwarded by them are delivered to our clients.
+   * The shared state of each room is decided by one shard of the group,
+   * the same whichever shard asks (see SubmitStateSet()).
+   * Must be called after Start() and before the shards' threads start.
+   * @return false if the cross-thread wake-up could not be set up.
+   */
+  [[nodiscard]] bool ConnectShards(std::span<ChatServer* const> peers);
+
+  /**
+   * @brief Serve the listener and clients handed over by a predecessor
+   *        (see session_handoff.h), instead of calling Start().
+   * @return false if the listener cannot be watched.
+   */
+  [[nodiscard]] bool ImportState(const HandoffState& state);
+
+  /**
+   * @brief Describe the listener and every client for a successor process.
+   *
+   * The descriptors stay open in this process, but once the successor has
+   * them this server must not be updated again.  Needs a backend that
+   * does not complete I/O (not io_uring), which could hold bytes already
+   * received from the clients.  Backlogs still being
+   * replayed, the room histories, the shared room states and the UDP
+   * channels are not handed over: the successor offers new channels if
+   * it calls StartUdp(), and clients must write their state again.
+   */
+  [[nodiscard]] HandoffState ExportState();
+
+  /**
+   * @brief Offer compressed chat text to the clients that support it.
+   *
+   * On by default.  Messages are then compressed once per shard, whatever
+   * the number of recipients (see text_compressor.h).
+   */
+  void SetCompression(bool enabled);
+
+  /**
+   * @brief Coalesce outgoing frames over up to @p interval.
+   *
+   * By default (an interval of 0) queued frames are flushed at the end of
+   * every tick.  With a non-zero interval, frames queued during several
+   * ticks are sent together, once @p interval has passed since the oldest
+   * of them was queued: fewer system calls and TCP segments per message,
+   * in exchange for up to @p interval of added latency.  SFML enables
+   * TCP_NODELAY on every TCP socket, so the kernel adds no delay of its
+   * own: a flushed batch goes on the wire at once.
+   */
+  void SetFlushInterval(std::chrono::microseconds interval);
+
+  /// @return The poller backend in use: the one asked for, unless it was
+  ///         not available.
+  [[nodiscard]] PollerBackend Backend() const;
+
+  /**
+   * @brief Record every chat message relayed from now on in @p log.
+   *
+   * Shards of a group share one log: each appends the messages of its own
+   * clients.  Appending never blocks (see message_log.h).
+   */
+  void SetMessageLog(std::shared_ptr<MessageLog> log);
+
+  /// Bound the queue of each client as described by @p config.
+  void SetBackpressure(const BackpressureConfig& config);
+
+  /// Ping and close silent clients as described by @p config.
+  void SetTimeouts(const TimeoutConfig& config);
+
+  /**
+   * @brief Run the simulation tick @p hz times per second
+   *        (kDefaultTickRate by default).
+   *
+   * Ticks are due at fixed times from this call, not a period after the
+   * previous tick, so the rate does not drift however late each one runs.
+   * A tick late by more than a period runs once: the ones missed are
+   * skipped (see ServerMetrics::simulationTicksSkipped), not run in a
+   * burst.
+   * @p hz must not be 0.
+   */
+  void SetTickRate(unsigned hz);
+
+  /**
+   * @brief Run one server tick: expire timers, accept new clients, relay
+   *        messages, and run the simulation tick if it is due.
+   *
+   * This is called in an infinite loop from main(), and waits at most
+   * until the next simulation tick.  In a game you would also update the
+   * game simulation in SimulationTick().
    */
   void Update();
 
+  /**
+   * @brief The metrics as last published by Update().
+   *
+   * Safe to call from any thread.  The values lag behind by at most
+   * kMetricsInterval (plus one tick).
+   */
+  [[nodiscard]] ServerMetrics MetricsSnapshot() const;
+
  private:
-  /// Accept any pending client connections from the listener.
+  /// Tokens identifying the listener and the waker in poller events.
+  /// Sessions use their packed SlotHandle, which is always >= 2^32.
+  static constexpr std::uint64_t kListenerToken = 0;
+  static constexpr std::uint64_t kWakerToken = 1;
+  static constexpr std::uint64_t kUdpToken = 2;
+  /// Frames from other shards that can wait in our inbox at once.
+  static constexpr std::size_t kInboxCapacity = 4096;
+  /// Frames that can wait for one peer's full inbox.  Beyond this they are
+  /// dropped (see ServerMetrics::forwardsDropped): that peer's thread is
+  /// stuck, and queuing more would only grow our memory.
+  static constexpr std::size_t kForwardBacklog = 4 * kInboxCapacity;
+  /// How often the metrics are copied for MetricsSnapshot().
+  static constexpr auto kMetricsInterval = std::chrono::milliseconds(250);
+  /// Frames kept per room for the clients that join it later.
+  static constexpr std::size_t kReplayLength = 100;
+  /// Rooms whose last frames are kept.  Beyond this the ring of the room
+  /// quiet for the longest is dropped, so that a client chatting in ever
+  /// new rooms cannot grow our memory: each ring pins up to kReplayLength
+  /// pooled frames.
+  static constexpr std::size_t kMaxReplayRooms = 256;
+  /// Backlog frames sent to one session per tick: one gathered write.
+  static constexpr std::size_t kReplayBatch = 64;
+  /// Backlog frames sent to all the sessions together per tick, so that a
+  /// wave of joins cannot delay the live messages.
+  static constexpr std::size_t kReplayBudget = 4096;
+  /// Longest poller wait while sessions are congested: paused ones get no
+  /// events, so their queues are checked by the clock.
+  static constexpr auto kCongestionCheckInterval =
+      std::chrono::milliseconds(10);
+  /// Precision of the session timers.
+  static constexpr auto kTimerResolution = std::chrono::milliseconds(50);
+  /// Longest poller wait while UDP channels have datagrams due or reliable
+  /// messages in flight: retransmissions are timed by the clock.
+  static constexpr auto kUdpServiceInterval = std::chrono::milliseconds(5);
+  /// A delta sent over UDP and still not acknowledged is sent again after
+  /// this, if nothing changed meanwhile.
+  static constexpr auto kStateRetryInterval = std::chrono::milliseconds(100);
+
+  /// The last frames of a room.
+  struct History {
+    ReplayRing ring{kReplayLength};
+    std::list<RoomId>::iterator recency;  ///< Its place in historyRecency_.
+  };
+
+  /// A room backlog still being sent to a session.
+  struct Replay {
+    RoomId room = LOBBY_ROOM;
+    std::uint64_t next = 0;  ///< Position in the room's ReplayRing.
+  };
+
+  /// Everything the server keeps for one connected client.
+  struct Session {
+    sf::TcpSocket socket;
+    FrameReader reader;     ///< Reassembles frames from the byte stream.
+    OutboundQueue outbound;  ///< Frames waiting to be sent to this client.
+    bool flushScheduled = false;  ///< Already listed in pendingFlush_.
+    std::vector<RoomId> rooms;  ///< Joined rooms, left when removed.
+    ClientId clientId = NO_CLIENT;  ///< Stamped on the messages it sends.
+    bool deflate = false;  ///< Negotiated DEFLATE text (see HELLO).
+    /// Joined rooms whose backlog is not fully queued yet.  Live frames of
+    /// these rooms are taken from the ring too, to keep them in order.
+    std::vector<Replay> replays;
+    bool congested = false;   ///< Listed in congested_.
+    bool paused = false;      ///< Out of the poller (PAUSE_READING).
+    bool overflowed = false;  ///< Hit the hard limit: closed soon.
+    std::chrono::steady_clock::time_point congestedSince;
+    /// When bytes last came in.  Updating it re-arms the timer lazily.
+    std::chrono::steady_clock::time_point lastReceived;
+    bool greeted = false;  ///< Sent a complete message.
+    bool pinged = false;   ///< Sent a PING since lastReceived.
+    /// Names the session in its datagrams, 0 until a UDP channel is
+    /// offered.  The channel is only created by the first datagram.
+    std::uint64_t udpToken = 0;
+    std::unique_ptr<UdpChannel> udp;
+    /// Where the last datagram came from: follows a client whose NAT
+    /// mapping changed.
+    sf::IpAddress udpAddress = sf::IpAddress::Any;
+    unsigned short udpPort = 0;
+    bool udpScheduled = false;  ///< Listed in pendingUdp_.
+  };
+
+  /// Where a member of a room with shared state stands.
+  struct StateSubscriber {
+    StateVersion acked = 0;  ///< Last version it acknowledged.
+    StateVersion sent = 0;   ///< Version of the last delta sent.
+    std::chrono::steady_clock::time_point sentAt;
+    bool sentOverUdp = false;  ///< May be lost: sent again if not acked.
+  };
+
+  /// A room with shared state.
+  struct SharedRoom {
+    ReplicatedState state;
+    /// Members on this server, by packed SlotHandle.
+    std::unordered_map<std::uint64_t, StateSubscriber> subscribers;
+    /// Nothing to send until the state changes or someone joins.
+    bool settled = false;
+  };
+
+  /// Another shard of the group.
+  struct Peer {
+    ChatServer* server = nullptr;
+    /// Frames that found its inbox full.  Later frames wait behind them,
+    /// so that the peer gets every frame in the order we sent it.
+    std::deque<RelayedFrame> backlog;
+  };
+
+  /// Accept every pending client connection from the listener.
   void AcceptNewConnections();
 
-  /// Remove sockets that have been disconnected since the last tick.
-  void CleanDisconnected();
+  /// Create a session for the accepted @p socket.
+  void AddSession(sf::TcpSocket socket);
 
-  /// Read incoming data from ready sockets and broadcast to all clients.
-  void HandleMessages();
+  /**
+   * @brief Handle the session timers that expired: ping or close silent
+   *        sessions, re-arm the others.
+   *
+   * Receiving data only updates Session::lastReceived.  Each session keeps
+   * one timer, which on expiry is armed again for the deadline that
+   * follows from lastReceived if that moved.
+   */
+  void ExpireTimers();
 
-  void RemoveSocketAt(int64_t index);
+  /// @return When @p session must be checked next.
+  [[nodiscard]] std::chrono::steady_clock::time_point NextDeadline(
+      const Session& session, std::chrono::steady_clock::time_point now) const;
 
-  sf::TcpListener listener_;  ///< Listens for new TCP connections.
-  sf::SocketSelector socketSelector_;  ///< Watches multiple sockets for readiness.
+  /**
+   * @brief Wait for ready sockets, then read and relay their frames.
+   * @return The time spent waiting.
+   */
+  std::chrono::nanoseconds HandleMessages();
 
   /**
-   * Connected client sockets.
-   * Slots may be nullopt after a client disconnects; they get reused by
-   * the next connecting client.
+   * @brief Read everything available on @p session and handle its frames.
+   * @return false if the session must be removed.
    */
-  std::vector<sf::TcpSocket> sockets_;
+  [[nodiscard]] bool ReadSession(SlotHandle handle, Session& session);
+
+  /**
+   * @brief Handle the @p bytes a completion backend received for
+   *        @p session.
+   * @return false if the session must be removed.
+   */
+  [[nodiscard]] bool HandleReceived(SlotHandle handle, Session& session,
+                                    std::span<const char> bytes);
+
+  /**
+   * @brief Handle every complete frame in the reader of @p session.
+   * @return false if the session must be removed.
+   */
+  [[nodiscard]] bool HandleFrames(SlotHandle handle, Session& session);
+
+  /**
+   * @brief Act on one message received from @p session.
+   * @return false if the message is malformed.
+   */
+  [[nodiscard]] bool HandlePayload(SlotHandle handle, Session& session,
+                                   std::string_view payload);
+
+  /// Answer the HELLO of @p session, which lists the encodings it accepts.
+  void Negotiate(SlotHandle handle, Session& session, std::string_view offer);
+
+  /// Give @p session a UDP token and send it a UDP_OPEN.
+  void OfferUdp(SlotHandle handle, Session& session);
+
+  /// Read every datagram waiting on the UDP socket and handle its messages.
+  void ReceiveDatagrams();
+
+  /// Relay a STATE message from @p session to the members of its room.
+  void RelayState(const MessageView& message, const Session& session);
+
+  /**
+   * @brief Send a STATE frame to every member of @p room on this server,
+   *        over their UDP channel if it works, over TCP otherwise.
+   */
+  void SendStateToRoom(RoomId room, Delivery delivery,
+                       const RelayedFrame& frame);
+
+  /// Make sure the UDP channel of @p session is served by FlushDatagrams().
+  void ScheduleUdp(SlotHandle handle, Session& session);
+
+  /// Write the datagrams due on every scheduled channel.
+  void FlushDatagrams();
+
+  /// Apply a STATE_SET of @p owner to @p room.  @return false if invalid.
+  bool ApplyStateSet(RoomId room, ClientId owner, std::string_view entries);
+
+  /**
+   * @brief Apply the STATE_SET @p set, from its @c sender, on every shard.
+   *
+   * The budget of a room's state is shared by all its writers, so whether
+   * an entry fits depends on the entries set before it.  Each room's state
+   * thus has one deciding shard (see StateOwner()): the others pass it
+   * their STATE_SETs, and it applies them and forwards them to everyone,
+   * so that every copy applies the same sets in the same order, and
+   * refuses the same entries.
+   */
+  void SubmitStateSet(const MessageView& set);
+
+  /// @return The shard deciding the state of @p room, or nullptr if we do.
+  [[nodiscard]] Peer* StateOwner(RoomId room);
+
+  /// Record the STATE_ACK of @p handle.
+  void AcknowledgeState(SlotHandle handle, const MessageView& message);
+
+  /// Subscribe @p handle to the shared state of @p room, which it joined.
+  void JoinSharedRoom(SlotHandle handle, RoomId room);
+
+  /// Unsubscribe @p session from @p room, which it left, and remove its
+  /// entries there, on every shard.
+  void LeaveSharedRoom(SlotHandle handle, const Session& session, RoomId room);
+
+  /// Run the simulation tick if it is due, and schedule the next one.
+  void RunSimulationTick();
+
+  /// Send every member of a shared room that is behind its delta.
+  void SimulationTick();
+
+  /// Queue a protocol message (HELLO, PING...), which is never dropped.
+  void SendControl(SlotHandle handle, Session& session, MessageType type,
+                   std::string_view text = {});
+
+  /**
+   * @brief Build the frames relaying @p message from @p sender.
+   * @return false if its compressed text is corrupt.
+   */
+  [[nodiscard]] bool EncodeRelayed(const MessageView& message,
+                                   ClientId sender, RelayedFrame& out);
+
+  /// Queue one frame for every member of @p room on this server.
+  void SendToRoom(RoomId room, const RelayedFrame& frame);
+
+  /// Keep @p frame in the ring of @p room, dropping the ring of the room
+  /// quiet for the longest if there are too many.
+  void RecordHistory(RoomId room, const RelayedFrame& frame);
+
+  /// Drop the ring of @p room.  Members still replaying it get its live
+  /// frames from now on.
+  void ForgetHistory(RoomId room);
+
+  /// Send the backlog of @p room to @p session, which just joined it.
+  void StartReplay(SlotHandle handle, Session& session, RoomId room);
+
+  /**
+   * @brief Queue the next batch of backlog frames of the replaying sessions.
+   *
+   * A session gets at most kReplayBatch frames per tick, and only once its
+   * previous batch was written out, so a slow client paces its own replay.
+   * All sessions share kReplayBudget frames per tick, in turn.
+   */
+  void ReplayBacklogs();
+
+  /**
+   * @brief Queue @p frame for @p session and enforce the backpressure.
+   * @param droppable Whether the frame may be discarded for a slow client.
+   */
+  void Enqueue(SlotHandle handle, Session& session, SharedFrame frame,
+               bool droppable = true);
+
+  /// Apply the policy to @p session, whose queue passed the high watermark.
+  void OnCongested(SlotHandle handle, Session& session);
+
+  /**
+   * @brief Resume, release or close the congested sessions.
+   *
+   * Sessions are never removed while queuing, since that happens while
+   * iterating over room members; they are closed here instead.
+   */
+  void CheckCongested();
+
+  /// Unsubscribe @p session from every room it joined.
+  void LeaveAllRooms(SlotHandle handle, Session& session);
+
+  /// Make sure @p session is flushed at the next flush.
+  void ScheduleFlush(SlotHandle handle, Session& session);
+
+  /// @return How long the next poller wait may last.
+  [[nodiscard]] std::chrono::milliseconds WaitTimeout() const;
+
+  /// Hand the queued frames of every scheduled session to the kernel.
+  void FlushPending();
+
+  /// FlushPending() with a poller that batches sends: the writes of every
+  /// session go to the kernel together.
+  void FlushBatched();
+
+  /// Act on the outcome of a flush of @p session.
+  void OnFlushed(SlotHandle handle, Session& session,
+                 sf::Socket::Status status);
+
+  /// Queue a frame received by this shard for delivery by the other shards.
+  void ForwardToShards(const RelayedFrame& frame);
+
+  /// Queue @p frame for @p peer only.
+  void ForwardToShard(Peer& peer, RelayedFrame frame);
+
+  /// Push the backlog of @p peer into its inbox, in order, while it fits.
+  void DrainForwards(Peer& peer);
+
+  /// Retry forwards that found a full inbox, then deliver our own inbox.
+  void ExchangeWithShards();
+
+  void RemoveSession(SlotHandle handle);
+
+  /// Sample the gauges and copy metrics_ for MetricsSnapshot().
+  void PublishMetrics();
+
+  ReusePortListener listener_;  ///< Listens for new TCP connections.
+  /// Declared before everything that may hold frames, so it is destroyed
+  /// after them.
+  std::shared_ptr<FramePool> framePool_;
+  std::unique_ptr<PollerInterface> poller_;  ///< Watches sockets for readiness.
+  PollerBackend backend_;  ///< Of poller_.
+
+  /**
+   * Connected clients.  A session's SlotHandle is its identity everywhere
+   * (poller token, flush list...): it goes stale when the session is
+   * removed, so it can never reach a client that reused the slot.  Values
+   * in a SlotMap never move, so the poller may keep pointers to sockets.
+   */
+  SlotMap<Session> sessions_;
+  RoomIndex rooms_;  ///< Room -> subscribed sessions.
+  std::unordered_map<RoomId, History> history_;
+  /// The rooms of history_, the one that relayed a frame last first.
+  std::list<RoomId> historyRecency_;
+  std::vector<SlotHandle> replaying_;  ///< Sessions with Replay entries.
+  std::size_t replayTurn_ = 0;  ///< First of replaying_ served next tick.
+
+  /// Sessions with queued frames, flushed by FlushPending().
+  std::vector<SlotHandle> pendingFlush_;
+  /// Longest time a frame is held back before being flushed.
+  std::chrono::microseconds flushInterval_{0};
+  /// When pendingFlush_ became non-empty.
+  std::chrono::steady_clock::time_point firstScheduled_;
+  std::vector<SlotHandle> flushing_;  ///< Scratch copy of pendingFlush_.
+  std::vector<SlotHandle> sending_;   ///< In the batch of FlushBatched().
+  std::shared_ptr<MessageLog> messageLog_;  ///< Optional persistence.
+  bool compression_ = true;     ///< Offered to the clients.
+  TextCompressor compressor_;  ///< Only used by the server's own thread.
+  BackpressureConfig backpressure_;
+  std::vector<SlotHandle> congested_;  ///< Sessions over the high watermark.
+  TimeoutConfig timeouts_;
+  TimingWheel timers_{kTimerResolution};  ///< Tokens are session handles.
+  std::vector<TimingWheel::Timer> expired_;  ///< Scratch for ExpireTimers().
+
+  // --- Simulation ticks and shared state ---
+  unsigned tickRate_ = kDefaultTickRate;
+  /// Tick n is due at tickEpoch_ + n / tickRate_ seconds.
+  std::chrono::steady_clock::time_point tickEpoch_;
+  std::uint64_t tickIndex_ = 0;  ///< Of the next tick.
+  std::chrono::steady_clock::time_point nextTick_;
+  std::unordered_map<RoomId, SharedRoom> sharedRooms_;
+
+  // --- UDP (unused until StartUdp()) ---
+  sf::UdpSocket udpSocket_;
+  bool udpStarted_ = false;
+  unsigned short udpPort_ = 0;  ///< Sent in the UDP_OPEN offers.
+  std::unordered_map<std::uint64_t, SlotHandle> udpTokens_;
+  std::mt19937_64 tokenRandom_{std::random_device{}()};
+  /// Sessions whose channel has datagrams due or messages in flight.
+  std::vector<SlotHandle> pendingUdp_;
+
+  // --- Sharding (unused by a standalone server) ---
+  /// The other shards of the group, by address: the order is the same on
+  /// every shard, which is how they agree on StateOwner().
+  std::vector<Peer> peers_;
+  std::size_t shardRank_ = 0;  ///< Our place among peers_.
+  MpscQueue<RelayedFrame> inbox_{kInboxCapacity};  ///< Filled by peers.
+  Waker waker_;                        ///< Interrupts Wait() for the inbox.
+
+  // --- Metrics ---
+  ServerMetrics metrics_;  ///< Only touched by the server's own thread.
+  std::uint64_t systemCalls_ = 0;  ///< Made outside of the poller.
+  std::chrono::steady_clock::time_point nextPublish_;
+  mutable std::mutex metricsMutex_;  ///< Guards publishedMetrics_.
+  ServerMetrics publishedMetrics_;
 };
 
 #endif  // CHAT_SERVER_H_
@@ -9,7 +9,8 @@
 
 class ClientController {
  public:
-  explicit ClientController(std::unique_ptr<ClientViewInterface> view);
+  explicit ClientController(std::unique_ptr<ClientViewInterface> view,
+                            HistoryLimits historyLimits = {});
 
   void Run();
 
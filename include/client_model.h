@@ -3,8 +3,18 @@
  * @brief The **Model** in the client's MVC (Model-View-Controller) pattern.
  *
  * The Model owns the application data and business logic.  Here it:
- *  - Wraps the low-level ChatClient (networking).
- *  - Stores all received chat messages in a vector.
+ *  - Talks to the server through a NetworkThread, which runs the
+ *    low-level ChatClient on its own thread so that network latency does
+ *    not depend on the frame rate.
+ *  - Tracks the rooms we joined and stores the received chat messages of
+ *    each one in a bounded MessageHistory, so memory stays flat however
+ *    long the client runs.
+ *  - Sends game state with the delivery class it needs, over the UDP
+ *    channel the server offers (see udp_channel.h), and keeps the latest
+ *    state received from each player.
+ *  - Writes our entries of the shared state of the active room, and keeps
+ *    a replica of the shared state of every joined room, which the server
+ *    updates with deltas (see replicated_state.h).
  *  - Exposes a simple interface that the Controller can call without
  *    knowing any networking details.
  *
@@ -15,32 +25,116 @@
 #ifndef CLIENT_MODEL_H_
 #define CLIENT_MODEL_H_
 
+#include <cstdint>
+#include <map>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "chat_client.h"
+#include "chat_protocol.h"
+#include "message_history.h"
+#include "network_thread.h"
+#include "replicated_state.h"
+#include "text_compressor.h"
 
 class ClientModel {
  public:
-  /// Connect to the server at the given address and port.
+  /// @param historyLimits Bounds of the history kept for each room.
+  explicit ClientModel(HistoryLimits historyLimits = {});
+
+  /// Start the network thread.  Call once before anything else.
+  [[nodiscard]] bool Init();
+
+  /**
+   * @brief Start connecting to the server at the given address and port.
+   *
+   * Returns at once; PollMessages() later reports the outcome, and joins
+   * the lobby once connected.
+   */
   [[nodiscard]] bool Connect(std::string_view host, unsigned short port);
 
-  /// Send a chat message (or game action) to the server.
+  /// Send a chat message (or game action) to the active room.
   [[nodiscard]] bool SendMessage(std::string_view message);
 
-  /// Read all available messages from the network and store them.
+  /**
+   * @brief Send game state to the active room, e.g. our position every
+   *        frame with Delivery::SEQUENCED.
+   * @return false if @p state does not fit in a datagram.
+   */
+  [[nodiscard]] bool SendState(std::string_view state, Delivery delivery);
+
+  /**
+   * @brief Set our entry @p key of the shared state of the active room.
+   * @return false if @p value is longer than
+   *         ReplicatedState::kMaxValueSize.
+   */
+  [[nodiscard]] bool SetSharedState(std::uint16_t key, std::string_view value);
+
+  /// Remove our entry @p key of the shared state of the active room.
+  [[nodiscard]] bool RemoveSharedState(std::uint16_t key);
+
+  /// Subscribe to @p room and make it the active room.
+  [[nodiscard]] bool JoinRoom(RoomId room);
+
+  /// Unsubscribe from @p room and drop its history.  The lobby cannot be left.
+  [[nodiscard]] bool LeaveRoom(RoomId room);
+
+  /// Handle everything the network thread reported since the last call:
+  /// connection changes and received messages.  Call once per frame.
   void PollMessages();
 
-  /// Get the full list of received messages (read-only).
-  [[nodiscard]] const std::vector<std::string>& GetMessages() const;
+  /// Get the received messages of the active room, oldest first.  The view
+  /// is valid until the next call to PollMessages().
+  [[nodiscard]] MessageHistory::View GetMessages() const;
+
+  /// Get the latest state received from each player, by client ID.
+  [[nodiscard]] const std::map<ClientId, std::string>& GetStates() const;
+
+  /// Get the shared state of @p room as last received, or nullptr if the
+  /// room has none (yet).
+  [[nodiscard]] const StateReplica* GetSharedState(RoomId room) const;
+
+  /// Get the rooms we joined, in ascending order.
+  [[nodiscard]] std::span<const RoomId> GetRooms() const;
+
+  [[nodiscard]] RoomId GetActiveRoom() const;
+
+  /// Show and send to @p room, which must be one of GetRooms().
+  void SetActiveRoom(RoomId room);
 
   /// Check whether we are still connected to the server.
   [[nodiscard]] bool IsConnected() const;
 
+  /// Check whether a connection attempt is in progress.
+  [[nodiscard]] bool IsConnecting() const;
+
  private:
-  ChatClient client_;  ///< Low-level network connection.
-  std::vector<std::string> receivedMessages_;  ///< Chat history.
+  /// Encode a message for @p room and send it to the server.
+  [[nodiscard]] bool Send(MessageType type, RoomId room, std::string_view text);
+
+  /// Send a STATE_SET of one entry to the active room.
+  [[nodiscard]] bool SendStateSet(std::uint16_t key, std::string_view value,
+                                  bool remove);
+
+  /// Apply a STATE_DELTA and acknowledge it.
+  void ApplyDelta(const MessageView& message);
+
+  /// Store a message received from the server.
+  void HandlePayload(std::string_view payload);
+
+  NetworkThread network_;  ///< Owns the connection to the server.
+  ConnectionStatus status_ = ConnectionStatus::NOT_CONNECTED;
+  std::vector<RoomId> rooms_;  ///< Joined rooms, sorted.
+  RoomId activeRoom_ = LOBBY_ROOM;
+  std::uint32_t nextSequence_ = 0;  ///< Sequence number of our next message.
+  bool deflate_ = false;  ///< The server accepted DEFLATE text.
+  TextCompressor compressor_;
+  HistoryLimits historyLimits_;
+  std::map<RoomId, MessageHistory> receivedMessages_;  ///< Chat history per room.
+  std::map<ClientId, std::string> states_;  ///< Latest STATE per sender.
+  std::map<RoomId, StateReplica> sharedStates_;  ///< Per joined room.
 };
 
 #endif  // CLIENT_MODEL_H_
@@ -4,6 +4,16 @@
 #include <span>
 #include <string>
 
+#include "chat_protocol.h"
+#include "message_history.h"
+
+/// What the user asked for in the room panel this frame.
+struct RoomRequest {
+  enum class Type { NONE, JOIN, LEAVE };
+  Type type = Type::NONE;
+  RoomId room = LOBBY_ROOM;
+};
+
 class ClientViewInterface {
  public:
   virtual ~ClientViewInterface() = default;
@@ -12,9 +22,13 @@ class ClientViewInterface {
   virtual void Shutdown() = 0;
   virtual void BeginFrame() = 0;
   virtual void EndFrame() = 0;
-  virtual bool DrawConnectionPanel(std::string& address,
-                                   unsigned short& port) = 0;
-  virtual bool DrawChatPanel(std::span<const std::string> messages,
+  /// @param connecting true while a connection attempt is in progress.
+  virtual bool DrawConnectionPanel(std::string& address, unsigned short& port,
+                                   bool connecting) = 0;
+  virtual RoomRequest DrawRoomPanel(std::span<const RoomId> rooms,
+                                    RoomId& activeRoom) = 0;
+  virtual bool DrawChatPanel(RoomId activeRoom,
+                             MessageHistory::View messages,
                              std::string& sendMessage) = 0;
   [[nodiscard]] virtual bool ShouldQuit() const = 0;
 };
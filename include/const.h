@@ -16,8 +16,28 @@
 /// Maximum number of bytes in a single chat message (or game packet).
 inline constexpr std::size_t MAX_MESSAGE_LENGTH = 150;
 
-/// TCP port the server listens on and the client connects to.
+/// Number of bytes in the length prefix written in front of every frame.
+inline constexpr std::size_t FRAME_HEADER_SIZE = 4;
+
+/// Largest payload a single frame may carry.  A peer announcing a bigger
+/// frame is treated as a protocol error and disconnected.
+inline constexpr std::size_t MAX_FRAME_PAYLOAD = 4096;
+
+/// Largest UDP datagram sent.  It fits in the path MTU of nearly every
+/// network, so datagrams are never fragmented: a fragment lost would lose
+/// the whole datagram.
+inline constexpr std::size_t MAX_DATAGRAM_SIZE = 1200;
+
+/// Capacity of the per-connection receive ring buffer.  Must be a power of
+/// two and comfortably larger than one full frame.
+inline constexpr std::size_t RECEIVE_BUFFER_SIZE = 16 * 1024;
+
+/// TCP port the server listens on and the client connects to.  The UDP
+/// channel uses the same number (see udp_channel.h).
 /// Make sure this port is not already in use on your machine.
 inline constexpr std::uint16_t PORT_NUMBER = 4533;
 
+/// Loopback TCP port on which the server exposes its metrics.
+inline constexpr std::uint16_t ADMIN_PORT_NUMBER = 9533;
+
 #endif  // SIMPLE_CHAT_CONST_H
@@ -0,0 +1,57 @@
+/**
+ * @file epoll_poller.h
+ * @brief Edge-triggered epoll PollerInterface (Linux only).
+ *
+ * Sockets are registered with EPOLLET: a socket is reported once when new
+ * data arrives, and not again until it has been read down to EAGAIN.  This
+ * keeps Wait() proportional to the number of *active* connections, so a
+ * single process can hold tens of thousands of idle clients.
+ *
+ * EPOLLOUT is registered too.  Being edge-triggered it only fires when a
+ * send buffer that had filled up drains again, so it costs nothing while
+ * clients keep up and needs no epoll_ctl() call to switch it on and off.
+ */
+
+#ifndef EPOLL_POLLER_H_
+#define EPOLL_POLLER_H_
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+#include <array>
+#include <vector>
+
+#include "poller_interface.h"
+
+class EpollPoller final : public PollerInterface {
+ public:
+  EpollPoller();
+  ~EpollPoller() override;
+  EpollPoller(const EpollPoller&) = delete;
+  EpollPoller& operator=(const EpollPoller&) = delete;
+
+  /// @return true if the epoll instance was created successfully.
+  [[nodiscard]] bool IsValid() const;
+
+  [[nodiscard]] bool Add(sf::Socket& socket, std::uint64_t token) override;
+  void Remove(sf::Socket& socket) override;
+  [[nodiscard]] std::span<const PollEvent> Wait(
+      std::chrono::milliseconds timeout) override;
+  [[nodiscard]] bool IsEdgeTriggered() const override;
+  [[nodiscard]] bool ReportsWritable() const override;
+  [[nodiscard]] std::uint64_t SystemCalls() const override;
+
+ private:
+  /// Maximum number of notifications collected by one epoll_wait() call.
+  static constexpr std::size_t kMaxEvents = 1024;
+
+  int epollFd_ = -1;
+  std::array<epoll_event, kMaxEvents> rawEvents_{};
+  std::vector<PollEvent> events_;
+  std::uint64_t systemCalls_ = 0;
+};
+
+#endif  // __linux__
+
+#endif  // EPOLL_POLLER_H_
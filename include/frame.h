@@ -0,0 +1,106 @@
+/**
+ * @file frame.h
+ * @brief Length-prefixed message framing shared by the client and the server.
+ *
+ * TCP is a byte stream: it does not preserve the boundaries of the send()
+ * calls.  Two chat lines may arrive glued together in one receive(), and a
+ * single line may be split across two.  To recover the messages we put a
+ * small header in front of each one:
+ *
+ *     +----------------------+---------------------------+
+ *     | length (4 bytes, BE) | payload (`length` bytes)  |
+ *     +----------------------+---------------------------+
+ *
+ * On the receiving side a FrameReader keeps a per-connection ring buffer.
+ * One receive() call fills as much of the ring as possible, then
+ * NextFrame() is called in a loop to extract every complete frame that is
+ * buffered.  No heap allocation happens per message: the ring is allocated
+ * once when the connection is created and frames are returned as views
+ * into it.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <SFML/Network/TcpSocket.hpp>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "const.h"
+
+/// Largest number of bytes a single encoded frame (header + payload) can use.
+inline constexpr std::size_t MAX_FRAME_SIZE =
+    FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD;
+
+/**
+ * @brief Write the header followed by @p payload into @p out.
+ * @return The number of bytes written, or 0 if the payload is larger than
+ *         MAX_FRAME_PAYLOAD or @p out is too small.
+ */
+[[nodiscard]] std::size_t EncodeFrame(std::string_view payload,
+                                      std::span<char> out);
+
+/**
+ * @brief Per-connection receive ring buffer that splits the byte stream
+ *        back into frames.
+ */
+class FrameReader {
+ public:
+  FrameReader();
+
+  /**
+   * @brief Perform one receive() into the free space of the ring.
+   *
+   * Call NextFrame() until it returns std::nullopt before calling this
+   * again, so that the ring always has room for at least one full frame.
+   */
+  [[nodiscard]] sf::Socket::Status ReceiveFrom(sf::TcpSocket& socket);
+
+  /**
+   * @brief Extract the next complete frame from the ring.
+   * @return A view on the payload, valid until the next call on this reader,
+   *         or std::nullopt if no complete frame is buffered yet.
+   */
+  [[nodiscard]] std::optional<std::string_view> NextFrame();
+
+  /// @return true if the peer sent a frame larger than MAX_FRAME_PAYLOAD.
+  [[nodiscard]] bool HasError() const;
+
+  /// @return The number of bytes received but not yet consumed as frames.
+  [[nodiscard]] std::size_t BufferedSize() const;
+
+  /// Append the bytes received but not yet consumed as frames to @p out,
+  /// e.g. to hand the connection over to another process.
+  void CopyBuffered(std::string& out) const;
+
+  /**
+   * @brief Buffer @p bytes as if they had just been received, e.g. by the
+   *        process that handed the connection over, or by io_uring.
+   * @return false if they do not fit.
+   */
+  [[nodiscard]] bool Restore(std::string_view bytes);
+
+ private:
+  static constexpr std::size_t kMask = RECEIVE_BUFFER_SIZE - 1;
+  static_assert((RECEIVE_BUFFER_SIZE & kMask) == 0,
+                "RECEIVE_BUFFER_SIZE must be a power of two");
+  static_assert(RECEIVE_BUFFER_SIZE > 2 * MAX_FRAME_SIZE,
+                "The ring must hold more than one full frame");
+
+  /**
+   * The ring itself, followed by MAX_FRAME_PAYLOAD spare bytes.  When a
+   * payload wraps around the end of the ring, the part stored at the start
+   * of the ring is copied into the spare bytes so that the payload can
+   * still be returned as one contiguous view.
+   */
+  std::vector<char> buffer_;
+  std::size_t readPos_ = 0;   ///< Monotonic index of the next unread byte.
+  std::size_t writePos_ = 0;  ///< Monotonic index of the next free byte.
+  bool error_ = false;
+};
+
+#endif  // FRAME_H_
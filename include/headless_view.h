@@ -0,0 +1,136 @@
+/**
+ * @file headless_view.h
+ * @brief A ClientViewInterface without a window, driven by a script.
+ *
+ * HeadlessView plays the part of the user: instead of drawing widgets it
+ * answers the Controller's Draw*Panel() calls from a feed of actions --
+ * connect, join a room, send messages, wait -- taken either from a text
+ * script (see ParseHeadlessScript()) or from code.  The real
+ * ClientController and ClientModel run unchanged, so their hot path can be
+ * profiled and tested on machines without a display.
+ *
+ * The loop runs unthrottled or at a fixed frame rate.  For every frame the
+ * view records two durations, using the order in which the Controller
+ * calls it:
+ *  - poll time, from BeginFrame() to the first Draw*Panel() call, which is
+ *    spent in ClientModel::PollMessages();
+ *  - processing time, from there to EndFrame(): handling the actions and
+ *    reading the history.
+ */
+
+#ifndef HEADLESS_VIEW_H_
+#define HEADLESS_VIEW_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "client_view_interface.h"
+#include "histogram.h"
+
+/// One step of a headless run.  Each one takes at least one frame.
+struct HeadlessAction {
+  enum class Type {
+    CONNECT,        ///< Connect to text:value, wait for the outcome.
+    JOIN,           ///< Join room value.
+    LEAVE,          ///< Leave room value.
+    SELECT,         ///< Make room value the active room.
+    SEND,           ///< Send text, value times, one per frame.
+    WAIT_FRAMES,    ///< Do nothing for value frames.
+    WAIT_MESSAGES,  ///< Wait until the active room holds value lines.
+    QUIT,
+  };
+  Type type = Type::QUIT;
+  std::string text;
+  std::uint64_t value = 0;
+};
+
+/// Returns the next action, or std::nullopt when the run is over.
+using HeadlessFeed = std::function<std::optional<HeadlessAction>()>;
+
+/**
+ * @brief Parse a script, one action per line:
+ *
+ *     connect <host> <port>
+ *     join <room> | leave <room> | select <room>
+ *     send <text>
+ *     send_many <count> <text>
+ *     wait <frames>
+ *     wait_messages <count>
+ *     quit
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ * @return std::nullopt, after logging the offending line, if invalid.
+ */
+[[nodiscard]] std::optional<std::vector<HeadlessAction>> ParseHeadlessScript(
+    std::string_view script);
+
+/// A feed that returns the actions of @p script in order.
+[[nodiscard]] HeadlessFeed MakeHeadlessFeed(
+    std::vector<HeadlessAction> script);
+
+class HeadlessView : public ClientViewInterface {
+ public:
+  /**
+   * @param feed Source of the actions to perform.
+   * @param frameRate Frames per second, or 0 to run as fast as possible.
+   */
+  explicit HeadlessView(HeadlessFeed feed, double frameRate = 0.0);
+
+  [[nodiscard]] bool Init() override;
+  void Shutdown() override;
+  void BeginFrame() override;
+  void EndFrame() override;
+  bool DrawConnectionPanel(std::string& address, unsigned short& port,
+                           bool connecting) override;
+  RoomRequest DrawRoomPanel(std::span<const RoomId> rooms,
+                            RoomId& activeRoom) override;
+  bool DrawChatPanel(RoomId activeRoom, MessageHistory::View messages,
+                     std::string& sendMessage) override;
+  [[nodiscard]] bool ShouldQuit() const override;
+
+  /// @return true if an action could not be performed (e.g. connect failed).
+  [[nodiscard]] bool HasFailed() const;
+
+  [[nodiscard]] std::uint64_t FrameCount() const;
+
+  /// Nanoseconds per frame spent polling the model.
+  [[nodiscard]] const Histogram& PollTimes() const;
+
+  /// Nanoseconds per frame spent after polling.
+  [[nodiscard]] const Histogram& ProcessingTimes() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  /// Record the end of the poll phase, on the first Draw*Panel() call.
+  void MarkPolled();
+
+  /// Finish the current action and fetch the next one.
+  void NextAction();
+
+  /// Stop the run because the current action cannot be performed.
+  void Fail(std::string_view reason);
+
+  HeadlessFeed feed_;
+  std::optional<HeadlessAction> action_;
+  bool connectRequested_ = false;  ///< The CONNECT action was handed over.
+
+  Clock::duration framePeriod_{};  ///< Zero when unthrottled.
+  Clock::time_point nextFrame_;
+  Clock::time_point frameStart_;
+  std::optional<Clock::time_point> polled_;
+  std::uint64_t frameCount_ = 0;
+  Histogram pollTimes_;
+  Histogram processingTimes_;
+
+  bool shouldQuit_ = false;
+  bool failed_ = false;
+};
+
+#endif  // HEADLESS_VIEW_H_
@@ -0,0 +1,59 @@
+/**
+ * @file histogram.h
+ * @brief Fixed-size log-linear histogram for latency measurements.
+ *
+ * Every power of two is split into kSubBuckets equal buckets, so a value is
+ * known to within 1/kSubBuckets (about 6%) of itself while the whole 64-bit
+ * range fits in under a thousand counters.  Recording a value is a couple
+ * of shifts and an increment, with no allocation, which keeps it cheap
+ * enough for a hot path.  Histograms filled by different threads are
+ * combined with Merge() once the threads are done.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class Histogram {
+ public:
+  static constexpr std::size_t kSubBucketBits = 4;
+  static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBucketBits;
+  static constexpr std::size_t kBucketCount =
+      (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  void Record(std::uint64_t value);
+
+  /// Add the values recorded by @p other to this histogram.
+  void Merge(const Histogram& other);
+
+  [[nodiscard]] std::uint64_t Count() const;
+  [[nodiscard]] std::uint64_t Sum() const;
+  [[nodiscard]] std::uint64_t Max() const;
+
+  /**
+   * @brief Value below which a fraction @p quantile (0 to 1) of the values
+   *        fall, rounded up to the end of its bucket.
+   * @return 0 if nothing was recorded.
+   */
+  [[nodiscard]] std::uint64_t Percentile(double quantile) const;
+
+  /// Index of the bucket that counts @p value.
+  [[nodiscard]] static std::size_t BucketOf(std::uint64_t value);
+
+  /// Largest value counted by the bucket at @p index.
+  [[nodiscard]] static std::uint64_t BucketUpperBound(std::size_t index);
+
+  /// Number of values counted by the bucket at @p index.
+  [[nodiscard]] std::uint64_t BucketCount(std::size_t index) const;
+
+ private:
+  std::array<std::uint64_t, kBucketCount> counts_{};
+  std::uint64_t count_ = 0;
+  std::uint64_t sum_ = 0;
+  std::uint64_t max_ = 0;
+};
+
+#endif  // HISTOGRAM_H_
@@ -0,0 +1,207 @@
+/**
+ * @file io_uring_poller.h
+ * @brief PollerInterface that does the server's socket I/O through io_uring
+ *        (Linux 6.3 or later).
+ *
+ * With epoll, the kernel says which sockets are ready, and the server then
+ * makes one more system call per socket to accept, receive or send.  Here
+ * the server hands the I/O itself to the kernel, through the submission
+ * and completion queues that io_uring shares with the process:
+ *  - the listener gets a multishot accept: one request that accepts every
+ *    connection until it is cancelled;
+ *  - each stream gets a multishot receive into a **buffer ring**, a pool
+ *    of kBufferCount buffers of kBufferSize bytes that the kernel picks
+ *    from as data arrives, so no buffer is tied up by idle connections.
+ *    A buffer goes back to the ring once Wait() is called again;
+ *  - the sends of a flush are queued with QueueSend() and submitted
+ *    together by SubmitSends(), one system call for all the clients.
+ *    They are non-blocking: a client whose socket buffer is full gets a
+ *    one-shot poll instead, reported as writable.
+ * Other sockets (the UDP socket, the waker) get a multishot poll and are
+ * reported when they become readable, like with epoll.
+ *
+ * Wait() submits whatever was queued and reaps the completions in the same
+ * system call, so a busy server makes two system calls per pass of its
+ * loop (Wait() and SubmitSends()), however many clients it serves.
+ *
+ * The kernel features needed (multishot receive, buffer rings) are only
+ * known to exist from the feature flags of Linux 6.3, which IsValid()
+ * checks: on older kernels, or where io_uring is disabled, CreatePoller()
+ * returns nullptr and the caller falls back to another backend.
+ */
+
+#ifndef IO_URING_POLLER_H_
+#define IO_URING_POLLER_H_
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// The headers must be recent enough to name the requests too (Linux 6.0).
+#ifdef IORING_RECV_MULTISHOT
+#define IO_URING_POLLER_AVAILABLE 1
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "poller_interface.h"
+
+class IoUringPoller final : public PollerInterface {
+ public:
+  IoUringPoller();
+  ~IoUringPoller() override;
+  IoUringPoller(const IoUringPoller&) = delete;
+  IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+  /// @return true if the ring was set up and the kernel has every feature.
+  [[nodiscard]] bool IsValid() const;
+
+  [[nodiscard]] bool Add(sf::Socket& socket, std::uint64_t token) override;
+  void Remove(sf::Socket& socket) override;
+  [[nodiscard]] std::span<const PollEvent> Wait(
+      std::chrono::milliseconds timeout) override;
+  [[nodiscard]] bool IsEdgeTriggered() const override;
+  [[nodiscard]] bool ReportsWritable() const override;
+  [[nodiscard]] std::uint64_t SystemCalls() const override;
+  [[nodiscard]] bool CompletesIo() const override;
+  [[nodiscard]] bool AddListener(sf::TcpListener& listener,
+                                 std::uint64_t token) override;
+  [[nodiscard]] bool AddStream(sf::TcpSocket& socket,
+                               std::uint64_t token) override;
+  [[nodiscard]] bool BatchesSends() const override;
+  [[nodiscard]] bool QueueSend(
+      sf::TcpSocket& socket,
+      std::span<const std::span<const char>> buffers) override;
+  [[nodiscard]] std::span<const std::int64_t> SubmitSends() override;
+
+ private:
+  /// Submission queue entries; the completion queue has four times more.
+  static constexpr unsigned kEntries = 4096;
+  /// Receive buffers in the ring (a power of two), and their size.
+  static constexpr unsigned kBufferCount = 1024;
+  static constexpr std::size_t kBufferSize = 4096;
+  static constexpr std::uint16_t kBufferGroup = 0;
+  /// Writes per SubmitSends(), and buffers per write.
+  static constexpr std::size_t kMaxSends = 256;
+  static constexpr std::size_t kMaxSendBuffers = 64;
+
+  /// What a request does, in the low byte of its user_data.
+  enum class Op : std::uint8_t {
+    POLL,      ///< Multishot poll of an Add()ed socket.
+    ACCEPT,    ///< Multishot accept of a listener.
+    RECEIVE,   ///< Multishot receive of a stream.
+    WRITABLE,  ///< One-shot poll of a stream whose buffer was full.
+    CANCEL,    ///< Cancels the requests of a removed socket.
+    SEND,      ///< A write of SubmitSends(), numbered in the batch.
+  };
+
+  /// Send::registration of a socket not added with AddStream().
+  static constexpr std::uint32_t kNoRegistration = 0xFFFFFFFF;
+
+  /// A watched socket.  Its slot is reused once removed and done with.
+  struct Registration {
+    std::uint64_t token = 0;
+    int fd = -1;
+    Op multishot = Op::POLL;  ///< The request that watches it.
+    bool active = false;      ///< Not removed.
+    bool armed = false;       ///< Its multishot request runs.
+    bool writeArmed = false;  ///< A WRITABLE request runs.
+    std::uint32_t inFlight = 0;  ///< Requests not completed yet.
+  };
+
+  /// Storage of one queued write, read by the kernel when it runs.
+  struct Send {
+    msghdr message{};
+    std::array<iovec, kMaxSendBuffers> iov{};
+    std::size_t bytes = 0;
+    std::uint32_t registration = kNoRegistration;
+  };
+
+  /// @return A free submission queue entry, submitting the queue if full.
+  [[nodiscard]] io_uring_sqe* NextSqe();
+
+  /**
+   * @brief Submit the queued entries with io_uring_enter(), counted in
+   *        SystemCalls().
+   * @return Its result, or -errno.
+   */
+  int Enter(unsigned minComplete, unsigned flags, const void* arg,
+            std::size_t argSize);
+
+  /// @return The slot of a new registration of @p fd.
+  std::uint32_t Register(int fd, std::uint64_t token, Op multishot);
+
+  /// Queue the multishot request of registration @p index.
+  void Arm(std::uint32_t index);
+
+  /// Queue a one-shot poll telling when registration @p index is writable.
+  void ArmWritable(std::uint32_t index);
+
+  /// Handle every completion in the queue, appending events to @p events
+  /// and the buffers they hold to @p held.
+  void Reap(std::vector<PollEvent>& events, std::vector<std::uint16_t>& held);
+
+  /// Handle one completion (see Reap()).
+  void Complete(const io_uring_cqe& cqe, std::vector<PollEvent>& events,
+                std::vector<std::uint16_t>& held);
+
+  /// Count a completed request of registration @p index, and free its
+  /// slot if it was the last of a removed one.
+  void Release(std::uint32_t index);
+
+  /// Give the buffers in @p held back to the kernel.
+  void Recycle(std::vector<std::uint16_t>& held);
+
+  int ringFd_ = -1;
+  bool valid_ = false;
+  std::uint64_t systemCalls_ = 0;
+
+  // --- The rings shared with the kernel. ---
+  void* ringMemory_ = nullptr;
+  std::size_t ringSize_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqesSize_ = 0;
+  unsigned* sqHead_ = nullptr;
+  unsigned* sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned sqEntries_ = 0;
+  unsigned sqTailLocal_ = 0;  ///< Published to the kernel by Enter().
+  unsigned* cqHead_ = nullptr;
+  unsigned* cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  // --- The buffer ring: its entries, the first of which holds the tail. ---
+  io_uring_buf_ring* bufferRing_ = nullptr;
+  io_uring_buf* bufferEntries_ = nullptr;
+  std::size_t bufferRingSize_ = 0;
+  std::vector<char> buffers_;
+  std::uint16_t bufferTail_ = 0;
+
+  std::vector<Registration> registrations_;
+  std::vector<std::uint32_t> freeRegistrations_;
+  std::unordered_map<int, std::uint32_t> byFd_;  ///< Active registrations.
+  /// Registrations whose multishot request stopped (e.g. no buffer was
+  /// left), armed again by the next Wait().
+  std::vector<std::uint32_t> rearm_;
+
+  std::vector<Send> sends_;
+  std::size_t sendCount_ = 0;
+  std::size_t sendsOutstanding_ = 0;  ///< Not completed yet.
+  std::vector<std::int64_t> sendResults_;
+
+  std::vector<PollEvent> events_;
+  std::vector<std::uint16_t> heldBuffers_;  ///< By events_.
+  /// Completions reaped while waiting for sends, for the next Wait().
+  std::vector<PollEvent> deferred_;
+  std::vector<std::uint16_t> deferredBuffers_;
+};
+
+#endif  // IORING_RECV_MULTISHOT
+
+#endif  // IO_URING_POLLER_H_
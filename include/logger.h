@@ -0,0 +1,214 @@
+/**
+ * @file logger.h
+ * @brief Asynchronous logger that never blocks the thread that logs.
+ *
+ * Printing from the server loop is expensive: formatting costs CPU, and a
+ * write to a slow pipe or terminal can stall the whole loop.  The logger
+ * moves both off the calling thread:
+ *
+ *  - LOG_INFO("{} clients", count) only copies the format string pointer
+ *    and the arguments into a record and pushes it into a lock-free ring
+ *    (an MpscQueue, so every thread may log).
+ *  - A background thread pops the records, formats them and writes them
+ *    out in batches: DEBUG and INFO to stdout, WARNING and ERROR to stderr.
+ *  - When the ring is full the record is dropped and counted, rather than
+ *    making the caller wait; the background thread reports how many were
+ *    lost.
+ *
+ * Arguments are copied by value: numbers as they are, strings into a small
+ * inline buffer (truncated to InlineString::kCapacity characters), so a
+ * record never points at memory that may be gone by the time it is
+ * formatted.
+ *
+ * LOG_DEBUG calls are removed at compile time when SIMPLECHAT_LOG_LEVEL is
+ * above 0, which is the default for release (NDEBUG) builds.  The level
+ * can also be raised at run time with Logger::SetLevel().
+ */
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#include "mpsc_queue.h"
+
+enum class LogLevel : std::uint8_t { DEBUG = 0, INFO = 1, WARNING = 2, ERROR = 3 };
+
+/// Lowest level compiled in: 0 DEBUG, 1 INFO, 2 WARNING, 3 ERROR.
+#ifndef SIMPLECHAT_LOG_LEVEL
+#ifdef NDEBUG
+#define SIMPLECHAT_LOG_LEVEL 1
+#else
+#define SIMPLECHAT_LOG_LEVEL 0
+#endif
+#endif
+
+inline constexpr LogLevel COMPILED_LOG_LEVEL =
+    static_cast<LogLevel>(SIMPLECHAT_LOG_LEVEL);
+
+/// A string argument copied into a log record.
+struct InlineString {
+  static constexpr std::size_t kCapacity = 63;
+  std::array<char, kCapacity> data;
+  std::uint8_t size;
+};
+
+class Logger {
+ public:
+  /// Records that fit in the ring at once.  A power of two.
+  static constexpr std::size_t kCapacity = 8192;
+  /// Bytes available for the arguments of one record.
+  static constexpr std::size_t kArgumentBytes = 192;
+
+  /// The process-wide logger.  Its thread starts on first use.
+  [[nodiscard]] static Logger& Instance();
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  /// Records below @p level are ignored from now on.
+  void SetLevel(LogLevel level);
+
+  [[nodiscard]] bool IsEnabled(LogLevel level) const;
+
+  /// Queue a record.  Never blocks; drops the record if the ring is full.
+  template <typename... Args>
+  void Log(LogLevel level, std::format_string<Args...> format,
+           Args&&... args) {
+    if (!IsEnabled(level)) return;
+    using Packed = std::tuple<StoredType<Args>...>;
+    static_assert(sizeof(Packed) <= kArgumentBytes,
+                  "Too many or too large log arguments");
+    static_assert((std::is_trivially_copyable_v<StoredType<Args>> && ...),
+                  "Log arguments must be numbers, enums or strings");
+    Record record;
+    record.level = level;
+    record.time = std::chrono::system_clock::now();
+    record.format = format.get();
+    record.formatter = &FormatRecord<StoredType<Args>...>;
+    [[maybe_unused]] auto* out = record.arguments.data();
+    ((Store(out, args)), ...);
+    if (ring_.TryPush(std::move(record))) {
+      pushed_.fetch_add(1, std::memory_order_release);
+    } else {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// Block until every record queued so far has been written.
+  void Flush();
+
+  /// @return The number of records dropped because the ring was full.
+  [[nodiscard]] std::uint64_t DroppedCount() const;
+
+ private:
+  Logger();
+  ~Logger();
+
+  struct Record {
+    LogLevel level = LogLevel::INFO;
+    std::chrono::system_clock::time_point time;
+    std::string_view format;
+    void (*formatter)(const Record&, std::string&) = nullptr;
+    std::array<std::byte, kArgumentBytes> arguments{};
+  };
+
+  /// How an argument of type T is kept in a record.
+  template <typename T>
+  using StoredType =
+      std::conditional_t<std::is_convertible_v<const T&, std::string_view>,
+                         InlineString, std::remove_cvref_t<T>>;
+
+  template <typename T>
+  static void Store(std::byte*& out, const T& value) {
+    StoredType<T> stored;
+    if constexpr (std::is_same_v<StoredType<T>, InlineString>) {
+      const std::string_view text = value;
+      stored.size = static_cast<std::uint8_t>(
+          std::min(text.size(), InlineString::kCapacity));
+      std::memcpy(stored.data.data(), text.data(), stored.size);
+    } else {
+      stored = value;
+    }
+    std::memcpy(out, &stored, sizeof(stored));
+    out += sizeof(stored);
+  }
+
+  template <typename T>
+  static T Load(const std::byte*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+  }
+
+  /// Turn a stored argument back into something std::format understands.
+  template <typename T>
+  static auto Formattable(const T& value) {
+    if constexpr (std::is_same_v<T, InlineString>) {
+      return std::string_view(value.data.data(), value.size);
+    } else {
+      return value;
+    }
+  }
+
+  /// Format @p record, whose arguments have types @p Stored, into @p out.
+  template <typename... Stored>
+  static void FormatRecord(const Record& record, std::string& out) {
+    [[maybe_unused]] const auto* in = record.arguments.data();
+    // Braced initialisation evaluates the loads from left to right.
+    const std::tuple<Stored...> stored{Load<Stored>(in)...};
+    auto values = std::apply(
+        [](const auto&... value) { return std::tuple{Formattable(value)...}; },
+        stored);
+    std::apply(
+        [&](auto&... value) {
+          std::vformat_to(std::back_inserter(out), record.format,
+                          std::make_format_args(value...));
+        },
+        values);
+  }
+
+  /// Body of the background thread.
+  void Run(std::stop_token stopToken);
+
+  /// Pop, format and write every queued record.  @return false if none.
+  bool Drain();
+
+  MpscQueue<Record> ring_{kCapacity};
+  std::atomic<LogLevel> level_{COMPILED_LOG_LEVEL};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> pushed_{0};   ///< Records queued so far.
+  std::atomic<std::uint64_t> written_{0};  ///< Records written so far.
+  std::uint64_t reportedDrops_ = 0;  ///< Drops already announced.
+  std::string stdoutBatch_;          ///< Background thread scratch space.
+  std::string stderrBatch_;
+  std::jthread thread_;  ///< Last member: stopped and joined first.
+};
+
+#define SIMPLECHAT_LOG(level, ...)                    \
+  do {                                                \
+    if constexpr ((level) >= COMPILED_LOG_LEVEL) {    \
+      Logger::Instance().Log((level), __VA_ARGS__);   \
+    }                                                 \
+  } while (false)
+
+#define LOG_DEBUG(...) SIMPLECHAT_LOG(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) SIMPLECHAT_LOG(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) SIMPLECHAT_LOG(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) SIMPLECHAT_LOG(LogLevel::ERROR, __VA_ARGS__)
+
+#endif  // LOGGER_H_
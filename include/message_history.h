@@ -0,0 +1,124 @@
+/**
+ * @file message_history.h
+ * @brief Bounded chat history stored in one contiguous byte ring.
+ *
+ * Keeping every received line in its own std::string costs one heap
+ * allocation per message, a growing vector that moves everything when it
+ * reallocates, and memory without bound in a busy room.  MessageHistory
+ * instead allocates two fixed rings when it is created:
+ *  - a byte ring that receives the text of the lines back to back, and
+ *  - a line ring holding where each line starts and how long it is.
+ *
+ * A line never wraps around the end of the byte ring (the tail is skipped
+ * instead), so every line is a plain std::string_view into the ring.  When
+ * either ring is full the oldest lines are evicted, so memory stays flat
+ * however long the session lasts and Append() costs the same whatever the
+ * history length.
+ */
+
+#ifndef MESSAGE_HISTORY_H_
+#define MESSAGE_HISTORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+/// Upper bounds of a MessageHistory.  Both must be greater than zero.
+struct HistoryLimits {
+  std::size_t maxLines = 10000;
+  std::size_t maxBytes = 1024 * 1024;
+};
+
+class MessageHistory {
+ public:
+  /**
+   * @brief Read-only view on the lines, oldest first.
+   *
+   * Named like std::span so that it works with range-for and the standard
+   * algorithms.  Valid until the history is modified.
+   */
+  class View {
+   public:
+    class Iterator {
+     public:
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+
+      Iterator() = default;
+      Iterator(const MessageHistory* history, std::size_t index)
+          : history_(history), index_(index) {}
+
+      std::string_view operator*() const { return history_->Line(index_); }
+      Iterator& operator++() {
+        ++index_;
+        return *this;
+      }
+      Iterator operator++(int) {
+        auto previous = *this;
+        ++index_;
+        return previous;
+      }
+      bool operator==(const Iterator& other) const = default;
+
+     private:
+      const MessageHistory* history_ = nullptr;
+      std::size_t index_ = 0;
+    };
+
+    View() = default;
+    explicit View(const MessageHistory& history) : history_(&history) {}
+
+    [[nodiscard]] std::size_t size() const {
+      return history_ == nullptr ? 0 : history_->Size();
+    }
+    [[nodiscard]] bool empty() const { return size() == 0; }
+    /// The line at @p index, 0 being the oldest.
+    [[nodiscard]] std::string_view operator[](std::size_t index) const {
+      return history_->Line(index);
+    }
+    [[nodiscard]] Iterator begin() const { return {history_, 0}; }
+    [[nodiscard]] Iterator end() const { return {history_, size()}; }
+
+   private:
+    const MessageHistory* history_ = nullptr;
+  };
+
+  explicit MessageHistory(HistoryLimits limits = {});
+
+  /// Store a copy of @p text, truncated to HistoryLimits::maxBytes, evicting the
+  /// oldest lines to make room.
+  void Append(std::string_view text);
+
+  /// Remove every line.  Keeps the allocated rings.
+  void Clear();
+
+  [[nodiscard]] std::size_t Size() const;
+
+  /// The line at @p index, 0 being the oldest.
+  [[nodiscard]] std::string_view Line(std::size_t index) const;
+
+  [[nodiscard]] View GetView() const;
+
+ private:
+  /// Where a line lives.  Positions count bytes since construction, so
+  /// they only grow; the offset in bytes_ is the position modulo its size.
+  struct LineRecord {
+    std::uint64_t position = 0;
+    std::size_t length = 0;
+  };
+
+  /// Drop the oldest line.
+  void EvictOldest();
+
+  std::vector<char> bytes_;
+  std::vector<LineRecord> lines_;
+  std::size_t firstLine_ = 0;  ///< Index in lines_ of the oldest line.
+  std::size_t lineCount_ = 0;
+  std::uint64_t writePosition_ = 0;  ///< Where the next line starts.
+};
+
+static_assert(std::forward_iterator<MessageHistory::View::Iterator>);
+
+#endif  // MESSAGE_HISTORY_H_
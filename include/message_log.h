@@ -0,0 +1,206 @@
+/**
+ * @file message_log.h
+ * @brief Append-only, memory-mapped log of the relayed chat messages.
+ *
+ * The log lives in a directory of **segments**: files named after the
+ * offset of their first record (00000000000000001234.log), created at
+ * their full size and mapped into memory.  Every relayed message becomes
+ * one record, numbered by a log-wide offset and stamped with the time it
+ * was written:
+ *
+ *     +--------------+----------+--------+--------------+---------+
+ *     | payload size | checksum | offset | timestamp us | payload |
+ *     | 4 bytes      | 4        | 8      | 8            | ...     |
+ *     +--------------+----------+--------+--------------+---------+
+ *
+ * in host byte order, each record starting on an 8-byte boundary.  The
+ * unused end of a segment is zeros, so on Open() each segment is scanned
+ * up to its first empty or damaged record.
+ *
+ *  - **Writes never block the network loop**: Append() only pushes the
+ *    (reference-counted) frame into a lock-free queue.  A writer thread
+ *    copies the frames into the active segment and, depending on the
+ *    FsyncPolicy, flushes them to disk after every batch it drained
+ *    (group commit) or at most once per interval.  When the queue is full
+ *    the message is not logged, and counted in DroppedCount() (and in
+ *    ServerMetrics::logRecordsDropped by the server that appended it).
+ *  - **Reads are zero-copy**: Read() hands out views into the mapping.  A
+ *    sparse index per segment (one entry every kIndexIntervalBytes, by
+ *    offset and by timestamp) locates the first record without scanning
+ *    the whole segment.  The index is kept in memory and rebuilt while
+ *    scanning on Open().
+ *  - When a record does not fit in the active segment, a new one is
+ *    started.  The oldest segments are then deleted while the log exceeds
+ *    its size limit or they are older than its age limit.
+ *
+ * POSIX only (mmap); on other platforms Open() fails.
+ */
+
+#ifndef MESSAGE_LOG_H_
+#define MESSAGE_LOG_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.h"
+#include "shared_frame.h"
+
+/// When the writer thread makes the appended records durable.
+enum class FsyncPolicy : std::uint8_t {
+  NONE,         ///< Leave it to the OS (records survive a process crash only).
+  EVERY_BATCH,  ///< After every batch of records drained from the queue.
+  INTERVAL,     ///< At most once per MessageLogConfig::fsyncInterval.
+};
+
+struct MessageLogConfig {
+  std::filesystem::path directory = "chat_log";
+  std::size_t segmentBytes = 64 * 1024 * 1024;
+  FsyncPolicy fsyncPolicy = FsyncPolicy::INTERVAL;
+  std::chrono::milliseconds fsyncInterval{100};
+  /// Oldest segments are deleted while the log is larger than this.
+  std::uint64_t retentionBytes = 1024ull * 1024 * 1024;
+  /// Segments whose last record is older than this are deleted.  0 keeps
+  /// them forever.
+  std::chrono::seconds retentionAge{std::chrono::hours(24 * 7)};
+};
+
+/// One record, as seen by Read().
+struct LogRecord {
+  std::uint64_t offset = 0;
+  std::uint64_t timestampUs = 0;  ///< When it was written, since the epoch.
+  std::string_view payload;       ///< Points into the segment mapping.
+};
+
+class MessageLog {
+ public:
+  /// Frames that can wait for the writer thread at once.
+  static constexpr std::size_t kQueueCapacity = 16384;
+  /// Bytes of records between two sparse index entries.
+  static constexpr std::size_t kIndexIntervalBytes = 4096;
+  /// Segments smaller than this are made this size.
+  static constexpr std::size_t kMinSegmentBytes = 64 * 1024;
+
+  explicit MessageLog(MessageLogConfig config = {});
+  /// Stops the writer thread after it has written and synced the queue.
+  ~MessageLog();
+
+  MessageLog(const MessageLog&) = delete;
+  MessageLog& operator=(const MessageLog&) = delete;
+
+  /**
+   * @brief Recover the existing segments and start the writer thread.
+   * @return false if the directory or a segment cannot be used.
+   */
+  [[nodiscard]] bool Open();
+
+  /**
+   * @brief Queue a relayed frame for the log.  Never blocks.
+   *
+   * Safe to call from any thread.
+   * @return false if the queue was full and the frame was dropped.
+   */
+  bool Append(SharedFrame frame);
+
+  /// @return The offset of the oldest record still kept.
+  [[nodiscard]] std::uint64_t FirstOffset() const;
+
+  /// @return The offset the next record will get (records before it can
+  ///         be read).
+  [[nodiscard]] std::uint64_t EndOffset() const;
+
+  /// @return The offset of the first record written at or after
+  ///         @p timestampUs, or std::nullopt if there is none yet.
+  [[nodiscard]] std::optional<std::uint64_t> OffsetForTime(
+      std::uint64_t timestampUs) const;
+
+  /**
+   * @brief Call @p visit for up to @p maxCount records, from @p offset on.
+   *
+   * Records that were already deleted are skipped.  The payloads are views
+   * into the mapping, valid until @p visit returns.  Safe to call from any
+   * thread, concurrently with the writer.
+   * @return The number of records visited.
+   */
+  std::size_t Read(std::uint64_t offset, std::size_t maxCount,
+                   const std::function<void(const LogRecord&)>& visit) const;
+
+  /// @return The number of frames dropped because the queue was full.
+  [[nodiscard]] std::uint64_t DroppedCount() const;
+
+ private:
+  struct IndexEntry {
+    std::uint64_t offset = 0;
+    std::uint64_t timestampUs = 0;
+    std::size_t position = 0;  ///< Of the record in the segment.
+  };
+
+  /// One mapped file.  Unmapped once the last reader lets go of it.
+  struct Segment {
+    ~Segment();
+
+    std::uint64_t baseOffset = 0;
+    std::filesystem::path path;
+    int fd = -1;
+    char* data = nullptr;
+    std::size_t capacity = 0;
+    /// Bytes of complete records and the offset after the last one,
+    /// published by the writer after each record.
+    std::atomic<std::size_t> size{0};
+    std::atomic<std::uint64_t> endOffset{0};
+    std::atomic<std::uint64_t> lastTimestampUs{0};
+    std::vector<IndexEntry> index;  ///< Guarded by segmentsMutex_.
+    std::size_t nextIndexPosition = 0;  ///< Writer only.
+    std::size_t syncedSize = 0;         ///< Writer only.
+  };
+
+  /// Map the segment at @p path, or create it if @p create.
+  std::shared_ptr<Segment> MapSegment(const std::filesystem::path& path,
+                                      std::uint64_t baseOffset,
+                                      std::size_t capacity, bool create);
+
+  /// Rebuild the size and index of a recovered segment.
+  void ScanSegment(Segment& segment);
+
+  /// Body of the writer thread.
+  void Run(std::stop_token stopToken);
+
+  /// Write one record into the active segment, rotating first if needed.
+  void WriteRecord(std::string_view payload);
+
+  /// Close the active segment and start a new one.  @return false on error.
+  bool Rotate();
+
+  /// Flush the active segment's new records to disk.
+  void Sync(Segment& segment);
+
+  /// Delete the segments beyond the retention limits.
+  void ApplyRetention();
+
+  MessageLogConfig config_;
+  MpscQueue<SharedFrame> queue_{kQueueCapacity};
+  std::atomic<std::uint64_t> dropped_{0};
+
+  mutable std::mutex segmentsMutex_;  ///< Guards the list and the indexes.
+  std::vector<std::shared_ptr<Segment>> segments_;  ///< Oldest first.
+
+  // --- Writer thread only ---
+  std::uint64_t nextOffset_ = 0;
+  std::uint64_t lastTimestampUs_ = 0;  ///< Timestamps never go backwards.
+  std::chrono::steady_clock::time_point lastSync_;
+  std::chrono::steady_clock::time_point nextRetentionCheck_;
+  bool failed_ = false;  ///< Writing stopped after an I/O error.
+
+  std::jthread thread_;  ///< Last member: stopped and joined first.
+};
+
+#endif  // MESSAGE_LOG_H_
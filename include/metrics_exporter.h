@@ -0,0 +1,61 @@
+/**
+ * @file metrics_exporter.h
+ * @brief Serves the server metrics on a local admin socket and/or a file.
+ *
+ * The exporter runs on its own thread so that a scrape never delays the
+ * server loop.  It asks its source for the current text (typically
+ * FormatPrometheus() over the shards' snapshots) and:
+ *  - answers every connection on the admin port with it, as a minimal
+ *    HTTP response, so that Prometheus or `curl localhost:9533` can read
+ *    it directly;
+ *  - optionally rewrites a snapshot file with it every second.  The file is
+ *    replaced atomically, so readers never see half of it.
+ *
+ * The admin socket only listens on the loopback interface.
+ */
+
+#ifndef METRICS_EXPORTER_H_
+#define METRICS_EXPORTER_H_
+
+#include <SFML/Network/TcpListener.hpp>
+#include <chrono>
+#include <functional>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+class MetricsExporter {
+ public:
+  /// Produces the text to export.  Called from the exporter's thread.
+  using Source = std::function<std::string()>;
+
+  explicit MetricsExporter(Source source);
+
+  /**
+   * @brief Start the exporter thread.
+   * @param adminPort Loopback port to serve on, or 0 for no admin socket.
+   * @param snapshotPath File to rewrite periodically, or empty for none.
+   * @return false if the admin socket could not be opened.
+   */
+  [[nodiscard]] bool Start(unsigned short adminPort,
+                           std::string snapshotPath = {});
+
+ private:
+  static constexpr auto kSnapshotInterval = std::chrono::seconds(1);
+
+  void Run(std::stop_token stopToken);
+
+  /// Answer one admin connection.
+  void Serve();
+
+  /// Replace the snapshot file with the current metrics.
+  void WriteSnapshot();
+
+  Source source_;
+  sf::TcpListener listener_;
+  bool serving_ = false;
+  std::string snapshotPath_;
+  std::jthread thread_;  ///< Last member: stopped and joined first.
+};
+
+#endif  // METRICS_EXPORTER_H_
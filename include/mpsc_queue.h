@@ -0,0 +1,104 @@
+/**
+ * @file mpsc_queue.h
+ * @brief Bounded lock-free multi-producer / single-consumer queue.
+ *
+ * Used to pass work between server threads without taking a lock: any
+ * thread may push, only the owning thread pops.  The implementation is the
+ * classic bounded queue by Dmitry Vyukov: every cell carries a sequence
+ * number that tells producers and the consumer whether the cell is free or
+ * holds a value, so a push or pop costs one atomic read-modify-write at most.
+ *
+ * The queue never allocates after construction.  When it is full TryPush()
+ * fails and leaves the value untouched, so the caller decides whether to
+ * retry later or drop it.
+ */
+
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+template <typename T>
+class MpscQueue {
+ public:
+  /// @param capacity Maximum number of queued values, a power of two.
+  explicit MpscQueue(std::size_t capacity)
+      : cells_(std::make_unique<Cell[]>(capacity)), mask_(capacity - 1) {
+    assert(capacity >= 2 && (capacity & mask_) == 0);
+    for (std::size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  /**
+   * @brief Append @p value.  Safe to call from any thread.
+   * @return false if the queue is full; @p value is then left unchanged.
+   */
+  [[nodiscard]] bool TryPush(T&& value) {
+    auto position = head_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+      cell = &cells_[position & mask_];
+      const auto sequence = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(sequence) -
+                        static_cast<std::intptr_t>(position);
+      if (diff == 0) {
+        // The cell is free for this position: try to claim it.
+        if (head_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // The consumer has not freed this cell yet: full.
+      } else {
+        position = head_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    // Publish the value to the consumer.
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest value.  Only the consumer thread may call this.
+   * @return The value, or std::nullopt if the queue is empty.
+   */
+  [[nodiscard]] std::optional<T> TryPop() {
+    auto& cell = cells_[tail_ & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+      return std::nullopt;
+    }
+    std::optional<T> value(std::move(cell.value));
+    cell.value = T{};  // Release resources held by the moved-from value.
+    // Hand the cell back to producers for the next lap around the ring.
+    cell.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+    ++tail_;
+    return value;
+  }
+
+ private:
+  /// Keeps the producer and consumer counters on separate cache lines.
+  static constexpr std::size_t kCacheLineSize = 64;
+
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T value{};
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  std::size_t mask_;
+  alignas(kCacheLineSize) std::atomic<std::size_t> head_{0};  ///< Producers.
+  alignas(kCacheLineSize) std::size_t tail_ = 0;              ///< Consumer.
+};
+
+#endif  // MPSC_QUEUE_H_
@@ -0,0 +1,171 @@
+/**
+ * @file network_thread.h
+ * @brief Runs the client's socket I/O on its own thread.
+ *
+ * The render loop is locked to the display refresh rate, so a client that
+ * reads its socket once per frame delivers messages up to a whole frame
+ * late -- and much later when the window is minimised or the GPU stalls.
+ * A blocking connect() or DNS lookup on the same thread freezes the UI.
+ *
+ * NetworkThread moves the ChatClient onto a dedicated thread that sleeps
+ * in a poller until the socket or the UI has something for it:
+ *  - The UI pushes NetworkCommand values (connect, send, disconnect) into
+ *    an SpscQueue and wakes the thread through a Waker.  Commands issued
+ *    faster than the thread takes them wait on the UI side for room.
+ *  - The thread pushes NetworkEvent values (connected, message, ...) into
+ *    a second SpscQueue, which the UI drains once per frame with
+ *    PollEvent().
+ *
+ * Once the server offers a UDP channel (see udp_channel.h), the thread
+ * also owns a UDP socket: messages sent with SendDatagram() go over it
+ * with their delivery class, and those received come out as MESSAGE
+ * events like the TCP ones.
+ *
+ * Messages are thus read from the kernel as soon as they arrive, whatever
+ * the frame rate.  If the UI stops draining events and the queue fills up,
+ * the thread stops reading the socket until there is room again, so the
+ * server sees TCP backpressure instead of the client growing without bound.
+ * In the other direction, frames the socket does not accept at once wait
+ * in the ChatClient and are retried every millisecond until they are out.
+ */
+
+#ifndef NETWORK_THREAD_H_
+#define NETWORK_THREAD_H_
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/UdpSocket.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "chat_client.h"
+#include "chat_protocol.h"
+#include "poller_interface.h"
+#include "spsc_queue.h"
+#include "udp_channel.h"
+#include "waker.h"
+
+/// A request from the UI thread to the network thread.
+struct NetworkCommand {
+  enum class Type { CONNECT, SEND, SEND_DATAGRAM, OPEN_UDP, DISCONNECT };
+  Type type = Type::SEND;
+  /// Host name for CONNECT, encoded message for SEND and SEND_DATAGRAM.
+  std::string data;
+  unsigned short port = 0;  ///< For CONNECT and OPEN_UDP.
+  Delivery delivery = Delivery::RELIABLE;  ///< For SEND_DATAGRAM.
+  std::uint64_t token = 0;                 ///< For OPEN_UDP.
+};
+
+/// A notification from the network thread to the UI thread.
+struct NetworkEvent {
+  enum class Type { CONNECTED, CONNECT_FAILED, DISCONNECTED, MESSAGE };
+  Type type = Type::MESSAGE;
+  std::string payload;  ///< The received message for MESSAGE.
+};
+
+class NetworkThread {
+ public:
+  /// Commands that can wait for the network thread at once.
+  static constexpr std::size_t kCommandCapacity = 1024;
+  /// Events that can wait for the UI thread at once.
+  static constexpr std::size_t kEventCapacity = 4096;
+
+  NetworkThread() = default;
+  ~NetworkThread();
+
+  NetworkThread(const NetworkThread&) = delete;
+  NetworkThread& operator=(const NetworkThread&) = delete;
+
+  /// Create the waker and start the thread.  Returns false on failure.
+  [[nodiscard]] bool Start();
+
+  /**
+   * @brief Ask the network thread to connect to @p host.
+   *
+   * Returns immediately; a CONNECTED or CONNECT_FAILED event follows.
+   */
+  void Connect(std::string_view host, unsigned short port);
+
+  /// Queue an encoded message.
+  void Send(std::string_view message);
+
+  /// Queue an encoded message for the UDP channel, or for TCP while there
+  /// is no working channel.
+  void SendDatagram(Delivery delivery, std::string_view message);
+
+  /// Open the UDP channel offered by the server (see UDP_OPEN).
+  void OpenUdp(const UdpOffer& offer);
+
+  /// Close the connection.  A DISCONNECTED event follows.
+  void Disconnect();
+
+  /// Hand over the commands that did not fit in the queue when they were
+  /// issued.  Call from the UI thread once per frame.
+  void FlushCommands();
+
+  /// Take the oldest event.  Call from the UI thread only.
+  [[nodiscard]] std::optional<NetworkEvent> PollEvent();
+
+ private:
+  /// Token of the Waker read socket in the poller.
+  static constexpr std::uint64_t kWakerToken = 0;
+  /// Token of the server connection in the poller.
+  static constexpr std::uint64_t kSocketToken = 1;
+  /// Token of the UDP socket in the poller.
+  static constexpr std::uint64_t kUdpToken = 2;
+
+  /// Queue @p command, or keep it aside while the queue is full.
+  void PushCommand(NetworkCommand command);
+
+  /// Body of the network thread.
+  void Run(std::stop_token stopToken);
+
+  void HandleCommand(NetworkCommand& command);
+
+  /// Receive until the socket is drained or the event queue is full.
+  void ReceiveMessages();
+
+  /// Read every waiting datagram and queue its messages for the UI.
+  void ReceiveDatagrams();
+
+  /// Write the datagrams due on the UDP channel.
+  void FlushDatagrams();
+
+  /// Queue @p event for the UI, or keep it aside while the queue is full.
+  void PushEvent(NetworkEvent event);
+
+  /// Move the events kept aside into the queue, as far as they fit.
+  void FlushBacklog();
+
+  /// Close the connection and tell the UI.
+  void CloseConnection();
+
+  /// Start over with a poller that only watches the waker.
+  [[nodiscard]] bool ResetPoller();
+
+  // --- Network thread only ---
+  ChatClient client_;
+  std::unique_ptr<PollerInterface> poller_;
+  std::deque<NetworkEvent> backlog_;  ///< Events that did not fit in events_.
+  bool socketReadable_ = false;  ///< Data may be waiting in the socket.
+  std::unique_ptr<UdpChannel> udp_;  ///< Once the server offered one.
+  sf::UdpSocket udpSocket_;
+  sf::IpAddress udpAddress_ = sf::IpAddress::Any;  ///< The server's.
+  unsigned short udpPort_ = 0;
+
+  // --- UI thread only ---
+  std::deque<NetworkCommand> pendingCommands_;  ///< Did not fit in commands_.
+
+  // --- Shared ---
+  Waker waker_;
+  SpscQueue<NetworkCommand> commands_{kCommandCapacity};
+  SpscQueue<NetworkEvent> events_{kEventCapacity};
+  std::jthread thread_;  ///< Last member: stopped and joined first.
+};
+
+#endif  // NETWORK_THREAD_H_
@@ -0,0 +1,112 @@
+/**
+ * @file outbound_queue.h
+ * @brief Per-connection queue of frames waiting to be sent.
+ *
+ * The server never blocks on a send.  Frames for a client are appended to
+ * its OutboundQueue, and Flush() later hands as many of them as the kernel
+ * accepts to the socket in a single gathered write (sendmsg() with one
+ * iovec per frame on POSIX).  A backend that batches the writes of many
+ * queues (io_uring) makes the write itself, with Gather() and Complete().  If the client's socket buffer is full, the
+ * rest simply stays queued until the socket becomes writable again, so a
+ * slow reader delays only itself and never the other clients.
+ *
+ * The queue holds SharedFrame references, not copies: a broadcast frame is
+ * stored once no matter how many queues it sits in.
+ *
+ * A client that never drains its queue would make it grow forever, so the
+ * server bounds it (see BackpressureConfig in chat_server.h), e.g. by
+ * discarding the oldest frames with DropOldest().
+ */
+
+#ifndef OUTBOUND_QUEUE_H_
+#define OUTBOUND_QUEUE_H_
+
+#include <SFML/Network/TcpSocket.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+
+#include "shared_frame.h"
+
+class OutboundQueue {
+ public:
+  /// Frames passed to one gathered write at most.
+  static constexpr std::size_t kMaxBatch = 64;
+
+  /**
+   * @brief Append a frame.  Only a reference is stored.
+   * @param droppable Whether DropOldest() may discard it.  Replies the
+   *        client's protocol depends on (e.g. HELLO) are not droppable.
+   */
+  void Push(SharedFrame frame, bool droppable = true);
+
+  /**
+   * @brief Discard the oldest droppable frames until at most @p maxBytes
+   *        are queued, or none is left to discard.
+   *
+   * A frame already partly sent is kept: cutting it would corrupt the
+   * stream.
+   * @return The number of frames discarded.
+   */
+  std::size_t DropOldest(std::size_t maxBytes);
+
+  /**
+   * @brief Send as much of the queue as the socket accepts right now.
+   * @param sendCalls If given, incremented for each system call made.
+   * @return Done if the queue is now empty, NotReady if the socket buffer
+   *         is full and data remains, Disconnected or Error on failure.
+   */
+  [[nodiscard]] sf::Socket::Status Flush(sf::TcpSocket& socket,
+                                         std::uint64_t* sendCalls = nullptr);
+
+  /**
+   * @brief Point @p out at the front of the queue, up to kMaxBatch frames,
+   *        for a gathered write made by someone else (see
+   *        PollerInterface::QueueSend()).
+   *
+   * The buffers stay valid until the queue is changed, which must then be
+   * by Complete().
+   * @return The number of buffers filled.
+   */
+  std::size_t Gather(std::span<std::span<const char>, kMaxBatch> out);
+
+  /**
+   * @brief Account for the write of what Gather() returned.
+   * @param result The bytes written, or a negative errno value.
+   * @return Done if the queue is now empty, Partial if everything gathered
+   *         was written but more is queued, NotReady if the socket buffer
+   *         is full, Disconnected or Error on failure.
+   */
+  [[nodiscard]] sf::Socket::Status Complete(std::int64_t result);
+
+  [[nodiscard]] bool Empty() const;
+
+  /// @return The number of frames still (partly) waiting to be sent.
+  [[nodiscard]] std::size_t Size() const;
+
+  /// @return The number of bytes still waiting to be sent.
+  [[nodiscard]] std::size_t SizeBytes() const;
+
+  /// Append the bytes still waiting to be sent to @p out, e.g. to hand the
+  /// connection over to another process.
+  void CopyPending(std::string& out) const;
+
+ private:
+  /// Drop @p count bytes from the front of the queue.
+  void Consume(std::size_t count);
+
+  struct Entry {
+    SharedFrame frame;
+    bool droppable = true;
+  };
+
+  /// Dropping a frame from here releases this queue's reference on it.
+  std::deque<Entry> frames_;
+  std::size_t frontOffset_ = 0;  ///< Bytes of frames_.front() already sent.
+  std::size_t sizeBytes_ = 0;
+  std::size_t gatheredBytes_ = 0;  ///< By the last Gather().
+};
+
+#endif  // OUTBOUND_QUEUE_H_
@@ -0,0 +1,163 @@
+/**
+ * @file poller_interface.h
+ * @brief Pluggable readiness notification used by the server event loop.
+ *
+ * The server needs to know which sockets have data waiting.  Different
+ * operating system facilities can answer that question:
+ *  - **SelectorPoller** wraps sf::SocketSelector (select() underneath).  It
+ *    works everywhere but scans every socket on each wait and cannot watch
+ *    descriptors above FD_SETSIZE (usually 1024).
+ *  - **EpollPoller** (Linux only) uses edge-triggered epoll.  The kernel
+ *    returns only the sockets that became ready, so the cost of a wait does
+ *    not grow with the number of idle connections.
+ *  - **IoUringPoller** (Linux 6.3 or later) goes one step further: it
+ *    does the I/O itself (see io_uring_poller.h).
+ *
+ * Each registered socket carries a 64-bit token chosen by the caller; Wait()
+ * reports readiness as a list of tokens so the server can jump straight to
+ * the matching session.
+ *
+ * Backends that report writability (epoll, io_uring) tell the server when
+ * a socket whose buffer was full can accept data again.  With the others
+ * the server has to retry pending sends itself on every tick.
+ *
+ * A backend that completes I/O (io_uring, see CompletesIo()) reports what
+ * it already did instead of readiness for the sockets added with
+ * AddListener() and AddStream(): the connections it accepted and the bytes
+ * it received.  It may also batch sends (see BatchesSends()): each flush
+ * then costs one system call for all the clients instead of one each.
+ * The defaults of these methods suit the readiness backends, so callers
+ * can use them whatever the backend.
+ */
+
+#ifndef POLLER_INTERFACE_H_
+#define POLLER_INTERFACE_H_
+
+#include <SFML/Network/Socket.hpp>
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+/// The I/O backends that can be selected at startup.
+enum class PollerBackend { SELECTOR, EPOLL, IO_URING };
+
+/// One notification returned by PollerInterface::Wait().
+struct PollEvent {
+  std::uint64_t token = 0;  ///< The token given to PollerInterface::Add().
+  bool readable = true;     ///< Data, a new connection or a hang-up waits.
+  bool writable = false;    ///< The send buffer has room again.
+
+  // --- Completion backends only (see PollerInterface::CompletesIo()). ---
+  /// Bytes received on a stream, valid until the next call to Wait().
+  std::span<const char> received{};
+  /// The stream was closed by the peer, or failed.
+  bool closed = false;
+  /// A connection accepted on a listener, owned by the caller.
+  std::optional<sf::SocketHandle> accepted{};
+};
+
+class PollerInterface {
+ public:
+  virtual ~PollerInterface() = default;
+
+  /**
+   * @brief Start watching @p socket for incoming data.
+   * @return false if the backend cannot watch this socket.
+   */
+  [[nodiscard]] virtual bool Add(sf::Socket& socket, std::uint64_t token) = 0;
+
+  /// Stop watching @p socket.  Must be called while the socket is still open.
+  virtual void Remove(sf::Socket& socket) = 0;
+
+  /**
+   * @brief Block for up to @p timeout until at least one socket is ready.
+   * @return The ready sockets, valid until the next call to Wait().
+   */
+  [[nodiscard]] virtual std::span<const PollEvent> Wait(
+      std::chrono::milliseconds timeout) = 0;
+
+  /**
+   * @return true if a socket is reported only once per readiness change, in
+   *         which case the caller must read it until it returns NotReady.
+   */
+  [[nodiscard]] virtual bool IsEdgeTriggered() const = 0;
+
+  /// @return true if Wait() reports sockets that became writable.
+  [[nodiscard]] virtual bool ReportsWritable() const = 0;
+
+  /// @return The system calls made so far, to compare the backends.
+  [[nodiscard]] virtual std::uint64_t SystemCalls() const = 0;
+
+  /**
+   * @return true if the sockets added with AddListener() and AddStream()
+   *         are reported with the connections accepted and the bytes
+   *         received (see PollEvent), rather than when they are ready.
+   *         Data already received may then still be reported after
+   *         Remove(), until the next call to Wait().
+   */
+  [[nodiscard]] virtual bool CompletesIo() const { return false; }
+
+  /// Start watching @p listener for new connections.
+  [[nodiscard]] virtual bool AddListener(sf::TcpListener& listener,
+                                         std::uint64_t token) {
+    return Add(listener, token);
+  }
+
+  /// Start watching the connected @p socket for incoming data.
+  [[nodiscard]] virtual bool AddStream(sf::TcpSocket& socket,
+                                       std::uint64_t token) {
+    return Add(socket, token);
+  }
+
+  /// @return true if QueueSend() and SubmitSends() are supported.
+  [[nodiscard]] virtual bool BatchesSends() const { return false; }
+
+  /**
+   * @brief Queue a gathered write of @p buffers on @p socket, which must
+   *        have been added with AddStream().
+   *
+   * The buffers are only read by SubmitSends().
+   * @return false if the batch is full (or unsupported): submit it first.
+   */
+  [[nodiscard]] virtual bool QueueSend(
+      sf::TcpSocket& /*socket*/,
+      std::span<const std::span<const char>> /*buffers*/) {
+    return false;
+  }
+
+  /**
+   * @brief Perform every queued write at once, without blocking.
+   *
+   * A socket whose buffer filled up is reported as writable once it has
+   * room again.
+   * @return For each write, in order: the bytes written, or a negative
+   *         errno value (e.g. -EAGAIN), valid until the next call.
+   */
+  [[nodiscard]] virtual std::span<const std::int64_t> SubmitSends() {
+    return {};
+  }
+};
+
+/// @return The most scalable backend available on this platform.
+[[nodiscard]] PollerBackend DefaultPollerBackend();
+
+/// @return The name of @p backend: "select", "epoll" or "io_uring".
+[[nodiscard]] std::string_view PollerBackendName(PollerBackend backend);
+
+/// @return The backend named @p name, or std::nullopt if none is.
+[[nodiscard]] std::optional<PollerBackend> ParsePollerBackend(
+    std::string_view name);
+
+/**
+ * @brief Create a poller for @p backend.
+ * @return nullptr if the backend is not available on this platform.
+ */
+[[nodiscard]] std::unique_ptr<PollerInterface> CreatePoller(
+    PollerBackend backend);
+
+#endif  // POLLER_INTERFACE_H_
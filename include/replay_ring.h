@@ -0,0 +1,47 @@
+/**
+ * @file replay_ring.h
+ * @brief The last frames relayed in a room, kept for late joiners.
+ *
+ * The ring holds references to the frames exactly as they were sent, in
+ * each encoding (see RelayedFrame in shared_frame.h), so replaying them to a new member costs no encoding and
+ * no copy: they are pushed to its OutboundQueue like live frames.  Once
+ * the ring is full each new frame replaces the oldest one.
+ *
+ * Frames are numbered by a position that only grows, so a reader can keep
+ * its place in the ring across ticks and tell when the frames it had not
+ * read yet were overwritten.
+ */
+
+#ifndef REPLAY_RING_H_
+#define REPLAY_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shared_frame.h"
+
+class ReplayRing {
+ public:
+  /// Keep up to @p capacity frames (at least one).
+  explicit ReplayRing(std::size_t capacity);
+
+  /// Add @p frame, dropping the oldest frame if the ring is full.
+  void Push(RelayedFrame frame);
+
+  /// @return The position of the oldest frame kept.
+  [[nodiscard]] std::uint64_t Begin() const;
+
+  /// @return The position the next frame will get.
+  [[nodiscard]] std::uint64_t End() const;
+
+  /// @pre Begin() <= @p position < End().
+  [[nodiscard]] const RelayedFrame& At(std::uint64_t position) const;
+
+ private:
+  std::size_t capacity_;
+  std::vector<RelayedFrame> frames_;  ///< Grows up to capacity_, then wraps.
+  std::uint64_t end_ = 0;
+};
+
+#endif  // REPLAY_RING_H_
@@ -0,0 +1,213 @@
+/**
+ * @file replicated_state.h
+ * @brief Shared game state of a room, replicated to clients as deltas.
+ *
+ * The state of a room is a set of entries, each owned by the client that
+ * wrote it (e.g. its avatar's position) and named by that client's own
+ * 16-bit key.  A client only writes its own entries, with STATE_SET, so
+ * writers never overwrite each other.  They do share the budget of the
+ * room (kMaxSnapshotBytes), though: whether a STATE_SET fits depends on
+ * the ones applied before it, so copies of the state that must agree have
+ * to apply them in the same order (see ChatServer::SubmitStateSet()).
+ *
+ * Every change gets the next version number of the state.  Each client
+ * acknowledges the version it has (STATE_ACK), and each tick the server
+ * sends it a STATE_DELTA with only the entries changed since: what is sent
+ * depends on what changed, not on the size of the state.  The entries are
+ * kept in the order of their last change, so finding them does not depend
+ * on the size of the state either.  A delta may be lost (it is sent over
+ * UDP when it can): the next one starts from the same acknowledged
+ * version, so it carries the lost changes too.
+ *
+ * A removed entry leaves a tombstone behind, so that deltas can tell the
+ * clients.  Only kMaxTombstones are kept: a client that acknowledged a
+ * version older than the oldest one forgotten, or so old that its delta
+ * would not fit in a frame, is sent a full snapshot instead (the RESET
+ * flag), which always fits since the live entries are kept within
+ * kMaxSnapshotBytes.
+ *
+ * A STATE_DELTA text is a StateDeltaHeader followed by entries, each a
+ * StateEntryHeader followed by @c size bytes of value; a STATE_SET text is
+ * entries only (the server ignores their owner: it is the sender), and an
+ * empty one removes all the sender's entries.  A removal has size
+ * STATE_REMOVED_SIZE and no value.
+ */
+
+#ifndef REPLICATED_STATE_H_
+#define REPLICATED_STATE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "chat_protocol.h"
+#include "const.h"
+#include "wire_schema.h"
+
+/// Counts the changes of a ReplicatedState: 0 is the empty state.
+using StateVersion = std::uint64_t;
+
+/// Names an entry of the state.
+struct StateKey {
+  ClientId owner = NO_CLIENT;
+  std::uint16_t key = 0;
+
+  friend auto operator<=>(const StateKey&, const StateKey&) = default;
+};
+
+/// In front of each entry of STATE_SET and STATE_DELTA.
+struct StateEntryHeader {
+  ClientId owner = NO_CLIENT;
+  std::uint16_t key = 0;
+  std::uint16_t size = 0;  ///< Of the value, or STATE_REMOVED_SIZE.
+};
+
+using StateEntrySchema =
+    WireSchema<&StateEntryHeader::owner, &StateEntryHeader::key,
+               &StateEntryHeader::size>;
+
+/// Entry size meaning the entry was removed.
+inline constexpr std::uint16_t STATE_REMOVED_SIZE = 0xFFFF;
+
+/// In front of the entries of a STATE_DELTA.
+struct StateDeltaHeader {
+  StateVersion base = 0;     ///< Version the changes apply to.
+  StateVersion version = 0;  ///< Version once they are applied.
+  std::uint32_t tick = 0;    ///< Server tick that sent it.
+  std::uint8_t flags = 0;    ///< STATE_DELTA_RESET.
+};
+
+using StateDeltaSchema =
+    WireSchema<&StateDeltaHeader::base, &StateDeltaHeader::version,
+               &StateDeltaHeader::tick, &StateDeltaHeader::flags>;
+
+/// Delta flag: a full snapshot, which replaces the client's state.
+inline constexpr std::uint8_t STATE_DELTA_RESET = 1;
+
+/// Text of a STATE_ACK.
+struct StateAck {
+  StateVersion version = 0;  ///< Version the client has.
+};
+
+using StateAckSchema = WireSchema<&StateAck::version>;
+
+/// Longest STATE_DELTA text: one frame.
+inline constexpr std::size_t MAX_STATE_DELTA =
+    MAX_FRAME_PAYLOAD - MESSAGE_HEADER_SIZE;
+
+/// The server's copy of the state of a room.
+class ReplicatedState {
+ public:
+  /// Bytes of live entries, headers included: a snapshot always fits in
+  /// a STATE_DELTA.
+  static constexpr std::size_t kMaxSnapshotBytes =
+      MAX_STATE_DELTA - StateDeltaSchema::kFixedSize;
+  /// Longest value of an entry.
+  static constexpr std::size_t kMaxValueSize = 256;
+  /// Removed entries remembered for the deltas.
+  static constexpr std::size_t kMaxTombstones = 512;
+
+  /**
+   * @brief Apply the entries of a STATE_SET from @p owner.
+   * @return false if @p entries is malformed, or if it would take the
+   *         state over kMaxSnapshotBytes: the entries before the offending
+   *         one are applied.
+   */
+  [[nodiscard]] bool ApplySet(ClientId owner, std::string_view entries);
+
+  /// Remove every entry of @p owner, e.g. when it leaves the room.
+  void RemoveOwner(ClientId owner);
+
+  /// @return The version of the latest change.
+  [[nodiscard]] StateVersion Version() const;
+
+  /// @return true if the state has no live entries.
+  [[nodiscard]] bool Empty() const;
+
+  /**
+   * @brief Write the STATE_DELTA text that brings a client from version
+   *        @p base to Version().
+   *
+   * It is a full snapshot if the changes since @p base are not all known
+   * any more, or would not fit in @p out.
+   * @param out At least MAX_STATE_DELTA bytes.
+   * @return The bytes written.
+   */
+  [[nodiscard]] std::size_t EncodeDelta(StateVersion base, std::uint32_t tick,
+                                        std::span<char> out) const;
+
+ private:
+  struct Entry {
+    StateKey key;
+    std::string value;
+    StateVersion version = 0;  ///< Of its last change.
+    bool removed = false;      ///< A tombstone.
+  };
+
+  /// Entries by last change, oldest first.
+  using ChangeList = std::list<Entry>;
+
+  /// Make @p key hold @p value, or remove it if @p value is std::nullopt.
+  /// @return false if that would exceed kMaxSnapshotBytes.
+  [[nodiscard]] bool Change(StateKey key,
+                            std::optional<std::string_view> value);
+
+  /// Forget the oldest tombstones, down to half of kMaxTombstones.
+  void PurgeTombstones();
+
+  /// Append @p entry to @p out at @p offset.  @return false if it is full.
+  [[nodiscard]] static bool EncodeEntry(const Entry& entry,
+                                        std::span<char> out,
+                                        std::size_t& offset);
+
+  ChangeList changes_;
+  std::map<StateKey, ChangeList::iterator> entries_;
+  StateVersion version_ = 0;
+  /// Changes up to this one may have been forgotten with their tombstone.
+  StateVersion horizon_ = 0;
+  std::size_t liveBytes_ = 0;  ///< Encoded size of the live entries.
+  std::size_t tombstones_ = 0;
+};
+
+/// A client's copy of the state of a room, kept up to date by deltas.
+class StateReplica {
+ public:
+  /**
+   * @brief Apply a STATE_DELTA text.
+   *
+   * Deltas older than the replica are ignored, as they may arrive out of
+   * order over UDP; snapshots always replace it.
+   * @return false if it is malformed or does not apply to this replica.
+   */
+  [[nodiscard]] bool Apply(std::string_view delta);
+
+  /// @return The version to acknowledge.
+  [[nodiscard]] StateVersion Version() const;
+
+  /// @return The server tick of the latest delta applied.
+  [[nodiscard]] std::uint32_t Tick() const;
+
+  [[nodiscard]] const std::map<StateKey, std::string>& Entries() const;
+
+ private:
+  StateVersion version_ = 0;
+  std::uint32_t tick_ = 0;
+  std::map<StateKey, std::string> entries_;
+};
+
+/**
+ * @brief Append a STATE_SET entry setting @p key to @p value (or removing
+ *        it if @p remove) to @p out at @p offset.
+ * @return false if it does not fit, or if @p value is longer than
+ *         ReplicatedState::kMaxValueSize.
+ */
+[[nodiscard]] bool EncodeStateSet(std::uint16_t key, std::string_view value,
+                                  bool remove, std::span<char> out,
+                                  std::size_t& offset);
+
+#endif  // REPLICATED_STATE_H_
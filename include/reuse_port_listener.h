@@ -0,0 +1,34 @@
+/**
+ * @file reuse_port_listener.h
+ * @brief sf::TcpListener that can share its port with other listeners.
+ *
+ * With SO_REUSEPORT several sockets (one per server thread) can listen on
+ * the same port, and the kernel spreads incoming connections between them.
+ * SFML has no option for it, so ListenShared() creates and binds the socket
+ * itself and then hands the descriptor to the SFML base class; after that
+ * the object is used like any other sf::TcpListener.  Adopt() does the
+ * same with a listening socket received from another process.
+ */
+
+#ifndef REUSE_PORT_LISTENER_H_
+#define REUSE_PORT_LISTENER_H_
+
+#include <SFML/Network/TcpListener.hpp>
+
+class ReusePortListener : public sf::TcpListener {
+ public:
+  /// @return true if this platform supports SO_REUSEPORT load balancing.
+  [[nodiscard]] static bool IsSupported();
+
+  /**
+   * @brief Listen on @p port (all interfaces) with SO_REUSEPORT enabled.
+   * @return Status::Done on success, Status::Error otherwise.
+   */
+  [[nodiscard]] sf::Socket::Status ListenShared(unsigned short port);
+
+  /// Take ownership of @p handle, a socket that is already listening (e.g.
+  /// inherited from the process this one took over from).
+  void Adopt(sf::SocketHandle handle);
+};
+
+#endif  // REUSE_PORT_LISTENER_H_
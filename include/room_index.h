@@ -0,0 +1,52 @@
+/**
+ * @file room_index.h
+ * @brief Subscription index from rooms to the sessions that joined them.
+ *
+ * Instead of sending every message to every client, the server looks up
+ * the members of the message's room here and sends it to them only, so the
+ * cost of a message is proportional to the size of its room rather than
+ * to the number of connected clients.
+ *
+ * Joining and leaving are O(1) whatever the size of the room: every client
+ * is in the lobby, so a scan of the members would make each connection and
+ * disconnection O(n), and a reconnection storm O(n^2).
+ */
+
+#ifndef ROOM_INDEX_H_
+#define ROOM_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "chat_protocol.h"
+#include "slot_map.h"
+
+class RoomIndex {
+ public:
+  /// Subscribe @p member to @p room.  @return false if it already was.
+  bool Join(RoomId room, SlotHandle member);
+
+  /// Unsubscribe @p member from @p room.  @return false if it was not in it.
+  bool Leave(RoomId room, SlotHandle member);
+
+  /// @return The members of @p room, valid until the next Join/Leave.
+  [[nodiscard]] std::span<const SlotHandle> Members(RoomId room) const;
+
+  [[nodiscard]] bool IsMember(RoomId room, SlotHandle member) const;
+
+ private:
+  struct Room {
+    /// Contiguous, for the sends to every member.
+    std::vector<SlotHandle> members;
+    /// Index of each member in @c members, by packed handle, so that Leave()
+    /// swaps it with the last one without searching.
+    std::unordered_map<std::uint64_t, std::size_t> positions;
+  };
+
+  std::unordered_map<RoomId, Room> rooms_;
+};
+
+#endif  // ROOM_INDEX_H_
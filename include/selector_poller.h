@@ -0,0 +1,37 @@
+/**
+ * @file selector_poller.h
+ * @brief Portable PollerInterface backed by sf::SocketSelector.
+ */
+
+#ifndef SELECTOR_POLLER_H_
+#define SELECTOR_POLLER_H_
+
+#include <SFML/Network/SocketSelector.hpp>
+#include <vector>
+
+#include "poller_interface.h"
+
+class SelectorPoller final : public PollerInterface {
+ public:
+  [[nodiscard]] bool Add(sf::Socket& socket, std::uint64_t token) override;
+  void Remove(sf::Socket& socket) override;
+  [[nodiscard]] std::span<const PollEvent> Wait(
+      std::chrono::milliseconds timeout) override;
+  [[nodiscard]] bool IsEdgeTriggered() const override;
+  [[nodiscard]] bool ReportsWritable() const override;
+  [[nodiscard]] std::uint64_t SystemCalls() const override;
+
+ private:
+  struct Registration {
+    sf::Socket* socket = nullptr;
+    std::uint64_t token = 0;
+  };
+
+  sf::SocketSelector selector_;
+  /// The selector cannot enumerate ready sockets, so we remember them all.
+  std::vector<Registration> registrations_;
+  std::vector<PollEvent> events_;
+  std::uint64_t systemCalls_ = 0;
+};
+
+#endif  // SELECTOR_POLLER_H_
@@ -0,0 +1,84 @@
+/**
+ * @file server_metrics.h
+ * @brief Health counters and latency histograms of one server thread.
+ *
+ * Every ChatServer (one per thread) owns a ServerMetrics and updates it
+ * with plain, unsynchronised increments: no atomics or locks on the hot
+ * path.  A few times per second the server copies it into a snapshot
+ * protected by a mutex, which other threads read.  Snapshots of several
+ * shards are then merged, or rendered side by side in the Prometheus text
+ * format by FormatPrometheus().
+ */
+
+#ifndef SERVER_METRICS_H_
+#define SERVER_METRICS_H_
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "histogram.h"
+
+struct ServerMetrics {
+  // --- Counters: only ever increase. ---
+  std::uint64_t connectionsAccepted = 0;
+  std::uint64_t connectionsClosed = 0;
+  std::uint64_t messagesIn = 0;  ///< Frames received from clients.
+  std::uint64_t bytesIn = 0;     ///< Bytes of those frames, headers included.
+  std::uint64_t messagesOut = 0;  ///< Frames queued for clients.
+  std::uint64_t bytesOut = 0;     ///< Bytes handed to the kernel.
+  std::uint64_t sendPartials = 0;  ///< Flushes stopped by a full socket buffer.
+  std::uint64_t sendFailures = 0;  ///< Flushes that closed the connection.
+  /// Times a client's queue went over the high watermark.
+  std::uint64_t slowConsumerEvents = 0;
+  std::uint64_t framesDropped = 0;  ///< Discarded for slow clients.
+  std::uint64_t slowConsumerDisconnects = 0;
+  std::uint64_t pingsSent = 0;  ///< To clients that went silent.
+  std::uint64_t handshakeTimeouts = 0;  ///< Closed before any message.
+  std::uint64_t idleTimeouts = 0;       ///< Closed after staying silent.
+  std::uint64_t datagramsIn = 0;   ///< Valid datagrams from UDP channels.
+  std::uint64_t datagramsOut = 0;  ///< Datagrams sent, resent ones included.
+  std::uint64_t simulationTicks = 0;
+  /// Simulation ticks skipped because the loop ran late.
+  std::uint64_t simulationTicksSkipped = 0;
+  std::uint64_t stateDeltas = 0;      ///< STATE_DELTA messages sent.
+  std::uint64_t stateDeltaBytes = 0;  ///< Bytes of those, headers included.
+  /// Frames not forwarded to another shard, whose inbox stayed full.
+  std::uint64_t forwardsDropped = 0;
+  /// Chat messages left out of the message log, its queue being full.
+  std::uint64_t logRecordsDropped = 0;
+  /// Made to wait for sockets, and to accept, receive and send on TCP.
+  std::uint64_t systemCalls = 0;
+  std::uint64_t waitTimeNs = 0;    ///< Time spent blocked in the poller.
+  std::uint64_t workTimeNs = 0;    ///< Time spent doing everything else.
+
+  // --- Gauges: sampled when the snapshot is taken. ---
+  std::uint64_t sessions = 0;
+  std::uint64_t outboundBytes = 0;  ///< Bytes queued, not yet sent.
+  std::uint64_t congestedSessions = 0;  ///< Over the high watermark.
+  std::uint64_t pausedSessions = 0;  ///< Not read until they catch up.
+  /// Bytes queued for the client furthest behind.
+  std::uint64_t largestOutboundBytes = 0;
+
+  // --- Histograms. ---
+  Histogram tickDurationNs;
+  Histogram waitDurationNs;
+  Histogram outboundDepth;  ///< Frames in a queue when it is flushed.
+  /// Time the oldest queued frame waited for the flush (coalescing only).
+  Histogram flushDelayNs;
+
+  /// Add the values of @p other (e.g. another shard) to these.
+  void Merge(const ServerMetrics& other);
+};
+
+/**
+ * @brief Render the metrics of every shard in the Prometheus text format.
+ *
+ * Each sample carries a `shard` label with the shard's index in @p shards.
+ * Histograms always have the same buckets, a power of two apart, whether
+ * they counted anything or not.
+ */
+[[nodiscard]] std::string FormatPrometheus(
+    std::span<const ServerMetrics> shards);
+
+#endif  // SERVER_METRICS_H_
@@ -0,0 +1,112 @@
+/**
+ * @file session_handoff.h
+ * @brief Passes a running server's connections on to a new process.
+ *
+ * For a zero-downtime upgrade, the running server (the predecessor) waits
+ * for a successor on a Unix socket.  The new build, started with the same
+ * socket path, takes over instead of binding the port:
+ *
+ *  1. The successor connects to the Unix socket (RequestHandoff()).
+ *  2. The predecessor's HandoffListener notices it on its own thread, and
+ *     the server loop sees Requested().  The server exports its state
+ *     (ChatServer::ExportState()) and Complete() sends it: the sessions
+ *     serialised, then the descriptors of the listener and of every client
+ *     as SCM_RIGHTS messages.
+ *  3. The successor acknowledges once it has everything, rebuilds the
+ *     sessions (ChatServer::ImportState()) and serves.  The predecessor
+ *     exits; without the acknowledgement it carries on serving instead.
+ *
+ * The TCP connections are never closed: what clients send meanwhile waits
+ * in the kernel for the successor, and the bytes the predecessor had
+ * received or queued but not processed travel with the state.  Clients
+ * only see a short pause.
+ *
+ * POSIX only; elsewhere every handoff fails.
+ */
+
+#ifndef SESSION_HANDOFF_H_
+#define SESSION_HANDOFF_H_
+
+#include <SFML/Network/SocketHandle.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chat_protocol.h"
+
+/// One client connection, as handed over.
+struct HandoffSession {
+  sf::SocketHandle socket{};
+  ClientId clientId = NO_CLIENT;
+  bool deflate = false;
+  bool greeted = false;
+  std::vector<RoomId> rooms;
+  std::string received;  ///< Start of a frame already read from the socket.
+  std::string unsent;    ///< Bytes queued for the client, not sent yet.
+};
+
+/// Everything a server hands over.
+struct HandoffState {
+  sf::SocketHandle listener{};
+  ClientId nextClientId = NO_CLIENT + 1;  ///< Never reuse a client ID.
+  std::vector<HandoffSession> sessions;
+};
+
+/// The predecessor's side: waits for a successor in the background.
+class HandoffListener {
+ public:
+  /// Longest wait for the other process at each step of a handoff.
+  static constexpr auto kTimeout = std::chrono::seconds(5);
+
+  HandoffListener() = default;
+  /// Also removes the socket file, unless a successor took over.
+  ~HandoffListener();
+
+  HandoffListener(const HandoffListener&) = delete;
+  HandoffListener& operator=(const HandoffListener&) = delete;
+
+  /**
+   * @brief Listen for a successor on @p path, replacing any socket file
+   *        there (e.g. the predecessor's own).
+   * @return false if the socket cannot be created.
+   */
+  [[nodiscard]] bool Start(const std::filesystem::path& path);
+
+  /// @return true once a successor is waiting for Complete().  Cheap
+  ///         enough to call every tick.
+  [[nodiscard]] bool Requested() const;
+
+  /**
+   * @brief Send @p state to the waiting successor.  Blocks up to a few
+   *        kTimeout.
+   * @return true if the successor took over: the server must then stop
+   *         without touching its sockets again.  On false it keeps serving,
+   *         and the listener waits for another successor.
+   */
+  [[nodiscard]] bool Complete(const HandoffState& state);
+
+ private:
+  void Run(std::stop_token stopToken);
+
+  std::filesystem::path path_;
+  int listenFd_ = -1;
+  int successorFd_ = -1;  ///< Set by the thread before requested_.
+  std::atomic<bool> requested_{false};
+  bool handedOver_ = false;
+  std::jthread thread_;  ///< Last member: stopped and joined first.
+};
+
+/**
+ * @brief Take over from the server waiting for a successor on @p path.
+ * @return Its state, whose descriptors the caller now owns, or
+ *         std::nullopt if no server answered or the transfer failed.
+ */
+[[nodiscard]] std::optional<HandoffState> RequestHandoff(
+    const std::filesystem::path& path);
+
+#endif  // SESSION_HANDOFF_H_
@@ -0,0 +1,108 @@
+/**
+ * @file sharded_chat_server.h
+ * @brief Runs several ChatServer shards on their own threads.
+ *
+ * A single ChatServer handles everything on one core.  To use more cores we
+ * run N of them, one per thread:
+ *  - Every shard listens on the same port with SO_REUSEPORT, so the kernel
+ *    spreads new connections between them and no thread has to hand
+ *    sockets over.
+ *  - A shard owns the sessions it accepted; no session is ever touched by
+ *    two threads.
+ *  - When a frame arrives, the shard broadcasts it to its own clients and
+ *    pushes one shared copy into the lock-free inbox of every other shard,
+ *    which then delivers it to theirs.
+ *
+ * With one shard this is exactly a plain ChatServer running on the calling
+ * thread.
+ */
+
+#ifndef SHARDED_CHAT_SERVER_H_
+#define SHARDED_CHAT_SERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "chat_server.h"
+
+class ShardedChatServer {
+ public:
+  /**
+   * @param shardCount Number of server threads.  Falls back to 1 when the
+   *        platform cannot share a port between listeners.
+   */
+  explicit ShardedChatServer(std::size_t shardCount,
+                             PollerBackend backend = DefaultPollerBackend());
+
+  /**
+   * @brief Start every shard listening on @p port and link them together.
+   * @return true if all the shards were set up successfully.
+   */
+  [[nodiscard]] bool Start(unsigned short port);
+
+  /**
+   * @brief Offer UDP channels (see ChatServer::StartUdp()).  Call after
+   *        Start() and before Run().
+   *
+   * Each shard owns the sessions its datagrams must reach, so shard i
+   * binds @p port + i rather than sharing one port: its clients learn the
+   * port from their UDP_OPEN.
+   * @return true if every shard could bind its port.
+   */
+  [[nodiscard]] bool StartUdp(unsigned short port);
+
+  /// Set the flush interval of every shard (see ChatServer).  Call before
+  /// Run().
+  void SetFlushInterval(std::chrono::microseconds interval);
+
+  /// Turn compression on or off on every shard (see ChatServer).  Call
+  /// before Run().
+  void SetCompression(bool enabled);
+
+  /// Share @p log between every shard (see ChatServer).  Call before Run().
+  void SetMessageLog(const std::shared_ptr<MessageLog>& log);
+
+  /// Set the backpressure of every shard (see ChatServer).  Call before
+  /// Run().
+  void SetBackpressure(const BackpressureConfig& config);
+
+  /// Set the timeouts of every shard (see ChatServer).  Call before Run().
+  void SetTimeouts(const TimeoutConfig& config);
+
+  /// Set the simulation tick rate of every shard (see ChatServer).  Call
+  /// before Run().
+  void SetTickRate(unsigned hz);
+
+  /**
+   * @brief Run the shards until Stop() is called.
+   *
+   * Shard 0 runs on the calling thread, the others on their own threads.
+   */
+  void Run();
+
+  /// Ask Run() to return.  Safe to call from any thread.
+  void Stop();
+
+  [[nodiscard]] std::size_t ShardCount() const;
+
+  /// @return The poller backend of the shards (see ChatServer::Backend()).
+  [[nodiscard]] PollerBackend Backend() const;
+
+  /// The metrics of every shard, in shard order.  Safe from any thread.
+  [[nodiscard]] std::vector<ServerMetrics> MetricsSnapshots() const;
+
+ private:
+  /// The shards' pools.  A frame made by one shard may sit in the queues of
+  /// another, so they are all destroyed after every shard.
+  std::vector<std::shared_ptr<FramePool>> framePools_;
+  /// Shards are heap-allocated so that their address never changes: other
+  /// shards keep pointers to them.
+  std::vector<std::unique_ptr<ChatServer>> shards_;
+  std::atomic<bool> running_{true};
+};
+
+#endif  // SHARDED_CHAT_SERVER_H_
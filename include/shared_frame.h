@@ -0,0 +1,152 @@
+/**
+ * @file shared_frame.h
+ * @brief Immutable, reference-counted encoded frames for zero-copy broadcast.
+ *
+ * A broadcast frame is encoded exactly once, into a block taken from a
+ * FramePool.  Every recipient's OutboundQueue then holds a SharedFrame
+ * pointing at that same block -- copying a SharedFrame only bumps a
+ * reference count.  When the last recipient has written the frame out (or
+ * was disconnected), the count drops to zero and the block goes back to the
+ * pool, ready for the next message.  The memory and copy cost of a
+ * broadcast is therefore independent of the number of recipients.
+ *
+ * The count is atomic so that a frame can be shared between the shards of
+ * a ShardedChatServer, which run on different threads.  Each shard makes
+ * its frames from a pool of its own, without locking; a frame whose last
+ * reference dies on another shard's thread goes back to the pool it came
+ * from through a lock-free list.
+ */
+
+#ifndef SHARED_FRAME_H_
+#define SHARED_FRAME_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+#include "frame.h"
+
+class FramePool;
+
+/// Handle on a pooled, encoded frame.  Cheap to copy.
+class SharedFrame {
+ public:
+  SharedFrame() = default;
+  SharedFrame(const SharedFrame& other);
+  SharedFrame& operator=(const SharedFrame& other);
+  SharedFrame(SharedFrame&& other) noexcept;
+  SharedFrame& operator=(SharedFrame&& other) noexcept;
+  ~SharedFrame();
+
+  /// @return The encoded frame: header followed by payload.
+  [[nodiscard]] std::span<const char> Bytes() const;
+
+  /// @return The payload without the header.
+  [[nodiscard]] std::string_view Payload() const;
+
+  /// @return true if this handle does not refer to any frame.
+  [[nodiscard]] bool Empty() const;
+
+ private:
+  friend class FramePool;
+
+  /// Header of a pooled block; the frame bytes follow it in memory.
+  struct Block {
+    std::atomic<std::uint32_t> refCount{0};
+    std::uint32_t size = 0;      ///< Encoded bytes in use.
+    std::size_t sizeClass = 0;   ///< Index of the pool free list it belongs to.
+    FramePool* pool = nullptr;
+    Block* nextFree = nullptr;   ///< Free list link while in the pool.
+
+    [[nodiscard]] char* Data();
+  };
+
+  explicit SharedFrame(Block* block);
+  void Release();
+
+  Block* block_ = nullptr;
+};
+
+/**
+ * @brief A relayed message, in each encoding its recipients may need.
+ *
+ * @c plain is always set.  @c compressed holds the same message with its
+ * text deflated (see text_compressor.h), when that made it smaller.  Both
+ * are encoded once and shared by all the recipients.
+ */
+struct RelayedFrame {
+  SharedFrame plain;
+  SharedFrame compressed;
+
+  /// @return The frame for a client that does (or does not) accept deflate.
+  [[nodiscard]] const SharedFrame& For(bool deflate) const {
+    return deflate && !compressed.Empty() ? compressed : plain;
+  }
+};
+
+/**
+ * @brief Recycles the memory blocks behind SharedFrame.
+ *
+ * Blocks come in two size classes (small chat lines and full-size frames)
+ * and are never returned to the system while the pool lives, so a steady
+ * stream of messages allocates nothing once the pool has warmed up.  The
+ * pool must outlive every frame it produced.
+ *
+ * Make() and MakeRaw() must only be called by one thread at a time (the
+ * pool's owner, e.g. a shard); the frames may be released on any thread.
+ */
+class FramePool {
+ public:
+  FramePool() = default;
+  ~FramePool();
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  /**
+   * @brief Encode @p payload into a pooled block.
+   * @return The frame, or an empty SharedFrame if the payload is larger
+   *         than MAX_FRAME_PAYLOAD.
+   */
+  [[nodiscard]] SharedFrame Make(std::string_view payload);
+
+  /**
+   * @brief Copy @p bytes, which are already framed (or part of a frame),
+   *        into a pooled block.  Payload() is meaningless on the result.
+   * @return The frame, or an empty SharedFrame if @p bytes is larger than
+   *         MAX_FRAME_SIZE.
+   */
+  [[nodiscard]] SharedFrame MakeRaw(std::string_view bytes);
+
+  /// @return The number of blocks currently referenced by SharedFrames.
+  [[nodiscard]] std::size_t LiveCount() const;
+
+ private:
+  friend class SharedFrame;
+  using Block = SharedFrame::Block;
+
+  /// Capacity in bytes (header included) of each size class.
+  static constexpr std::array<std::size_t, 2> kBlockSizes = {256,
+                                                             MAX_FRAME_SIZE};
+
+  /// Take a block for @p frameSize bytes from the pool, or allocate one.
+  Block* Allocate(std::size_t frameSize);
+
+  /// Called when the last SharedFrame on @p block goes away, on any thread.
+  void Recycle(Block* block);
+
+  /// Move the blocks of returned_ to the free lists.
+  void TakeReturned();
+
+  /// Only touched by the owner's thread.
+  std::array<Block*, kBlockSizes.size()> freeLists_{};
+  /// Blocks released since the last TakeReturned(), whatever their size
+  /// class.  Recycle() pushes onto it and TakeReturned() takes it whole,
+  /// so no block is ever popped alone (no ABA problem).
+  std::atomic<Block*> returned_{nullptr};
+  std::atomic<std::size_t> liveCount_{0};
+};
+
+#endif  // SHARED_FRAME_H_
@@ -0,0 +1,162 @@
+/**
+ * @file slot_map.h
+ * @brief Container with O(1) insert/remove and generational handles.
+ *
+ * A SlotMap stores values in fixed slots and hands out a SlotHandle for
+ * each one: the slot index plus the slot's *generation*.  Removing a value
+ * bumps the generation of its slot, so any handle still pointing at it
+ * becomes stale and Get() returns nullptr instead of silently reaching the
+ * next value stored there.  Handles are therefore safe to keep in rooms,
+ * queues or poller tokens long after the value may have gone away.
+ *
+ *  - Insert and Remove are O(1): free slots are recycled from a free list.
+ *  - Values never move once inserted (slots live in fixed-size chunks), so
+ *    pointers into them -- like the socket pointers kept by SelectorPoller --
+ *    stay valid until the value is removed.
+ *  - A dense array of live slot indices makes iteration touch only live
+ *    values, with no holes to skip, however many values were removed.
+ */
+
+#ifndef SLOT_MAP_H_
+#define SLOT_MAP_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/// Stable identifier of a value stored in a SlotMap.
+struct SlotHandle {
+  std::uint32_t index = 0;
+  std::uint32_t generation = 0;  ///< 0 never refers to a live value.
+
+  /// Pack into 64 bits, e.g. to use as a poller token.  Always >= 2^32.
+  [[nodiscard]] constexpr std::uint64_t Pack() const {
+    return (std::uint64_t{generation} << 32) | index;
+  }
+  [[nodiscard]] static constexpr SlotHandle Unpack(std::uint64_t packed) {
+    return {static_cast<std::uint32_t>(packed & 0xFFFFFFFFu),
+            static_cast<std::uint32_t>(packed >> 32)};
+  }
+
+  friend constexpr bool operator==(SlotHandle, SlotHandle) = default;
+};
+
+template <typename T>
+class SlotMap {
+ public:
+  /// One live value as seen while iterating.
+  struct Entry {
+    SlotHandle handle;
+    T& value;
+  };
+
+  class Iterator {
+   public:
+    Iterator(SlotMap* map, std::size_t position)
+        : map_(map), position_(position) {}
+    Entry operator*() const {
+      auto& slot = map_->SlotAt(map_->dense_[position_]);
+      return {{map_->dense_[position_], slot.generation}, *slot.value};
+    }
+    Iterator& operator++() {
+      ++position_;
+      return *this;
+    }
+    friend bool operator==(const Iterator&, const Iterator&) = default;
+
+   private:
+    SlotMap* map_;
+    std::size_t position_;
+  };
+
+  /// Construct a value in a free slot and return its handle.
+  template <typename... Args>
+  SlotHandle Emplace(Args&&... args) {
+    std::uint32_t index = 0;
+    if (freeList_.empty()) {
+      index = slotCount_++;
+      if (index / kChunkSize == chunks_.size()) {
+        chunks_.push_back(std::make_unique<Slot[]>(kChunkSize));
+      }
+    } else {
+      index = freeList_.back();
+      freeList_.pop_back();
+    }
+    auto& slot = SlotAt(index);
+    slot.value.emplace(std::forward<Args>(args)...);
+    slot.densePosition = static_cast<std::uint32_t>(dense_.size());
+    dense_.push_back(index);
+    return {index, slot.generation};
+  }
+
+  /// @return The value for @p handle, or nullptr if it was removed.
+  [[nodiscard]] T* Get(SlotHandle handle) {
+    if (handle.index >= slotCount_) return nullptr;
+    auto& slot = SlotAt(handle.index);
+    if (slot.generation != handle.generation || !slot.value) return nullptr;
+    return &*slot.value;
+  }
+
+  /// Destroy the value for @p handle.  @return false if it was already gone.
+  bool Remove(SlotHandle handle) {
+    if (Get(handle) == nullptr) return false;
+    auto& slot = SlotAt(handle.index);
+    slot.value.reset();
+    // Invalidate every outstanding handle.  Generation 0 is reserved for
+    // "no value", so skip it when the counter wraps around.
+    if (++slot.generation == 0) slot.generation = 1;
+    // Keep the dense array packed: move its last entry into the hole.
+    const auto lastIndex = dense_.back();
+    dense_[slot.densePosition] = lastIndex;
+    SlotAt(lastIndex).densePosition = slot.densePosition;
+    dense_.pop_back();
+    freeList_.push_back(handle.index);
+    return true;
+  }
+
+  /// Remove every value for which @p predicate(handle, value) returns true.
+  template <typename Predicate>
+  void EraseIf(Predicate predicate) {
+    // Walk backwards: Remove() only moves entries from the back, which we
+    // have already visited.
+    for (auto position = dense_.size(); position-- > 0;) {
+      const auto index = dense_[position];
+      auto& slot = SlotAt(index);
+      const SlotHandle handle{index, slot.generation};
+      if (predicate(handle, *slot.value)) {
+        Remove(handle);
+      }
+    }
+  }
+
+  [[nodiscard]] std::size_t Size() const { return dense_.size(); }
+  [[nodiscard]] bool Empty() const { return dense_.empty(); }
+
+  /// Iteration order is unspecified.  Do not insert or remove while iterating.
+  [[nodiscard]] Iterator begin() { return {this, 0}; }
+  [[nodiscard]] Iterator end() { return {this, dense_.size()}; }
+
+ private:
+  static constexpr std::size_t kChunkSize = 256;
+
+  struct Slot {
+    std::optional<T> value;
+    std::uint32_t generation = 1;
+    std::uint32_t densePosition = 0;  ///< Where this slot sits in dense_.
+  };
+
+  Slot& SlotAt(std::uint32_t index) {
+    return chunks_[index / kChunkSize][index % kChunkSize];
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> chunks_;  ///< Never reallocated.
+  std::uint32_t slotCount_ = 0;        ///< Slots handed out so far.
+  std::vector<std::uint32_t> dense_;     ///< Indices of the live slots.
+  std::vector<std::uint32_t> freeList_;  ///< Indices of reusable slots.
+};
+
+#endif  // SLOT_MAP_H_
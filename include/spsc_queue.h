@@ -0,0 +1,88 @@
+/**
+ * @file spsc_queue.h
+ * @brief Bounded lock-free single-producer / single-consumer queue.
+ *
+ * The cheapest way to hand values from exactly one thread to exactly one
+ * other: a ring buffer with a head index written only by the producer and
+ * a tail index written only by the consumer.  A push or pop is one relaxed
+ * load of its own index, one acquire load of the other side's index and
+ * one release store -- no read-modify-write at all.  Each side also keeps
+ * a cached copy of the other side's index, so it only touches the shared
+ * cache line when the ring looks full (or empty).
+ *
+ * The queue never allocates after construction.  When it is full
+ * TryPush() fails and leaves the value untouched.
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+template <typename T>
+class SpscQueue {
+ public:
+  /// @param capacity Maximum number of queued values, a power of two.
+  explicit SpscQueue(std::size_t capacity)
+      : values_(std::make_unique<T[]>(capacity)), mask_(capacity - 1) {
+    assert(capacity >= 2 && (capacity & mask_) == 0);
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /**
+   * @brief Append @p value.  Only the producer thread may call this.
+   * @return false if the queue is full; @p value is then left unchanged.
+   */
+  [[nodiscard]] bool TryPush(T&& value) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head - cachedTail_ > mask_) {
+      cachedTail_ = tail_.load(std::memory_order_acquire);
+      if (head - cachedTail_ > mask_) {
+        return false;
+      }
+    }
+    values_[head & mask_] = std::move(value);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest value.  Only the consumer thread may call this.
+   * @return The value, or std::nullopt if the queue is empty.
+   */
+  [[nodiscard]] std::optional<T> TryPop() {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail == cachedHead_) {
+      cachedHead_ = head_.load(std::memory_order_acquire);
+      if (tail == cachedHead_) {
+        return std::nullopt;
+      }
+    }
+    std::optional<T> value(std::move(values_[tail & mask_]));
+    values_[tail & mask_] = T{};  // Release resources held by the value.
+    tail_.store(tail + 1, std::memory_order_release);
+    return value;
+  }
+
+ private:
+  /// Keeps the producer and consumer sides on separate cache lines.
+  static constexpr std::size_t kCacheLineSize = 64;
+
+  std::unique_ptr<T[]> values_;
+  std::size_t mask_;
+  // Producer side.
+  alignas(kCacheLineSize) std::atomic<std::size_t> head_{0};
+  std::size_t cachedTail_ = 0;  ///< Last tail_ seen by the producer.
+  // Consumer side.
+  alignas(kCacheLineSize) std::atomic<std::size_t> tail_{0};
+  std::size_t cachedHead_ = 0;  ///< Last head_ seen by the consumer.
+};
+
+#endif  // SPSC_QUEUE_H_
@@ -0,0 +1,62 @@
+/**
+ * @file text_compressor.h
+ * @brief Per-message compression of chat text (raw deflate, zlib).
+ *
+ * Chat lines and game messages repeat the same words, names and keys, but
+ * a single line is too short for deflate to find much to reuse in it.  Both
+ * sides therefore start every message from the same preset dictionary of
+ * common text, which is where most of the gain on short lines comes from.
+ *
+ * Each message is compressed on its own, without a context carried from
+ * one message to the next: a broadcast frame is compressed once and the
+ * same bytes can be sent to every member of the room, whatever each of
+ * them received before.
+ *
+ * Text shorter than COMPRESSION_THRESHOLD is not worth the CPU and is sent
+ * as it is.  So is text that would not get smaller.
+ */
+
+#ifndef TEXT_COMPRESSOR_H_
+#define TEXT_COMPRESSOR_H_
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+struct z_stream_s;
+
+/// Shortest text worth compressing, in bytes.
+inline constexpr std::size_t COMPRESSION_THRESHOLD = 64;
+
+class TextCompressor {
+ public:
+  TextCompressor();
+  ~TextCompressor();
+
+  TextCompressor(const TextCompressor&) = delete;
+  TextCompressor& operator=(const TextCompressor&) = delete;
+
+  /**
+   * @brief Deflate @p text into @p out.
+   * @return The compressed size, or 0 if it would not be smaller than
+   *         @p text (or zlib failed): send the text uncompressed then.
+   */
+  [[nodiscard]] std::size_t Compress(std::string_view text,
+                                     std::span<char> out);
+
+  /**
+   * @brief Inflate @p data into @p out.
+   * @return The text size, or std::nullopt if @p data is corrupt or its
+   *         text does not fit in @p out.
+   */
+  [[nodiscard]] std::optional<std::size_t> Decompress(std::string_view data,
+                                                      std::span<char> out);
+
+ private:
+  std::unique_ptr<z_stream_s> deflate_;
+  std::unique_ptr<z_stream_s> inflate_;
+};
+
+#endif  // TEXT_COMPRESSOR_H_
@@ -0,0 +1,78 @@
+/**
+ * @file timing_wheel.h
+ * @brief Hierarchical timing wheel: many timers, O(1) to arm and expire.
+ *
+ * Time is cut into ticks of a fixed resolution.  Level 0 has one slot per
+ * tick for the next kSlots ticks; each level above has slots kSlots times
+ * wider, so kLevels levels cover kSlots^kLevels ticks.  A timer is put in
+ * the slot of the lowest level that holds its deadline.  When the current
+ * tick enters a slot of a higher level, that slot's timers are moved down
+ * ("cascaded") to finer slots, and the timers of each level-0 slot expire
+ * when its tick is reached.
+ *
+ * Arming is a push_back and every timer is moved at most kLevels times, so
+ * the cost does not depend on the number of timers, unlike a scan or a
+ * heap.  Timers cannot be cancelled: the owner checks whether an expired
+ * timer still matters, and arms it again if its deadline moved later (see
+ * ChatServer).  Deadlines are rounded up to the resolution.
+ */
+
+#ifndef TIMING_WHEEL_H_
+#define TIMING_WHEEL_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TimingWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t kSlotBits = 6;
+  static constexpr std::size_t kSlots = std::size_t{1} << kSlotBits;
+  static constexpr std::size_t kLevels = 4;
+
+  struct Timer {
+    std::uint64_t token = 0;  ///< Chosen by the owner, e.g. a SlotHandle.
+    Clock::time_point deadline;
+  };
+
+  /// Start the wheel at @p start, with ticks of @p resolution.
+  explicit TimingWheel(Clock::duration resolution,
+                       Clock::time_point start = Clock::now());
+
+  /// Expire @p token at @p deadline, or at the next Advance() if it is due.
+  void Arm(std::uint64_t token, Clock::time_point deadline);
+
+  /**
+   * @brief Move the wheel up to @p now.
+   *
+   * The timers that expired are appended to @p expired, roughly in
+   * deadline order.
+   */
+  void Advance(Clock::time_point now, std::vector<Timer>& expired);
+
+  /// @return The number of armed timers.
+  [[nodiscard]] std::size_t Size() const;
+
+ private:
+  /// @return The tick @p time falls in, rounded up.
+  [[nodiscard]] std::uint64_t TickOf(Clock::time_point time) const;
+
+  /// Put @p timer in the slot of @p tick, its expiry tick (>= the current
+  /// one).
+  void Insert(const Timer& timer, std::uint64_t tick);
+
+  Clock::duration resolution_;
+  Clock::time_point start_;
+  std::uint64_t currentTick_ = 0;  ///< Every tick up to it was processed.
+  std::size_t size_ = 0;
+  /// Level by level.  Cleared vectors keep their storage, so a wheel in a
+  /// steady state does not allocate.
+  std::array<std::vector<Timer>, kLevels * kSlots> slots_;
+  std::vector<Timer> scratch_;  ///< A slot being cascaded or expired.
+};
+
+#endif  // TIMING_WHEEL_H_
@@ -0,0 +1,255 @@
+/**
+ * @file udp_channel.h
+ * @brief Delivery classes over UDP: unreliable, sequenced, reliable.
+ *
+ * On a TCP stream, one lost segment holds back every byte behind it until
+ * it is sent again, so a game state update waits for a retransmission
+ * timeout even when a newer update has already arrived.  A UdpChannel
+ * carries each message in its own datagram with the delivery class the
+ * sender chose (see Delivery in chat_protocol.h):
+ *  - UNRELIABLE messages are delivered as they arrive;
+ *  - SEQUENCED messages are numbered, and one older than the newest
+ *    delivered is dropped;
+ *  - RELIABLE messages are numbered separately, kept by the sender until
+ *    acknowledged and sent again after a timeout derived from the round
+ *    trip time, and delivered in order: early ones wait for the gaps.
+ *
+ * Every datagram acknowledges the reliable messages received so far: all
+ * those before @c ack, plus a bit for each of the kWindow - 1 following
+ * ones (selective acks), so only the messages really lost are sent again.
+ * A message is also sent again early, after about a round trip, once one
+ * sent after it was acknowledged: like TCP's fast retransmit, this spares
+ * most losses the full timeout.
+ * At most kWindow reliable messages are in flight; later ones wait.  A
+ * lost datagram therefore delays the reliable messages only.
+ *
+ * Each datagram is one message (at most MAX_DATAGRAM_SIZE bytes with this
+ * header, big-endian):
+ *
+ *     +---------+------+-------+----------+-----+----------+-------------+
+ *     | version | kind | token | sequence | ack | ack bits | message ... |
+ *     | 1 byte  | 1    | 8     | 4        | 4   | 4        |             |
+ *     +---------+------+-------+----------+-----+----------+-------------+
+ *
+ * The token is the one of the connection's UDP_OPEN: it tells the server
+ * which session a datagram belongs to, from whatever address it comes.
+ * The client sends PROBE datagrams until the server answers, then every
+ * kKeepAlive so that NATs keep the mapping open and each side knows the
+ * other still hears it.
+ *
+ * The channel does no I/O: the owner passes it the datagrams received and
+ * writes out the ones it returns, so the same code serves the server's
+ * single socket and the client's.
+ */
+
+#ifndef UDP_CHANNEL_H_
+#define UDP_CHANNEL_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "chat_protocol.h"
+#include "const.h"
+#include "wire_schema.h"
+
+/// What a datagram carries.
+enum class DatagramKind : std::uint8_t {
+  ACK = 0,         ///< Acknowledgements only.
+  PROBE = 1,       ///< Acknowledgements, and asks for an ACK back.
+  UNRELIABLE = 2,  ///< A Delivery::UNRELIABLE message.
+  SEQUENCED = 3,   ///< A Delivery::SEQUENCED message.
+  RELIABLE = 4,    ///< A Delivery::RELIABLE message.
+};
+
+/// A datagram.  Once decoded, @c message points into the input.
+struct DatagramView {
+  std::uint8_t version = PROTOCOL_VERSION;
+  DatagramKind kind = DatagramKind::ACK;
+  std::uint64_t token = 0;
+  std::uint32_t sequence = 0;  ///< Of SEQUENCED and RELIABLE messages.
+  std::uint32_t ack = 0;       ///< Every reliable message before it arrived.
+  std::uint32_t ackBits = 0;   ///< Bit i: reliable message ack + 1 + i did.
+  std::string_view message;
+};
+
+using DatagramSchema =
+    WireSchema<&DatagramView::version, &DatagramView::kind,
+               &DatagramView::token, &DatagramView::sequence,
+               &DatagramView::ack, &DatagramView::ackBits,
+               &DatagramView::message>;
+
+/// Bytes in front of the message.
+inline constexpr std::size_t DATAGRAM_HEADER_SIZE = DatagramSchema::kFixedSize;
+
+/// Largest message a datagram can carry.
+inline constexpr std::size_t MAX_DATAGRAM_MESSAGE =
+    MAX_DATAGRAM_SIZE - DATAGRAM_HEADER_SIZE;
+
+/// One end of a UDP channel.
+class UdpChannel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Reliable messages in flight at once.
+  static constexpr std::uint32_t kWindow = 32;
+  /// Reliable messages that may wait for room in the window.
+  static constexpr std::size_t kMaxBacklog = 1024;
+  /// Least margin of the retransmission timeout over the round trip, for
+  /// the delays the estimate misses (e.g. waiting for the other end's
+  /// tick), and its upper bound.
+  static constexpr auto kMinResendMargin = std::chrono::milliseconds(10);
+  static constexpr auto kMaxResend = std::chrono::milliseconds(1000);
+  /// Timeout before the first round trip was measured.
+  static constexpr auto kInitialResend = std::chrono::milliseconds(200);
+  /// Longest silence of a channel in use, and interval of the probes that
+  /// open it.
+  static constexpr auto kKeepAlive = std::chrono::milliseconds(1000);
+  static constexpr auto kProbeInterval = std::chrono::milliseconds(100);
+  /// Silence after which the other end counts as unreachable.
+  static constexpr auto kTimeout = std::chrono::seconds(5);
+
+  /**
+   * @param token Identifies the connection in every datagram.
+   * @param probe Whether this end opens the channel (the client): it then
+   *        sends PROBE datagrams until it hears from the other end.
+   */
+  UdpChannel(std::uint64_t token, bool probe);
+
+  /// @return The token of @p datagram, to find its channel, or
+  ///         std::nullopt if it is not a datagram of this protocol.
+  [[nodiscard]] static std::optional<std::uint64_t> PeekToken(
+      std::string_view datagram);
+
+  /**
+   * @brief Queue @p message, which NextDatagram() then returns.
+   * @return false if it is longer than MAX_DATAGRAM_MESSAGE, or if it is
+   *         reliable and kMaxBacklog reliable messages already wait.
+   */
+  [[nodiscard]] bool Send(Delivery delivery, std::string_view message);
+
+  /**
+   * @brief Handle a datagram received from the other end.
+   *
+   * Its message and the reliable ones it unblocked are then returned by
+   * NextMessage(): @p datagram must stay valid until that returns
+   * std::nullopt.
+   * @return false if the datagram is malformed or of another channel.
+   */
+  [[nodiscard]] bool Receive(std::string_view datagram, Clock::time_point now);
+
+  /// @return The next message received, valid until the next call, or
+  ///         std::nullopt once all were returned.
+  [[nodiscard]] std::optional<std::string_view> NextMessage();
+
+  /**
+   * @brief The next datagram to write to the other end: a queued message,
+   *        a reliable one to send again, acknowledgements or a probe.
+   * @return The datagram, valid until the next call, or std::nullopt once
+   *         nothing more is due at @p now.
+   */
+  [[nodiscard]] std::optional<std::string_view> NextDatagram(
+      Clock::time_point now);
+
+  /// @return true while reliable messages wait for an acknowledgement or
+  ///         messages for NextDatagram(): the owner must then call it
+  ///         again soon, for the retransmissions.
+  [[nodiscard]] bool Busy() const;
+
+  /**
+   * @return true if the other end was heard from within kTimeout.  While
+   *         it is not, the owner should send over TCP instead; the probes
+   *         go on, so the channel comes back if the path does.
+   */
+  [[nodiscard]] bool Connected(Clock::time_point now) const;
+
+  /// @return Reliable messages sent again so far.
+  [[nodiscard]] std::uint64_t Resends() const;
+
+ private:
+  /// A reliable message in the send window.
+  struct Outgoing {
+    std::string message;
+    Clock::time_point sentAt;  ///< When it was last sent.
+    std::uint32_t sends = 0;   ///< 0 until sent the first time.
+    bool acked = false;
+  };
+
+  /// A reliable message that arrived ahead of a gap.
+  struct Early {
+    std::string message;
+    bool present = false;
+  };
+
+  /// A message waiting for NextDatagram().
+  struct Queued {
+    DatagramKind kind = DatagramKind::UNRELIABLE;
+    std::uint32_t sequence = 0;
+    std::string message;
+  };
+
+  /// @return true if sequence number @p a comes after @p b, wrapping.
+  [[nodiscard]] static bool After(std::uint32_t a, std::uint32_t b);
+
+  /// Take the acknowledgements of a datagram into account.
+  void OnAck(std::uint32_t ack, std::uint32_t ackBits, Clock::time_point now);
+
+  /// Update the round trip estimate with @p sample (RFC 6298).
+  void OnRoundTrip(Clock::duration sample);
+
+  /// @return Whether reliable message @p sequence, in @p slot, must be
+  ///         sent (again) at @p now.
+  [[nodiscard]] bool Due(std::uint32_t sequence, const Outgoing& slot,
+                         Clock::time_point now) const;
+
+  /// @return The timeout of a message already sent @p sends times.
+  [[nodiscard]] Clock::duration ResendTimeout(std::uint32_t sends) const;
+
+  /// Encode a datagram carrying our acknowledgements into datagram_.
+  [[nodiscard]] std::string_view Encode(DatagramKind kind,
+                                        std::uint32_t sequence,
+                                        std::string_view message,
+                                        Clock::time_point now);
+
+  std::uint64_t token_;
+  bool probe_;  ///< Opens the channel and keeps it alive.
+
+  // --- Sending ---
+  std::deque<Queued> queue_;  ///< Not sent yet (unreliable or new).
+  std::uint32_t nextSequenced_ = 0;
+  /// Reliable messages [sendBase_, sendNext_) are in sendWindow_, at their
+  /// sequence modulo kWindow; those that did not fit wait in backlog_.
+  std::array<Outgoing, kWindow> sendWindow_;
+  std::uint32_t sendBase_ = 0;
+  std::uint32_t sendNext_ = 0;
+  std::deque<std::string> backlog_;
+  std::uint32_t ackedEnd_ = 0;  ///< One past the newest message acked.
+  Clock::duration smoothedRtt_{};
+  Clock::duration rttVariance_{};
+  bool rttMeasured_ = false;
+  Clock::time_point lastSent_;
+  std::uint64_t resends_ = 0;
+
+  // --- Receiving ---
+  bool received_ = false;  ///< Heard from the other end at least once.
+  Clock::time_point lastReceived_;
+  bool sequencedReceived_ = false;
+  std::uint32_t lastSequenced_ = 0;  ///< Newest SEQUENCED message delivered.
+  /// Reliable messages before it were all delivered.  Those after it that
+  /// arrived early wait in receiveWindow_, at their sequence modulo kWindow.
+  std::uint32_t receiveNext_ = 0;
+  std::array<Early, kWindow> receiveWindow_;
+  bool ackDue_ = false;  ///< Acknowledgements to send, even without data.
+  std::string_view current_;  ///< Message of the datagram being received.
+  bool currentPending_ = false;  ///< current_ not returned yet.
+  std::string delivered_;  ///< Message returned last, out of receiveWindow_.
+
+  std::array<char, MAX_DATAGRAM_SIZE> datagram_;  ///< Returned last.
+};
+
+#endif  // UDP_CHANNEL_H_
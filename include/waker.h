@@ -0,0 +1,43 @@
+/**
+ * @file waker.h
+ * @brief Lets another thread interrupt a server blocked in its poller.
+ *
+ * The server sleeps in PollerInterface::Wait() until a socket is ready.
+ * When another thread hands it work (e.g. a frame to broadcast), it must be
+ * woken up right away rather than at the end of the wait timeout.  The
+ * Waker is a connected pair of loopback TCP sockets: the read end is
+ * registered with the poller like any client, and Wake() writes one byte to
+ * the other end.  This works with every poller backend, including
+ * sf::SocketSelector which can only watch SFML sockets.
+ *
+ * Wakes are coalesced: only the first Wake() after a Drain() writes a byte.
+ */
+
+#ifndef WAKER_H_
+#define WAKER_H_
+
+#include <SFML/Network/TcpSocket.hpp>
+#include <atomic>
+
+class Waker {
+ public:
+  /// Create and connect the socket pair.  Returns false on failure.
+  [[nodiscard]] bool Init();
+
+  /// The socket to register with the poller.
+  [[nodiscard]] sf::TcpSocket& ReadSocket();
+
+  /// Interrupt the poller.  Safe to call from any thread.
+  void Wake();
+
+  /// Consume pending wake-ups.  Call from the polling thread only, before
+  /// looking for the work that caused them.
+  void Drain();
+
+ private:
+  sf::TcpSocket readEnd_;
+  sf::TcpSocket writeEnd_;
+  std::atomic<bool> pending_{false};
+};
+
+#endif  // WAKER_H_
@@ -0,0 +1,195 @@
+/**
+ * @file wire_schema.h
+ * @brief Binary encoding of message structs, generated from a field list.
+ *
+ * A message type is declared once, as a plain struct plus the list of its
+ * members in wire order:
+ *
+ *     struct Move {
+ *       std::uint32_t player = 0;
+ *       std::uint16_t x = 0;
+ *       std::uint16_t y = 0;
+ *       std::string_view comment;
+ *     };
+ *     using MoveSchema = WireSchema<&Move::player, &Move::x, &Move::y,
+ *                                   &Move::comment>;
+ *
+ * The schema then encodes and decodes that struct:
+ *  - integers and enums are written big-endian with their exact size;
+ *  - a std::string_view may only come last and takes the rest of the
+ *    payload, so it needs no length field.
+ *
+ * Everything is resolved at compile time: Encode() writes straight into the
+ * caller's buffer, and Decode() returns views into the input, so neither
+ * allocates.  Sizes and offsets are constants the compiler folds into
+ * plain loads and stores.
+ */
+
+#ifndef WIRE_SCHEMA_H_
+#define WIRE_SCHEMA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+/// Splits a pointer to member into its class and member type.
+template <typename T>
+struct WireMember;
+
+template <typename Class, typename T>
+struct WireMember<T Class::*> {
+  using ClassType = Class;
+  using Type = T;
+};
+
+/// How one member type is written.  Specialised for integers and enums.
+template <typename T>
+struct WireCodec;
+
+template <typename T>
+  requires std::is_integral_v<T> || std::is_enum_v<T>
+struct WireCodec<T> {
+  static constexpr std::size_t kSize = sizeof(T);
+
+  static void Write(char* out, T value) {
+    using Raw = std::make_unsigned_t<
+        typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>,
+                                    std::type_identity<T>>::type>;
+    auto raw = static_cast<Raw>(value);
+    for (std::size_t i = kSize; i-- > 0;) {
+      out[i] = static_cast<char>(raw & 0xFF);
+      if constexpr (kSize > 1) raw = static_cast<Raw>(raw >> 8);
+    }
+  }
+
+  static T Read(const char* in) {
+    using Raw = std::make_unsigned_t<
+        typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>,
+                                    std::type_identity<T>>::type>;
+    Raw raw = 0;
+    for (std::size_t i = 0; i < kSize; ++i) {
+      if constexpr (kSize > 1) raw = static_cast<Raw>(raw << 8);
+      raw = static_cast<Raw>(raw | static_cast<unsigned char>(in[i]));
+    }
+    return static_cast<T>(raw);
+  }
+};
+
+/// The type of the member @p Member points to.
+template <auto Member>
+using WireMemberType = typename WireMember<decltype(Member)>::Type;
+
+/// true for the variable-size member, which takes the rest of the payload.
+template <auto Member>
+inline constexpr bool WIRE_IS_TAIL =
+    std::is_same_v<WireMemberType<Member>, std::string_view>;
+
+/// Bytes always taken by @p Member: 0 for the tail.
+template <auto Member>
+consteval std::size_t WireFixedSize() {
+  if constexpr (WIRE_IS_TAIL<Member>) {
+    return 0;
+  } else {
+    return WireCodec<WireMemberType<Member>>::kSize;
+  }
+}
+
+template <auto First, auto... Rest>
+class WireSchema {
+ public:
+  using Message = typename WireMember<decltype(First)>::ClassType;
+
+  /// The last member, the only one allowed to be a string.
+  static constexpr auto kLast =
+      std::get<sizeof...(Rest)>(std::tuple{First, Rest...});
+
+  /// Bytes taken by the fixed-size members.
+  static constexpr std::size_t kFixedSize =
+      (WireFixedSize<First>() + ... + WireFixedSize<Rest>());
+
+  /// @return The number of bytes Encode() writes for @p message.
+  [[nodiscard]] static std::size_t EncodedSize(const Message& message) {
+    if constexpr (WIRE_IS_TAIL<kLast>) {
+      return kFixedSize + (message.*kLast).size();
+    } else {
+      return kFixedSize;
+    }
+  }
+
+  /**
+   * @brief Write @p message into @p out.
+   * @return The number of bytes written, or 0 if @p out is too small.
+   */
+  [[nodiscard]] static std::size_t Encode(const Message& message,
+                                          std::span<char> out) {
+    const auto size = EncodedSize(message);
+    if (out.size() < size) {
+      return 0;
+    }
+    char* cursor = out.data();
+    WriteMember<First>(cursor, message);
+    (WriteMember<Rest>(cursor, message), ...);
+    return size;
+  }
+
+  /**
+   * @brief Read a message from @p in.
+   * @return The message, whose string member points into @p in, or
+   *         std::nullopt if @p in is too short (or too long for a message
+   *         without a string member).
+   */
+  [[nodiscard]] static std::optional<Message> Decode(std::string_view in) {
+    if (in.size() < kFixedSize ||
+        (!WIRE_IS_TAIL<kLast> && in.size() != kFixedSize)) {
+      return std::nullopt;
+    }
+    Message message{};
+    const char* cursor = in.data();
+    const char* const end = in.data() + in.size();
+    ReadMember<First>(cursor, end, message);
+    (ReadMember<Rest>(cursor, end, message), ...);
+    return message;
+  }
+
+ private:
+
+  // Only the last member may be a string: it has no length field.
+  static_assert((static_cast<int>(WIRE_IS_TAIL<First>) + ... +
+                 static_cast<int>(WIRE_IS_TAIL<Rest>)) ==
+                    static_cast<int>(WIRE_IS_TAIL<kLast>),
+                "A std::string_view member must come last");
+
+  template <auto Member>
+  static void WriteMember(char*& cursor, const Message& message) {
+    if constexpr (WIRE_IS_TAIL<Member>) {
+      const std::string_view text = message.*Member;
+      if (!text.empty()) std::memcpy(cursor, text.data(), text.size());
+      cursor += text.size();
+    } else {
+      using Codec = WireCodec<WireMemberType<Member>>;
+      Codec::Write(cursor, message.*Member);
+      cursor += Codec::kSize;
+    }
+  }
+
+  template <auto Member>
+  static void ReadMember(const char*& cursor, const char* end,
+                         Message& message) {
+    if constexpr (WIRE_IS_TAIL<Member>) {
+      message.*Member =
+          std::string_view(cursor, static_cast<std::size_t>(end - cursor));
+      cursor = end;
+    } else {
+      using Codec = WireCodec<WireMemberType<Member>>;
+      message.*Member = Codec::Read(cursor);
+      cursor += Codec::kSize;
+    }
+  }
+};
+
+#endif  // WIRE_SCHEMA_H_
@@ -0,0 +1,24 @@
+/**
+ * @file bench_utils.h
+ * @brief Helpers shared by the benchmark executables.
+ */
+
+#ifndef BENCH_UTILS_H_
+#define BENCH_UTILS_H_
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/// Allow the process to open as many descriptors as the hard limit permits.
+inline void RaiseDescriptorLimit() {
+#ifndef _WIN32
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+}
+
+#endif  // BENCH_UTILS_H_
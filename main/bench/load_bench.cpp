@@ -0,0 +1,570 @@
+/**
+ * @file load_bench.cpp
+ * @brief Headless load generator: many bot clients against a local server.
+ *
+ * The benchmark starts a ChatServer (or a ShardedChatServer) in-process on
+ * BENCH_PORT, then opens the requested number of bot connections, spread
+ * over a few bot threads.  Each bot joins one room (bots are grouped in
+ * rooms of @c room_size members) and sends chat messages at a fixed rate.
+ *
+ * Every message starts with the time at which it was *scheduled* to be
+ * sent.  When a bot receives a message, the difference with the current
+ * time is the end-to-end latency of that delivery: client send, server
+ * relay and client receive.  Using the scheduled rather than the actual
+ * send time means a bot thread falling behind shows up as latency instead
+ * of silently lowering the offered load.
+ *
+ * With `compress=1` the bots negotiate compressed text (see
+ * text_compressor.h).  The messages are then made of ordinary chat
+ * sentences rather than filler, so that they compress like real ones.  The
+ * result row reports the bytes received on the wire relative to the same
+ * messages uncompressed, and the CPU time of the whole process (server and
+ * bots) per received message, to compare with a `compress=0` run.
+ *
+ * With `slow=N` one bot in each of the first N rooms never reads its
+ * socket, like a client that hung or sits behind a dead link.  Their server queues then reach the
+ * high watermark (`high_kb`, the low one being a quarter of it) and the
+ * server applies `policy` (drop, pause or disconnect, see
+ * BackpressureConfig).  The latency measured by the other bots shows
+ * whether they are affected; the result row also counts the frames the
+ * server dropped and the slow bots it closed.  Their queues only grow
+ * once the kernel buffers are full (a few MB on loopback), so use a high
+ * enough rate and payload, e.g.
+ *
+ *     load_bench clients=100 rate=100 payload=1000 slow=10 policy=drop
+ *
+ * Frames are dropped in the server and only counted there: with
+ * `server_threads` > 1 the counts are summed over the shards.
+ *
+ * `backend` picks the server's poller (select, epoll or io_uring, see
+ * poller_interface.h); the bots always use the default one.  The result
+ * row names the backend actually used, and the system calls the server
+ * made per message it received, to compare them at the same load:
+ *
+ *     load_bench clients=2000 rate=50 backend=select
+ *     load_bench clients=2000 rate=50 backend=io_uring
+ *
+ * Options are given as `name=value` pairs, e.g.
+ *
+ *     load_bench clients=5000 rate=2 seconds=20 server_threads=4
+ *
+ * A single CSV header and result row are printed on stdout, so that runs
+ * can be collected and compared to catch regressions.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <latch>
+#include <memory>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bench_utils.h"
+#include "chat_protocol.h"
+#include "chat_server.h"
+#include "const.h"
+#include "frame.h"
+#include "histogram.h"
+#include "poller_interface.h"
+#include "server_metrics.h"
+#include "sharded_chat_server.h"
+#include "text_compressor.h"
+
+namespace {
+
+/// Not PORT_NUMBER, so the benchmark can run next to a real server.
+constexpr unsigned short BENCH_PORT = PORT_NUMBER + 1;
+/// Time left to in-flight messages after the bots stop sending.
+constexpr auto kDrainTime = std::chrono::seconds(1);
+/// Time given to the server to process the joins before sending starts.
+constexpr auto kSettleTime = std::chrono::milliseconds(500);
+/// Repeated to fill the messages when compression is on.
+constexpr std::string_view kSampleText =
+    "Does anyone want to play another game? I think the blue team should "
+    "defend the north side this time, we lost too many players there. ";
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::size_t clients = 1000;
+  std::size_t botThreads = 4;
+  std::size_t serverThreads = 1;
+  std::size_t roomSize = 10;
+  double rate = 1.0;  ///< Messages per second sent by each bot.
+  std::size_t payloadBytes = 64;  ///< Text size of a chat message.
+  double seconds = 10.0;
+  std::int64_t flushUs = 0;  ///< Server coalescing interval, 0 for none.
+  bool compress = false;     ///< Negotiate compressed text.
+  std::size_t slowClients = 0;  ///< Bots that never read.
+  std::size_t highWatermarkKb = 1024;
+  SlowConsumerPolicy policy = SlowConsumerPolicy::DISCONNECT;
+  PollerBackend backend = DefaultPollerBackend();  ///< The server's.
+};
+
+constexpr std::string_view PolicyName(SlowConsumerPolicy policy) {
+  switch (policy) {
+    case SlowConsumerPolicy::DROP_OLDEST:
+      return "drop";
+    case SlowConsumerPolicy::PAUSE_READING:
+      return "pause";
+    case SlowConsumerPolicy::DISCONNECT:
+      return "disconnect";
+  }
+  return "";
+}
+
+/// Parse one `name=value` argument into @p options.  @return false if invalid.
+bool ParseOption(std::string_view arg, Options& options) {
+  const auto equal = arg.find('=');
+  if (equal == std::string_view::npos) return false;
+  const auto name = arg.substr(0, equal);
+  const auto value = arg.substr(equal + 1);
+  const auto parse = [value](auto& out) {
+    const auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), out);
+    return ec == std::errc{} && ptr == value.data() + value.size();
+  };
+  if (name == "clients") return parse(options.clients);
+  if (name == "bot_threads") return parse(options.botThreads);
+  if (name == "server_threads") return parse(options.serverThreads);
+  if (name == "room_size") return parse(options.roomSize);
+  if (name == "rate") return parse(options.rate);
+  if (name == "payload") return parse(options.payloadBytes);
+  if (name == "seconds") return parse(options.seconds);
+  if (name == "flush_us") return parse(options.flushUs);
+  if (name == "compress") {
+    options.compress = value == "1";
+    return value == "0" || value == "1";
+  }
+  if (name == "slow") return parse(options.slowClients);
+  if (name == "high_kb") return parse(options.highWatermarkKb);
+  if (name == "backend") {
+    const auto backend = ParsePollerBackend(value);
+    if (backend) options.backend = *backend;
+    return backend.has_value();
+  }
+  if (name == "policy") {
+    for (const auto policy :
+         {SlowConsumerPolicy::DROP_OLDEST, SlowConsumerPolicy::PAUSE_READING,
+          SlowConsumerPolicy::DISCONNECT}) {
+      if (value == PolicyName(policy)) {
+        options.policy = policy;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::uint64_t NowNs() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now().time_since_epoch())
+          .count());
+}
+
+struct Bot {
+  sf::TcpSocket socket;
+  FrameReader reader;
+  RoomId room = LOBBY_ROOM;
+  std::uint32_t nextSequence = 0;
+  bool deflate = false;  ///< The server accepted compressed text.
+  bool slow = false;     ///< Never reads.
+  bool closed = false;   ///< A slow bot the server disconnected.
+  std::string unsent;  ///< Bytes the socket did not accept yet.
+};
+
+/// What one bot thread measured.
+struct BotStats {
+  std::uint64_t sent = 0;
+  std::uint64_t received = 0;
+  std::uint64_t receivedBytes = 0;
+  std::uint64_t plainBytes = 0;  ///< receivedBytes, were nothing compressed.
+  Histogram latencyNs;
+  bool failed = false;
+};
+
+/// Send what is left of @p bot's backlog.  @return false on a socket error.
+bool Flush(Bot& bot) {
+  while (!bot.unsent.empty()) {
+    std::size_t sent = 0;
+    const auto status =
+        bot.socket.send(bot.unsent.data(), bot.unsent.size(), sent);
+    bot.unsent.erase(0, sent);
+    switch (status) {
+      case sf::Socket::Status::Done:
+      case sf::Socket::Status::Partial:
+        break;
+      case sf::Socket::Status::NotReady:
+        return true;  // Retried on the next send or writable event.
+      case sf::Socket::Status::Disconnected:
+      case sf::Socket::Status::Error:
+        return false;
+    }
+  }
+  return true;
+}
+
+/// One per bot thread: it keeps zlib's state between messages.
+TextCompressor& ThreadCompressor() {
+  thread_local TextCompressor compressor;
+  return compressor;
+}
+
+/// Queue one framed message on @p bot and try to send it.
+bool Send(Bot& bot, MessageType type, std::string_view text) {
+  std::array<char, MAX_FRAME_PAYLOAD> payload{};
+  std::array<char, MAX_FRAME_SIZE> frame{};
+  std::array<char, MAX_FRAME_PAYLOAD> compressed;
+  MessageView message;
+  message.type = type;
+  message.room = bot.room;
+  message.sequence = bot.nextSequence++;
+  message.text = text;
+  if (bot.deflate && type == MessageType::CHAT &&
+      text.size() >= COMPRESSION_THRESHOLD) {
+    const auto size = ThreadCompressor().Compress(text, compressed);
+    if (size > 0) {
+      message.encoding = TextEncoding::DEFLATE;
+      message.text = std::string_view(compressed.data(), size);
+    }
+  }
+  const auto payloadSize = EncodeMessage(message, payload);
+  const auto frameSize =
+      EncodeFrame(std::string_view(payload.data(), payloadSize), frame);
+  bot.unsent.append(frame.data(), frameSize);
+  return Flush(bot);
+}
+
+/// Read everything pending on @p bot and record the latency of each message.
+bool Receive(Bot& bot, BotStats& stats) {
+  while (true) {
+    const auto status = bot.reader.ReceiveFrom(bot.socket);
+    if (status == sf::Socket::Status::NotReady) return true;
+    if (status != sf::Socket::Status::Done) return false;
+    const auto now = NowNs();
+    while (const auto payload = bot.reader.NextFrame()) {
+      auto message = DecodeMessage(*payload);
+      if (!message) continue;
+      if (message->type == MessageType::HELLO) {
+        bot.deflate = message->text.size() == 1 &&
+                      message->text[0] ==
+                          static_cast<char>(TextEncoding::DEFLATE);
+        continue;
+      }
+      if (message->type == MessageType::PING) {
+        if (!Send(bot, MessageType::PONG, {})) return false;
+        continue;
+      }
+      // E.g. the UDP_OPEN offer: bots only measure chat messages.
+      if (message->type != MessageType::CHAT) continue;
+      std::array<char, MAX_FRAME_PAYLOAD> text;
+      if (message->encoding == TextEncoding::DEFLATE) {
+        const auto size = ThreadCompressor().Decompress(message->text, text);
+        if (!size) return false;
+        message->text = std::string_view(text.data(), *size);
+      }
+      if (message->text.size() < sizeof(std::uint64_t)) continue;
+      std::uint64_t scheduled = 0;
+      std::memcpy(&scheduled, message->text.data(), sizeof(scheduled));
+      stats.latencyNs.Record(now > scheduled ? now - scheduled : 0);
+      ++stats.received;
+      stats.receivedBytes += FRAME_HEADER_SIZE + payload->size();
+      stats.plainBytes +=
+          FRAME_HEADER_SIZE + MESSAGE_HEADER_SIZE + message->text.size();
+    }
+    if (bot.reader.HasError()) return false;
+  }
+}
+
+/// Connect the bots with IDs [firstBot, firstBot + count) and join their rooms.
+bool ConnectBots(const Options& options, std::size_t firstBot,
+                 std::size_t count, PollerInterface& poller,
+                 std::vector<std::unique_ptr<Bot>>& bots) {
+  bots.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    auto bot = std::make_unique<Bot>();
+    bot->room = static_cast<RoomId>((firstBot + i) / options.roomSize + 1);
+    bot->slow = (firstBot + i) % options.roomSize == 0 &&
+                (firstBot + i) / options.roomSize < options.slowClients;
+    if (bot->socket.connect(sf::IpAddress::LocalHost, BENCH_PORT) !=
+        sf::Socket::Status::Done) {
+      return false;
+    }
+    bot->socket.setBlocking(false);
+    const auto offer = static_cast<char>(TextEncoding::DEFLATE);
+    if (!poller.Add(bot->socket, i) ||
+        (options.compress &&
+         !Send(*bot, MessageType::HELLO, std::string_view(&offer, 1))) ||
+        !Send(*bot, MessageType::JOIN_ROOM, {})) {
+      return false;
+    }
+    bots.push_back(std::move(bot));
+  }
+  return true;
+}
+
+/**
+ * @brief Handle a socket error on @p bot.
+ * @return false if the run failed: only slow bots may be disconnected.
+ */
+bool CloseBot(Bot& bot, PollerInterface& poller) {
+  if (!bot.slow) return false;
+  poller.Remove(bot.socket);
+  bot.closed = true;
+  return true;
+}
+
+/// Send from @p start until @p sendEnd and receive until kDrainTime later.
+void RunBots(const Options& options, std::span<std::unique_ptr<Bot>> bots,
+             PollerInterface& poller, Clock::time_point start,
+             Clock::time_point sendEnd, BotStats& stats) {
+  if (bots.empty()) return;
+  std::string text(options.payloadBytes, 'x');
+  if (options.compress) {
+    for (std::size_t i = 0; i < text.size(); ++i) {
+      text[i] = kSampleText[i % kSampleText.size()];
+    }
+  }
+
+  // The thread sends for its bots in turn, one message every `interval`.
+  const auto interval =
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+          1.0 / (options.rate * static_cast<double>(bots.size()))));
+  auto nextSend = start;
+  std::size_t nextBot = 0;
+  std::this_thread::sleep_until(start);
+
+  const auto end = sendEnd + kDrainTime;
+  while (Clock::now() < end) {
+    auto now = Clock::now();
+    // Catch up on the schedule, but never send more than one message per
+    // bot in a row so that receiving keeps up.
+    for (std::size_t burst = 0;
+         burst < bots.size() && nextSend <= now && nextSend < sendEnd;
+         ++burst) {
+      const auto scheduled = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              nextSend.time_since_epoch())
+              .count());
+      std::memcpy(text.data(), &scheduled, sizeof(scheduled));
+      auto& bot = *bots[nextBot];
+      if (!bot.closed) {
+        if (Send(bot, MessageType::CHAT, text)) {
+          ++stats.sent;
+        } else if (!CloseBot(bot, poller)) {
+          stats.failed = true;
+          return;
+        }
+      }
+      nextBot = (nextBot + 1) % bots.size();
+      nextSend += interval;
+    }
+
+    // Sleep in the poller until the next message is due (at most 1 ms).
+    now = Clock::now();
+    const auto timeout = nextSend < sendEnd && nextSend > now
+                             ? std::chrono::ceil<std::chrono::milliseconds>(
+                                   nextSend - now)
+                             : std::chrono::milliseconds(1);
+    for (const auto& event :
+         poller.Wait(std::min(timeout, std::chrono::milliseconds(1)))) {
+      auto& bot = *bots[event.token];
+      if (bot.closed) continue;
+      if (((event.writable && !Flush(bot)) ||
+           (event.readable && !bot.slow && !Receive(bot, stats))) &&
+          !CloseBot(bot, poller)) {
+        stats.failed = true;
+        return;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (!ParseOption(argv[i], options)) {
+      std::print(stderr,
+                 "Usage: {} [clients=N] [bot_threads=N] [server_threads=N] "
+                 "[room_size=N] [rate=MSG_PER_S] [payload=BYTES] "
+                 "[seconds=S] [flush_us=US] [compress=0|1] [slow=N] "
+                 "[policy=drop|pause|disconnect] [high_kb=KB] "
+                 "[backend=select|epoll|io_uring]\n",
+                 argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (options.clients == 0 || options.botThreads == 0 ||
+      options.serverThreads == 0 || options.roomSize == 0 ||
+      options.rate <= 0.0 || options.seconds <= 0.0 ||
+      options.flushUs < 0 ||
+      options.slowClients >
+          (options.clients + options.roomSize - 1) / options.roomSize ||
+      options.highWatermarkKb == 0 ||
+      options.payloadBytes < sizeof(std::uint64_t) ||
+      options.payloadBytes > MAX_FRAME_PAYLOAD - MESSAGE_HEADER_SIZE) {
+    std::print(stderr, "Invalid options\n");
+    return EXIT_FAILURE;
+  }
+  options.botThreads = std::min(options.botThreads, options.clients);
+  RaiseDescriptorLimit();
+
+  BackpressureConfig backpressure;
+  backpressure.highWatermark = options.highWatermarkKb * 1024;
+  backpressure.lowWatermark = backpressure.highWatermark / 4;
+  backpressure.hardLimit =
+      std::max(backpressure.hardLimit, backpressure.highWatermark * 2);
+  backpressure.policy = options.policy;
+
+  // --- Server, on its own thread(s). ---
+  std::unique_ptr<ChatServer> server;
+  std::unique_ptr<ShardedChatServer> shardedServer;
+  std::jthread serverThread;
+  if (options.serverThreads > 1) {
+    shardedServer = std::make_unique<ShardedChatServer>(options.serverThreads,
+                                                        options.backend);
+    if (!shardedServer->Start(BENCH_PORT)) return EXIT_FAILURE;
+    shardedServer->SetFlushInterval(std::chrono::microseconds(options.flushUs));
+    shardedServer->SetCompression(options.compress);
+    shardedServer->SetBackpressure(backpressure);
+    serverThread = std::jthread([&shardedServer] { shardedServer->Run(); });
+  } else {
+    server = std::make_unique<ChatServer>(options.backend);
+    if (!server->Start(BENCH_PORT)) return EXIT_FAILURE;
+    server->SetFlushInterval(std::chrono::microseconds(options.flushUs));
+    server->SetCompression(options.compress);
+    server->SetBackpressure(backpressure);
+    serverThread = std::jthread([&server](std::stop_token stopToken) {
+      while (!stopToken.stop_requested()) {
+        server->Update();
+      }
+    });
+  }
+
+  // --- Bots.  Connecting thousands of sockets takes a while, so the
+  // common start time is only fixed once every thread is connected. ---
+  std::vector<BotStats> stats(options.botThreads);
+  std::latch connected(static_cast<std::ptrdiff_t>(options.botThreads));
+  std::latch started(1);
+  Clock::time_point start;
+  std::clock_t cpuStart = 0;
+  const auto sendDuration = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.seconds));
+  {
+    std::vector<std::jthread> botThreads;
+    std::size_t firstBot = 0;
+    for (std::size_t t = 0; t < options.botThreads; ++t) {
+      const auto count = options.clients / options.botThreads +
+                         (t < options.clients % options.botThreads ? 1 : 0);
+      botThreads.emplace_back([&, t, firstBot, count] {
+        auto poller = CreatePoller(DefaultPollerBackend());
+        std::vector<std::unique_ptr<Bot>> bots;
+        const bool ok = poller != nullptr &&
+                        ConnectBots(options, firstBot, count, *poller, bots);
+        connected.count_down();
+        started.wait();
+        if (!ok) {
+          stats[t].failed = true;
+          return;
+        }
+        RunBots(options, bots, *poller, start, start + sendDuration, stats[t]);
+        for (auto& bot : bots) {
+          poller->Remove(bot->socket);
+        }
+      });
+      firstBot += count;
+    }
+    connected.wait();
+    start = Clock::now() + kSettleTime;
+    cpuStart = std::clock();
+    started.count_down();
+  }  // Joins the bot threads.
+  const auto cpuSeconds =
+      static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+  if (shardedServer != nullptr) {
+    shardedServer->Stop();
+  } else {
+    serverThread.request_stop();
+  }
+  serverThread.join();
+  // Published a few times per second: the last fraction of a second of the
+  // run may be missing.
+  ServerMetrics serverMetrics;
+  const auto backend = shardedServer != nullptr ? shardedServer->Backend()
+                                                : server->Backend();
+  if (shardedServer != nullptr) {
+    for (const auto& shard : shardedServer->MetricsSnapshots()) {
+      serverMetrics.Merge(shard);
+    }
+  } else {
+    serverMetrics = server->MetricsSnapshot();
+  }
+
+  BotStats total;
+  for (const auto& threadStats : stats) {
+    total.sent += threadStats.sent;
+    total.received += threadStats.received;
+    total.receivedBytes += threadStats.receivedBytes;
+    total.plainBytes += threadStats.plainBytes;
+    total.latencyNs.Merge(threadStats.latencyNs);
+    total.failed = total.failed || threadStats.failed;
+  }
+  if (total.failed) {
+    std::print(stderr, "Some bots failed (descriptor limit?)\n");
+    return EXIT_FAILURE;
+  }
+
+  const auto toUs = [](std::uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+  };
+  std::print(
+      "clients,bot_threads,server_threads,room_size,rate_per_client,"
+      "payload_bytes,seconds,flush_us,sent,received,sent_msgs_per_s,"
+      "received_msgs_per_s,received_bytes_per_s,p50_us,p99_us,p999_us,"
+      "max_us,compress,wire_bytes_ratio,cpu_us_per_msg,slow_clients,policy,"
+      "frames_dropped,slow_disconnects,backend,syscalls_per_msg\n");
+  std::print("{},{},{},{},{},{},{},{},{},{},{:.1f},{:.1f},{:.1f},{:.1f},{:.1f},"
+             "{:.1f},{:.1f},{:d},{:.3f},{:.2f},{},{},{},{},{},{:.3f}\n",
+             options.clients, options.botThreads, options.serverThreads,
+             options.roomSize, options.rate, options.payloadBytes,
+             options.seconds, options.flushUs, total.sent, total.received,
+             static_cast<double>(total.sent) / options.seconds,
+             static_cast<double>(total.received) / options.seconds,
+             static_cast<double>(total.receivedBytes) / options.seconds,
+             toUs(total.latencyNs.Percentile(0.5)),
+             toUs(total.latencyNs.Percentile(0.99)),
+             toUs(total.latencyNs.Percentile(0.999)),
+             toUs(total.latencyNs.Max()), options.compress,
+             total.plainBytes == 0 ? 1.0
+                                   : static_cast<double>(total.receivedBytes) /
+                                         static_cast<double>(total.plainBytes),
+             total.received == 0
+                 ? 0.0
+                 : cpuSeconds * 1e6 / static_cast<double>(total.received),
+             options.slowClients, PolicyName(options.policy),
+             serverMetrics.framesDropped,
+             serverMetrics.slowConsumerDisconnects, PollerBackendName(backend),
+             serverMetrics.messagesIn == 0
+                 ? 0.0
+                 : static_cast<double>(serverMetrics.systemCalls) /
+                       static_cast<double>(serverMetrics.messagesIn));
+  return EXIT_SUCCESS;
+}
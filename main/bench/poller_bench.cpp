@@ -0,0 +1,187 @@
+/**
+ * @file poller_bench.cpp
+ * @brief Compares the server's readiness backends (SocketSelector vs epoll).
+ *
+ * For 100, 1 000 and 10 000 localhost connections the benchmark measures:
+ *  - **idle wait**: the cost of one Wait() when no socket has data, i.e. the
+ *    price every server tick pays just for having connections open;
+ *  - **active round**: 1% of the clients send one byte each, and we time
+ *    how long the server side takes to be notified of and read all of them.
+ *
+ * Results are printed as CSV on stdout.  A backend that cannot hold the
+ * requested number of sockets (select() stops at FD_SETSIZE) is reported as
+ * "unsupported".
+ */
+
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <print>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "bench_utils.h"
+#include "poller_interface.h"
+
+namespace {
+
+constexpr std::array<std::size_t, 3> kConnectionCounts = {100, 1000, 10000};
+constexpr int kIdleIterations = 1000;
+constexpr int kActiveRounds = 200;
+/// Connections are opened in batches so the listen backlog never overflows.
+constexpr std::size_t kBatchSize = 1000;
+
+using Clock = std::chrono::steady_clock;
+
+struct Connections {
+  std::vector<sf::TcpSocket> clients;  ///< Sending side.
+  std::vector<sf::TcpSocket> servers;  ///< Accepted side, watched by pollers.
+};
+
+/**
+ * Open @p count connected socket pairs.  On POSIX, placeholder descriptors
+ * are opened before each batch of connects and released right before the
+ * matching accepts, so the accepted sockets get the lowest descriptor
+ * numbers -- as they would in a real server whose clients live elsewhere.
+ */
+bool OpenConnections(sf::TcpListener& listener, std::size_t count,
+                     Connections& connections) {
+  connections.clients.reserve(count);
+  connections.servers.reserve(count);
+  while (connections.servers.size() < count) {
+    const auto batch = std::min(kBatchSize, count - connections.servers.size());
+#ifndef _WIN32
+    std::vector<int> placeholders;
+    for (std::size_t i = 0; i < batch; ++i) {
+      placeholders.push_back(open("/dev/null", O_RDONLY));
+    }
+#endif
+    for (std::size_t i = 0; i < batch; ++i) {
+      sf::TcpSocket client;
+      if (client.connect(sf::IpAddress::LocalHost, listener.getLocalPort()) !=
+          sf::Socket::Status::Done) {
+        return false;
+      }
+      connections.clients.push_back(std::move(client));
+    }
+#ifndef _WIN32
+    for (const int fd : placeholders) {
+      if (fd >= 0) close(fd);
+    }
+#endif
+    for (std::size_t i = 0; i < batch; ++i) {
+      sf::TcpSocket server;
+      if (listener.accept(server) != sf::Socket::Status::Done) {
+        return false;
+      }
+      server.setBlocking(false);
+      connections.servers.push_back(std::move(server));
+    }
+  }
+  return true;
+}
+
+/// Read everything pending on @p socket and return the number of bytes.
+std::size_t Drain(sf::TcpSocket& socket) {
+  std::array<char, 256> buffer{};
+  std::size_t total = 0;
+  std::size_t received = 0;
+  while (socket.receive(buffer.data(), buffer.size(), received) ==
+         sf::Socket::Status::Done) {
+    total += received;
+  }
+  return total;
+}
+
+void RunBackend(std::string_view name, PollerBackend backend,
+                Connections& connections) {
+  const auto count = connections.servers.size();
+  auto poller = CreatePoller(backend);
+  if (poller == nullptr) {
+    std::print("{},{},unavailable,unavailable\n", name, count);
+    return;
+  }
+  std::size_t registered = 0;
+  for (; registered < count; ++registered) {
+    if (!poller->Add(connections.servers[registered], registered)) break;
+  }
+  if (registered < count) {
+    std::print("{},{},unsupported,unsupported\n", name, count);
+    for (std::size_t i = 0; i < registered; ++i) {
+      poller->Remove(connections.servers[i]);
+    }
+    return;
+  }
+
+  // --- Idle: nobody sends anything. ---
+  // The first wait returns the one-off "writable" notifications of freshly
+  // registered sockets; keep it out of the measurement.
+  static_cast<void>(poller->Wait(std::chrono::milliseconds(0)));
+  const auto idleStart = Clock::now();
+  for (int i = 0; i < kIdleIterations; ++i) {
+    static_cast<void>(poller->Wait(std::chrono::milliseconds(0)));
+  }
+  const std::chrono::duration<double, std::micro> idleTime =
+      Clock::now() - idleStart;
+
+  // --- Active: 1% of the clients (at least one) send a byte per round. ---
+  const auto active = std::max<std::size_t>(1, count / 100);
+  std::size_t nextSender = 0;
+  std::chrono::duration<double, std::micro> activeTime{0};
+  for (int round = 0; round < kActiveRounds; ++round) {
+    for (std::size_t i = 0; i < active; ++i) {
+      const char byte = 'x';
+      static_cast<void>(connections.clients[nextSender].send(&byte, 1));
+      nextSender = (nextSender + 1) % count;
+    }
+    const auto roundStart = Clock::now();
+    std::size_t receivedBytes = 0;
+    while (receivedBytes < active) {
+      for (const auto& event : poller->Wait(std::chrono::milliseconds(10))) {
+        if (event.readable) {
+          receivedBytes += Drain(connections.servers[event.token]);
+        }
+      }
+    }
+    activeTime += Clock::now() - roundStart;
+  }
+
+  for (auto& socket : connections.servers) {
+    poller->Remove(socket);
+  }
+  std::print("{},{},{:.2f},{:.2f}\n", name, count,
+             idleTime.count() / kIdleIterations,
+             activeTime.count() / kActiveRounds);
+}
+
+}  // namespace
+
+int main() {
+  RaiseDescriptorLimit();
+
+  std::print("backend,connections,idle_wait_us,active_round_us\n");
+  for (const auto count : kConnectionCounts) {
+    sf::TcpListener listener;
+    if (listener.listen(sf::Socket::AnyPort) != sf::Socket::Status::Done) {
+      std::print(stderr, "Error while listening\n");
+      return EXIT_FAILURE;
+    }
+    Connections connections;
+    if (!OpenConnections(listener, count, connections)) {
+      std::print(stderr, "Could not open {} connections (descriptor limit?)\n",
+                 count);
+      return EXIT_FAILURE;
+    }
+    RunBackend("selector", PollerBackend::SELECTOR, connections);
+    RunBackend("epoll", PollerBackend::EPOLL, connections);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file protocol_bench.cpp
+ * @brief Compares the binary message schema with ad-hoc string handling.
+ *
+ * For several text sizes the benchmark encodes then decodes the same chat
+ * message many times, in two ways:
+ *  - **schema**: EncodeMessage() / DecodeMessage() (see chat_protocol.h),
+ *    into a stack buffer, without any allocation;
+ *  - **text**: the fields joined with '|' by std::format into a
+ *    std::string, then split again and parsed with std::from_chars, the
+ *    way such messages are often handled by hand.
+ *
+ * Results are printed as CSV on stdout, in nanoseconds per message
+ * (one encode plus one decode).
+ */
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+
+#include "chat_protocol.h"
+#include "const.h"
+
+namespace {
+
+constexpr std::array<std::size_t, 3> kTextSizes = {16, 128, 1024};
+constexpr int kIterations = 1'000'000;
+
+using Clock = std::chrono::steady_clock;
+
+/// What the text decoder produces: it owns its copy of the text.
+struct TextMessage {
+  unsigned version = 0;
+  unsigned type = 0;
+  RoomId room = 0;
+  ClientId sender = 0;
+  std::uint32_t sequence = 0;
+  std::uint64_t timestampUs = 0;
+  std::string text;
+};
+
+std::string EncodeText(const MessageView& message) {
+  return std::format("{}|{}|{}|{}|{}|{}|{}", message.version,
+                     static_cast<unsigned>(message.type), message.room,
+                     message.sender, message.sequence, message.timestampUs,
+                     message.text);
+}
+
+/// Parse the next '|'-terminated number of @p input into @p value.
+template <typename T>
+bool ParseField(std::string_view& input, T& value) {
+  const auto separator = input.find('|');
+  if (separator == std::string_view::npos) return false;
+  const auto* end = input.data() + separator;
+  const auto [ptr, error] = std::from_chars(input.data(), end, value);
+  if (error != std::errc() || ptr != end) return false;
+  input.remove_prefix(separator + 1);
+  return true;
+}
+
+std::optional<TextMessage> DecodeText(std::string_view input) {
+  TextMessage message;
+  if (!ParseField(input, message.version) ||
+      !ParseField(input, message.type) || !ParseField(input, message.room) ||
+      !ParseField(input, message.sender) ||
+      !ParseField(input, message.sequence) ||
+      !ParseField(input, message.timestampUs)) {
+    return std::nullopt;
+  }
+  message.text = input;
+  return message;
+}
+
+/// @return The average time of one encode + decode, in nanoseconds.
+template <typename RoundTrip>
+double Measure(RoundTrip roundTrip) {
+  // The checksum keeps the compiler from dropping the work.
+  std::uint64_t checksum = 0;
+  const auto start = Clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    checksum += roundTrip(static_cast<std::uint32_t>(i));
+  }
+  const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  if (checksum == 0) {
+    std::print(stderr, "Nothing was decoded\n");
+  }
+  return elapsed.count() / kIterations;
+}
+
+}  // namespace
+
+int main() {
+  std::print("text_bytes,schema_ns,text_ns\n");
+  for (const auto size : kTextSizes) {
+    const std::string text(size, 'x');
+    MessageView message;
+    message.room = 42;
+    message.sender = 7;
+    message.timestampUs = 1'700'000'000'000'000;
+    message.text = text;
+
+    const auto schemaNs = Measure([&](std::uint32_t sequence) {
+      message.sequence = sequence;
+      std::array<char, MAX_FRAME_PAYLOAD> buffer;
+      const auto encoded = EncodeMessage(message, buffer);
+      const auto decoded =
+          DecodeMessage(std::string_view(buffer.data(), encoded));
+      return decoded ? decoded->sequence + decoded->text.size() : 0;
+    });
+    const auto textNs = Measure([&](std::uint32_t sequence) {
+      message.sequence = sequence;
+      const auto encoded = EncodeText(message);
+      const auto decoded = DecodeText(encoded);
+      return decoded ? decoded->sequence + decoded->text.size() : 0;
+    });
+    std::print("{},{:.1f},{:.1f}\n", size, schemaNs, textNs);
+  }
+  return 0;
+}
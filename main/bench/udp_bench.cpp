@@ -0,0 +1,286 @@
+/**
+ * @file udp_bench.cpp
+ * @brief Latency of the UDP delivery classes over a lossy, slow link.
+ *
+ * For each delivery class (see udp_channel.h) a sender and a receiver
+ * UdpChannel talk through a pair of loopback UDP sockets.  Every datagram,
+ * in both directions, goes through a simulated link first: it is lost
+ * with probability @c loss percent, otherwise delayed by @c latency_ms
+ * plus up to @c jitter_ms, so datagrams may also be reordered.  The sender
+ * sends @c rate messages per second, each carrying the time it was
+ * scheduled, and the receiver records the delay of every delivery.
+ *
+ * The reliable class behaves like a TCP stream, with selective acks: a
+ * lost message is sent again after a timeout, and the ones behind it wait.
+ * Comparing its tail latency with the sequenced class shows what
+ * head-of-line blocking costs a stream of state updates, where the newest
+ * update makes the lost ones useless anyway.
+ *
+ * Options are given as `name=value` pairs, e.g.
+ *
+ *     udp_bench loss=5 latency_ms=20 jitter_ms=5 rate=60 seconds=10
+ *
+ * A CSV header and one row per class are printed on stdout.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/UdpSocket.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "chat_protocol.h"
+#include "const.h"
+#include "histogram.h"
+#include "udp_channel.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Time left to in-flight messages after the sender stops.
+constexpr auto kDrainTime = std::chrono::seconds(2);
+/// Sleep between two passes of the loop.
+constexpr auto kPollInterval = std::chrono::microseconds(200);
+constexpr std::size_t kPayloadBytes = 64;
+
+struct Options {
+  double lossPercent = 5.0;
+  double latencyMs = 20.0;  ///< One way.
+  double jitterMs = 5.0;
+  double rate = 60.0;  ///< Messages per second.
+  double seconds = 10.0;
+};
+
+/// Parse one `name=value` argument into @p options.  @return false if invalid.
+bool ParseOption(std::string_view arg, Options& options) {
+  const auto equal = arg.find('=');
+  if (equal == std::string_view::npos) return false;
+  const auto name = arg.substr(0, equal);
+  const auto value = arg.substr(equal + 1);
+  const auto parse = [value](auto& out) {
+    const auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), out);
+    return ec == std::errc{} && ptr == value.data() + value.size();
+  };
+  if (name == "loss") return parse(options.lossPercent);
+  if (name == "latency_ms") return parse(options.latencyMs);
+  if (name == "jitter_ms") return parse(options.jitterMs);
+  if (name == "rate") return parse(options.rate);
+  if (name == "seconds") return parse(options.seconds);
+  return false;
+}
+
+constexpr std::string_view DeliveryName(Delivery delivery) {
+  switch (delivery) {
+    case Delivery::UNRELIABLE:
+      return "unreliable";
+    case Delivery::SEQUENCED:
+      return "sequenced";
+    case Delivery::RELIABLE:
+      return "reliable";
+  }
+  return "";
+}
+
+/// One direction of the simulated link, ending in a loopback socket.
+class Link {
+ public:
+  Link(const Options& options, unsigned short port, std::uint32_t seed)
+      : options_(options), port_(port), random_(seed) {}
+
+  /// Lose @p datagram, or schedule it.
+  void Send(std::string_view datagram, Clock::time_point now) {
+    if (std::uniform_real_distribution<>(0.0, 100.0)(random_) <
+        options_.lossPercent) {
+      return;
+    }
+    const auto delay = std::chrono::duration<double, std::milli>(
+        options_.latencyMs +
+        std::uniform_real_distribution<>(0.0, options_.jitterMs)(random_));
+    inFlight_.emplace(now + std::chrono::duration_cast<Clock::duration>(delay),
+                      std::string(datagram));
+  }
+
+  /// Write the datagrams whose delay is over through @p socket.
+  void Deliver(sf::UdpSocket& socket, Clock::time_point now) {
+    while (!inFlight_.empty() && inFlight_.begin()->first <= now) {
+      const auto& datagram = inFlight_.begin()->second;
+      if (socket.send(datagram.data(), datagram.size(),
+                      sf::IpAddress::LocalHost,
+                      port_) != sf::Socket::Status::Done) {
+        std::print(stderr, "Failed to send a datagram\n");
+      }
+      inFlight_.erase(inFlight_.begin());
+    }
+  }
+
+ private:
+  const Options& options_;
+  unsigned short port_;  ///< Of the receiving socket.
+  std::mt19937 random_;
+  std::multimap<Clock::time_point, std::string> inFlight_;
+};
+
+/// A channel, its socket and the link to the other end.
+struct Endpoint {
+  UdpChannel channel;
+  sf::UdpSocket socket;
+  std::optional<Link> link;
+};
+
+/// Write out what @p endpoint has due.
+void Flush(Endpoint& endpoint, Clock::time_point now) {
+  while (const auto datagram = endpoint.channel.NextDatagram(now)) {
+    endpoint.link->Send(*datagram, now);
+  }
+  endpoint.link->Deliver(endpoint.socket, now);
+}
+
+/// Drain the socket of @p endpoint; @p onMessage gets each message.
+template <typename OnMessage>
+void Receive(Endpoint& endpoint, OnMessage onMessage) {
+  std::array<char, MAX_DATAGRAM_SIZE + 1> buffer;
+  std::size_t received = 0;
+  std::optional<sf::IpAddress> address;
+  unsigned short port = 0;
+  while (endpoint.socket.receive(buffer.data(), buffer.size(), received,
+                                 address, port) == sf::Socket::Status::Done) {
+    if (!endpoint.channel.Receive(std::string_view(buffer.data(), received),
+                                  Clock::now())) {
+      continue;
+    }
+    while (const auto message = endpoint.channel.NextMessage()) {
+      onMessage(*message);
+    }
+  }
+}
+
+struct Result {
+  std::uint64_t sent = 0;
+  std::uint64_t delivered = 0;
+  std::uint64_t outOfOrder = 0;  ///< Delivered after a later message.
+  std::uint64_t resends = 0;
+  Histogram latencyNs;
+};
+
+std::optional<Result> Run(const Options& options, Delivery delivery,
+                          std::uint32_t seed) {
+  Endpoint sender{UdpChannel(1, true), {}, {}};
+  Endpoint receiver{UdpChannel(1, false), {}, {}};
+  for (auto* endpoint : {&sender, &receiver}) {
+    if (endpoint->socket.bind(sf::Socket::AnyPort,
+                              sf::IpAddress::LocalHost) !=
+        sf::Socket::Status::Done) {
+      return std::nullopt;
+    }
+    endpoint->socket.setBlocking(false);
+  }
+  sender.link.emplace(options, receiver.socket.getLocalPort(), seed);
+  receiver.link.emplace(options, sender.socket.getLocalPort(), seed + 1);
+
+  Result result;
+  std::uint64_t newest = 0;
+  const auto start = Clock::now();
+  const auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / options.rate));
+  const auto sendEnd = start + std::chrono::duration_cast<Clock::duration>(
+                                   std::chrono::duration<double>(
+                                       options.seconds));
+  auto nextSend = start;
+  for (auto now = start; now < sendEnd + kDrainTime; now = Clock::now()) {
+    for (; nextSend <= now && nextSend < sendEnd; nextSend += interval) {
+      // The scheduled time, so that a late loop shows up as latency.
+      std::array<char, kPayloadBytes> payload{};
+      const auto scheduled = static_cast<std::uint64_t>(
+          nextSend.time_since_epoch().count());
+      std::memcpy(payload.data(), &scheduled, sizeof scheduled);
+      if (!sender.channel.Send(delivery,
+                               std::string_view(payload.data(),
+                                                payload.size()))) {
+        std::print(stderr, "Reliable backlog full\n");
+        return std::nullopt;
+      }
+      ++result.sent;
+    }
+    Flush(sender, now);
+    Flush(receiver, now);
+    Receive(receiver, [&](std::string_view message) {
+      std::uint64_t scheduled = 0;
+      std::memcpy(&scheduled, message.data(), sizeof scheduled);
+      const auto delay =
+          Clock::now() - Clock::time_point(Clock::duration(scheduled));
+      result.latencyNs.Record(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(delay)
+              .count()));
+      ++result.delivered;
+      if (scheduled < newest) {
+        ++result.outOfOrder;
+      }
+      newest = std::max(newest, scheduled);
+    });
+    Receive(sender, [](std::string_view) {});
+    std::this_thread::sleep_for(kPollInterval);
+  }
+  result.resends = sender.channel.Resends();
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (!ParseOption(argv[i], options)) {
+      std::print(stderr,
+                 "Usage: {} [loss=PERCENT] [latency_ms=MS] [jitter_ms=MS] "
+                 "[rate=MSG_PER_S] [seconds=S]\n",
+                 argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (options.lossPercent < 0.0 || options.lossPercent >= 100.0 ||
+      options.latencyMs < 0.0 || options.jitterMs < 0.0 ||
+      options.rate <= 0.0 || options.seconds <= 0.0) {
+    std::print(stderr, "Invalid options\n");
+    return EXIT_FAILURE;
+  }
+
+  const auto toUs = [](std::uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+  };
+  std::print(
+      "delivery,loss_pct,latency_ms,jitter_ms,rate,seconds,sent,delivered,"
+      "out_of_order,resends,p50_us,p99_us,p999_us,max_us\n");
+  std::uint32_t seed = 1;
+  for (const auto delivery :
+       {Delivery::UNRELIABLE, Delivery::SEQUENCED, Delivery::RELIABLE}) {
+    const auto result = Run(options, delivery, seed);
+    seed += 2;
+    if (!result) {
+      std::print(stderr, "Cannot run the {} channel\n",
+                 DeliveryName(delivery));
+      return EXIT_FAILURE;
+    }
+    std::print("{},{},{},{},{},{},{},{},{},{},{:.1f},{:.1f},{:.1f},{:.1f}\n",
+               DeliveryName(delivery), options.lossPercent, options.latencyMs,
+               options.jitterMs, options.rate, options.seconds, result->sent,
+               result->delivered, result->outOfOrder, result->resends,
+               toUs(result->latencyNs.Percentile(0.5)),
+               toUs(result->latencyNs.Percentile(0.99)),
+               toUs(result->latencyNs.Percentile(0.999)),
+               toUs(result->latencyNs.Max()));
+  }
+  return EXIT_SUCCESS;
+}
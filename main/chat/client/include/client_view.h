@@ -11,19 +11,32 @@ struct SDL_Renderer;
 
 class ClientView : public ClientViewInterface {
  public:
+  /// @param showFrameTime Draw the frame time in the top-right corner.
+  explicit ClientView(bool showFrameTime = false);
+
   [[nodiscard]] bool Init() override;
   void Shutdown() override;
   void BeginFrame() override;
   void EndFrame() override;
-  bool DrawConnectionPanel(std::string& address, unsigned short& port) override;
-  bool DrawChatPanel(std::span<const std::string> messages,
+  bool DrawConnectionPanel(std::string& address, unsigned short& port,
+                           bool connecting) override;
+  RoomRequest DrawRoomPanel(std::span<const RoomId> rooms,
+                            RoomId& activeRoom) override;
+  bool DrawChatPanel(RoomId activeRoom, MessageHistory::View messages,
                      std::string& sendMessage) override;
   [[nodiscard]] bool ShouldQuit() const override;
 
  private:
+  void DrawFrameTimeOverlay();
+
   SDL_Window* window_ = nullptr;
   SDL_Renderer* renderer_ = nullptr;
   bool shouldQuit_ = false;
+  int roomToJoin_ = 1;  ///< Content of the "Room" input field.
+  bool showFrameTime_ = false;
+  float worstFrameTime_ = 0.0f;       ///< Seconds, in the current window.
+  float worstFrameWindow_ = 0.0f;     ///< Seconds since the window began.
+  float shownWorstFrameTime_ = 0.0f;  ///< Seconds, of the last window.
 };
 
 #endif  // CLIENT_VIEW_H_
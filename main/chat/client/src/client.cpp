@@ -1,9 +1,13 @@
 #include <memory>
+#include <string_view>
 
 #include "client_controller.h"
 #include "client_view.h"
 
-int main() {
-  ClientController controller(std::make_unique<ClientView>());
+int main(int argc, char* argv[]) {
+  // Pass --frame-time to display the frame time overlay.
+  const bool showFrameTime =
+      argc > 1 && std::string_view(argv[1]) == "--frame-time";
+  ClientController controller(std::make_unique<ClientView>(showFrameTime));
   controller.Run();
 }
@@ -2,9 +2,13 @@
  * @file client_view.cpp
  * @brief Implementation of the client View (rendering + input).
  *
- * This file sets up SDL3 and Dear ImGui, and provides two GUI panels:
+ * This file sets up SDL3 and Dear ImGui, and provides three GUI panels:
  *  - DrawConnectionPanel(): shown when not yet connected to a server.
- *  - DrawChatPanel(): shown once connected; displays messages and a send box.
+ *  - DrawRoomPanel(): shown once connected; switches, joins and leaves rooms.
+ *  - DrawChatPanel(): shown once connected; displays the messages of the
+ *    active room and a send box.  Only the lines in view are submitted to
+ *    ImGui, so long histories do not slow the frame down.
+ *  - An optional overlay shows the frame time, to check just that.
  *
  * ImGui uses an "immediate mode" paradigm: every frame you describe the
  * entire UI, and ImGui figures out what changed.  Buttons return true on
@@ -20,24 +24,29 @@
 #include <imgui_impl_sdlrenderer3.h>
 #include <imgui_stdlib.h>
 
-#include <print>
+#include <algorithm>
+#include <format>
 #include <span>
 
+#include "logger.h"
+
+ClientView::ClientView(bool showFrameTime) : showFrameTime_(showFrameTime) {}
+
 bool ClientView::Init() {
   // --- SDL initialisation ---
   if (!SDL_Init(SDL_INIT_VIDEO)) {
-    std::print(stderr, "Failed to init SDL: {}\n", SDL_GetError());
+    LOG_ERROR("Failed to init SDL: {}", SDL_GetError());
     return false;
   }
   window_ =
       SDL_CreateWindow("Simple Chat", 1280, 720, SDL_WINDOW_RESIZABLE);
   if (window_ == nullptr) {
-    std::print(stderr, "Failed to create window: {}\n", SDL_GetError());
+    LOG_ERROR("Failed to create window: {}", SDL_GetError());
     return false;
   }
   renderer_ = SDL_CreateRenderer(window_, nullptr);
   if (renderer_ == nullptr) {
-    std::print(stderr, "Failed to create renderer: {}\n", SDL_GetError());
+    LOG_ERROR("Failed to create renderer: {}", SDL_GetError());
     return false;
   }
   // Enable VSync so we don't render faster than the monitor refresh rate.
@@ -90,6 +99,9 @@ void ClientView::BeginFrame() {
 
 void ClientView::EndFrame() {
   ImGui::End();  // Close the ImGui window opened in BeginFrame().
+  if (showFrameTime_) {
+    DrawFrameTimeOverlay();
+  }
 
   // Clear the background, render ImGui draw data, and present to screen.
   SDL_SetRenderDrawColor(renderer_, 0, 0, 0, 255);
@@ -100,7 +112,7 @@ void ClientView::EndFrame() {
 }
 
 bool ClientView::DrawConnectionPanel(std::string& address,
-                                      unsigned short& port) {
+                                      unsigned short& port, bool connecting) {
   // Text input for the server address.
   ImGui::InputText("Host Address", &address);
   ImGui::SameLine();
@@ -113,21 +125,108 @@ bool ClientView::DrawConnectionPanel(std::string& address,
     }
   }
 
+  // The connection is made on the network thread: keep drawing meanwhile.
+  if (connecting) {
+    ImGui::TextUnformatted("Connecting...");
+    return false;
+  }
+
   // Returns true on the frame the user clicks "Connect".
   return ImGui::Button("Connect");
 }
 
-bool ClientView::DrawChatPanel(std::span<const std::string> messages,
+RoomRequest ClientView::DrawRoomPanel(std::span<const RoomId> rooms,
+                                      RoomId& activeRoom) {
+  RoomRequest request;
+
+  // One radio button per joined room; clicking one makes it active.
+  for (const auto room : rooms) {
+    const auto label = room == LOBBY_ROOM ? std::string("Lobby")
+                                          : std::format("Room {}", room);
+    if (ImGui::RadioButton(label.c_str(), activeRoom == room)) {
+      activeRoom = room;
+    }
+    ImGui::SameLine();
+  }
+  ImGui::NewLine();
+
+  // Integer input for the room to join, limited to non-lobby room IDs.
+  ImGui::InputInt("Room", &roomToJoin_);
+  roomToJoin_ = std::max(roomToJoin_, 1);
+  ImGui::SameLine();
+  if (ImGui::Button("Join")) {
+    request = {RoomRequest::Type::JOIN, static_cast<RoomId>(roomToJoin_)};
+  }
+  if (activeRoom != LOBBY_ROOM) {
+    ImGui::SameLine();
+    if (ImGui::Button("Leave")) {
+      request = {RoomRequest::Type::LEAVE, activeRoom};
+    }
+  }
+  return request;
+}
+
+bool ClientView::DrawChatPanel(RoomId activeRoom,
+                               MessageHistory::View messages,
                                std::string& sendMessage) {
+  ImGui::Text("Room %u", activeRoom);
+
   // Text input for composing a message.
   ImGui::InputText("Message", &sendMessage);
   bool send = ImGui::Button("Send");
 
-  // Display every received message as a line of text.
-  for (const auto& message : messages) {
-    ImGui::TextUnformatted(message.c_str());
+  // The history scrolls inside its own region below the send box.
+  ImGui::BeginChild("History", ImVec2(0.0f, 0.0f), ImGuiChildFlags_Borders,
+                    ImGuiWindowFlags_HorizontalScrollbar);
+  // Lines are never wrapped, so they all have the same height and the
+  // clipper knows which ones are visible without laying any of them out:
+  // only those are submitted, whatever the length of the history.
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(messages.size()));
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+      const auto message = messages[static_cast<std::size_t>(i)];
+      ImGui::TextUnformatted(message.data(), message.data() + message.size());
+    }
   }
+  clipper.End();
+  // Follow new messages, unless the user scrolled up to read older ones.
+  if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+    ImGui::SetScrollHereY(1.0f);
+  }
+  ImGui::EndChild();
   return send;
 }
 
 bool ClientView::ShouldQuit() const { return shouldQuit_; }
+
+void ClientView::DrawFrameTimeOverlay() {
+  const auto& io = ImGui::GetIO();
+  // Keep the worst frame of the last second on screen long enough to read.
+  worstFrameTime_ = std::max(worstFrameTime_, io.DeltaTime);
+  worstFrameWindow_ += io.DeltaTime;
+  if (worstFrameWindow_ >= 1.0f) {
+    shownWorstFrameTime_ = worstFrameTime_;
+    worstFrameTime_ = 0.0f;
+    worstFrameWindow_ = 0.0f;
+  }
+
+  // A small transparent window in the top-right corner that ignores input.
+  constexpr float kMargin = 10.0f;
+  ImGui::SetNextWindowPos({io.DisplaySize.x - kMargin, kMargin},
+                          ImGuiCond_Always, {1.0f, 0.0f});
+  ImGui::SetNextWindowBgAlpha(0.35f);
+  ImGui::Begin("Frame time", nullptr,
+               ImGuiWindowFlags_NoDecoration |
+                   ImGuiWindowFlags_AlwaysAutoResize |
+                   ImGuiWindowFlags_NoSavedSettings |
+                   ImGuiWindowFlags_NoFocusOnAppearing |
+                   ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoInputs);
+  // Framerate is ImGui's average over the last 60 frames.
+  ImGui::Text("%.2f ms/frame (%.0f fps)",
+              static_cast<double>(1000.0f / io.Framerate),
+              static_cast<double>(io.Framerate));
+  ImGui::Text("worst %.2f ms in the last second",
+              static_cast<double>(shownWorstFrameTime_ * 1000.0f));
+  ImGui::End();
+}
@@ -0,0 +1,72 @@
+/**
+ * @file headless_client.cpp
+ * @brief Runs the chat client without a window, following a script.
+ *
+ *     headless_client <script> [frames_per_second]
+ *
+ * The real ClientController and ClientModel run against a HeadlessView
+ * (see headless_view.h for the script format), unthrottled unless a frame
+ * rate is given.  When the script ends, one CSV header and result row with
+ * the frame count and the per-frame poll and processing times are printed
+ * on stdout.  The exit code is non-zero if an action failed.
+ */
+
+#include <charconv>
+#include <fstream>
+#include <memory>
+#include <print>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "client_controller.h"
+#include "headless_view.h"
+#include "logger.h"
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::println(stderr, "Usage: {} <script> [frames_per_second]", argv[0]);
+    return 2;
+  }
+  std::ifstream file(argv[1]);
+  if (!file) {
+    LOG_ERROR("Cannot open {}", argv[1]);
+    return 2;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  auto script = ParseHeadlessScript(text.str());
+  if (!script) {
+    return 2;
+  }
+
+  double frameRate = 0.0;
+  if (argc == 3) {
+    const std::string_view arg = argv[2];
+    const auto [end, error] =
+        std::from_chars(arg.data(), arg.data() + arg.size(), frameRate);
+    if (error != std::errc() || end != arg.data() + arg.size()) {
+      LOG_ERROR("Invalid frame rate: {}", arg);
+      return 2;
+    }
+  }
+
+  auto view = std::make_unique<HeadlessView>(
+      MakeHeadlessFeed(std::move(*script)), frameRate);
+  const auto& results = *view;
+  ClientController controller(std::move(view));
+  controller.Run();
+
+  const auto& poll = results.PollTimes();
+  const auto& processing = results.ProcessingTimes();
+  std::println(
+      "frames,poll_p50_ns,poll_p99_ns,poll_max_ns,processing_p50_ns,"
+      "processing_p99_ns,processing_max_ns");
+  std::println("{},{},{},{},{},{},{}", results.FrameCount(),
+               poll.Percentile(0.5), poll.Percentile(0.99), poll.Max(),
+               processing.Percentile(0.5), processing.Percentile(0.99),
+               processing.Max());
+  Logger::Instance().Flush();
+  return results.HasFailed() ? 1 : 0;
+}
@@ -7,21 +7,198 @@
  *  2. Runs an infinite loop calling Update(), which accepts new clients,
  *     cleans up disconnected ones, and relays messages.
  *
+ * Passing a thread count (e.g. `server 8`) runs that many ChatServer shards
+ * in parallel instead, all sharing PORT_NUMBER (see sharded_chat_server.h).
+ *
+ * Clients are offered a UDP channel for game state on the UDP port
+ * PORT_NUMBER (PORT_NUMBER + i for shard i, see udp_channel.h).
+ *
+ * Metrics are served in the Prometheus text format on the loopback port
+ * ADMIN_PORT_NUMBER (e.g. `curl localhost:9533`).  An optional second
+ * argument names a file that also receives them every second.
+ *
+ * An optional third argument turns on send coalescing: outgoing messages
+ * are held back for up to that many microseconds and sent together (see
+ * ChatServer::SetFlushInterval()).
+ *
+ * An optional fourth argument names a directory in which the relayed
+ * messages are persisted (see message_log.h).
+ *
+ * An optional fifth argument names a Unix socket for zero-downtime
+ * upgrades (single-threaded server only, see session_handoff.h).  The
+ * server waits there for a successor; if another server already does, this
+ * one takes over its clients instead of listening on PORT_NUMBER, and the
+ * other one exits.  To upgrade, start the new build with the same
+ * arguments:
+ *
+ *     server 1 "" 0 chat_log /tmp/simplechat.sock
+ *
+ * An optional sixth argument sets the simulation tick rate in Hz, at which
+ * the shared room states are replicated to the clients (see
+ * ChatServer::SetTickRate()).
+ *
+ * An optional seventh argument picks the poller backend: select, epoll or
+ * io_uring (see poller_interface.h).  A backend the system lacks falls
+ * back to the default one; io_uring cannot hand clients over, so a server
+ * with a handoff socket uses epoll instead.
+ *
  * To run: launch this executable first, then start one or more clients.
  */
 
-#include <iostream>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
 
 #include "chat_server.h"
 #include "const.h"
+#include "logger.h"
+#include "message_log.h"
+#include "metrics_exporter.h"
+#include "poller_interface.h"
+#include "server_metrics.h"
+#include "session_handoff.h"
+#include "sharded_chat_server.h"
+
+namespace {
+
+/// Tries to bind the UDP and admin ports after a handoff, 100 ms apart.
+constexpr int kPortAttempts = 50;
 
-int main() {
-  ChatServer server;
-  if (!server.Start(PORT_NUMBER)) {
+/// Parse the whole of @p arg as a number.  @return false if invalid.
+template <typename T>
+bool ParseNumber(std::string_view arg, T& value) {
+  const auto [ptr, ec] =
+      std::from_chars(arg.data(), arg.data() + arg.size(), value);
+  return ec == std::errc{} && ptr == arg.data() + arg.size();
+}
+
+/// Open the message log in @p directory, if any.  @return false on error.
+bool OpenMessageLog(const std::filesystem::path& directory,
+                    std::shared_ptr<MessageLog>& log) {
+  if (directory.empty()) return true;
+  MessageLogConfig config;
+  config.directory = directory;
+  log = std::make_shared<MessageLog>(config);
+  return log->Open();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t threadCount = 1;
+  std::uint32_t flushUs = 0;
+  unsigned tickRate = ChatServer::kDefaultTickRate;
+  const auto backendArg =
+      argc > 7 ? ParsePollerBackend(argv[7]) : DefaultPollerBackend();
+  if ((argc > 1 && (!ParseNumber(argv[1], threadCount) || threadCount == 0)) ||
+      (argc > 3 && !ParseNumber(argv[3], flushUs)) ||
+      (argc > 6 && (!ParseNumber(argv[6], tickRate) || tickRate == 0)) ||
+      !backendArg) {
+    std::print(stderr,
+               "Usage: {} [thread count] [metrics file] [flush interval us] "
+               "[log directory] [handoff socket] [tick rate hz] "
+               "[select|epoll|io_uring]\n",
+               argv[0]);
+    return EXIT_FAILURE;
+  }
+  auto backend = *backendArg;
+  const std::string metricsFile = argc > 2 ? argv[2] : "";
+  const std::chrono::microseconds flushInterval(flushUs);
+  const std::filesystem::path logDirectory = argc > 4 ? argv[4] : "";
+  const std::filesystem::path handoffPath = argc > 5 ? argv[5] : "";
+
+  std::shared_ptr<MessageLog> messageLog;
+  if (threadCount > 1) {
+    if (!handoffPath.empty()) {
+      LOG_WARNING("Handoff is only supported by a single-threaded server");
+    }
+    if (!OpenMessageLog(logDirectory, messageLog)) {
+      return EXIT_FAILURE;
+    }
+    ShardedChatServer server(threadCount, backend);
+    if (!server.Start(PORT_NUMBER) || !server.StartUdp(PORT_NUMBER)) {
+      return EXIT_FAILURE;
+    }
+    server.SetFlushInterval(flushInterval);
+    server.SetMessageLog(messageLog);
+    server.SetTickRate(tickRate);
+    MetricsExporter exporter(
+        [&server] { return FormatPrometheus(server.MetricsSnapshots()); });
+    if (!exporter.Start(ADMIN_PORT_NUMBER, metricsFile)) {
+      return EXIT_FAILURE;
+    }
+    LOG_INFO("Running {} server shards with {}", server.ShardCount(),
+             PollerBackendName(server.Backend()));
+    server.Run();
+    return EXIT_SUCCESS;
+  }
+
+  if (!handoffPath.empty() && backend == PollerBackend::IO_URING) {
+    LOG_WARNING("io_uring cannot hand clients over, using epoll");
+    backend = PollerBackend::EPOLL;
+  }
+  ChatServer server(backend);
+  std::optional<HandoffState> handedOver;
+  if (!handoffPath.empty()) {
+    handedOver = RequestHandoff(handoffPath);
+  }
+  // The predecessor closed its message log before handing over.
+  if (!(handedOver ? server.ImportState(*handedOver)
+                   : server.Start(PORT_NUMBER)) ||
+      !OpenMessageLog(logDirectory, messageLog)) {
+    return EXIT_FAILURE;
+  }
+  server.SetFlushInterval(flushInterval);
+  server.SetMessageLog(messageLog);
+  server.SetTickRate(tickRate);
+  HandoffListener handoff;
+  if (!handoffPath.empty() && !handoff.Start(handoffPath)) {
+    return EXIT_FAILURE;
+  }
+  MetricsExporter exporter([&server] {
+    const ServerMetrics snapshot = server.MetricsSnapshot();
+    return FormatPrometheus({&snapshot, 1});
+  });
+  // A predecessor keeps the UDP and admin ports until it exits, right
+  // after the handoff.
+  const auto acquire = [&handedOver](const auto& start) {
+    for (int attempt = 0; !start(); ++attempt) {
+      if (!handedOver || attempt == kPortAttempts) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return true;
+  };
+  if (!acquire([&server] { return server.StartUdp(PORT_NUMBER); }) ||
+      !acquire([&] {
+        return exporter.Start(ADMIN_PORT_NUMBER, metricsFile);
+      })) {
     return EXIT_FAILURE;
   }
-  // Server main loop -- runs forever until the process is killed (Ctrl+C).
+  // Server main loop -- runs until the process is killed (Ctrl+C) or a
+  // successor takes over.
   while (true) {
     server.Update();
+    if (handoff.Requested()) {
+      // Only one process may write the log: let the successor open it.
+      server.SetMessageLog(nullptr);
+      messageLog.reset();
+      if (handoff.Complete(server.ExportState())) {
+        return EXIT_SUCCESS;
+      }
+      if (!OpenMessageLog(logDirectory, messageLog)) {
+        return EXIT_FAILURE;
+      }
+      server.SetMessageLog(messageLog);
+    }
   }
 }
@@ -1,9 +1,11 @@
 #include <SFML/Network/TcpListener.hpp>
 #include <SFML/Network/TcpSocket.hpp>
 #include <array>
-#include <print>
+#include <string_view>
+#include <vector>
 
 #include "SFML/Network/SocketSelector.hpp"
+#include "logger.h"
 
 constexpr size_t kMaxMsgLength = 100;
 constexpr uint16_t kPort = 53000;
@@ -16,7 +18,7 @@ int main() {
   // bind the listener to a port
   if (const auto status = listener.listen(kPort);
       status != sf::Socket::Status::Done) {
-    std::print(stderr, "Error while listening status: {}\n",
+    LOG_ERROR("Error while listening status: {}",
                static_cast<int>(status));
     return EXIT_FAILURE;
   }
@@ -27,7 +29,7 @@ int main() {
       sf::TcpSocket newClient;
       newClient.setBlocking(false);
       if (listener.accept(newClient) == sf::Socket::Status::Done) {
-        std::print("Client at {}:{} connected!\n",
+        LOG_INFO("Client at {}:{} connected!",
                    newClient.getRemoteAddress()->toString(),
                    newClient.getRemotePort());
         newClient.setBlocking(true);
@@ -52,29 +54,28 @@ int main() {
               selector.remove(socket);
               clientSockets.erase(clientSockets.begin() + i);
             } else {
-              std::print(stderr,
-                         "Error while receiving data from {}:{} status: {}, "
-                         "local port: {}\n",
-                         socket.getRemoteAddress().has_value()
-                             ? socket.getRemoteAddress()->toString()
-                             : "disconnected",
-                         socket.getRemotePort(), static_cast<int>(status),
-                         socket.getLocalPort());
+              LOG_ERROR(
+                  "Error while receiving data from {}:{} status: {}, "
+                  "local port: {}",
+                  socket.getRemoteAddress().has_value()
+                      ? socket.getRemoteAddress()->toString()
+                      : "disconnected",
+                  socket.getRemotePort(), static_cast<int>(status),
+                  socket.getLocalPort());
             }
             continue;
           }
 
-          std::print("Received data: {}\n", receive_data.data());
+          LOG_INFO("Received data: {}",
+                   std::string_view(receive_data.data(), received));
 
           if (const auto status = socket.send(receive_data.data(), received);
               status != sf::Socket::Status::Done) {
-            std::print(stderr, "Error while sending data: {}\n",
+            LOG_ERROR("Error while sending data: {}",
                        static_cast<int>(status));
           }
         }
       }
     }
-
-    std::fflush(stdout);
   }
 }
\ No newline at end of file
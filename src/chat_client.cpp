@@ -7,21 +7,23 @@
 
 #include <SFML/Network/IpAddress.hpp>
 #include <algorithm>
-#include <print>
 
 #include "const.h"
+#include "logger.h"
 
 bool ChatClient::Connect(std::string_view host, unsigned short port) {
   // Resolve the human-readable host name (e.g. "localhost") to an IP address.
   auto address = sf::IpAddress::resolve(std::string(host));
   if (!address) {
-    std::print(stderr, "Failed to resolve address: {}\n", host);
+    LOG_ERROR("Failed to resolve address: {}", host);
     return false;
   }
 
-  // Use blocking mode for the connection attempt so we wait for the result.
+  // Use blocking mode for the connection attempt so we wait for the result,
+  // but give up on a server that does not answer.
   socket_.setBlocking(true);
-  const auto connectionStatus = socket_.connect(*address, port);
+  const auto connectionStatus =
+      socket_.connect(*address, port, kConnectTimeout);
   // Switch back to non-blocking so that Receive() won't freeze the UI.
   socket_.setBlocking(false);
 
@@ -30,65 +32,70 @@ bool ChatClient::Connect(std::string_view host, unsigned short port) {
       status_ = ConnectionStatus::CONNECTED;
       return true;
     case sf::Socket::Status::NotReady:
-      std::print(stderr, "Socket not ready\n");
+      LOG_ERROR("Socket not ready");
       break;
     case sf::Socket::Status::Partial:
-      std::print(stderr, "Partial\n");
+      LOG_ERROR("Partial");
       break;
     case sf::Socket::Status::Disconnected:
-      std::print(stderr, "Socket disconnected\n");
+      LOG_ERROR("Socket disconnected");
       break;
     case sf::Socket::Status::Error:
-      std::print(stderr, "Socket error\n");
+      LOG_ERROR("Socket error");
       break;
   }
   return false;
 }
 
 bool ChatClient::Send(std::string_view message) {
-  // Clamp the message to MAX_MESSAGE_LENGTH to avoid buffer overflows.
-  const auto sendSize = std::min(message.size(), MAX_MESSAGE_LENGTH);
+  // Clamp the message to MAX_FRAME_PAYLOAD: the server rejects larger frames.
+  const auto sendSize = std::min(message.size(), MAX_FRAME_PAYLOAD);
+  // Queued whole: a frame is never half sent then forgotten.
+  outbound_.Push(framePool_.Make(message.substr(0, sendSize)), false);
+  return FlushPending();
+}
 
-  // TCP may not send all bytes in one call (especially for large messages).
-  // We loop, advancing a cursor, until everything has been sent.
-  std::size_t totalSent = 0;
-  while (totalSent < sendSize) {
-    std::size_t dataSent = 0;
-    const auto sendStatus =
-        socket_.send(message.data() + totalSent, sendSize - totalSent, dataSent);
-    if (sendStatus == sf::Socket::Status::Partial) {
-      // Only part of the data was sent -- advance the cursor and retry.
-      totalSent += dataSent;
-      continue;
-    }
-    if (sendStatus == sf::Socket::Status::Done) {
+bool ChatClient::FlushPending() {
+  switch (outbound_.Flush(socket_)) {
+    case sf::Socket::Status::Done:
+    case sf::Socket::Status::NotReady:
+    case sf::Socket::Status::Partial:
       return true;
-    }
-    // Any other status (Error, Disconnected, ...) is a failure.
-    return false;
+    case sf::Socket::Status::Disconnected:
+    case sf::Socket::Status::Error:
+      break;
   }
-  return true;
+  Disconnect();
+  return false;
 }
 
-std::optional<std::string> ChatClient::Receive() {
-  // Prepare a buffer large enough for one message.
-  std::string message;
-  message.resize(MAX_MESSAGE_LENGTH);
-  std::size_t actuallyReceived = 0;
+bool ChatClient::HasPending() const { return !outbound_.Empty(); }
+
+std::optional<std::string_view> ChatClient::Receive() {
+  if (auto frame = reader_.NextFrame()) {
+    return frame;
+  }
 
   // Non-blocking receive: returns immediately even if no data is available.
-  const auto receivedStatus =
-      socket_.receive(message.data(), MAX_MESSAGE_LENGTH, actuallyReceived);
-  if (receivedStatus == sf::Socket::Status::Done) {
-    // Shrink the string to the actual number of bytes received.
-    message.resize(actuallyReceived);
-    return message;
+  // Keep reading while only part of a frame has arrived.
+  auto receivedStatus = reader_.ReceiveFrom(socket_);
+  while (receivedStatus == sf::Socket::Status::Done) {
+    if (auto frame = reader_.NextFrame()) {
+      return frame;
+    }
+    if (reader_.HasError()) {
+      break;
+    }
+    receivedStatus = reader_.ReceiveFrom(socket_);
   }
 
-  // If the local port dropped to 0 the OS has closed the socket -- mark
-  // ourselves as disconnected so the Controller can react.
-  if (socket_.getLocalPort() == 0) {
-    status_ = ConnectionStatus::NOT_CONNECTED;
+  // A malformed frame leaves the stream unrecoverable, and a local port of
+  // 0 means the OS has closed the socket -- in both cases mark ourselves
+  // as disconnected so the Controller can react.
+  if (reader_.HasError() ||
+      receivedStatus == sf::Socket::Status::Disconnected ||
+      socket_.getLocalPort() == 0) {
+    Disconnect();
   }
   return std::nullopt;
 }
@@ -99,5 +106,9 @@ bool ChatClient::IsConnected() const {
 
 void ChatClient::Disconnect() {
   socket_.disconnect();
+  reader_ = FrameReader{};  // Drop bytes left over from this connection.
+  outbound_ = OutboundQueue{};
   status_ = ConnectionStatus::NOT_CONNECTED;
 }
+
+sf::TcpSocket& ChatClient::GetSocket() { return socket_; }
@@ -0,0 +1,50 @@
+/**
+ * @file chat_protocol.cpp
+ * @brief Encoding and decoding of the chat messages.
+ */
+
+#include "chat_protocol.h"
+
+std::size_t EncodeMessage(const MessageView& message, std::span<char> out) {
+  return MessageSchema::Encode(message, out);
+}
+
+std::optional<MessageView> DecodeMessage(std::string_view payload) {
+  auto message = MessageSchema::Decode(payload);
+  if (!message || message->version != PROTOCOL_VERSION) {
+    return std::nullopt;
+  }
+  switch (message->encoding) {
+    case TextEncoding::PLAIN:
+      break;
+    case TextEncoding::DEFLATE:
+      // Only chat text may be compressed.
+      if (message->type != MessageType::CHAT) return std::nullopt;
+      break;
+    default:
+      return std::nullopt;
+  }
+  switch (message->delivery) {
+    case Delivery::UNRELIABLE:
+    case Delivery::SEQUENCED:
+    case Delivery::RELIABLE:
+      break;
+    default:
+      return std::nullopt;
+  }
+  switch (message->type) {
+    case MessageType::CHAT:
+    case MessageType::JOIN_ROOM:
+    case MessageType::LEAVE_ROOM:
+    case MessageType::HELLO:
+    case MessageType::PING:
+    case MessageType::PONG:
+    case MessageType::STATE:
+    case MessageType::UDP_OPEN:
+    case MessageType::STATE_SET:
+    case MessageType::STATE_DELTA:
+    case MessageType::STATE_ACK:
+      return message;
+  }
+  return std::nullopt;
+}
@@ -3,128 +3,1307 @@
  * @brief Implementation of the TCP chat server.
  *
  * The server follows a simple loop each tick:
- *  1. CleanDisconnected() -- remove dead sockets.
- *  2. AcceptNewConnections() -- accept any pending clients.
- *  3. HandleMessages() -- wait (briefly) for incoming data, then broadcast.
+ *  1. ExpireTimers() -- ping silent clients, close the ones that stay
+ *     silent.
+ *  2. HandleMessages() -- wait (briefly) for ready sockets, accept pending
+ *     clients if the listener is ready, queue incoming chat messages for
+ *     the members of their room, then flush the queues that received data
+ *     (or, when coalescing, once the flush interval has passed), and
+ *     finally deal with the clients that fall too far behind.  Datagrams
+ *     are read like a socket's data and written after the TCP flush, with
+ *     the retransmissions that fell due.
+ *     With io_uring the poller reports connections already accepted and
+ *     bytes already received instead, and the flush hands the writes of
+ *     all the queues to the kernel in one system call.
+ *
+ * The time spent waiting and working is recorded in the metrics at the
+ * end of each tick.
  */
 
 #include "chat_server.h"
 
-#include <filesystem>
-#include <print>
-#include <ranges>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "chat_protocol.h"
 #include "const.h"
+#include "logger.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+/// Shared by all the shards of the process, so client IDs are unique
+/// across them.  Starts at 1: 0 is NO_CLIENT.
+std::atomic<ClientId> nextClientId{1};
+
+/// sf::Socket::create() is protected, but a pointer to it taken through a
+/// derived class may be called on any socket.
+struct SocketAccess : sf::TcpSocket {
+  static constexpr auto kCreate =
+      static_cast<void (sf::Socket::*)(sf::SocketHandle)>(
+          &SocketAccess::create);
+};
+
+/// Make @p socket own @p handle, a connected TCP socket.
+void AdoptSocket(sf::TcpSocket& socket, sf::SocketHandle handle) {
+  (socket.*SocketAccess::kCreate)(handle);
+}
+}  // namespace
+
+ChatServer::ChatServer(PollerBackend backend,
+                       std::shared_ptr<FramePool> framePool)
+    : framePool_(framePool != nullptr ? std::move(framePool)
+                                      : std::make_shared<FramePool>()),
+      poller_(CreatePoller(backend)),
+      backend_(backend) {
+  // E.g. io_uring on an old kernel.
+  if (poller_ == nullptr && backend != DefaultPollerBackend()) {
+    LOG_WARNING("{} unavailable, using {}", PollerBackendName(backend),
+                PollerBackendName(DefaultPollerBackend()));
+    backend_ = DefaultPollerBackend();
+    poller_ = CreatePoller(backend_);
+  }
+  if (poller_ == nullptr) {
+    LOG_WARNING("Poller backend unavailable, using SocketSelector");
+    backend_ = PollerBackend::SELECTOR;
+    poller_ = CreatePoller(backend_);
+  }
+  SetTickRate(kDefaultTickRate);
+}
 
-bool ChatServer::Start(unsigned short port) {
+bool ChatServer::Start(unsigned short port, bool reusePort) {
   // Non-blocking listener so that accept() returns immediately when no
   // new client is waiting.
   listener_.setBlocking(false);
-  const auto listenerStatus = listener_.listen(port);
+  const auto listenerStatus =
+      reusePort ? listener_.ListenShared(port) : listener_.listen(port);
   if (listenerStatus != sf::Socket::Status::Done) {
-    std::print(stderr, "Error while listening\n");
+    LOG_ERROR("Error while listening");
     return false;
   }
+  // The listener is watched like any other socket: it becomes "ready" when
+  // a client is waiting to be accepted.
+  return poller_->AddListener(listener_, kListenerToken);
+}
+
+unsigned short ChatServer::Port() const { return listener_.getLocalPort(); }
+
+bool ChatServer::StartUdp(unsigned short port) {
+  if (udpSocket_.bind(port) != sf::Socket::Status::Done) {
+    LOG_ERROR("Cannot bind UDP port {}", port);
+    return false;
+  }
+  udpSocket_.setBlocking(false);
+  if (!poller_->Add(udpSocket_, kUdpToken)) {
+    udpSocket_.unbind();
+    return false;
+  }
+  udpStarted_ = true;
+  udpPort_ = udpSocket_.getLocalPort();
+  for (auto [handle, session] : sessions_) {
+    if (session.greeted) {
+      OfferUdp(handle, session);
+    }
+  }
+  return true;
+}
+
+bool ChatServer::ConnectShards(std::span<ChatServer* const> peers) {
+  peers_.clear();
+  for (auto* peer : peers) {
+    peers_.push_back({peer, {}});
+  }
+  std::ranges::sort(peers_, std::less<>{}, &Peer::server);
+  shardRank_ = static_cast<std::size_t>(std::ranges::count_if(
+      peers_, [this](const Peer& peer) {
+        return std::less<>{}(peer.server, this);
+      }));
+  return waker_.Init() && poller_->Add(waker_.ReadSocket(), kWakerToken);
+}
+
+bool ChatServer::ImportState(const HandoffState& state) {
+  listener_.Adopt(state.listener);
+  listener_.setBlocking(false);
+  if (!poller_->AddListener(listener_, kListenerToken)) {
+    return false;
+  }
+  // The predecessor may have given out IDs this process has not.
+  auto next = nextClientId.load(std::memory_order_relaxed);
+  while (next < state.nextClientId &&
+         !nextClientId.compare_exchange_weak(next, state.nextClientId,
+                                             std::memory_order_relaxed)) {
+  }
+  const auto now = Clock::now();
+  for (const auto& imported : state.sessions) {
+    const auto handle = sessions_.Emplace();
+    auto& session = *sessions_.Get(handle);
+    AdoptSocket(session.socket, imported.socket);
+    session.socket.setBlocking(false);
+    if (!session.reader.Restore(imported.received) ||
+        !poller_->AddStream(session.socket, handle.Pack())) {
+      sessions_.Remove(handle);
+      continue;
+    }
+    session.clientId = imported.clientId;
+    session.deflate = imported.deflate;
+    session.greeted = imported.greeted;
+    for (const auto room : imported.rooms) {
+      if (rooms_.Join(room, handle)) {
+        session.rooms.push_back(room);
+      }
+    }
+    // The unsent bytes may start in the middle of a frame: never drop them.
+    for (std::string_view unsent = imported.unsent; !unsent.empty();) {
+      const auto chunk = unsent.substr(0, MAX_FRAME_SIZE);
+      session.outbound.Push(framePool_->MakeRaw(chunk), false);
+      unsent.remove_prefix(chunk.size());
+    }
+    if (!session.outbound.Empty()) {
+      ScheduleFlush(handle, session);
+    }
+    session.lastReceived = now;
+    timers_.Arm(handle.Pack(), NextDeadline(session, now));
+  }
+  LOG_INFO("Took over {} sessions", sessions_.Size());
   return true;
 }
 
+HandoffState ChatServer::ExportState() {
+  HandoffState state;
+  state.listener = listener_.getNativeHandle();
+  state.nextClientId = nextClientId.load(std::memory_order_relaxed);
+  state.sessions.reserve(sessions_.Size());
+  for (auto [handle, session] : sessions_) {
+    auto& exported = state.sessions.emplace_back();
+    exported.socket = session.socket.getNativeHandle();
+    exported.clientId = session.clientId;
+    exported.deflate = session.deflate;
+    exported.greeted = session.greeted;
+    exported.rooms = session.rooms;
+    session.reader.CopyBuffered(exported.received);
+    session.outbound.CopyPending(exported.unsent);
+  }
+  return state;
+}
+
+PollerBackend ChatServer::Backend() const { return backend_; }
+
+void ChatServer::SetFlushInterval(std::chrono::microseconds interval) {
+  flushInterval_ = interval;
+}
+
+void ChatServer::SetCompression(bool enabled) { compression_ = enabled; }
+
+void ChatServer::SetMessageLog(std::shared_ptr<MessageLog> log) {
+  messageLog_ = std::move(log);
+}
+
+void ChatServer::SetBackpressure(const BackpressureConfig& config) {
+  backpressure_ = config;
+}
+
+void ChatServer::SetTimeouts(const TimeoutConfig& config) {
+  timeouts_ = config;
+}
+
+void ChatServer::SetTickRate(unsigned hz) {
+  tickRate_ = std::max(hz, 1U);
+  tickEpoch_ = Clock::now();
+  tickIndex_ = 0;
+  nextTick_ = tickEpoch_;
+}
+
 void ChatServer::Update() {
-  CleanDisconnected();
-  AcceptNewConnections();
-  HandleMessages();
+  const auto tickStart = Clock::now();
+  ExpireTimers();
+  const auto waitTime = HandleMessages();
+  const auto tickEnd = Clock::now();
+
+  const auto tickNs = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(tickEnd - tickStart)
+          .count());
+  const auto waitNs = static_cast<std::uint64_t>(waitTime.count());
+  metrics_.tickDurationNs.Record(tickNs);
+  metrics_.waitDurationNs.Record(waitNs);
+  metrics_.waitTimeNs += waitNs;
+  metrics_.workTimeNs += tickNs - std::min(tickNs, waitNs);
+  if (tickEnd >= nextPublish_) {
+    PublishMetrics();
+    nextPublish_ = tickEnd + kMetricsInterval;
+  }
+}
+
+ServerMetrics ChatServer::MetricsSnapshot() const {
+  const std::scoped_lock lock(metricsMutex_);
+  return publishedMetrics_;
 }
 
 void ChatServer::AcceptNewConnections() {
-  // Try to accept a new client.  Because the listener is non-blocking this
-  // returns immediately with a status other than Done when nobody is waiting.
-  sf::TcpSocket socket;
-  socket.setBlocking(false);
-  const auto newSocketStatus = listener_.accept(socket);
-  if (newSocketStatus == sf::Socket::Status::Done) {
-    socketSelector_.add(socket);
-    sockets_.push_back(std::move(socket));
+  // Accept until the listener runs dry: an edge-triggered poller will not
+  // report the listener again for clients that are already queued.
+  while (true) {
+    sf::TcpSocket socket;
+    socket.setBlocking(false);
+    ++systemCalls_;
+    if (listener_.accept(socket) != sf::Socket::Status::Done) {
+      return;
+    }
+    AddSession(std::move(socket));
   }
 }
 
-void ChatServer::CleanDisconnected() {
-  for (int64_t socket_idx = std::ssize(sockets_) - 1; socket_idx >= 0; --socket_idx) {
-    auto& socket = sockets_[socket_idx];
-    // A local port of 0 means the OS has closed the socket.
-    if (socket.getLocalPort() == 0) {
-      RemoveSocketAt(socket_idx);
-    }
+void ChatServer::AddSession(sf::TcpSocket socket) {
+  const auto handle = sessions_.Emplace();
+  auto& session = *sessions_.Get(handle);
+  session.socket = std::move(socket);
+  session.clientId = nextClientId.fetch_add(1, std::memory_order_relaxed);
+  if (!poller_->AddStream(session.socket, handle.Pack())) {
+    sessions_.Remove(handle);  // The backend is full, drop the client.
+    return;
   }
+  session.lastReceived = Clock::now();
+  timers_.Arm(handle.Pack(), NextDeadline(session, session.lastReceived));
+  ++metrics_.connectionsAccepted;
 }
 
-void ChatServer::HandleMessages() {
-  // Wait up to 100 ms for any socket to become ready.  This small timeout
-  // prevents the loop from busy-spinning while still being responsive.
-  if (!socketSelector_.wait(sf::milliseconds(100))) {
-    return;  // No socket had data within the timeout.
+void ChatServer::ExpireTimers() {
+  const auto now = Clock::now();
+  timers_.Advance(now, expired_);
+  for (const auto& timer : expired_) {
+    const auto handle = SlotHandle::Unpack(timer.token);
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;  // Removed since it was armed.
+    const auto silence = now - session->lastReceived;
+    if (!session->greeted && silence >= timeouts_.handshake) {
+      LOG_WARNING("Client {} sent nothing, closing connection",
+                  session->clientId);
+      ++metrics_.handshakeTimeouts;
+      RemoveSession(handle);
+      continue;
+    }
+    // A paused session may well have talked: we just did not read it.
+    if (session->greeted && !session->paused) {
+      if (silence >= timeouts_.idle) {
+        LOG_WARNING("Client {} silent, closing connection", session->clientId);
+        ++metrics_.idleTimeouts;
+        RemoveSession(handle);
+        continue;
+      }
+      if (!session->pinged && silence >= timeouts_.ping) {
+        SendControl(handle, *session, MessageType::PING);
+        session->pinged = true;
+        ++metrics_.pingsSent;
+      }
+    }
+    timers_.Arm(timer.token, NextDeadline(*session, now));
   }
+  expired_.clear();
+}
 
-  for (int64_t socket_idx = std::ssize(sockets_) - 1; socket_idx >= 0; --socket_idx) {
-    auto& socket = sockets_[socket_idx];
-    // Only read from sockets that the selector flagged as ready.
-    if (!socketSelector_.isReady(socket)) continue;
+Clock::time_point ChatServer::NextDeadline(const Session& session,
+                                           Clock::time_point now) const {
+  if (!session.greeted) return session.lastReceived + timeouts_.handshake;
+  if (session.paused) return now + timeouts_.idle;
+  return session.lastReceived +
+         (session.pinged ? timeouts_.idle : timeouts_.ping);
+}
 
-    std::string message;
-    message.resize(MAX_MESSAGE_LENGTH);
-    size_t actualLength = 0;
+std::chrono::nanoseconds ChatServer::HandleMessages() {
+  const auto waitStart = Clock::now();
+  const auto events = poller_->Wait(WaitTimeout());
+  const auto waitTime = Clock::now() - waitStart;
 
-    sf::Socket::Status receiveStatus = socket.receive(message.data(), MAX_MESSAGE_LENGTH, actualLength);
-    if (receiveStatus == sf::Socket::Status::Disconnected) {
-      RemoveSocketAt(socket_idx);
+  for (const auto& event : events) {
+    if (event.token == kListenerToken) {
+      if (event.accepted) {
+        // Accepted by the backend already.
+        sf::TcpSocket socket;
+        AdoptSocket(socket, *event.accepted);
+        socket.setBlocking(false);
+        AddSession(std::move(socket));
+      } else {
+        AcceptNewConnections();
+      }
+      continue;
+    }
+    if (event.token == kWakerToken) {
+      if (event.readable) {
+        waker_.Drain();  // The inbox itself is delivered below.
+      }
       continue;
     }
+    if (event.token == kUdpToken) {
+      if (event.readable) {
+        ReceiveDatagrams();
+      }
+      continue;
+    }
+    // The session may have been removed by an earlier event of this tick,
+    // in which case its handle is stale and Get() returns nullptr.
+    const auto handle = SlotHandle::Unpack(event.token);
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    if (poller_->CompletesIo()) {
+      // Handled even if the session was paused since: the bytes already
+      // left its socket.
+      if (event.closed ||
+          (!event.received.empty() &&
+           !HandleReceived(handle, *session, event.received))) {
+        RemoveSession(handle);
+        continue;
+      }
+    } else if (event.readable && !session->paused &&
+               !ReadSession(handle, *session)) {
+      RemoveSession(handle);
+      continue;
+    }
+    if (event.writable && !session->outbound.Empty()) {
+      ScheduleFlush(handle, *session);
+    }
+  }
+
+  if (!peers_.empty()) {
+    ExchangeWithShards();
+  }
+  RunSimulationTick();
+  if (!replaying_.empty()) {
+    ReplayBacklogs();
+  }
+  if (!pendingFlush_.empty() &&
+      (flushInterval_ == std::chrono::microseconds::zero() ||
+       Clock::now() - firstScheduled_ >= flushInterval_)) {
+    FlushPending();
+  }
+  if (!pendingUdp_.empty()) {
+    FlushDatagrams();
+  }
+  if (!congested_.empty()) {
+    CheckCongested();
+  }
+  return waitTime;
+}
 
+bool ChatServer::ReadSession(SlotHandle handle, Session& session) {
+  // Read until the socket has nothing left.  With a level-triggered poller
+  // this is an optimisation; with an edge-triggered one it is required,
+  // since the socket will not be reported again for data already queued.
+  while (!session.paused) {
+    // One receive() may bring in several frames (or only part of one), so
+    // the bytes go into the session's ring buffer and we then extract every
+    // complete frame from it.
+    ++systemCalls_;
+    const auto receiveStatus = session.reader.ReceiveFrom(session.socket);
     switch (receiveStatus) {
-      case sf::Socket::Status::Done: {
-        message.resize(actualLength);
-        std::print("Message received: {}\n", message);
-
-        // --- Broadcast: send the message to ALL connected clients. ---
-        // For a game you would replace this with game logic (validate
-        // the move, update state, send targeted responses, etc.).
-        for (int64_t other_idx = std::ssize(sockets_) - 1; other_idx >= 0; --other_idx) {
-          auto& otherSocket = sockets_[other_idx];
-          size_t totalSent = 0;
-          while (totalSent < actualLength) {
-            size_t sentDataCount = 0;
-            const auto sendStatus = otherSocket.send(
-                message.data() + totalSent, actualLength - totalSent,
-                sentDataCount);
-            if (sendStatus == sf::Socket::Status::Partial) {
-              totalSent += sentDataCount;
-              continue;
-            }
-            else if (sendStatus == sf::Socket::Status::Disconnected) {
-              RemoveSocketAt(other_idx);
-              break;
-            }
-            else {
-              break;
-            }
-          }
+      case sf::Socket::Status::Done:
+        session.lastReceived = Clock::now();
+        session.pinged = false;
+        if (!HandleFrames(handle, session)) {
+          return false;
         }
         break;
-      }
-      case sf::Socket::Status::Partial:
-        std::print(stderr, "Partial received...\n");
-        break;
-      case sf::Socket::Status::Error:
-        std::print(stderr, "Error receiving\n");
-        break;
       case sf::Socket::Status::NotReady:
-        std::print(stderr, "Not ready on received\n");
-        break;
+        return true;  // Drained.
       case sf::Socket::Status::Disconnected:
-        std::print(stderr, "Socket disconnected\n");
-        break;
+        return false;
+      case sf::Socket::Status::Partial:
+        LOG_WARNING("Partial received...");
+        return true;
+      case sf::Socket::Status::Error:
+        LOG_ERROR("Error receiving");
+        return false;
+    }
+  }
+  return true;  // Paused by its own messages: the rest waits in the kernel.
+}
+
+bool ChatServer::HandleReceived(SlotHandle handle, Session& session,
+                                std::span<const char> bytes) {
+  // Fits: the frames are handled as soon as they are complete, so the ring
+  // never holds more than part of one, and the backend's buffers are no
+  // larger than a frame.
+  if (!session.reader.Restore(std::string_view(bytes.data(), bytes.size()))) {
+    LOG_ERROR("Receive buffer full, closing connection");
+    return false;
+  }
+  session.lastReceived = Clock::now();
+  session.pinged = false;
+  return HandleFrames(handle, session);
+}
+
+bool ChatServer::HandleFrames(SlotHandle handle, Session& session) {
+  while (const auto payload = session.reader.NextFrame()) {
+    session.greeted = true;
+    ++metrics_.messagesIn;
+    metrics_.bytesIn += FRAME_HEADER_SIZE + payload->size();
+    if (!HandlePayload(handle, session, *payload)) {
+      LOG_ERROR("Malformed message, closing connection");
+      return false;
+    }
+  }
+  if (session.reader.HasError()) {
+    LOG_ERROR("Oversized frame, closing connection");
+    return false;
+  }
+  return true;
+}
+
+bool ChatServer::HandlePayload(SlotHandle handle, Session& session,
+                               std::string_view payload) {
+  const auto message = DecodeMessage(payload);
+  if (!message) return false;
+
+  switch (message->type) {
+    case MessageType::JOIN_ROOM:
+      if (rooms_.Join(message->room, handle)) {
+        session.rooms.push_back(message->room);
+        StartReplay(handle, session, message->room);
+        JoinSharedRoom(handle, message->room);
+      }
+      return true;
+    case MessageType::LEAVE_ROOM:
+      if (rooms_.Leave(message->room, handle)) {
+        LeaveSharedRoom(handle, session, message->room);
+        std::erase(session.rooms, message->room);
+        std::erase_if(session.replays, [&](const Replay& replay) {
+          return replay.room == message->room;
+        });
+      }
+      return true;
+    case MessageType::HELLO:
+      Negotiate(handle, session, message->text);
+      return true;
+    case MessageType::PING:
+      SendControl(handle, session, MessageType::PONG);
+      return true;
+    case MessageType::PONG:
+      return true;  // Receiving it was the point (see ExpireTimers()).
+    case MessageType::STATE:
+      RelayState(*message, session);
+      return true;
+    case MessageType::UDP_OPEN:
+    case MessageType::STATE_DELTA:
+      return false;  // Only the server sends these.
+    case MessageType::STATE_SET: {
+      // Only members may write the state of a room.
+      if (std::ranges::find(session.rooms, message->room) ==
+          session.rooms.end()) {
+        return true;
+      }
+      // Entries over the room's budget are refused, which is no reason to
+      // close the client.
+      MessageView set = *message;
+      set.sender = session.clientId;
+      SubmitStateSet(set);
+      return true;
+    }
+    case MessageType::STATE_ACK:
+      AcknowledgeState(handle, *message);
+      return true;
+    case MessageType::CHAT: {
+      // Only members may talk in a room.
+      if (std::ranges::find(session.rooms, message->room) ==
+          session.rooms.end()) {
+        return true;
+      }
+      LOG_DEBUG("Message received in room {} from {} ({} bytes)",
+                message->room, session.clientId, message->text.size());
+      RelayedFrame frame;
+      if (!EncodeRelayed(*message, session.clientId, frame)) {
+        return false;
+      }
+      SendToRoom(message->room, frame);
+      ForwardToShards(frame);
+      if (messageLog_ != nullptr && !messageLog_->Append(frame.plain)) {
+        ++metrics_.logRecordsDropped;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChatServer::Negotiate(SlotHandle handle, Session& session,
+                           std::string_view offer) {
+  session.deflate =
+      compression_ &&
+      offer.find(static_cast<char>(TextEncoding::DEFLATE)) != offer.npos;
+  const auto chosen = static_cast<char>(session.deflate ? TextEncoding::DEFLATE
+                                                        : TextEncoding::PLAIN);
+  SendControl(handle, session, MessageType::HELLO,
+              std::string_view(&chosen, 1));
+  if (udpStarted_) {
+    OfferUdp(handle, session);
+  }
+}
+
+void ChatServer::OfferUdp(SlotHandle handle, Session& session) {
+  if (session.udpToken == 0) {
+    // Random, so that a client cannot guess the token of another session
+    // and feed it datagrams.  0 means none.
+    do {
+      session.udpToken = tokenRandom_();
+    } while (session.udpToken == 0 ||
+             !udpTokens_.try_emplace(session.udpToken, handle).second);
+  }
+  const UdpOffer offer{session.udpToken, udpPort_};
+  std::array<char, UdpOfferSchema::kFixedSize> text;
+  if (UdpOfferSchema::Encode(offer, text) == 0) return;
+  SendControl(handle, session, MessageType::UDP_OPEN,
+              std::string_view(text.data(), text.size()));
+}
+
+void ChatServer::ReceiveDatagrams() {
+  // One byte more than any valid datagram, so that a longer one, cut to
+  // the buffer size, is recognised and dropped.
+  std::array<char, MAX_DATAGRAM_SIZE + 1> buffer;
+  std::size_t size = 0;
+  std::optional<sf::IpAddress> address;
+  unsigned short port = 0;
+  // Drain the socket, as an edge-triggered poller requires.
+  while (udpSocket_.receive(buffer.data(), buffer.size(), size, address,
+                            port) == sf::Socket::Status::Done) {
+    const std::string_view datagram(buffer.data(), size);
+    const auto token = UdpChannel::PeekToken(datagram);
+    if (size > MAX_DATAGRAM_SIZE || !address || !token) continue;
+    const auto it = udpTokens_.find(*token);
+    if (it == udpTokens_.end()) continue;
+    const auto handle = it->second;
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    if (session->udp == nullptr) {
+      session->udp = std::make_unique<UdpChannel>(*token, false);
+    }
+    const auto now = Clock::now();
+    if (!session->udp->Receive(datagram, now)) continue;
+    ++metrics_.datagramsIn;
+    session->udpAddress = *address;
+    session->udpPort = port;
+    while (const auto payload = session->udp->NextMessage()) {
+      // Only game state and its acknowledgements may come this way: the
+      // other messages must stay in order with the TCP stream.
+      const auto message = DecodeMessage(*payload);
+      if (message && message->type == MessageType::STATE) {
+        RelayState(*message, *session);
+      } else if (message && message->type == MessageType::STATE_ACK) {
+        AcknowledgeState(handle, *message);
+      }
+    }
+    ScheduleUdp(handle, *session);  // Acknowledge, maybe.
+  }
+}
+
+void ChatServer::RelayState(const MessageView& message,
+                            const Session& session) {
+  // Only members may talk in a room.
+  if (std::ranges::find(session.rooms, message.room) == session.rooms.end()) {
+    return;
+  }
+  MessageView relayed = message;
+  relayed.sender = session.clientId;
+  std::array<char, MAX_FRAME_PAYLOAD> buffer;
+  const auto size = EncodeMessage(relayed, buffer);
+  RelayedFrame frame;
+  frame.plain = framePool_->Make(std::string_view(buffer.data(), size));
+  if (frame.plain.Empty()) return;
+  SendStateToRoom(message.room, message.delivery, frame);
+  ForwardToShards(frame);
+}
+
+void ChatServer::SendStateToRoom(RoomId room, Delivery delivery,
+                                 const RelayedFrame& frame) {
+  const auto now = Clock::now();
+  for (const auto handle : rooms_.Members(room)) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    // Over TCP if the channel is down or the frame too long for a datagram.
+    if (session->udp != nullptr && session->udp->Connected(now) &&
+        session->udp->Send(delivery, frame.plain.Payload())) {
+      ScheduleUdp(handle, *session);
+    } else {
+      Enqueue(handle, *session, frame.plain);
+    }
+    ++metrics_.messagesOut;
+  }
+}
+
+void ChatServer::ScheduleUdp(SlotHandle handle, Session& session) {
+  if (!session.udpScheduled) {
+    session.udpScheduled = true;
+    pendingUdp_.push_back(handle);
+  }
+}
+
+void ChatServer::FlushDatagrams() {
+  const auto now = Clock::now();
+  std::erase_if(pendingUdp_, [&](SlotHandle handle) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) return true;
+    while (const auto datagram = session->udp->NextDatagram(now)) {
+      // A full socket buffer loses the datagram, like the network would:
+      // reliable messages are sent again anyway.
+      if (udpSocket_.send(datagram->data(), datagram->size(),
+                          session->udpAddress,
+                          session->udpPort) == sf::Socket::Status::Done) {
+        ++metrics_.datagramsOut;
+      }
+    }
+    // Messages in flight: come back for their retransmission.
+    if (session->udp->Busy()) return false;
+    session->udpScheduled = false;
+    return true;
+  });
+}
+
+bool ChatServer::ApplyStateSet(RoomId room, ClientId owner,
+                               std::string_view entries) {
+  auto [it, created] = sharedRooms_.try_emplace(room);
+  auto& shared = it->second;
+  if (created) {
+    for (const auto handle : rooms_.Members(room)) {
+      shared.subscribers.try_emplace(handle.Pack());
+    }
+  }
+  const auto before = shared.state.Version();
+  const bool valid = shared.state.ApplySet(owner, entries);
+  if (shared.state.Version() != before) {
+    shared.settled = false;
+  }
+  if (!valid) {
+    LOG_WARNING("Invalid or oversized state from client {} in room {}",
+                owner, room);
+  }
+  return valid;
+}
+
+void ChatServer::SubmitStateSet(const MessageView& set) {
+  auto* owner = StateOwner(set.room);
+  if (owner == nullptr) {
+    static_cast<void>(ApplyStateSet(set.room, set.sender, set.text));
+  }
+  if (peers_.empty()) return;
+  std::array<char, MAX_FRAME_PAYLOAD> buffer;
+  const auto size = EncodeMessage(set, buffer);
+  RelayedFrame frame;
+  frame.plain = framePool_->Make(std::string_view(buffer.data(), size));
+  if (owner == nullptr) {
+    ForwardToShards(frame);
+  } else {
+    // Applied here once the owner forwards it back, in its order.
+    ForwardToShard(*owner, std::move(frame));
+  }
+}
+
+ChatServer::Peer* ChatServer::StateOwner(RoomId room) {
+  if (peers_.empty()) return nullptr;
+  const std::size_t owner = room % (peers_.size() + 1);
+  if (owner == shardRank_) return nullptr;
+  return &peers_[owner < shardRank_ ? owner : owner - 1];
+}
+
+void ChatServer::AcknowledgeState(SlotHandle handle,
+                                  const MessageView& message) {
+  const auto ack = StateAckSchema::Decode(message.text);
+  const auto it = sharedRooms_.find(message.room);
+  if (!ack || it == sharedRooms_.end()) return;
+  auto& shared = it->second;
+  const auto subscriber = shared.subscribers.find(handle.Pack());
+  // Acks may arrive out of order over UDP: an older one only makes the
+  // next delta a bit longer.
+  if (subscriber == shared.subscribers.end() ||
+      ack->version > subscriber->second.sent) {
+    return;
+  }
+  subscriber->second.acked = ack->version;
+  if (ack->version != shared.state.Version()) {
+    shared.settled = false;
+  }
+}
+
+void ChatServer::JoinSharedRoom(SlotHandle handle, RoomId room) {
+  const auto it = sharedRooms_.find(room);
+  if (it == sharedRooms_.end()) return;
+  // Starts from version 0: its first delta is a snapshot.
+  it->second.subscribers.try_emplace(handle.Pack());
+  it->second.settled = false;
+}
+
+void ChatServer::LeaveSharedRoom(SlotHandle handle, const Session& session,
+                                 RoomId room) {
+  const auto it = sharedRooms_.find(room);
+  if (it == sharedRooms_.end()) return;
+  auto& shared = it->second;
+  shared.subscribers.erase(handle.Pack());
+  // An empty STATE_SET removes the entries of its sender, on every shard.
+  MessageView clear;
+  clear.type = MessageType::STATE_SET;
+  clear.room = room;
+  clear.sender = session.clientId;
+  SubmitStateSet(clear);
+}
+
+void ChatServer::RunSimulationTick() {
+  const auto now = Clock::now();
+  if (now < nextTick_) return;
+  SimulationTick();
+  ++metrics_.simulationTicks;
+  // The next tick is the first one still ahead: the ones missed are
+  // skipped, and the schedule keeps its phase.
+  const auto period = std::chrono::nanoseconds(std::chrono::seconds(1)) /
+                      static_cast<std::int64_t>(tickRate_);
+  const auto late = static_cast<std::uint64_t>((now - nextTick_) / period);
+  metrics_.simulationTicksSkipped += late;
+  tickIndex_ += late + 1;
+  // From the epoch each time, so that the rounding of the period adds up
+  // to no drift.
+  nextTick_ = tickEpoch_ +
+              std::chrono::seconds(tickIndex_ / tickRate_) +
+              std::chrono::nanoseconds((tickIndex_ % tickRate_) *
+                                       1'000'000'000 / tickRate_);
+}
+
+void ChatServer::SimulationTick() {
+  const auto now = Clock::now();
+  const auto tick = static_cast<std::uint32_t>(tickIndex_);
+  // Members usually acknowledged the same version: encode each delta once
+  // per tick and share it.
+  using EncodedDelta = std::pair<StateVersion, SharedFrame>;
+  std::vector<EncodedDelta> encoded;
+  std::array<char, MAX_STATE_DELTA> delta;
+  std::array<char, MAX_FRAME_PAYLOAD> buffer;
+  for (auto it = sharedRooms_.begin(); it != sharedRooms_.end();) {
+    auto& [room, shared] = *it;
+    if (shared.subscribers.empty() && shared.state.Empty()) {
+      it = sharedRooms_.erase(it);
+      continue;
+    }
+    if (shared.settled) {
+      ++it;
+      continue;
+    }
+    encoded.clear();
+    const auto version = shared.state.Version();
+    bool settled = true;
+    for (auto& [token, subscriber] : shared.subscribers) {
+      if (subscriber.acked == version) continue;
+      settled = false;
+      // Everything was sent: wait for the ack, or resend what UDP may have
+      // lost.
+      if (subscriber.sent == version &&
+          (!subscriber.sentOverUdp ||
+           now - subscriber.sentAt < kStateRetryInterval)) {
+        continue;
+      }
+      const auto handle = SlotHandle::Unpack(token);
+      auto* session = sessions_.Get(handle);
+      if (session == nullptr) continue;
+      auto found =
+          std::ranges::find(encoded, subscriber.acked, &EncodedDelta::first);
+      if (found == encoded.end()) {
+        MessageView message;
+        message.type = MessageType::STATE_DELTA;
+        message.delivery = Delivery::SEQUENCED;
+        message.room = room;
+        message.text = std::string_view(
+            delta.data(),
+            shared.state.EncodeDelta(subscriber.acked, tick, delta));
+        const auto size =
+            message.text.empty() ? 0 : EncodeMessage(message, buffer);
+        found = encoded.emplace(
+            encoded.end(), subscriber.acked,
+            size == 0
+                ? SharedFrame()
+                : framePool_->Make(std::string_view(buffer.data(), size)));
+      }
+      const auto& frame = found->second;
+      if (frame.Empty()) continue;
+      // A newer delta makes a lost one useless: sequenced, over UDP.
+      subscriber.sentOverUdp =
+          session->udp != nullptr && session->udp->Connected(now) &&
+          session->udp->Send(Delivery::SEQUENCED, frame.Payload());
+      if (subscriber.sentOverUdp) {
+        ScheduleUdp(handle, *session);
+      } else {
+        // Never dropped: a lost delta over TCP would not be sent again.
+        Enqueue(handle, *session, frame, false);
+      }
+      subscriber.sent = version;
+      subscriber.sentAt = now;
+      ++metrics_.stateDeltas;
+      metrics_.stateDeltaBytes += frame.Payload().size();
+      ++metrics_.messagesOut;
+    }
+    shared.settled = settled;
+    ++it;
+  }
+}
+
+void ChatServer::SendControl(SlotHandle handle, Session& session,
+                             MessageType type, std::string_view text) {
+  MessageView message;
+  message.type = type;
+  message.text = text;
+  // The UDP offer is the longest control message.
+  std::array<char, MESSAGE_HEADER_SIZE + UdpOfferSchema::kFixedSize> buffer;
+  const auto size = EncodeMessage(message, buffer);
+  if (size == 0) {
+    LOG_ERROR("Cannot encode a control message of {} bytes", text.size());
+    return;
+  }
+  // The client waits for these: they are never dropped.
+  Enqueue(handle, session,
+          framePool_->Make(std::string_view(buffer.data(), size)), false);
+}
+
+bool ChatServer::EncodeRelayed(const MessageView& message, ClientId sender,
+                               RelayedFrame& out) {
+  // Relayed with the sender's real ID, whatever the client put there, and
+  // in both encodings: each is encoded once, then shared by every
+  // recipient, the replay ring and every shard.
+  MessageView plain = message;
+  plain.sender = sender;
+  MessageView compressed = plain;
+  std::array<char, MAX_FRAME_PAYLOAD - MESSAGE_HEADER_SIZE> text;
+  if (message.encoding == TextEncoding::DEFLATE) {
+    const auto size = compressor_.Decompress(message.text, text);
+    if (!size) return false;
+    plain.encoding = TextEncoding::PLAIN;
+    plain.text = std::string_view(text.data(), *size);
+  } else if (compression_ && message.text.size() >= COMPRESSION_THRESHOLD) {
+    const auto size = compressor_.Compress(message.text, text);
+    if (size > 0) {
+      compressed.encoding = TextEncoding::DEFLATE;
+      compressed.text = std::string_view(text.data(), size);
     }
   }
+
+  std::array<char, MAX_FRAME_PAYLOAD> buffer;
+  const auto make = [&](const MessageView& view) {
+    const auto size = EncodeMessage(view, buffer);
+    return framePool_->Make(std::string_view(buffer.data(), size));
+  };
+  out.plain = make(plain);
+  if (compressed.encoding == TextEncoding::DEFLATE) {
+    out.compressed = make(compressed);
+  }
+  return !out.plain.Empty();
 }
-void ChatServer::RemoveSocketAt(int64_t index) {
-  socketSelector_.remove(sockets_[index]);
-  sockets_.erase(sockets_.begin() + index);
+
+void ChatServer::SendToRoom(RoomId room, const RelayedFrame& frame) {
+  // --- Relay: queue the frame for the members of the room only. ---
+  // For a game you would replace this with game logic (validate the move,
+  // update state, send targeted responses, etc.).
+  if (frame.plain.Empty()) return;
+  RecordHistory(room, frame);
+  for (const auto handle : rooms_.Members(room)) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    // Still catching up on the backlog: it will get the frame from there.
+    if (std::ranges::find(session->replays, room, &Replay::room) !=
+        session->replays.end()) {
+      continue;
+    }
+    Enqueue(handle, *session, frame.For(session->deflate));
+    ++metrics_.messagesOut;
+  }
+}
+
+void ChatServer::RecordHistory(RoomId room, const RelayedFrame& frame) {
+  const auto [it, added] = history_.try_emplace(room);
+  auto& history = it->second;
+  if (added) {
+    historyRecency_.push_front(room);
+    history.recency = historyRecency_.begin();
+    if (history_.size() > kMaxReplayRooms) {
+      ForgetHistory(historyRecency_.back());
+    }
+  } else {
+    historyRecency_.splice(historyRecency_.begin(), historyRecency_,
+                           history.recency);
+  }
+  history.ring.Push(frame);
+}
+
+void ChatServer::ForgetHistory(RoomId room) {
+  const auto it = history_.find(room);
+  if (it == history_.end()) return;
+  // ReplayBacklogs() drops the sessions left without replays.
+  for (const auto handle : replaying_) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    std::erase_if(session->replays, [room](const Replay& replay) {
+      return replay.room == room;
+    });
+  }
+  historyRecency_.erase(it->second.recency);
+  history_.erase(it);
+}
+
+void ChatServer::StartReplay(SlotHandle handle, Session& session,
+                             RoomId room) {
+  const auto it = history_.find(room);
+  if (it == history_.end()) return;
+  if (session.replays.empty()) {
+    replaying_.push_back(handle);
+  }
+  session.replays.push_back({room, it->second.ring.Begin()});
+}
+
+void ChatServer::ReplayBacklogs() {
+  std::size_t budget = kReplayBudget;
+  const auto count = replaying_.size();
+  std::size_t served = 0;
+  for (; served < count && budget > 0; ++served) {
+    const auto handle = replaying_[(replayTurn_ + served) % count];
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr || session->replays.empty() ||
+        !session->outbound.Empty()) {
+      continue;
+    }
+    auto& replay = session->replays.front();
+    const auto& ring = history_.at(replay.room).ring;
+    // Frames overwritten since the join are lost, as for any client that
+    // falls a whole ring behind.
+    replay.next = std::max(replay.next, ring.Begin());
+    const std::size_t batch = std::min<std::uint64_t>(
+        ring.End() - replay.next, std::min(budget, kReplayBatch));
+    budget -= batch;
+    metrics_.messagesOut += batch;
+    for (const auto end = replay.next + batch; replay.next < end;
+         ++replay.next) {
+      Enqueue(handle, *session, ring.At(replay.next).For(session->deflate));
+    }
+    if (replay.next == ring.End()) {
+      // Caught up: the room's frames come live from now on.
+      session->replays.erase(session->replays.begin());
+    }
+  }
+  std::erase_if(replaying_, [this](SlotHandle handle) {
+    const auto* session = sessions_.Get(handle);
+    return session == nullptr || session->replays.empty();
+  });
+  replayTurn_ =
+      replaying_.empty() ? 0 : (replayTurn_ + served) % replaying_.size();
+}
+
+void ChatServer::Enqueue(SlotHandle handle, Session& session,
+                         SharedFrame frame, bool droppable) {
+  if (session.overflowed ||
+      session.outbound.SizeBytes() + frame.Bytes().size() >
+          backpressure_.hardLimit) {
+    // Whatever the policy, no client may hold more memory than this.
+    ++metrics_.framesDropped;
+    if (!session.overflowed) {
+      session.overflowed = true;
+      OnCongested(handle, session);
+    }
+    return;
+  }
+  session.outbound.Push(std::move(frame), droppable);
+  ScheduleFlush(handle, session);
+  if (session.outbound.SizeBytes() > backpressure_.highWatermark) {
+    OnCongested(handle, session);
+  }
+}
+
+void ChatServer::OnCongested(SlotHandle handle, Session& session) {
+  if (!session.congested) {
+    LOG_DEBUG("Client {} is not keeping up ({} bytes queued)",
+              session.clientId, session.outbound.SizeBytes());
+    session.congested = true;
+    session.congestedSince = Clock::now();
+    congested_.push_back(handle);
+    ++metrics_.slowConsumerEvents;
+    if (backpressure_.policy == SlowConsumerPolicy::PAUSE_READING) {
+      // Out of the poller, so that a level-triggered one does not keep
+      // reporting the unread data.  CheckCongested() puts it back.
+      poller_->Remove(session.socket);
+      session.paused = true;
+    }
+  }
+  if (backpressure_.policy == SlowConsumerPolicy::DROP_OLDEST) {
+    metrics_.framesDropped +=
+        session.outbound.DropOldest(backpressure_.lowWatermark);
+  }
+}
+
+void ChatServer::CheckCongested() {
+  const auto now = Clock::now();
+  std::vector<SlotHandle> resumed;
+  std::erase_if(congested_, [&](SlotHandle handle) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) return true;
+    const bool drained =
+        session->outbound.SizeBytes() <= backpressure_.lowWatermark;
+    const bool expired =
+        backpressure_.policy == SlowConsumerPolicy::DISCONNECT &&
+        now - session->congestedSince >= backpressure_.gracePeriod;
+    if (session->overflowed || (expired && !drained)) {
+      LOG_WARNING("Client {} too slow, closing connection",
+                  session->clientId);
+      ++metrics_.slowConsumerDisconnects;
+      RemoveSession(handle);
+      return true;
+    }
+    if (!drained) {
+      // A paused socket is out of the poller: retry its flush by the clock.
+      if (session->paused) {
+        ScheduleFlush(handle, *session);
+      }
+      return false;
+    }
+    session->congested = false;
+    if (session->paused) {
+      resumed.push_back(handle);
+    }
+    return true;
+  });
+  // Read what the resumed clients sent meanwhile (outside of the loop
+  // above, since reading may congest sessions again).  An edge-triggered
+  // poller would not report that data again; a completion backend
+  // receives it by itself.
+  for (const auto handle : resumed) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    session->paused = false;
+    if (!poller_->AddStream(session->socket, handle.Pack()) ||
+        (!poller_->CompletesIo() && !ReadSession(handle, *session))) {
+      RemoveSession(handle);
+    }
+  }
+}
+
+void ChatServer::LeaveAllRooms(SlotHandle handle, Session& session) {
+  for (const auto room : session.rooms) {
+    rooms_.Leave(room, handle);
+    LeaveSharedRoom(handle, session, room);
+  }
+  session.rooms.clear();
+}
+
+void ChatServer::ScheduleFlush(SlotHandle handle, Session& session) {
+  if (!session.flushScheduled) {
+    // The first frame of a batch starts the flush interval.
+    if (pendingFlush_.empty() && flushInterval_.count() > 0) {
+      firstScheduled_ = Clock::now();
+    }
+    session.flushScheduled = true;
+    pendingFlush_.push_back(handle);
+  }
+}
+
+std::chrono::milliseconds ChatServer::WaitTimeout() const {
+  // Wait up to 100 ms for any socket to become ready.  This small timeout
+  // prevents the loop from busy-spinning while still being responsive.
+  constexpr auto kIdleTimeout = std::chrono::milliseconds(100);
+  auto longest = congested_.empty() ? kIdleTimeout : kCongestionCheckInterval;
+  if (!pendingUdp_.empty()) {
+    longest = std::min<std::chrono::milliseconds>(longest, kUdpServiceInterval);
+  }
+  // Wake up for the next simulation tick, rounding down like the flush.
+  longest = std::clamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           nextTick_ - Clock::now()),
+                       std::chrono::milliseconds(0), longest);
+  // Backlogs are sent a batch per tick: come back quickly for the next.
+  if (!replaying_.empty()) {
+    return std::chrono::milliseconds(1);
+  }
+  if (pendingFlush_.empty()) {
+    return longest;
+  }
+  // Some clients still have unsent data and the poller cannot tell us when
+  // their sockets drain: come back quickly to retry.
+  if (flushInterval_.count() == 0) {
+    return std::chrono::milliseconds(1);
+  }
+  // Wake up in time for the flush.  Pollers count in milliseconds, so round
+  // down: polling without blocking for the last fraction of a millisecond
+  // is better than holding frames longer than promised.
+  const auto remaining = firstScheduled_ + flushInterval_ - Clock::now();
+  return std::clamp(
+      std::chrono::duration_cast<std::chrono::milliseconds>(remaining),
+      std::chrono::milliseconds(0), longest);
+}
+
+void ChatServer::FlushPending() {
+  // Sessions that cannot be flushed completely may be scheduled again while
+  // we iterate, so work on a copy of the list.
+  flushing_.swap(pendingFlush_);
+  if (flushInterval_.count() > 0) {
+    metrics_.flushDelayNs.Record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             firstScheduled_)
+            .count()));
+  }
+  if (poller_->BatchesSends()) {
+    FlushBatched();
+    flushing_.clear();
+    return;
+  }
+  for (const auto handle : flushing_) {
+    auto* session = sessions_.Get(handle);
+    if (session == nullptr) continue;
+    session->flushScheduled = false;
+    metrics_.outboundDepth.Record(session->outbound.Size());
+    const auto queuedBytes = session->outbound.SizeBytes();
+    const auto status = session->outbound.Flush(session->socket, &systemCalls_);
+    metrics_.bytesOut += queuedBytes - session->outbound.SizeBytes();
+    OnFlushed(handle, *session, status);
+  }
+  flushing_.clear();
+}
+
+void ChatServer::FlushBatched() {
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> buffers;
+  // Sessions whose write went through whole but that have more queued
+  // (over kMaxBatch frames) are appended to flushing_ for another round.
+  for (std::size_t next = 0; next < flushing_.size();) {
+    sending_.clear();
+    for (; next < flushing_.size(); ++next) {
+      auto* session = sessions_.Get(flushing_[next]);
+      if (session == nullptr) continue;
+      session->flushScheduled = false;
+      if (session->outbound.Empty()) continue;
+      const auto count = session->outbound.Gather(buffers);
+      if (!poller_->QueueSend(session->socket,
+                              std::span(buffers).first(count))) {
+        break;  // The batch is full: send it first.
+      }
+      metrics_.outboundDepth.Record(session->outbound.Size());
+      sending_.push_back(flushing_[next]);
+    }
+    const auto results = poller_->SubmitSends();
+    for (std::size_t i = 0; i < sending_.size(); ++i) {
+      auto* session = sessions_.Get(sending_[i]);
+      if (session == nullptr) continue;
+      const auto queuedBytes = session->outbound.SizeBytes();
+      const auto status = session->outbound.Complete(results[i]);
+      metrics_.bytesOut += queuedBytes - session->outbound.SizeBytes();
+      if (status == sf::Socket::Status::Partial) {
+        flushing_.push_back(sending_[i]);
+      } else {
+        OnFlushed(sending_[i], *session, status);
+      }
+    }
+  }
+}
+
+void ChatServer::OnFlushed(SlotHandle handle, Session& session,
+                           sf::Socket::Status status) {
+  switch (status) {
+    case sf::Socket::Status::Done:
+      break;
+    case sf::Socket::Status::NotReady:
+    case sf::Socket::Status::Partial:
+      // The client's socket buffer is full.  epoll reports the socket as
+      // writable once it drains; other pollers need a retry next tick.
+      ++metrics_.sendPartials;
+      if (!poller_->ReportsWritable()) {
+        ScheduleFlush(handle, session);
+      }
+      break;
+    case sf::Socket::Status::Error:
+      LOG_ERROR("Error sending, closing connection");
+      ++metrics_.sendFailures;
+      RemoveSession(handle);
+      break;
+    case sf::Socket::Status::Disconnected:
+      ++metrics_.sendFailures;
+      RemoveSession(handle);
+      break;
+  }
+}
+
+void ChatServer::ForwardToShards(const RelayedFrame& frame) {
+  if (peers_.empty() || frame.plain.Empty()) return;
+  // Every shard gets a reference to the same frame, not a copy.
+  for (auto& peer : peers_) {
+    ForwardToShard(peer, frame);
+  }
+}
+
+void ChatServer::ForwardToShard(Peer& peer, RelayedFrame frame) {
+  if (peer.backlog.empty() && peer.server->inbox_.TryPush(std::move(frame))) {
+    peer.server->waker_.Wake();
+  } else if (peer.backlog.size() < kForwardBacklog) {
+    // Never spin on a full inbox: its owner may be spinning on ours.
+    peer.backlog.push_back(std::move(frame));
+  } else {
+    ++metrics_.forwardsDropped;
+  }
+}
+
+void ChatServer::DrainForwards(Peer& peer) {
+  bool pushed = false;
+  while (!peer.backlog.empty() &&
+         peer.server->inbox_.TryPush(std::move(peer.backlog.front()))) {
+    peer.backlog.pop_front();
+    pushed = true;
+  }
+  if (pushed) {
+    peer.server->waker_.Wake();
+  }
+}
+
+void ChatServer::ExchangeWithShards() {
+  for (auto& peer : peers_) {
+    DrainForwards(peer);
+  }
+  // Frames from other shards go to our clients only: they have already
+  // been delivered everywhere else.
+  while (const auto frame = inbox_.TryPop()) {
+    const auto message = DecodeMessage(frame->plain.Payload());
+    if (!message) continue;
+    if (message->type == MessageType::STATE) {
+      SendStateToRoom(message->room, message->delivery, *frame);
+    } else if (message->type == MessageType::STATE_SET) {
+      // Checked by the shard that received it.  Sent to us either for our
+      // decision, as the owner, or with the owner's.
+      static_cast<void>(
+          ApplyStateSet(message->room, message->sender, message->text));
+      if (StateOwner(message->room) == nullptr) {
+        ForwardToShards(*frame);
+      }
+    } else {
+      SendToRoom(message->room, *frame);
+    }
+  }
+}
+
+void ChatServer::RemoveSession(SlotHandle handle) {
+  auto* session = sessions_.Get(handle);
+  if (session == nullptr) return;
+  if (!session->paused) {
+    poller_->Remove(session->socket);
+  }
+  LeaveAllRooms(handle, *session);
+  if (session->udpToken != 0) {
+    udpTokens_.erase(session->udpToken);
+  }
+  sessions_.Remove(handle);
+  ++metrics_.connectionsClosed;
+}
+
+void ChatServer::PublishMetrics() {
+  metrics_.sessions = sessions_.Size();
+  metrics_.systemCalls = systemCalls_ + poller_->SystemCalls();
+  metrics_.congestedSessions = congested_.size();
+  metrics_.pausedSessions = 0;
+  metrics_.outboundBytes = 0;
+  metrics_.largestOutboundBytes = 0;
+  for (auto [handle, session] : sessions_) {
+    const auto queued = session.outbound.SizeBytes();
+    metrics_.outboundBytes += queued;
+    metrics_.largestOutboundBytes =
+        std::max<std::uint64_t>(metrics_.largestOutboundBytes, queued);
+    metrics_.pausedSessions += session.paused ? 1 : 0;
+  }
+  const std::scoped_lock lock(metricsMutex_);
+  publishedMetrics_ = metrics_;
 }
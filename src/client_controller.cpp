@@ -1,30 +1,56 @@
 #include "client_controller.h"
 
-#include <print>
 #include <utility>
 
-ClientController::ClientController(std::unique_ptr<ClientViewInterface> view)
-    : view_(std::move(view)) {}
+#include "logger.h"
+
+ClientController::ClientController(std::unique_ptr<ClientViewInterface> view,
+                                   HistoryLimits historyLimits)
+    : model_(historyLimits), view_(std::move(view)) {}
 
 void ClientController::Run() {
-  if (!view_->Init()) {
+  if (!view_->Init() || !model_.Init()) {
     return;
   }
 
   while (!view_->ShouldQuit()) {
     view_->BeginFrame();
 
+    // The network thread has already received the messages: this only
+    // collects them, so it costs nothing when there are none.
+    model_.PollMessages();
+
     if (!model_.IsConnected()) {
-      if (view_->DrawConnectionPanel(serverAddress_, portNumber_)) {
+      if (view_->DrawConnectionPanel(serverAddress_, portNumber_,
+                                     model_.IsConnecting())) {
         if (!model_.Connect(serverAddress_, portNumber_)) {
-          std::print(stderr, "Failed to connect to {}:{}\n", serverAddress_, portNumber_);
+          LOG_ERROR("Failed to connect to {}:{}", serverAddress_, portNumber_);
         }
       }
     } else {
-      model_.PollMessages();
-      if (view_->DrawChatPanel(model_.GetMessages(), sendMessage_)) {
+
+      auto activeRoom = model_.GetActiveRoom();
+      const auto request = view_->DrawRoomPanel(model_.GetRooms(), activeRoom);
+      model_.SetActiveRoom(activeRoom);
+      switch (request.type) {
+        case RoomRequest::Type::NONE:
+          break;
+        case RoomRequest::Type::JOIN:
+          if (!model_.JoinRoom(request.room)) {
+            LOG_ERROR("Failed to join room {}", request.room);
+          }
+          break;
+        case RoomRequest::Type::LEAVE:
+          if (!model_.LeaveRoom(request.room)) {
+            LOG_ERROR("Failed to leave room {}", request.room);
+          }
+          break;
+      }
+
+      if (view_->DrawChatPanel(model_.GetActiveRoom(), model_.GetMessages(),
+                               sendMessage_)) {
         if (!model_.SendMessage(sendMessage_)) {
-          std::print(stderr, "Failed to send message\n");
+          LOG_ERROR("Failed to send message");
         }
       }
     }
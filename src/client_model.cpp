@@ -2,31 +2,289 @@
  * @file client_model.cpp
  * @brief Implementation of the client Model (data layer).
  *
- * Every method here is a thin wrapper around ChatClient, plus storage for
- * the received messages.  The Model isolates the Controller from low-level
+ * Every method here is a thin wrapper around the NetworkThread, plus the
+ * room bookkeeping, the negotiation of compressed text and storage for the
+ * received messages.  The Model isolates the Controller from low-level
  * networking details.
  */
 
 #include "client_model.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <format>
+
+#include "const.h"
+#include "logger.h"
+
+ClientModel::ClientModel(HistoryLimits historyLimits)
+    : historyLimits_(historyLimits) {}
+
+bool ClientModel::Init() { return network_.Start(); }
+
 bool ClientModel::Connect(std::string_view host, unsigned short port) {
-  return client_.Connect(host, port);
+  if (status_ != ConnectionStatus::NOT_CONNECTED) {
+    return false;
+  }
+  network_.Connect(host, port);
+  status_ = ConnectionStatus::CONNECTING;
+  return true;
 }
 
 bool ClientModel::SendMessage(std::string_view message) {
-  return client_.Send(message);
+  // Clamp the message to MAX_MESSAGE_LENGTH to keep chat lines short.
+  return Send(MessageType::CHAT, activeRoom_,
+              message.substr(0, std::min(message.size(), MAX_MESSAGE_LENGTH)));
+}
+
+bool ClientModel::SendState(std::string_view state, Delivery delivery) {
+  MessageView message;
+  message.type = MessageType::STATE;
+  message.delivery = delivery;
+  message.room = activeRoom_;
+  message.sequence = nextSequence_++;
+  message.timestampUs = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  message.text = state;
+  // Sized for a datagram, so that no state message is too long for UDP.
+  std::array<char, MAX_DATAGRAM_MESSAGE> buffer;
+  const auto size = EncodeMessage(message, buffer);
+  if (size == 0) {
+    return false;
+  }
+  network_.SendDatagram(delivery, std::string_view(buffer.data(), size));
+  return true;
+}
+
+bool ClientModel::SetSharedState(std::uint16_t key, std::string_view value) {
+  return SendStateSet(key, value, false);
+}
+
+bool ClientModel::RemoveSharedState(std::uint16_t key) {
+  return SendStateSet(key, {}, true);
+}
+
+bool ClientModel::JoinRoom(RoomId room) {
+  if (!Send(MessageType::JOIN_ROOM, room, {})) {
+    return false;
+  }
+  const auto it = std::ranges::lower_bound(rooms_, room);
+  if (it == rooms_.end() || *it != room) {
+    rooms_.insert(it, room);
+  }
+  activeRoom_ = room;
+  return true;
+}
+
+bool ClientModel::LeaveRoom(RoomId room) {
+  if (room == LOBBY_ROOM || !Send(MessageType::LEAVE_ROOM, room, {})) {
+    return false;
+  }
+  std::erase(rooms_, room);
+  receivedMessages_.erase(room);
+  sharedStates_.erase(room);
+  if (activeRoom_ == room) {
+    activeRoom_ = LOBBY_ROOM;
+  }
+  return true;
 }
 
 void ClientModel::PollMessages() {
-  // The socket is non-blocking, so Receive() returns std::nullopt when
-  // there is nothing to read.  We loop until the socket has no more data.
-  while (auto msg = client_.Receive()) {
-    receivedMessages_.push_back(std::move(*msg));
+  network_.FlushCommands();
+  // PollEvent() never blocks: it returns std::nullopt once the network
+  // thread has nothing more for us.
+  while (auto event = network_.PollEvent()) {
+    switch (event->type) {
+      case NetworkEvent::Type::CONNECTED:
+        status_ = ConnectionStatus::CONNECTED;
+        // Start from a clean slate: the server forgot our rooms when we left.
+        rooms_.clear();
+        receivedMessages_.clear();
+        states_.clear();
+        sharedStates_.clear();
+        // Offer compression; we send plain text until the server agrees.
+        deflate_ = false;
+        if (const auto offer = static_cast<char>(TextEncoding::DEFLATE);
+            !Send(MessageType::HELLO, LOBBY_ROOM,
+                  std::string_view(&offer, 1))) {
+          LOG_ERROR("Failed to negotiate compression");
+        }
+        if (!JoinRoom(LOBBY_ROOM)) {
+          LOG_ERROR("Failed to join the lobby");
+        }
+        break;
+      case NetworkEvent::Type::CONNECT_FAILED:
+        status_ = ConnectionStatus::NOT_CONNECTED;
+        LOG_ERROR("Failed to connect");
+        break;
+      case NetworkEvent::Type::DISCONNECTED:
+        status_ = ConnectionStatus::NOT_CONNECTED;
+        break;
+      case NetworkEvent::Type::MESSAGE:
+        HandlePayload(event->payload);
+        break;
+    }
+  }
+}
+
+MessageHistory::View ClientModel::GetMessages() const {
+  const auto it = receivedMessages_.find(activeRoom_);
+  return it == receivedMessages_.end() ? MessageHistory::View()
+                                       : it->second.GetView();
+}
+
+const std::map<ClientId, std::string>& ClientModel::GetStates() const {
+  return states_;
+}
+
+const StateReplica* ClientModel::GetSharedState(RoomId room) const {
+  const auto it = sharedStates_.find(room);
+  return it != sharedStates_.end() ? &it->second : nullptr;
+}
+
+std::span<const RoomId> ClientModel::GetRooms() const { return rooms_; }
+
+RoomId ClientModel::GetActiveRoom() const { return activeRoom_; }
+
+void ClientModel::SetActiveRoom(RoomId room) {
+  if (std::ranges::binary_search(rooms_, room)) {
+    activeRoom_ = room;
+  }
+}
+
+bool ClientModel::IsConnected() const {
+  return status_ == ConnectionStatus::CONNECTED;
+}
+
+bool ClientModel::IsConnecting() const {
+  return status_ == ConnectionStatus::CONNECTING;
+}
+
+bool ClientModel::Send(MessageType type, RoomId room, std::string_view text) {
+  MessageView message;
+  message.type = type;
+  message.room = room;
+  message.sequence = nextSequence_++;
+  message.timestampUs = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  message.text = text;
+  std::array<char, MAX_MESSAGE_LENGTH> compressed;
+  if (deflate_ && type == MessageType::CHAT &&
+      text.size() >= COMPRESSION_THRESHOLD) {
+    if (const auto size = compressor_.Compress(text, compressed); size > 0) {
+      message.encoding = TextEncoding::DEFLATE;
+      message.text = std::string_view(compressed.data(), size);
+    }
+  }
+  std::array<char, MESSAGE_HEADER_SIZE + MAX_MESSAGE_LENGTH> buffer{};
+  const auto size = EncodeMessage(message, buffer);
+  if (size == 0) {
+    return false;
   }
+  network_.Send(std::string_view(buffer.data(), size));
+  return true;
 }
 
-const std::vector<std::string>& ClientModel::GetMessages() const {
-  return receivedMessages_;
+bool ClientModel::SendStateSet(std::uint16_t key, std::string_view value,
+                               bool remove) {
+  std::array<char, StateEntrySchema::kFixedSize +
+                       ReplicatedState::kMaxValueSize>
+      entry;
+  std::size_t entrySize = 0;
+  if (!EncodeStateSet(key, value, remove, entry, entrySize)) {
+    return false;
+  }
+  MessageView message;
+  message.type = MessageType::STATE_SET;
+  message.room = activeRoom_;
+  message.sequence = nextSequence_++;
+  message.text = std::string_view(entry.data(), entrySize);
+  std::array<char, MESSAGE_HEADER_SIZE + entry.size()> buffer;
+  const auto size = EncodeMessage(message, buffer);
+  if (size == 0) {
+    return false;
+  }
+  network_.Send(std::string_view(buffer.data(), size));
+  return true;
 }
 
-bool ClientModel::IsConnected() const { return client_.IsConnected(); }
+void ClientModel::ApplyDelta(const MessageView& message) {
+  auto& replica = sharedStates_[message.room];
+  if (!replica.Apply(message.text)) {
+    LOG_WARNING("Dropping a state delta that does not apply");
+    return;
+  }
+  // Also for a stale delta: the server may not have our last ack.
+  MessageView ack;
+  ack.type = MessageType::STATE_ACK;
+  ack.room = message.room;
+  std::array<char, StateAckSchema::kFixedSize> text;
+  if (StateAckSchema::Encode(StateAck{replica.Version()}, text) == 0) return;
+  ack.text = std::string_view(text.data(), text.size());
+  std::array<char, MESSAGE_HEADER_SIZE + StateAckSchema::kFixedSize> buffer;
+  const auto size = EncodeMessage(ack, buffer);
+  // Losing an ack only makes the next delta longer.
+  network_.SendDatagram(Delivery::UNRELIABLE,
+                        std::string_view(buffer.data(), size));
+}
+
+void ClientModel::HandlePayload(std::string_view payload) {
+  auto message = DecodeMessage(payload);
+  if (message && message->type == MessageType::HELLO) {
+    deflate_ = message->text.size() == 1 &&
+               message->text[0] == static_cast<char>(TextEncoding::DEFLATE);
+    return;
+  }
+  // The server closes clients that do not answer its heartbeat.
+  if (message && message->type == MessageType::PING) {
+    if (!Send(MessageType::PONG, LOBBY_ROOM, {})) {
+      LOG_WARNING("Failed to answer a ping");
+    }
+    return;
+  }
+  if (message && message->type == MessageType::UDP_OPEN) {
+    if (const auto offer = UdpOfferSchema::Decode(message->text)) {
+      network_.OpenUdp(*offer);
+    }
+    return;
+  }
+  if (message && message->type == MessageType::STATE) {
+    if (std::ranges::binary_search(rooms_, message->room)) {
+      states_[message->sender].assign(message->text);
+    }
+    return;
+  }
+  if (message && message->type == MessageType::STATE_DELTA) {
+    if (std::ranges::binary_search(rooms_, message->room)) {
+      ApplyDelta(*message);
+    }
+    return;
+  }
+  // Messages for a room we just left may still be in flight: drop them.
+  if (!message || message->type != MessageType::CHAT ||
+      !std::ranges::binary_search(rooms_, message->room)) {
+    return;
+  }
+  std::array<char, MAX_FRAME_PAYLOAD> text;
+  if (message->encoding == TextEncoding::DEFLATE) {
+    const auto size = compressor_.Decompress(message->text, text);
+    if (!size) {
+      LOG_WARNING("Dropping a corrupt compressed message");
+      return;
+    }
+    message->text = std::string_view(text.data(), *size);
+  }
+  // Prefix the line with its sender, formatted on the stack.
+  std::array<char, 16 + MAX_FRAME_PAYLOAD> line;
+  const auto end = std::format_to_n(line.data(), line.size(), "[{}] {}",
+                                    message->sender, message->text)
+                       .out;
+  const auto size = static_cast<std::size_t>(end - line.data());
+  receivedMessages_.try_emplace(message->room, historyLimits_)
+      .first->second.Append(std::string_view(line.data(), size));
+}
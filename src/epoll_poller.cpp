@@ -0,0 +1,83 @@
+/**
+ * @file epoll_poller.cpp
+ * @brief Implementation of the edge-triggered epoll poller.
+ */
+
+#include "epoll_poller.h"
+
+#ifdef __linux__
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+
+EpollPoller::EpollPoller() : epollFd_(epoll_create1(EPOLL_CLOEXEC)) {
+  if (epollFd_ < 0) {
+    LOG_ERROR("epoll_create1 failed: {}", std::strerror(errno));
+  }
+  events_.reserve(kMaxEvents);
+}
+
+EpollPoller::~EpollPoller() {
+  if (epollFd_ >= 0) {
+    close(epollFd_);
+  }
+}
+
+bool EpollPoller::IsValid() const { return epollFd_ >= 0; }
+
+bool EpollPoller::Add(sf::Socket& socket, std::uint64_t token) {
+  epoll_event event{};
+  // EPOLLRDHUP reports a peer shutdown even if it sent no data with it.
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.u64 = token;
+  ++systemCalls_;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, socket.getNativeHandle(), &event) !=
+      0) {
+    LOG_ERROR("epoll_ctl(ADD) failed: {}", std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void EpollPoller::Remove(sf::Socket& socket) {
+  // Closing a descriptor also removes it, but sockets can be removed while
+  // still open (e.g. before a disconnect), so do it explicitly.
+  ++systemCalls_;
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, socket.getNativeHandle(), nullptr);
+}
+
+std::span<const PollEvent> EpollPoller::Wait(
+    std::chrono::milliseconds timeout) {
+  events_.clear();
+  ++systemCalls_;
+  const int count =
+      epoll_wait(epollFd_, rawEvents_.data(), static_cast<int>(kMaxEvents),
+                 static_cast<int>(timeout.count()));
+  if (count < 0) {
+    if (errno != EINTR) {
+      LOG_ERROR("epoll_wait failed: {}", std::strerror(errno));
+    }
+    return events_;
+  }
+  for (int i = 0; i < count; ++i) {
+    const auto& raw = rawEvents_[static_cast<std::size_t>(i)];
+    // Errors and hang-ups count as readable: the next receive() reports them.
+    const bool readable =
+        (raw.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+    const bool writable = (raw.events & EPOLLOUT) != 0;
+    events_.push_back({raw.data.u64, readable, writable});
+  }
+  return events_;
+}
+
+bool EpollPoller::IsEdgeTriggered() const { return true; }
+
+bool EpollPoller::ReportsWritable() const { return true; }
+
+std::uint64_t EpollPoller::SystemCalls() const { return systemCalls_; }
+
+#endif  // __linux__
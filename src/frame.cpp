@@ -0,0 +1,103 @@
+/**
+ * @file frame.cpp
+ * @brief Implementation of the length-prefixed framing layer.
+ */
+
+#include "frame.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+std::size_t EncodeFrame(std::string_view payload, std::span<char> out) {
+  if (payload.size() > MAX_FRAME_PAYLOAD ||
+      out.size() < FRAME_HEADER_SIZE + payload.size()) {
+    return 0;
+  }
+  // Big-endian ("network order") length, one byte at a time so that the
+  // result does not depend on the host endianness.
+  const auto length = static_cast<std::uint32_t>(payload.size());
+  out[0] = static_cast<char>((length >> 24) & 0xFF);
+  out[1] = static_cast<char>((length >> 16) & 0xFF);
+  out[2] = static_cast<char>((length >> 8) & 0xFF);
+  out[3] = static_cast<char>(length & 0xFF);
+  std::memcpy(out.data() + FRAME_HEADER_SIZE, payload.data(), payload.size());
+  return FRAME_HEADER_SIZE + payload.size();
+}
+
+FrameReader::FrameReader() : buffer_(RECEIVE_BUFFER_SIZE + MAX_FRAME_PAYLOAD) {}
+
+sf::Socket::Status FrameReader::ReceiveFrom(sf::TcpSocket& socket) {
+  // Restart at the beginning of the ring whenever it is empty, so the next
+  // receive gets the largest possible contiguous region.
+  if (readPos_ == writePos_) {
+    readPos_ = 0;
+    writePos_ = 0;
+  }
+  const auto freeSpace = RECEIVE_BUFFER_SIZE - BufferedSize();
+  const auto writeIndex = writePos_ & kMask;
+  const auto contiguous = std::min(freeSpace, RECEIVE_BUFFER_SIZE - writeIndex);
+  // The caller drains every complete frame before receiving again, and the
+  // ring is larger than one frame, so there is always some room left.
+  assert(contiguous > 0);
+
+  std::size_t received = 0;
+  const auto status =
+      socket.receive(buffer_.data() + writeIndex, contiguous, received);
+  if (status == sf::Socket::Status::Done) {
+    writePos_ += received;
+  }
+  return status;
+}
+
+std::optional<std::string_view> FrameReader::NextFrame() {
+  if (error_ || BufferedSize() < FRAME_HEADER_SIZE) {
+    return std::nullopt;
+  }
+
+  // The header itself may wrap around the end of the ring.
+  std::uint32_t length = 0;
+  for (std::size_t i = 0; i < FRAME_HEADER_SIZE; ++i) {
+    length = (length << 8) |
+             static_cast<unsigned char>(buffer_[(readPos_ + i) & kMask]);
+  }
+  if (length > MAX_FRAME_PAYLOAD) {
+    error_ = true;
+    return std::nullopt;
+  }
+  if (BufferedSize() < FRAME_HEADER_SIZE + length) {
+    return std::nullopt;  // Wait for the rest of the payload.
+  }
+
+  const auto start = (readPos_ + FRAME_HEADER_SIZE) & kMask;
+  if (start + length > RECEIVE_BUFFER_SIZE) {
+    // Make the payload contiguous by appending its wrapped part right after
+    // the end of the ring.
+    const auto wrapped = start + length - RECEIVE_BUFFER_SIZE;
+    std::memcpy(buffer_.data() + RECEIVE_BUFFER_SIZE, buffer_.data(), wrapped);
+  }
+  readPos_ += FRAME_HEADER_SIZE + length;
+  return std::string_view(buffer_.data() + start, length);
+}
+
+bool FrameReader::HasError() const { return error_; }
+
+std::size_t FrameReader::BufferedSize() const { return writePos_ - readPos_; }
+
+void FrameReader::CopyBuffered(std::string& out) const {
+  for (auto position = readPos_; position < writePos_; ++position) {
+    out.push_back(buffer_[position & kMask]);
+  }
+}
+
+bool FrameReader::Restore(std::string_view bytes) {
+  if (bytes.size() > RECEIVE_BUFFER_SIZE - BufferedSize()) return false;
+  if (bytes.empty()) return true;
+  // At most two copies: up to the end of the buffer, then from its start.
+  const auto offset = writePos_ & kMask;
+  const auto first = std::min(bytes.size(), RECEIVE_BUFFER_SIZE - offset);
+  std::memcpy(buffer_.data() + offset, bytes.data(), first);
+  std::memcpy(buffer_.data(), bytes.data() + first, bytes.size() - first);
+  writePos_ += bytes.size();
+  return true;
+}
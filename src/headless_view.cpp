@@ -0,0 +1,274 @@
+/**
+ * @file headless_view.cpp
+ * @brief Implementation of the scripted, windowless view.
+ */
+
+#include "headless_view.h"
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <thread>
+#include <utility>
+
+#include "logger.h"
+
+namespace {
+
+/// Split the first space-separated word off @p text.
+std::string_view NextWord(std::string_view& text) {
+  const auto start = text.find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    text = {};
+    return {};
+  }
+  text.remove_prefix(start);
+  const auto end = std::min(text.find(' '), text.size());
+  const auto word = text.substr(0, end);
+  text.remove_prefix(end);
+  return word;
+}
+
+bool ParseNumber(std::string_view word, std::uint64_t& value) {
+  const auto [end, error] =
+      std::from_chars(word.data(), word.data() + word.size(), value);
+  return error == std::errc() && end == word.data() + word.size();
+}
+
+/// Parse one non-empty script line.  @return false if it is invalid.
+bool ParseAction(std::string_view line, HeadlessAction& action) {
+  using Type = HeadlessAction::Type;
+  const auto command = NextWord(line);
+  const auto rest = [&line] {
+    return line.substr(std::min(line.find_first_not_of(' '), line.size()));
+  };
+  if (command == "connect") {
+    action.type = Type::CONNECT;
+    action.text = NextWord(line);
+    return !action.text.empty() && ParseNumber(NextWord(line), action.value) &&
+           action.value <= 65535;
+  }
+  if (command == "join" || command == "leave" || command == "select") {
+    action.type = command == "join"    ? Type::JOIN
+                  : command == "leave" ? Type::LEAVE
+                                       : Type::SELECT;
+    return ParseNumber(NextWord(line), action.value) &&
+           action.value <= std::numeric_limits<RoomId>::max();
+  }
+  if (command == "send") {
+    action.type = Type::SEND;
+    action.text = rest();
+    action.value = 1;
+    return true;
+  }
+  if (command == "send_many") {
+    action.type = Type::SEND;
+    if (!ParseNumber(NextWord(line), action.value)) return false;
+    action.text = rest();
+    return action.value > 0;
+  }
+  if (command == "wait" || command == "wait_messages") {
+    action.type =
+        command == "wait" ? Type::WAIT_FRAMES : Type::WAIT_MESSAGES;
+    return ParseNumber(NextWord(line), action.value);
+  }
+  if (command == "quit") {
+    action.type = Type::QUIT;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::optional<std::vector<HeadlessAction>> ParseHeadlessScript(
+    std::string_view script) {
+  std::vector<HeadlessAction> actions;
+  std::size_t lineNumber = 0;
+  while (!script.empty()) {
+    const auto end = std::min(script.find('\n'), script.size());
+    auto line = script.substr(0, end);
+    script.remove_prefix(std::min(end + 1, script.size()));
+    ++lineNumber;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.find_first_not_of(' ') == std::string_view::npos ||
+        line[line.find_first_not_of(' ')] == '#') {
+      continue;
+    }
+    HeadlessAction action;
+    if (!ParseAction(line, action)) {
+      LOG_ERROR("Invalid script line {}: {}", lineNumber, line);
+      return std::nullopt;
+    }
+    actions.push_back(std::move(action));
+  }
+  return actions;
+}
+
+HeadlessFeed MakeHeadlessFeed(std::vector<HeadlessAction> script) {
+  return [script = std::move(script),
+          next = std::size_t{0}]() mutable -> std::optional<HeadlessAction> {
+    if (next == script.size()) return std::nullopt;
+    return std::move(script[next++]);
+  };
+}
+
+HeadlessView::HeadlessView(HeadlessFeed feed, double frameRate)
+    : feed_(std::move(feed)) {
+  if (frameRate > 0.0) {
+    framePeriod_ = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / frameRate));
+  }
+}
+
+bool HeadlessView::Init() {
+  nextFrame_ = Clock::now();
+  NextAction();
+  return true;
+}
+
+void HeadlessView::Shutdown() {
+  LOG_INFO("Headless run: {} frames, poll p99 {} ns, processing p99 {} ns",
+           frameCount_, pollTimes_.Percentile(0.99),
+           processingTimes_.Percentile(0.99));
+}
+
+void HeadlessView::BeginFrame() {
+  frameStart_ = Clock::now();
+  polled_.reset();
+}
+
+void HeadlessView::EndFrame() {
+  const auto now = Clock::now();
+  const auto polled = polled_.value_or(now);
+  pollTimes_.Record(static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(polled - frameStart_)
+          .count()));
+  processingTimes_.Record(static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - polled)
+          .count()));
+  ++frameCount_;
+
+  if (action_ && action_->type == HeadlessAction::Type::WAIT_FRAMES) {
+    if (action_->value <= 1) {
+      NextAction();
+    } else {
+      --action_->value;
+    }
+  }
+
+  if (framePeriod_ != Clock::duration::zero()) {
+    // Catch up without bursting if a frame ran late.
+    nextFrame_ = std::max(nextFrame_ + framePeriod_, now);
+    std::this_thread::sleep_until(nextFrame_);
+  }
+}
+
+bool HeadlessView::DrawConnectionPanel(std::string& address,
+                                       unsigned short& port,
+                                       bool connecting) {
+  MarkPolled();
+  if (!action_ || action_->type == HeadlessAction::Type::WAIT_FRAMES) {
+    return false;
+  }
+  if (action_->type != HeadlessAction::Type::CONNECT) {
+    Fail("not connected");
+    return false;
+  }
+  if (!connectRequested_) {
+    address = action_->text;
+    port = static_cast<unsigned short>(action_->value);
+    connectRequested_ = true;
+    return true;
+  }
+  if (!connecting) {
+    Fail("connection failed");
+  }
+  return false;
+}
+
+RoomRequest HeadlessView::DrawRoomPanel(std::span<const RoomId> /*rooms*/,
+                                        RoomId& activeRoom) {
+  MarkPolled();
+  if (!action_) {
+    return {};
+  }
+  RoomRequest request;
+  const auto room = static_cast<RoomId>(action_->value);
+  switch (action_->type) {
+    case HeadlessAction::Type::CONNECT:
+      break;  // The room panel only shows once connected.
+    case HeadlessAction::Type::JOIN:
+      request = {RoomRequest::Type::JOIN, room};
+      break;
+    case HeadlessAction::Type::LEAVE:
+      request = {RoomRequest::Type::LEAVE, room};
+      break;
+    case HeadlessAction::Type::SELECT:
+      activeRoom = room;
+      break;
+    default:
+      return {};  // Handled by the chat panel or at the end of the frame.
+  }
+  NextAction();
+  return request;
+}
+
+bool HeadlessView::DrawChatPanel(RoomId /*activeRoom*/,
+                                 MessageHistory::View messages,
+                                 std::string& sendMessage) {
+  if (!action_) {
+    return false;
+  }
+  switch (action_->type) {
+    case HeadlessAction::Type::SEND:
+      sendMessage = action_->text;
+      if (action_->value <= 1) {
+        NextAction();
+      } else {
+        --action_->value;
+      }
+      return true;
+    case HeadlessAction::Type::WAIT_MESSAGES:
+      if (messages.size() >= action_->value) {
+        NextAction();
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+bool HeadlessView::ShouldQuit() const { return shouldQuit_; }
+
+bool HeadlessView::HasFailed() const { return failed_; }
+
+std::uint64_t HeadlessView::FrameCount() const { return frameCount_; }
+
+const Histogram& HeadlessView::PollTimes() const { return pollTimes_; }
+
+const Histogram& HeadlessView::ProcessingTimes() const {
+  return processingTimes_;
+}
+
+void HeadlessView::MarkPolled() {
+  if (!polled_) {
+    polled_ = Clock::now();
+  }
+}
+
+void HeadlessView::NextAction() {
+  connectRequested_ = false;
+  action_ = feed_();
+  if (!action_ || action_->type == HeadlessAction::Type::QUIT) {
+    action_.reset();
+    shouldQuit_ = true;
+  }
+}
+
+void HeadlessView::Fail(std::string_view reason) {
+  LOG_ERROR("Headless run stopped: {}", reason);
+  action_.reset();
+  failed_ = true;
+  shouldQuit_ = true;
+}
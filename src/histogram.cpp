@@ -0,0 +1,75 @@
+/**
+ * @file histogram.cpp
+ * @brief Implementation of the log-linear histogram.
+ *
+ * Values below kSubBuckets get one bucket each.  Above that, a value whose
+ * highest set bit is bit @c b is shifted right by (b - kSubBucketBits), which
+ * leaves a number between kSubBuckets and 2 * kSubBuckets - 1: its offset
+ * from kSubBuckets picks the sub-bucket, and the shift picks the group.
+ */
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+void Histogram::Record(std::uint64_t value) {
+  ++counts_[BucketOf(value)];
+  ++count_;
+  sum_ += value;
+  max_ = std::max(max_, value);
+}
+
+void Histogram::Merge(const Histogram& other) {
+  for (std::size_t i = 0; i < kBucketCount; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = std::max(max_, other.max_);
+}
+
+std::uint64_t Histogram::Count() const { return count_; }
+
+std::uint64_t Histogram::Sum() const { return sum_; }
+
+std::uint64_t Histogram::Max() const { return max_; }
+
+std::uint64_t Histogram::Percentile(double quantile) const {
+  if (count_ == 0) return 0;
+  const auto rank = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(
+             std::ceil(std::clamp(quantile, 0.0, 1.0) *
+                       static_cast<double>(count_))));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < kBucketCount; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::min(BucketUpperBound(i), max_);
+    }
+  }
+  return max_;
+}
+
+std::size_t Histogram::BucketOf(std::uint64_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+  const std::size_t shift = std::bit_width(value) - 1 - kSubBucketBits;
+  const std::size_t subBucket = (value >> shift) - kSubBuckets;
+  return (shift + 1) * kSubBuckets + subBucket;
+}
+
+std::uint64_t Histogram::BucketUpperBound(std::size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const auto shift = index / kSubBuckets - 1;
+  const auto lower = std::uint64_t{kSubBuckets + index % kSubBuckets} << shift;
+  return lower + ((std::uint64_t{1} << shift) - 1);
+}
+
+std::uint64_t Histogram::BucketCount(std::size_t index) const {
+  return counts_[index];
+}
@@ -0,0 +1,484 @@
+/**
+ * @file io_uring_poller.cpp
+ * @brief Implementation of the io_uring poller.
+ *
+ * liburing is not required: the three system calls and the ring layout are
+ * all in the kernel headers.
+ */
+
+#include "io_uring_poller.h"
+
+#ifdef IO_URING_POLLER_AVAILABLE
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+#include "logger.h"
+
+namespace {
+
+/// IORING_FEAT_REG_REG_RING, first reported by Linux 6.3, whose headers
+/// name it: older headers still build a poller for newer kernels.
+constexpr unsigned kLinux63Feature = 1U << 13;
+
+/// One mapping for both rings, completions never dropped, a timeout for
+/// io_uring_enter(), and the last one stands for a kernel that has
+/// multishot receive into buffer rings.
+constexpr unsigned kRequiredFeatures = IORING_FEAT_SINGLE_MMAP |
+                                       IORING_FEAT_NODROP |
+                                       IORING_FEAT_EXT_ARG | kLinux63Feature;
+
+// The kernel reads and writes the heads and tails concurrently.
+unsigned LoadAcquire(unsigned* value) {
+  return std::atomic_ref<unsigned>(*value).load(std::memory_order_acquire);
+}
+
+void StoreRelease(unsigned* value, unsigned newValue) {
+  std::atomic_ref<unsigned>(*value).store(newValue, std::memory_order_release);
+}
+
+template <typename T>
+T* At(void* base, std::uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}  // namespace
+
+IoUringPoller::IoUringPoller() {
+  io_uring_params params{};
+  // COOP_TASKRUN: completions are processed when we enter the kernel
+  // anyway, instead of interrupting the server thread.
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+                 IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = 4 * kEntries;
+  ++systemCalls_;
+  ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &params));
+  if (ringFd_ < 0) {
+    LOG_WARNING("io_uring_setup failed: {}", std::strerror(errno));
+    return;
+  }
+  if ((params.features & kRequiredFeatures) != kRequiredFeatures) {
+    LOG_WARNING("io_uring lacks multishot receive (Linux 6.3 or later)");
+    return;
+  }
+
+  ringSize_ = std::max<std::size_t>(
+      params.sq_off.array + params.sq_entries * sizeof(unsigned),
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+  ringMemory_ = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+  if (ringMemory_ == MAP_FAILED) {
+    ringMemory_ = nullptr;
+    LOG_ERROR("Cannot map the io_uring rings: {}", std::strerror(errno));
+    return;
+  }
+  sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG_ERROR("Cannot map the io_uring entries: {}", std::strerror(errno));
+    return;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+  sqHead_ = At<unsigned>(ringMemory_, params.sq_off.head);
+  sqTail_ = At<unsigned>(ringMemory_, params.sq_off.tail);
+  sqMask_ = *At<unsigned>(ringMemory_, params.sq_off.ring_mask);
+  sqEntries_ = params.sq_entries;
+  sqTailLocal_ = *sqTail_;
+  // Entries are submitted in order, so slot i of the array always names
+  // entry i.
+  auto* sqArray = At<unsigned>(ringMemory_, params.sq_off.array);
+  std::iota(sqArray, sqArray + sqEntries_, 0U);
+  cqHead_ = At<unsigned>(ringMemory_, params.cq_off.head);
+  cqTail_ = At<unsigned>(ringMemory_, params.cq_off.tail);
+  cqMask_ = *At<unsigned>(ringMemory_, params.cq_off.ring_mask);
+  cqes_ = At<io_uring_cqe>(ringMemory_, params.cq_off.cqes);
+
+  bufferRingSize_ = kBufferCount * sizeof(io_uring_buf);
+  void* bufferRing = mmap(nullptr, bufferRingSize_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (bufferRing == MAP_FAILED) {
+    LOG_ERROR("Cannot map the buffer ring: {}", std::strerror(errno));
+    return;
+  }
+  bufferRing_ = static_cast<io_uring_buf_ring*>(bufferRing);
+  bufferEntries_ = static_cast<io_uring_buf*>(bufferRing);
+  io_uring_buf_reg registration{};
+  registration.ring_addr = reinterpret_cast<std::uint64_t>(bufferRing);
+  registration.ring_entries = kBufferCount;
+  registration.bgid = kBufferGroup;
+  ++systemCalls_;
+  if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING,
+              &registration, 1) != 0) {
+    LOG_WARNING("Cannot register the buffer ring: {}", std::strerror(errno));
+    return;
+  }
+  buffers_.resize(kBufferCount * kBufferSize);
+  heldBuffers_.resize(kBufferCount);
+  std::iota(heldBuffers_.begin(), heldBuffers_.end(), std::uint16_t{0});
+  Recycle(heldBuffers_);
+
+  sends_.resize(kMaxSends);
+  sendResults_.reserve(kMaxSends);
+  valid_ = true;
+}
+
+IoUringPoller::~IoUringPoller() {
+  // Closing the ring cancels every request first.
+  if (ringFd_ >= 0) {
+    close(ringFd_);
+  }
+  if (bufferRing_ != nullptr) {
+    munmap(bufferRing_, bufferRingSize_);
+  }
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqesSize_);
+  }
+  if (ringMemory_ != nullptr) {
+    munmap(ringMemory_, ringSize_);
+  }
+}
+
+bool IoUringPoller::IsValid() const { return valid_; }
+
+bool IoUringPoller::Add(sf::Socket& socket, std::uint64_t token) {
+  if (byFd_.contains(socket.getNativeHandle())) return false;
+  Arm(Register(socket.getNativeHandle(), token, Op::POLL));
+  return true;
+}
+
+bool IoUringPoller::AddListener(sf::TcpListener& listener,
+                                std::uint64_t token) {
+  if (byFd_.contains(listener.getNativeHandle())) return false;
+  Arm(Register(listener.getNativeHandle(), token, Op::ACCEPT));
+  return true;
+}
+
+bool IoUringPoller::AddStream(sf::TcpSocket& socket, std::uint64_t token) {
+  if (byFd_.contains(socket.getNativeHandle())) return false;
+  Arm(Register(socket.getNativeHandle(), token, Op::RECEIVE));
+  return true;
+}
+
+void IoUringPoller::Remove(sf::Socket& socket) {
+  const auto found = byFd_.find(socket.getNativeHandle());
+  if (found == byFd_.end()) return;
+  const auto index = found->second;
+  byFd_.erase(found);
+  std::erase(rearm_, index);
+  auto& registration = registrations_[index];
+  registration.active = false;
+  // By user_data, not by descriptor: the caller closes the socket before
+  // the cancellation is submitted, and the descriptor may be reused.  The
+  // requests hold the socket open until then.
+  const auto cancel = [this, index](Op op) {
+    auto* sqe = NextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (std::uint64_t{index} << 8) | static_cast<std::uint8_t>(op);
+    sqe->user_data =
+        (std::uint64_t{index} << 8) | static_cast<std::uint8_t>(Op::CANCEL);
+    ++registrations_[index].inFlight;
+  };
+  if (registration.armed) {
+    cancel(registration.multishot);
+  }
+  if (registration.writeArmed) {
+    cancel(Op::WRITABLE);
+  }
+  if (registrations_[index].inFlight == 0) {
+    freeRegistrations_.push_back(index);
+  }
+}
+
+std::span<const PollEvent> IoUringPoller::Wait(
+    std::chrono::milliseconds timeout) {
+  // The caller is done with the events of the previous call.
+  Recycle(heldBuffers_);
+  for (const auto index : rearm_) {
+    if (registrations_[index].active && !registrations_[index].armed) {
+      Arm(index);
+    }
+  }
+  rearm_.clear();
+  events_.clear();
+  events_.swap(deferred_);
+  heldBuffers_.swap(deferredBuffers_);
+
+  // Completions waiting already: only submit, and do not even enter the
+  // kernel if nothing is queued.
+  const bool ready = !events_.empty() || LoadAcquire(cqTail_) != *cqHead_;
+  if (!ready || sqTailLocal_ != LoadAcquire(sqHead_)) {
+    __kernel_timespec timespec{};
+    timespec.tv_sec = timeout.count() / 1000;
+    timespec.tv_nsec = (timeout.count() % 1000) * 1'000'000;
+    io_uring_getevents_arg arg{};
+    arg.ts = reinterpret_cast<std::uint64_t>(&timespec);
+    const int result =
+        Enter(ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+              &arg, sizeof arg);
+    if (result < 0 && result != -ETIME && result != -EINTR) {
+      LOG_ERROR("io_uring_enter failed: {}", std::strerror(-result));
+    }
+  }
+  Reap(events_, heldBuffers_);
+  return events_;
+}
+
+bool IoUringPoller::IsEdgeTriggered() const { return true; }
+
+bool IoUringPoller::ReportsWritable() const { return true; }
+
+std::uint64_t IoUringPoller::SystemCalls() const { return systemCalls_; }
+
+bool IoUringPoller::CompletesIo() const { return true; }
+
+bool IoUringPoller::BatchesSends() const { return true; }
+
+bool IoUringPoller::QueueSend(sf::TcpSocket& socket,
+                              std::span<const std::span<const char>> buffers) {
+  if (sendCount_ == kMaxSends) return false;
+  auto& send = sends_[sendCount_];
+  const auto count = std::min(buffers.size(), kMaxSendBuffers);
+  send.bytes = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    // iovec is shared with readv(), hence the non-const pointer.
+    send.iov[i].iov_base = const_cast<char*>(buffers[i].data());
+    send.iov[i].iov_len = buffers[i].size();
+    send.bytes += buffers[i].size();
+  }
+  send.message = {};
+  send.message.msg_iov = send.iov.data();
+  send.message.msg_iovlen = count;
+  const auto found = byFd_.find(socket.getNativeHandle());
+  send.registration = found != byFd_.end() ? found->second : kNoRegistration;
+
+  auto* sqe = NextSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = socket.getNativeHandle();
+  sqe->addr = reinterpret_cast<std::uint64_t>(&send.message);
+  sqe->len = 1;
+  // MSG_DONTWAIT: fail with EAGAIN rather than wait in the kernel, so
+  // that SubmitSends() never blocks and the frames are free once it
+  // returns.
+  sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+  sqe->user_data =
+      (std::uint64_t{static_cast<std::uint32_t>(sendCount_)} << 8) |
+      static_cast<std::uint8_t>(Op::SEND);
+  ++sendCount_;
+  return true;
+}
+
+std::span<const std::int64_t> IoUringPoller::SubmitSends() {
+  sendResults_.assign(sendCount_, 0);
+  sendsOutstanding_ = sendCount_;
+  while (sendsOutstanding_ > 0) {
+    const int result = Enter(static_cast<unsigned>(sendsOutstanding_),
+                             IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (result < 0 && result != -EINTR && result != -EAGAIN &&
+        result != -EBUSY) {
+      LOG_ERROR("io_uring_enter failed: {}", std::strerror(-result));
+      break;
+    }
+    // Other completions wait for the next Wait().
+    Reap(deferred_, deferredBuffers_);
+  }
+  sendCount_ = 0;
+  return sendResults_;
+}
+
+io_uring_sqe* IoUringPoller::NextSqe() {
+  if (sqTailLocal_ - LoadAcquire(sqHead_) == sqEntries_) {
+    Enter(0, 0, nullptr, 0);  // Full: submit what is queued.
+  }
+  auto* sqe = &sqes_[sqTailLocal_ & sqMask_];
+  std::memset(sqe, 0, sizeof *sqe);
+  ++sqTailLocal_;
+  return sqe;
+}
+
+int IoUringPoller::Enter(unsigned minComplete, unsigned flags,
+                         const void* arg, std::size_t argSize) {
+  StoreRelease(sqTail_, sqTailLocal_);
+  const unsigned toSubmit = sqTailLocal_ - LoadAcquire(sqHead_);
+  ++systemCalls_;
+  const auto result = syscall(__NR_io_uring_enter, ringFd_, toSubmit,
+                              minComplete, flags, arg, argSize);
+  return result < 0 ? -errno : static_cast<int>(result);
+}
+
+std::uint32_t IoUringPoller::Register(int fd, std::uint64_t token,
+                                      Op multishot) {
+  std::uint32_t index = 0;
+  if (!freeRegistrations_.empty()) {
+    index = freeRegistrations_.back();
+    freeRegistrations_.pop_back();
+  } else {
+    index = static_cast<std::uint32_t>(registrations_.size());
+    registrations_.emplace_back();
+  }
+  registrations_[index] = {token, fd, multishot, true, false, false, 0};
+  byFd_[fd] = index;
+  return index;
+}
+
+void IoUringPoller::Arm(std::uint32_t index) {
+  auto* sqe = NextSqe();
+  auto& registration = registrations_[index];
+  sqe->fd = registration.fd;
+  switch (registration.multishot) {
+    case Op::POLL:
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->poll32_events = POLLIN;
+      sqe->len = IORING_POLL_ADD_MULTI;
+      break;
+    case Op::ACCEPT:
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      break;
+    default:
+      sqe->opcode = IORING_OP_RECV;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = kBufferGroup;
+      break;
+  }
+  sqe->user_data = (std::uint64_t{index} << 8) |
+                   static_cast<std::uint8_t>(registration.multishot);
+  registration.armed = true;
+  ++registration.inFlight;
+}
+
+void IoUringPoller::ArmWritable(std::uint32_t index) {
+  if (registrations_[index].writeArmed || !registrations_[index].active) {
+    return;
+  }
+  auto* sqe = NextSqe();
+  auto& registration = registrations_[index];
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = registration.fd;
+  sqe->poll32_events = POLLOUT;
+  sqe->user_data =
+      (std::uint64_t{index} << 8) | static_cast<std::uint8_t>(Op::WRITABLE);
+  registration.writeArmed = true;
+  ++registration.inFlight;
+}
+
+void IoUringPoller::Reap(std::vector<PollEvent>& events,
+                         std::vector<std::uint16_t>& held) {
+  auto head = *cqHead_;
+  const auto tail = LoadAcquire(cqTail_);
+  for (; head != tail; ++head) {
+    Complete(cqes_[head & cqMask_], events, held);
+  }
+  StoreRelease(cqHead_, head);
+}
+
+void IoUringPoller::Complete(const io_uring_cqe& cqe,
+                             std::vector<PollEvent>& events,
+                             std::vector<std::uint16_t>& held) {
+  const auto index = static_cast<std::uint32_t>(cqe.user_data >> 8);
+  const auto op = static_cast<Op>(cqe.user_data & 0xFF);
+  if (op == Op::SEND) {
+    sendResults_[index] = cqe.res;
+    --sendsOutstanding_;
+    const auto& send = sends_[index];
+    // A full socket buffer: tell the caller when it has room again.
+    if ((cqe.res == -EAGAIN ||
+         (cqe.res >= 0 && static_cast<std::size_t>(cqe.res) < send.bytes)) &&
+        send.registration != kNoRegistration) {
+      ArmWritable(send.registration);
+    }
+    return;
+  }
+  auto& registration = registrations_[index];
+  switch (op) {
+    case Op::POLL:
+      if (registration.active && cqe.res > 0) {
+        events.push_back({.token = registration.token});
+      }
+      break;
+    case Op::ACCEPT:
+      // Even for a removed listener: the caller owns the connection.
+      if (cqe.res >= 0) {
+        events.push_back({.token = registration.token, .accepted = cqe.res});
+      } else if (cqe.res != -ECANCELED) {
+        LOG_ERROR("accept failed: {}", std::strerror(-cqe.res));
+      }
+      break;
+    case Op::RECEIVE:
+      if ((cqe.flags & IORING_CQE_F_BUFFER) != 0) {
+        const auto buffer =
+            static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        held.push_back(buffer);
+        // Even for a removed stream: these bytes left the socket already.
+        if (cqe.res > 0) {
+          events.push_back(
+              {.token = registration.token,
+               .received = std::span<const char>(
+                   buffers_.data() + std::size_t{buffer} * kBufferSize,
+                   static_cast<std::size_t>(cqe.res))});
+        }
+      } else if (registration.active && cqe.res != -ENOBUFS &&
+                 cqe.res != -ECANCELED) {
+        events.push_back({.token = registration.token, .closed = true});
+      }
+      break;
+    case Op::WRITABLE:
+      registration.writeArmed = false;
+      if (registration.active && cqe.res > 0) {
+        events.push_back(
+            {.token = registration.token, .readable = false, .writable = true});
+      }
+      Release(index);
+      return;
+    default:  // Op::CANCEL
+      Release(index);
+      return;
+  }
+  if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+    registration.armed = false;
+    // The request stopped on its own, e.g. when the buffer ring ran out:
+    // start it again, unless the stream ended.
+    const bool ended = op == Op::RECEIVE && cqe.res <= 0 && cqe.res != -ENOBUFS;
+    if (registration.active && !ended) {
+      rearm_.push_back(index);
+    }
+    Release(index);
+  }
+}
+
+void IoUringPoller::Release(std::uint32_t index) {
+  auto& registration = registrations_[index];
+  if (--registration.inFlight == 0 && !registration.active) {
+    freeRegistrations_.push_back(index);
+  }
+}
+
+void IoUringPoller::Recycle(std::vector<std::uint16_t>& held) {
+  constexpr unsigned kMask = kBufferCount - 1;
+  for (const auto buffer : held) {
+    // Not the whole entry: the reserved field of the first one is the
+    // ring's tail.
+    auto& entry = bufferEntries_[bufferTail_ & kMask];
+    entry.addr = reinterpret_cast<std::uint64_t>(buffers_.data() +
+                                                 std::size_t{buffer} *
+                                                     kBufferSize);
+    entry.len = static_cast<std::uint32_t>(kBufferSize);
+    entry.bid = buffer;
+    ++bufferTail_;
+  }
+  std::atomic_ref<std::uint16_t>(bufferRing_->tail)
+      .store(bufferTail_, std::memory_order_release);
+  held.clear();
+}
+
+#endif  // IO_URING_POLLER_AVAILABLE
@@ -0,0 +1,114 @@
+/**
+ * @file logger.cpp
+ * @brief Background thread of the asynchronous logger.
+ */
+
+#include "logger.h"
+
+#include <cstdio>
+
+namespace {
+
+/// Sleep of the background thread when the ring is empty.
+constexpr auto kIdleSleep = std::chrono::milliseconds(5);
+
+std::string_view LevelName(LogLevel level) {
+  switch (level) {
+    case LogLevel::DEBUG:
+      return "DEBUG";
+    case LogLevel::INFO:
+      return "INFO";
+    case LogLevel::WARNING:
+      return "WARNING";
+    case LogLevel::ERROR:
+      return "ERROR";
+  }
+  return "?";
+}
+
+/// Append "HH:MM:SS.mmm" (UTC) for @p time.
+void AppendTime(std::string& out, std::chrono::system_clock::time_point time) {
+  using namespace std::chrono;
+  const auto sinceMidnight = time.time_since_epoch() % days(1);
+  const auto ms = duration_cast<milliseconds>(sinceMidnight).count();
+  std::format_to(std::back_inserter(out), "{:02}:{:02}:{:02}.{:03}",
+                 ms / 3'600'000, ms / 60'000 % 60, ms / 1000 % 60, ms % 1000);
+}
+
+void Write(std::string& batch, std::FILE* stream) {
+  if (batch.empty()) return;
+  std::fwrite(batch.data(), 1, batch.size(), stream);
+  std::fflush(stream);
+  batch.clear();
+}
+
+}  // namespace
+
+Logger& Logger::Instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger()
+    : thread_([this](std::stop_token stopToken) { Run(stopToken); }) {}
+
+Logger::~Logger() {
+  thread_.request_stop();
+  thread_.join();
+  Drain();  // Whatever was logged while the thread was stopping.
+}
+
+void Logger::SetLevel(LogLevel level) {
+  level_.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::IsEnabled(LogLevel level) const {
+  return level >= level_.load(std::memory_order_relaxed);
+}
+
+void Logger::Flush() {
+  const auto target = pushed_.load(std::memory_order_acquire);
+  while (written_.load(std::memory_order_acquire) < target) {
+    std::this_thread::sleep_for(kIdleSleep);
+  }
+}
+
+std::uint64_t Logger::DroppedCount() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+void Logger::Run(std::stop_token stopToken) {
+  while (!stopToken.stop_requested()) {
+    if (!Drain()) {
+      std::this_thread::sleep_for(kIdleSleep);
+    }
+  }
+}
+
+bool Logger::Drain() {
+  std::uint64_t count = 0;
+  while (auto record = ring_.TryPop()) {
+    auto& batch =
+        record->level >= LogLevel::WARNING ? stderrBatch_ : stdoutBatch_;
+    batch += '[';
+    AppendTime(batch, record->time);
+    std::format_to(std::back_inserter(batch), "] [{}] ",
+                   LevelName(record->level));
+    record->formatter(*record, batch);
+    batch += '\n';
+    ++count;
+  }
+
+  const auto dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != reportedDrops_) {
+    std::format_to(std::back_inserter(stderrBatch_),
+                   "[WARNING] Logger: {} records dropped (ring full)\n",
+                   dropped - reportedDrops_);
+    reportedDrops_ = dropped;
+  }
+
+  Write(stdoutBatch_, stdout);
+  Write(stderrBatch_, stderr);
+  written_.fetch_add(count, std::memory_order_release);
+  return count > 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file message_history.cpp
+ * @brief Implementation of the bounded chat history.
+ */
+
+#include "message_history.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+MessageHistory::MessageHistory(HistoryLimits limits)
+    : bytes_(limits.maxBytes), lines_(limits.maxLines) {
+  assert(limits.maxBytes > 0 && limits.maxLines > 0);
+}
+
+void MessageHistory::Append(std::string_view text) {
+  const std::uint64_t capacity = bytes_.size();
+  text = text.substr(0, std::min(text.size(), bytes_.size()));
+
+  // Skip the end of the ring if the line would not fit there in one piece.
+  auto position = writePosition_;
+  if (position % capacity + text.size() > capacity) {
+    position += capacity - position % capacity;
+  }
+  const auto end = position + text.size();
+
+  // Evict until both the line and its bytes fit.  The bytes in use run from
+  // the start of the oldest line to the end of the new one.
+  while (lineCount_ == lines_.size() ||
+         (lineCount_ > 0 && end - lines_[firstLine_].position > capacity)) {
+    EvictOldest();
+  }
+
+  if (!text.empty()) {
+    std::memcpy(bytes_.data() + position % capacity, text.data(),
+                text.size());
+  }
+  lines_[(firstLine_ + lineCount_) % lines_.size()] = {position, text.size()};
+  ++lineCount_;
+  writePosition_ = end;
+}
+
+void MessageHistory::Clear() {
+  firstLine_ = 0;
+  lineCount_ = 0;
+}
+
+std::size_t MessageHistory::Size() const { return lineCount_; }
+
+std::string_view MessageHistory::Line(std::size_t index) const {
+  assert(index < lineCount_);
+  const auto& line = lines_[(firstLine_ + index) % lines_.size()];
+  return {bytes_.data() + line.position % bytes_.size(), line.length};
+}
+
+MessageHistory::View MessageHistory::GetView() const { return View(*this); }
+
+void MessageHistory::EvictOldest() {
+  firstLine_ = (firstLine_ + 1) % lines_.size();
+  --lineCount_;
+}
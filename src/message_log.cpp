@@ -0,0 +1,469 @@
+/**
+ * @file message_log.cpp
+ * @brief Implementation of the memory-mapped message log.
+ */
+
+#include "message_log.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <string>
+#include <utility>
+
+#include "const.h"
+#include "logger.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Frames written before the writer looks at its sync and retention duties.
+constexpr std::size_t kMaxBatch = 1024;
+constexpr auto kIdleSleep = std::chrono::milliseconds(1);
+constexpr auto kRetentionCheckInterval = std::chrono::seconds(1);
+
+struct RecordHeader {
+  std::uint32_t size;
+  std::uint32_t checksum;
+  std::uint64_t offset;
+  std::uint64_t timestampUs;
+};
+static_assert(sizeof(RecordHeader) == 24);
+
+constexpr std::size_t kRecordAlignment = 8;
+
+constexpr std::size_t RecordSize(std::size_t payloadSize) {
+  return (sizeof(RecordHeader) + payloadSize + kRecordAlignment - 1) /
+         kRecordAlignment * kRecordAlignment;
+}
+
+/// FNV-1a, enough to tell a torn write from a record.
+std::uint32_t Checksum(std::string_view payload) {
+  std::uint32_t hash = 2166136261u;
+  for (const char c : payload) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+std::uint64_t NowUs() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+RecordHeader LoadHeader(const char* data) {
+  RecordHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  return header;
+}
+
+std::string_view LoadPayload(const char* data, const RecordHeader& header) {
+  return {data + sizeof(RecordHeader), header.size};
+}
+
+/// Parse a segment file name.  @return false if it is not one.
+bool ParseSegmentName(const std::filesystem::path& path,
+                      std::uint64_t& baseOffset) {
+  if (path.extension() != ".log") return false;
+  const auto stem = path.stem().string();
+  const auto [ptr, error] =
+      std::from_chars(stem.data(), stem.data() + stem.size(), baseOffset);
+  return error == std::errc() && ptr == stem.data() + stem.size();
+}
+
+}  // namespace
+
+MessageLog::Segment::~Segment() {
+#ifndef _WIN32
+  if (data != nullptr) munmap(data, capacity);
+  if (fd >= 0) close(fd);
+#endif
+}
+
+MessageLog::MessageLog(MessageLogConfig config) : config_(std::move(config)) {
+  config_.segmentBytes = std::max(config_.segmentBytes, kMinSegmentBytes);
+}
+
+MessageLog::~MessageLog() {
+  // Run() drains the queue once asked to stop.
+  if (thread_.joinable()) {
+    thread_.request_stop();
+    thread_.join();
+  }
+}
+
+bool MessageLog::Open() {
+#ifdef _WIN32
+  LOG_ERROR("The message log is not supported on this platform");
+  return false;
+#else
+  std::error_code error;
+  std::filesystem::create_directories(config_.directory, error);
+  if (error) {
+    LOG_ERROR("Cannot create the log directory: {}", error.message());
+    return false;
+  }
+
+  std::vector<std::pair<std::uint64_t, std::filesystem::path>> files;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(config_.directory, error)) {
+    std::uint64_t baseOffset = 0;
+    if (entry.is_regular_file() && ParseSegmentName(entry.path(), baseOffset)) {
+      files.emplace_back(baseOffset, entry.path());
+    }
+  }
+  if (error) {
+    LOG_ERROR("Cannot list the log directory: {}", error.message());
+    return false;
+  }
+  std::ranges::sort(files);
+
+  for (const auto& [baseOffset, path] : files) {
+    auto segment = MapSegment(path, baseOffset, 0, false);
+    if (segment == nullptr) return false;
+    ScanSegment(*segment);
+    segments_.push_back(std::move(segment));
+  }
+  if (segments_.empty()) {
+    auto segment = MapSegment(config_.directory / std::format("{:020}.log", 0),
+                              0, config_.segmentBytes, true);
+    if (segment == nullptr) return false;
+    segments_.push_back(std::move(segment));
+  }
+  nextOffset_ = segments_.back()->endOffset.load(std::memory_order_relaxed);
+  lastTimestampUs_ =
+      segments_.back()->lastTimestampUs.load(std::memory_order_relaxed);
+  LOG_INFO("Message log opened: {} segments, next offset {}", segments_.size(),
+           nextOffset_);
+
+  thread_ = std::jthread([this](std::stop_token stopToken) { Run(stopToken); });
+  return true;
+#endif
+}
+
+bool MessageLog::Append(SharedFrame frame) {
+  if (queue_.TryPush(std::move(frame))) return true;
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+std::uint64_t MessageLog::FirstOffset() const {
+  const std::scoped_lock lock(segmentsMutex_);
+  return segments_.empty() ? 0 : segments_.front()->baseOffset;
+}
+
+std::uint64_t MessageLog::EndOffset() const {
+  const std::scoped_lock lock(segmentsMutex_);
+  return segments_.empty()
+             ? 0
+             : segments_.back()->endOffset.load(std::memory_order_acquire);
+}
+
+std::optional<std::uint64_t> MessageLog::OffsetForTime(
+    std::uint64_t timestampUs) const {
+  const std::scoped_lock lock(segmentsMutex_);
+  for (const auto& segment : segments_) {
+    if (segment->lastTimestampUs.load(std::memory_order_acquire) <
+        timestampUs) {
+      continue;
+    }
+    // Start from the last indexed record written before timestampUs.
+    const auto entry = std::ranges::lower_bound(segment->index, timestampUs,
+                                                {}, &IndexEntry::timestampUs);
+    std::size_t position =
+        entry == segment->index.begin() ? 0 : std::prev(entry)->position;
+    const auto size = segment->size.load(std::memory_order_acquire);
+    while (position < size) {
+      const auto header = LoadHeader(segment->data + position);
+      if (header.timestampUs >= timestampUs) return header.offset;
+      position += RecordSize(header.size);
+    }
+  }
+  return std::nullopt;
+}
+
+std::size_t MessageLog::Read(
+    std::uint64_t offset, std::size_t maxCount,
+    const std::function<void(const LogRecord&)>& visit) const {
+  // Pin the segments to read under the lock, so retention cannot unmap
+  // them, then read without it.
+  std::vector<std::shared_ptr<Segment>> segments;
+  std::size_t position = 0;
+  {
+    const std::scoped_lock lock(segmentsMutex_);
+    auto it = std::ranges::upper_bound(segments_, offset, {},
+                                       [](const auto& segment) {
+                                         return segment->baseOffset;
+                                       });
+    if (it != segments_.begin()) --it;
+    if (it == segments_.end()) return 0;
+    const auto& index = (*it)->index;
+    const auto entry =
+        std::ranges::upper_bound(index, offset, {}, &IndexEntry::offset);
+    position = entry == index.begin() ? 0 : std::prev(entry)->position;
+    segments.assign(it, segments_.end());
+  }
+
+  std::size_t visited = 0;
+  for (const auto& segment : segments) {
+    const auto size = segment->size.load(std::memory_order_acquire);
+    while (position < size && visited < maxCount) {
+      const char* data = segment->data + position;
+      const auto header = LoadHeader(data);
+      if (header.offset >= offset) {
+        visit({header.offset, header.timestampUs, LoadPayload(data, header)});
+        ++visited;
+      }
+      position += RecordSize(header.size);
+    }
+    position = 0;
+  }
+  return visited;
+}
+
+std::uint64_t MessageLog::DroppedCount() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<MessageLog::Segment> MessageLog::MapSegment(
+    const std::filesystem::path& path, std::uint64_t baseOffset,
+    std::size_t capacity, bool create) {
+#ifdef _WIN32
+  (void)path, (void)baseOffset, (void)capacity, (void)create;
+  return nullptr;
+#else
+  auto segment = std::make_shared<Segment>();
+  segment->baseOffset = baseOffset;
+  segment->path = path;
+  segment->endOffset.store(baseOffset, std::memory_order_relaxed);
+  segment->fd = open(path.c_str(),
+                     O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0),
+                     0644);
+  if (segment->fd < 0) {
+    LOG_ERROR("Cannot open {}: {}", path.string(), std::strerror(errno));
+    return nullptr;
+  }
+  if (!create) {
+    struct stat status{};
+    if (fstat(segment->fd, &status) != 0) {
+      LOG_ERROR("Cannot stat {}: {}", path.string(), std::strerror(errno));
+      return nullptr;
+    }
+    capacity = static_cast<std::size_t>(status.st_size);
+  }
+  // A segment left empty by a crash right after its creation gets its size.
+  if (create || capacity < RecordSize(0)) {
+    capacity = std::max(capacity, config_.segmentBytes);
+    if (ftruncate(segment->fd, static_cast<off_t>(capacity)) != 0) {
+      LOG_ERROR("Cannot size {}: {}", path.string(), std::strerror(errno));
+      return nullptr;
+    }
+  }
+  void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    segment->fd, 0);
+  if (data == MAP_FAILED) {
+    LOG_ERROR("Cannot map {}: {}", path.string(), std::strerror(errno));
+    return nullptr;
+  }
+  segment->data = static_cast<char*>(data);
+  segment->capacity = capacity;
+  return segment;
+#endif
+}
+
+void MessageLog::ScanSegment(Segment& segment) {
+  std::size_t position = 0;
+  std::uint64_t offset = segment.baseOffset;
+  std::uint64_t lastTimestampUs = 0;
+  while (position + sizeof(RecordHeader) <= segment.capacity) {
+    const char* data = segment.data + position;
+    const auto header = LoadHeader(data);
+    if (header.size == 0 || header.size > MAX_FRAME_PAYLOAD ||
+        header.offset != offset ||
+        position + RecordSize(header.size) > segment.capacity ||
+        Checksum(LoadPayload(data, header)) != header.checksum) {
+      break;
+    }
+    if (position >= segment.nextIndexPosition) {
+      segment.index.push_back({offset, header.timestampUs, position});
+      segment.nextIndexPosition = position + kIndexIntervalBytes;
+    }
+    lastTimestampUs = header.timestampUs;
+    ++offset;
+    position += RecordSize(header.size);
+  }
+  // Clear what a crash may have left half-written after the last record,
+  // so that new records are never followed by stale bytes.
+  const auto tail = std::min(segment.capacity - position, RecordSize(0));
+  if (std::any_of(segment.data + position, segment.data + position + tail,
+                  [](char c) { return c != 0; })) {
+    LOG_WARNING("Discarding a damaged record at offset {} of {}", offset,
+                segment.path.string());
+    std::fill(segment.data + position, segment.data + segment.capacity, '\0');
+  }
+  segment.size.store(position, std::memory_order_relaxed);
+  segment.endOffset.store(offset, std::memory_order_relaxed);
+  segment.lastTimestampUs.store(lastTimestampUs, std::memory_order_relaxed);
+  segment.syncedSize = position;
+}
+
+void MessageLog::Run(std::stop_token stopToken) {
+  lastSync_ = Clock::now();
+  nextRetentionCheck_ = lastSync_ + kRetentionCheckInterval;
+  while (!stopToken.stop_requested()) {
+    std::size_t written = 0;
+    while (written < kMaxBatch) {
+      const auto frame = queue_.TryPop();
+      if (!frame) break;
+      WriteRecord(frame->Payload());
+      ++written;
+    }
+
+    const auto now = Clock::now();
+    // Group commit: one sync covers every record written since the last.
+    switch (config_.fsyncPolicy) {
+      case FsyncPolicy::NONE:
+        break;
+      case FsyncPolicy::EVERY_BATCH:
+        if (written > 0) Sync(*segments_.back());
+        break;
+      case FsyncPolicy::INTERVAL:
+        if (now - lastSync_ >= config_.fsyncInterval) {
+          Sync(*segments_.back());
+          lastSync_ = now;
+        }
+        break;
+    }
+    if (now >= nextRetentionCheck_) {
+      ApplyRetention();
+      nextRetentionCheck_ = now + kRetentionCheckInterval;
+    }
+    if (written == 0) {
+      std::this_thread::sleep_for(kIdleSleep);
+    }
+  }
+
+  while (const auto frame = queue_.TryPop()) {
+    WriteRecord(frame->Payload());
+  }
+  if (config_.fsyncPolicy != FsyncPolicy::NONE) {
+    Sync(*segments_.back());
+  }
+}
+
+void MessageLog::WriteRecord(std::string_view payload) {
+  if (failed_) return;
+  const auto recordSize = RecordSize(payload.size());
+  auto* segment = segments_.back().get();
+  auto position = segment->size.load(std::memory_order_relaxed);
+  if (position + recordSize > segment->capacity) {
+    if (!Rotate()) {
+      failed_ = true;
+      LOG_ERROR("Message log disabled after a write error");
+      return;
+    }
+    segment = segments_.back().get();
+    position = 0;
+  }
+
+  lastTimestampUs_ = std::max(lastTimestampUs_, NowUs());
+  const RecordHeader header{static_cast<std::uint32_t>(payload.size()),
+                            Checksum(payload), nextOffset_, lastTimestampUs_};
+  char* data = segment->data + position;
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + sizeof(header), payload.data(), payload.size());
+  if (position >= segment->nextIndexPosition) {
+    const std::scoped_lock lock(segmentsMutex_);
+    segment->index.push_back({nextOffset_, lastTimestampUs_, position});
+    segment->nextIndexPosition = position + kIndexIntervalBytes;
+  }
+  ++nextOffset_;
+  // Publish the record to the readers.
+  segment->lastTimestampUs.store(lastTimestampUs_, std::memory_order_release);
+  segment->endOffset.store(nextOffset_, std::memory_order_release);
+  segment->size.store(position + recordSize, std::memory_order_release);
+}
+
+bool MessageLog::Rotate() {
+  if (config_.fsyncPolicy != FsyncPolicy::NONE) {
+    Sync(*segments_.back());
+  }
+  auto segment =
+      MapSegment(config_.directory / std::format("{:020}.log", nextOffset_),
+                 nextOffset_, config_.segmentBytes, true);
+  if (segment == nullptr) return false;
+  {
+    const std::scoped_lock lock(segmentsMutex_);
+    segments_.push_back(std::move(segment));
+  }
+  ApplyRetention();
+  return true;
+}
+
+void MessageLog::Sync(Segment& segment) {
+#ifndef _WIN32
+  const auto size = segment.size.load(std::memory_order_relaxed);
+  if (size == segment.syncedSize) return;
+  // msync() wants a page-aligned start.
+  const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = segment.syncedSize / pageSize * pageSize;
+  if (msync(segment.data + begin, size - begin, MS_SYNC) != 0) {
+    LOG_ERROR("msync of {} failed: {}", segment.path.string(),
+              std::strerror(errno));
+    return;
+  }
+  segment.syncedSize = size;
+#else
+  (void)segment;
+#endif
+}
+
+void MessageLog::ApplyRetention() {
+  std::vector<std::shared_ptr<Segment>> removed;
+  {
+    const std::scoped_lock lock(segmentsMutex_);
+    std::uint64_t totalBytes = 0;
+    for (const auto& segment : segments_) {
+      totalBytes += segment->size.load(std::memory_order_relaxed);
+    }
+    const auto maxAgeUs = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            config_.retentionAge)
+            .count());
+    const auto nowUs = NowUs();
+    // The active segment is always kept.
+    while (segments_.size() > 1) {
+      const auto& oldest = *segments_.front();
+      const auto lastUs =
+          oldest.lastTimestampUs.load(std::memory_order_relaxed);
+      const bool tooOld = maxAgeUs > 0 && lastUs + maxAgeUs < nowUs;
+      if (totalBytes <= config_.retentionBytes && !tooOld) break;
+      totalBytes -= oldest.size.load(std::memory_order_relaxed);
+      removed.push_back(std::move(segments_.front()));
+      segments_.erase(segments_.begin());
+    }
+  }
+  // Readers may still hold a segment: it stays mapped until they let go.
+  for (const auto& segment : removed) {
+    std::error_code error;
+    std::filesystem::remove(segment->path, error);
+    if (error) {
+      LOG_WARNING("Cannot delete {}: {}", segment->path.string(),
+                  error.message());
+    } else {
+      LOG_INFO("Deleted log segment {}", segment->path.string());
+    }
+  }
+}
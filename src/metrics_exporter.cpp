@@ -0,0 +1,95 @@
+/**
+ * @file metrics_exporter.cpp
+ * @brief Implementation of the metrics admin socket and snapshot file.
+ */
+
+#include "metrics_exporter.h"
+
+#include <SFML/Network/SocketSelector.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <array>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <utility>
+
+#include "logger.h"
+
+MetricsExporter::MetricsExporter(Source source) : source_(std::move(source)) {}
+
+bool MetricsExporter::Start(unsigned short adminPort,
+                            std::string snapshotPath) {
+  if (adminPort != 0) {
+    if (listener_.listen(adminPort, sf::IpAddress::LocalHost) !=
+        sf::Socket::Status::Done) {
+      LOG_ERROR("Metrics: cannot listen on port {}", adminPort);
+      return false;
+    }
+    serving_ = true;
+  }
+  snapshotPath_ = std::move(snapshotPath);
+  thread_ = std::jthread([this](std::stop_token stopToken) { Run(stopToken); });
+  return true;
+}
+
+void MetricsExporter::Run(std::stop_token stopToken) {
+  sf::SocketSelector selector;
+  if (serving_) {
+    selector.add(listener_);
+  }
+  auto nextSnapshot = std::chrono::steady_clock::now();
+  while (!stopToken.stop_requested()) {
+    // Short waits so that Stop is noticed quickly; the thread is idle
+    // otherwise.
+    if (serving_ && selector.wait(sf::milliseconds(100)) &&
+        selector.isReady(listener_)) {
+      Serve();
+    } else if (!serving_) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (!snapshotPath_.empty() &&
+        std::chrono::steady_clock::now() >= nextSnapshot) {
+      WriteSnapshot();
+      nextSnapshot += kSnapshotInterval;
+    }
+  }
+}
+
+void MetricsExporter::Serve() {
+  sf::TcpSocket client;
+  if (listener_.accept(client) != sf::Socket::Status::Done) {
+    return;
+  }
+  // Whatever was asked, the answer is the metrics page.  Read what the
+  // client already sent so that closing does not reset the connection.
+  sf::SocketSelector selector;
+  selector.add(client);
+  if (selector.wait(sf::milliseconds(100))) {
+    std::array<char, 1024> request{};
+    std::size_t received = 0;
+    static_cast<void>(client.receive(request.data(), request.size(), received));
+  }
+  const auto body = source_();
+  const auto response = std::format(
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: {}\r\n\r\n{}",
+      body.size(), body);
+  static_cast<void>(client.send(response.data(), response.size()));
+}
+
+void MetricsExporter::WriteSnapshot() {
+  const auto temporaryPath = snapshotPath_ + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      LOG_ERROR("Metrics: cannot write {}", temporaryPath);
+      return;
+    }
+    file << source_();
+  }
+  // rename() replaces the old snapshot in one step.
+  if (std::rename(temporaryPath.c_str(), snapshotPath_.c_str()) != 0) {
+    LOG_ERROR("Metrics: cannot replace {}", snapshotPath_);
+  }
+}
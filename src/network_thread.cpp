@@ -0,0 +1,283 @@
+/**
+ * @file network_thread.cpp
+ * @brief Implementation of the client network thread.
+ */
+
+#include "network_thread.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <optional>
+#include <utility>
+
+#include "const.h"
+#include "logger.h"
+
+namespace {
+
+/// Poller timeout when nothing is pending.  Commands and socket data wake
+/// the thread earlier, so this only bounds how late a stop is noticed.
+constexpr auto kIdleWait = std::chrono::milliseconds(100);
+
+/// Poller timeout while events wait for the UI to make room.
+constexpr auto kBacklogWait = std::chrono::milliseconds(1);
+
+/// Poller timeout while the UDP channel has reliable messages in flight,
+/// for their retransmissions.
+constexpr auto kUdpWait = std::chrono::milliseconds(5);
+
+/// Poller timeout while frames wait for room in the socket: select() does
+/// not report when it becomes writable.
+constexpr auto kSendRetryWait = std::chrono::milliseconds(1);
+
+}  // namespace
+
+NetworkThread::~NetworkThread() {
+  if (thread_.joinable()) {
+    thread_.request_stop();
+    waker_.Wake();  // Do not wait for the poller timeout.
+  }
+}
+
+bool NetworkThread::Start() {
+  if (!waker_.Init() || !ResetPoller()) {
+    return false;
+  }
+  thread_ = std::jthread([this](std::stop_token stopToken) {
+    Run(std::move(stopToken));
+  });
+  return true;
+}
+
+void NetworkThread::Connect(std::string_view host, unsigned short port) {
+  PushCommand({NetworkCommand::Type::CONNECT, std::string(host), port});
+}
+
+void NetworkThread::Send(std::string_view message) {
+  PushCommand({NetworkCommand::Type::SEND, std::string(message), 0});
+}
+
+void NetworkThread::SendDatagram(Delivery delivery, std::string_view message) {
+  PushCommand({NetworkCommand::Type::SEND_DATAGRAM, std::string(message), 0,
+               delivery});
+}
+
+void NetworkThread::OpenUdp(const UdpOffer& offer) {
+  PushCommand({NetworkCommand::Type::OPEN_UDP, {}, offer.port,
+               Delivery::RELIABLE, offer.token});
+}
+
+void NetworkThread::Disconnect() {
+  PushCommand({NetworkCommand::Type::DISCONNECT, {}, 0});
+}
+
+void NetworkThread::FlushCommands() {
+  if (pendingCommands_.empty()) {
+    return;
+  }
+  while (!pendingCommands_.empty() &&
+         commands_.TryPush(std::move(pendingCommands_.front()))) {
+    pendingCommands_.pop_front();
+  }
+  waker_.Wake();
+}
+
+std::optional<NetworkEvent> NetworkThread::PollEvent() {
+  return events_.TryPop();
+}
+
+void NetworkThread::PushCommand(NetworkCommand command) {
+  // Same ordering rule as PushEvent().
+  if (pendingCommands_.empty() && commands_.TryPush(std::move(command))) {
+    waker_.Wake();
+    return;
+  }
+  pendingCommands_.push_back(std::move(command));
+  FlushCommands();
+}
+
+void NetworkThread::Run(std::stop_token stopToken) {
+  while (!stopToken.stop_requested()) {
+    auto timeout = backlog_.empty() ? kIdleWait : kBacklogWait;
+    if (udp_ != nullptr && udp_->Busy()) {
+      timeout = std::min(timeout, kUdpWait);
+    }
+    if (client_.HasPending()) {
+      timeout = std::min(timeout, kSendRetryWait);
+    }
+    for (const auto& event : poller_->Wait(timeout)) {
+      if (event.token == kWakerToken) {
+        waker_.Drain();
+      } else if (event.token == kUdpToken) {
+        ReceiveDatagrams();
+      } else if (event.readable) {
+        socketReadable_ = true;
+      }
+    }
+    // What the socket did not take last time goes before new messages.
+    if (client_.HasPending() && !client_.FlushPending()) {
+      CloseConnection();
+    }
+    while (auto command = commands_.TryPop()) {
+      HandleCommand(*command);
+    }
+    FlushBacklog();
+    // Leave the data in the socket while the UI is behind.
+    if (socketReadable_ && backlog_.empty()) {
+      ReceiveMessages();
+    }
+    // Also sends the acknowledgements, retransmissions and keep-alives.
+    if (udp_ != nullptr) {
+      FlushDatagrams();
+    }
+  }
+  client_.Disconnect();
+}
+
+void NetworkThread::HandleCommand(NetworkCommand& command) {
+  switch (command.type) {
+    case NetworkCommand::Type::CONNECT:
+      if (client_.IsConnected()) {
+        CloseConnection();
+      }
+      // Resolving and connecting block, but only this thread.
+      if (!client_.Connect(command.data, command.port)) {
+        PushEvent({NetworkEvent::Type::CONNECT_FAILED, {}});
+        break;
+      }
+      if (!poller_->Add(client_.GetSocket(), kSocketToken)) {
+        client_.Disconnect();
+        PushEvent({NetworkEvent::Type::CONNECT_FAILED, {}});
+        break;
+      }
+      socketReadable_ = true;  // The server may have written already.
+      PushEvent({NetworkEvent::Type::CONNECTED, {}});
+      break;
+    case NetworkCommand::Type::SEND:
+      if (client_.IsConnected() && !client_.Send(command.data)) {
+        LOG_ERROR("Failed to send message");
+        CloseConnection();
+      }
+      break;
+    case NetworkCommand::Type::SEND_DATAGRAM:
+      // Over TCP if the channel is down or the message too long for it.
+      if (udp_ != nullptr &&
+          udp_->Connected(std::chrono::steady_clock::now()) &&
+          udp_->Send(command.delivery, command.data)) {
+        break;
+      }
+      if (client_.IsConnected() && !client_.Send(command.data)) {
+        LOG_ERROR("Failed to send message");
+        CloseConnection();
+      }
+      break;
+    case NetworkCommand::Type::OPEN_UDP: {
+      const auto address = client_.GetSocket().getRemoteAddress();
+      if (!client_.IsConnected() || !address) break;
+      // A new offer (e.g. from a server that took over) replaces the
+      // channel.
+      if (udp_ != nullptr) {
+        poller_->Remove(udpSocket_);
+      }
+      udp_.reset();
+      udpSocket_.setBlocking(false);
+      if (udpSocket_.bind(sf::Socket::AnyPort) != sf::Socket::Status::Done ||
+          !poller_->Add(udpSocket_, kUdpToken)) {
+        LOG_WARNING("Cannot open a UDP channel, game state stays on TCP");
+        udpSocket_.unbind();
+        break;
+      }
+      udp_ = std::make_unique<UdpChannel>(command.token, true);
+      udpAddress_ = *address;
+      udpPort_ = command.port;
+      break;
+    }
+    case NetworkCommand::Type::DISCONNECT:
+      if (client_.IsConnected()) {
+        CloseConnection();
+      }
+      break;
+  }
+}
+
+void NetworkThread::ReceiveMessages() {
+  while (const auto message = client_.Receive()) {
+    PushEvent({NetworkEvent::Type::MESSAGE, std::string(*message)});
+    if (!backlog_.empty()) {
+      return;  // The queue is full: resume once the UI made room.
+    }
+  }
+  socketReadable_ = false;
+  // Receive() closes the socket itself when the server went away.
+  if (!client_.IsConnected()) {
+    CloseConnection();
+  }
+}
+
+void NetworkThread::ReceiveDatagrams() {
+  // One byte more than any valid datagram, so that a longer one, cut to
+  // the buffer size, is recognised and dropped.
+  std::array<char, MAX_DATAGRAM_SIZE + 1> buffer;
+  std::size_t size = 0;
+  std::optional<sf::IpAddress> address;
+  unsigned short port = 0;
+  while (udp_ != nullptr &&
+         udpSocket_.receive(buffer.data(), buffer.size(), size, address,
+                            port) == sf::Socket::Status::Done) {
+    if (size > MAX_DATAGRAM_SIZE || address != udpAddress_ ||
+        !udp_->Receive(std::string_view(buffer.data(), size),
+                       std::chrono::steady_clock::now())) {
+      continue;
+    }
+    while (const auto message = udp_->NextMessage()) {
+      PushEvent({NetworkEvent::Type::MESSAGE, std::string(*message)});
+    }
+  }
+}
+
+void NetworkThread::FlushDatagrams() {
+  const auto now = std::chrono::steady_clock::now();
+  while (const auto datagram = udp_->NextDatagram(now)) {
+    // Lost if the socket buffer is full, like on the network.
+    if (udpSocket_.send(datagram->data(), datagram->size(), udpAddress_,
+                        udpPort_) != sf::Socket::Status::Done) {
+      break;
+    }
+  }
+}
+
+void NetworkThread::PushEvent(NetworkEvent event) {
+  // Keep the order: nothing overtakes an event that is already waiting.
+  // A failed TryPush() leaves the event untouched.
+  if (!backlog_.empty() || !events_.TryPush(std::move(event))) {
+    backlog_.push_back(std::move(event));
+  }
+}
+
+void NetworkThread::FlushBacklog() {
+  while (!backlog_.empty() && events_.TryPush(std::move(backlog_.front()))) {
+    backlog_.pop_front();
+  }
+}
+
+void NetworkThread::CloseConnection() {
+  client_.Disconnect();
+  socketReadable_ = false;
+  // The channel belongs to the connection.
+  udp_.reset();
+  udpSocket_.unbind();
+  // The socket may already be closed, and select() must never watch a
+  // closed descriptor, so drop it by starting with a fresh poller.
+  if (!ResetPoller()) {
+    LOG_ERROR("Network thread: cannot recreate poller");
+  }
+  PushEvent({NetworkEvent::Type::DISCONNECTED, {}});
+}
+
+bool NetworkThread::ResetPoller() {
+  // Two sockets: select() costs no more than epoll here, works on every
+  // platform and cannot fail to initialise.
+  poller_ = CreatePoller(PollerBackend::SELECTOR);
+  return poller_->Add(waker_.ReadSocket(), kWakerToken);
+}
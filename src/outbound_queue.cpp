@@ -0,0 +1,154 @@
+/**
+ * @file outbound_queue.cpp
+ * @brief Implementation of the per-connection outbound queue.
+ */
+
+#include "outbound_queue.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include <array>
+#include <cerrno>
+
+void OutboundQueue::Push(SharedFrame frame, bool droppable) {
+  sizeBytes_ += frame.Bytes().size();
+  frames_.push_back({std::move(frame), droppable});
+}
+
+std::size_t OutboundQueue::DropOldest(std::size_t maxBytes) {
+  std::size_t dropped = 0;
+  auto it = frames_.begin();
+  if (frontOffset_ > 0 && it != frames_.end()) ++it;
+  // Erasing near the front of a deque only moves the few frames before it.
+  while (sizeBytes_ > maxBytes && it != frames_.end()) {
+    if (!it->droppable) {
+      ++it;
+      continue;
+    }
+    sizeBytes_ -= it->frame.Bytes().size();
+    it = frames_.erase(it);
+    ++dropped;
+  }
+  return dropped;
+}
+
+sf::Socket::Status OutboundQueue::Flush(sf::TcpSocket& socket,
+                                        std::uint64_t* sendCalls) {
+  while (!frames_.empty()) {
+#ifndef _WIN32
+    // Gather up to kMaxBatch frames into one sendmsg() call.
+    std::array<std::span<const char>, kMaxBatch> buffers;
+    const auto count = Gather(buffers);
+    std::array<iovec, kMaxBatch> iov{};
+    for (std::size_t i = 0; i < count; ++i) {
+      // iovec is shared with readv(), hence the non-const pointer.
+      iov[i].iov_base = const_cast<char*>(buffers[i].data());
+      iov[i].iov_len = buffers[i].size();
+    }
+    msghdr message{};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+    constexpr int kFlags = MSG_NOSIGNAL;  // Report EPIPE instead of SIGPIPE.
+#else
+    constexpr int kFlags = 0;  // SFML sets SO_NOSIGPIPE on these platforms.
+#endif
+    if (sendCalls != nullptr) {
+      ++*sendCalls;
+    }
+    const auto sent = sendmsg(socket.getNativeHandle(), &message, kFlags);
+    const auto status = Complete(sent < 0 ? -errno : sent);
+    if (status != sf::Socket::Status::Partial) {
+      return status;
+    }
+#else
+    // No gathered write through SFML: send the front frame on its own.
+    const auto bytes = frames_.front().frame.Bytes().subspan(frontOffset_);
+    std::size_t sent = 0;
+    if (sendCalls != nullptr) {
+      ++*sendCalls;
+    }
+    const auto status = socket.send(bytes.data(), bytes.size(), sent);
+    Consume(sent);
+    if (status == sf::Socket::Status::Partial) {
+      return sf::Socket::Status::NotReady;
+    }
+    if (status != sf::Socket::Status::Done) {
+      return status;
+    }
+#endif
+  }
+  return sf::Socket::Status::Done;
+}
+
+std::size_t OutboundQueue::Gather(
+    std::span<std::span<const char>, kMaxBatch> out) {
+  std::size_t count = 0;
+  gatheredBytes_ = 0;
+  for (const auto& entry : frames_) {
+    if (count == kMaxBatch) break;
+    out[count] = entry.frame.Bytes().subspan(count == 0 ? frontOffset_ : 0);
+    gatheredBytes_ += out[count].size();
+    ++count;
+  }
+  return count;
+}
+
+sf::Socket::Status OutboundQueue::Complete(std::int64_t result) {
+  if (result < 0) {
+    switch (-result) {
+      case EINTR:
+        return sf::Socket::Status::Partial;  // Nothing written: try again.
+      case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+      case EWOULDBLOCK:
+#endif
+        return sf::Socket::Status::NotReady;
+      case EPIPE:
+      case ECONNRESET:
+      case ENOTCONN:
+        return sf::Socket::Status::Disconnected;
+      default:
+        return sf::Socket::Status::Error;
+    }
+  }
+  const auto sent = static_cast<std::size_t>(result);
+  Consume(sent);
+  if (sent < gatheredBytes_) {
+    return sf::Socket::Status::NotReady;  // The socket buffer is full.
+  }
+  return frames_.empty() ? sf::Socket::Status::Done
+                         : sf::Socket::Status::Partial;
+}
+
+bool OutboundQueue::Empty() const { return frames_.empty(); }
+
+std::size_t OutboundQueue::Size() const { return frames_.size(); }
+
+std::size_t OutboundQueue::SizeBytes() const { return sizeBytes_; }
+
+void OutboundQueue::CopyPending(std::string& out) const {
+  for (const auto& entry : frames_) {
+    const auto bytes =
+        entry.frame.Bytes().subspan(&entry == &frames_.front() ? frontOffset_
+                                                               : 0);
+    out.append(bytes.data(), bytes.size());
+  }
+}
+
+void OutboundQueue::Consume(std::size_t count) {
+  sizeBytes_ -= count;
+  while (count > 0) {
+    const auto remaining = frames_.front().frame.Bytes().size() - frontOffset_;
+    if (count < remaining) {
+      frontOffset_ += count;
+      return;
+    }
+    count -= remaining;
+    frames_.pop_front();
+    frontOffset_ = 0;
+  }
+}
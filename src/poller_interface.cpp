@@ -0,0 +1,61 @@
+/**
+ * @file poller_interface.cpp
+ * @brief Factory for the available PollerInterface backends.
+ */
+
+#include "poller_interface.h"
+
+#include "epoll_poller.h"
+#include "io_uring_poller.h"
+#include "selector_poller.h"
+
+PollerBackend DefaultPollerBackend() {
+#ifdef __linux__
+  return PollerBackend::EPOLL;
+#else
+  return PollerBackend::SELECTOR;
+#endif
+}
+
+std::unique_ptr<PollerInterface> CreatePoller(PollerBackend backend) {
+  switch (backend) {
+    case PollerBackend::SELECTOR:
+      return std::make_unique<SelectorPoller>();
+    case PollerBackend::EPOLL:
+#ifdef __linux__
+      if (auto poller = std::make_unique<EpollPoller>(); poller->IsValid()) {
+        return poller;
+      }
+#endif
+      return nullptr;
+    case PollerBackend::IO_URING:
+#ifdef IO_URING_POLLER_AVAILABLE
+      if (auto poller = std::make_unique<IoUringPoller>();
+          poller->IsValid()) {
+        return poller;
+      }
+#endif
+      return nullptr;
+  }
+  return nullptr;
+}
+
+std::string_view PollerBackendName(PollerBackend backend) {
+  switch (backend) {
+    case PollerBackend::SELECTOR:
+      return "select";
+    case PollerBackend::EPOLL:
+      return "epoll";
+    case PollerBackend::IO_URING:
+      return "io_uring";
+  }
+  return "";
+}
+
+std::optional<PollerBackend> ParsePollerBackend(std::string_view name) {
+  for (const auto backend : {PollerBackend::SELECTOR, PollerBackend::EPOLL,
+                             PollerBackend::IO_URING}) {
+    if (name == PollerBackendName(backend)) return backend;
+  }
+  return std::nullopt;
+}
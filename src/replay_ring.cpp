@@ -0,0 +1,30 @@
+/**
+ * @file replay_ring.cpp
+ * @brief Implementation of the replay ring.
+ */
+
+#include "replay_ring.h"
+
+#include <algorithm>
+#include <utility>
+
+ReplayRing::ReplayRing(std::size_t capacity)
+    : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+void ReplayRing::Push(RelayedFrame frame) {
+  // Rings of quiet rooms stay small: the storage grows only as needed.
+  if (frames_.size() < capacity_) {
+    frames_.push_back(std::move(frame));
+  } else {
+    frames_[end_ % capacity_] = std::move(frame);
+  }
+  ++end_;
+}
+
+std::uint64_t ReplayRing::Begin() const { return end_ - frames_.size(); }
+
+std::uint64_t ReplayRing::End() const { return end_; }
+
+const RelayedFrame& ReplayRing::At(std::uint64_t position) const {
+  return frames_[position % capacity_];
+}
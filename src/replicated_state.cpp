@@ -0,0 +1,240 @@
+/**
+ * @file replicated_state.cpp
+ * @brief Implementation of the room state and its replicas.
+ */
+
+#include "replicated_state.h"
+
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+/// Encoded size of an entry holding @p value.
+std::size_t EntrySize(std::string_view value) {
+  return StateEntrySchema::kFixedSize + value.size();
+}
+
+/// One entry of a STATE_SET or STATE_DELTA text.
+struct WireEntry {
+  StateEntryHeader header;
+  std::string_view value;  ///< Empty for a removal.
+};
+
+/// Read the entry at the front of @p in and remove it from @p in.
+std::optional<WireEntry> NextEntry(std::string_view& in) {
+  if (in.size() < StateEntrySchema::kFixedSize) return std::nullopt;
+  const auto header =
+      StateEntrySchema::Decode(in.substr(0, StateEntrySchema::kFixedSize));
+  if (!header) return std::nullopt;
+  in.remove_prefix(StateEntrySchema::kFixedSize);
+  if (header->size == STATE_REMOVED_SIZE) return WireEntry{*header, {}};
+  if (header->size > ReplicatedState::kMaxValueSize ||
+      in.size() < header->size) {
+    return std::nullopt;
+  }
+  const WireEntry entry{*header, in.substr(0, header->size)};
+  in.remove_prefix(header->size);
+  return entry;
+}
+
+/// Append an entry to @p out at @p offset.  @return false if it is full.
+bool WriteEntry(const StateEntryHeader& header, std::string_view value,
+                std::span<char> out, std::size_t& offset) {
+  if (out.size() - offset < EntrySize(value)) return false;
+  if (StateEntrySchema::Encode(header, out.subspan(offset)) == 0) return false;
+  offset += StateEntrySchema::kFixedSize;
+  std::memcpy(out.data() + offset, value.data(), value.size());
+  offset += value.size();
+  return true;
+}
+
+}  // namespace
+
+bool ReplicatedState::ApplySet(ClientId owner, std::string_view entries) {
+  if (entries.empty()) {
+    RemoveOwner(owner);
+    return true;
+  }
+  while (!entries.empty()) {
+    const auto entry = NextEntry(entries);
+    if (!entry) return false;
+    const StateKey key{owner, entry->header.key};
+    const auto changed =
+        entry->header.size == STATE_REMOVED_SIZE
+            ? Change(key, std::nullopt)
+            : Change(key, entry->value);
+    if (!changed) return false;
+  }
+  return true;
+}
+
+void ReplicatedState::RemoveOwner(ClientId owner) {
+  // Change() may forget tombstones, and with them map nodes: collect the
+  // keys first.
+  std::vector<StateKey> keys;
+  for (auto it = entries_.lower_bound(StateKey{owner, 0});
+       it != entries_.end() && it->first.owner == owner; ++it) {
+    if (!it->second->removed) {
+      keys.push_back(it->first);
+    }
+  }
+  for (const auto key : keys) {
+    // Removing never exceeds the budget.
+    static_cast<void>(Change(key, std::nullopt));
+  }
+}
+
+StateVersion ReplicatedState::Version() const { return version_; }
+
+bool ReplicatedState::Empty() const { return liveBytes_ == 0; }
+
+std::size_t ReplicatedState::EncodeDelta(StateVersion base,
+                                         std::uint32_t tick,
+                                         std::span<char> out) const {
+  StateDeltaHeader header{base, version_, tick, 0};
+  std::size_t offset = StateDeltaSchema::kFixedSize;
+  // A client at version 0 has nothing, so its delta would be a snapshot
+  // plus useless tombstones.
+  bool reset = base == 0 || base < horizon_ || base > version_;
+  if (!reset) {
+    // The entries changed since base are at the end of the list.
+    auto first = changes_.end();
+    while (first != changes_.begin() && std::prev(first)->version > base) {
+      --first;
+    }
+    for (auto it = first; it != changes_.end() && !reset; ++it) {
+      reset = !EncodeEntry(*it, out, offset);
+    }
+  }
+  if (reset) {
+    header.base = 0;
+    header.flags = STATE_DELTA_RESET;
+    offset = StateDeltaSchema::kFixedSize;
+    for (const auto& entry : changes_) {
+      // Fits: the live entries stay within kMaxSnapshotBytes.
+      if (!entry.removed && !EncodeEntry(entry, out, offset)) return 0;
+    }
+  }
+  if (StateDeltaSchema::Encode(header, out) == 0) return 0;
+  return offset;
+}
+
+bool ReplicatedState::Change(StateKey key,
+                             std::optional<std::string_view> value) {
+  const auto found = entries_.find(key);
+  const bool live = found != entries_.end() && !found->second->removed;
+  if (!value) {
+    if (!live) return true;
+    auto& entry = *found->second;
+    liveBytes_ -= EntrySize(entry.value);
+    entry.value.clear();
+    entry.removed = true;
+    ++tombstones_;
+  } else {
+    const auto oldSize = live ? EntrySize(found->second->value) : 0;
+    if (liveBytes_ - oldSize + EntrySize(*value) > kMaxSnapshotBytes) {
+      return false;
+    }
+    // Rewriting the same value is no change: nothing to send.
+    if (live && found->second->value == *value) return true;
+    liveBytes_ = liveBytes_ - oldSize + EntrySize(*value);
+    if (found == entries_.end()) {
+      changes_.push_back(Entry{key, std::string(*value), 0, false});
+      entries_.emplace(key, std::prev(changes_.end()));
+    } else {
+      auto& entry = *found->second;
+      if (entry.removed) {
+        entry.removed = false;
+        --tombstones_;
+      }
+      entry.value.assign(*value);
+    }
+  }
+  // Newest change last.
+  const auto it = entries_.find(key)->second;
+  changes_.splice(changes_.end(), changes_, it);
+  it->version = ++version_;
+  if (tombstones_ > kMaxTombstones) {
+    PurgeTombstones();
+  }
+  return true;
+}
+
+void ReplicatedState::PurgeTombstones() {
+  // Each purge makes room for kMaxTombstones / 2 removals, so the walk
+  // over the live entries in front is paid once per as many removals.
+  for (auto it = changes_.begin();
+       it != changes_.end() && tombstones_ > kMaxTombstones / 2;) {
+    if (!it->removed) {
+      ++it;
+      continue;
+    }
+    horizon_ = it->version;
+    entries_.erase(it->key);
+    it = changes_.erase(it);
+    --tombstones_;
+  }
+}
+
+bool ReplicatedState::EncodeEntry(const Entry& entry, std::span<char> out,
+                                  std::size_t& offset) {
+  const StateEntryHeader header{
+      entry.key.owner, entry.key.key,
+      entry.removed ? STATE_REMOVED_SIZE
+                    : static_cast<std::uint16_t>(entry.value.size())};
+  return WriteEntry(header, entry.value, out, offset);
+}
+
+bool StateReplica::Apply(std::string_view delta) {
+  if (delta.size() < StateDeltaSchema::kFixedSize) return false;
+  const auto header =
+      StateDeltaSchema::Decode(delta.substr(0, StateDeltaSchema::kFixedSize));
+  if (!header) return false;
+  delta.remove_prefix(StateDeltaSchema::kFixedSize);
+  const bool reset = (header->flags & STATE_DELTA_RESET) != 0;
+  // A snapshot always applies: the server may have started the state over
+  // (e.g. after a handoff), with lower versions.
+  if (!reset) {
+    if (header->version <= version_) return true;  // Stale: already applied.
+    if (header->base > version_) return false;
+  }
+  // Check the whole delta before touching the entries.
+  for (auto rest = delta; !rest.empty();) {
+    if (!NextEntry(rest)) return false;
+  }
+  if (reset) {
+    entries_.clear();
+  }
+  while (!delta.empty()) {
+    const auto entry = NextEntry(delta);
+    const StateKey key{entry->header.owner, entry->header.key};
+    if (entry->header.size == STATE_REMOVED_SIZE) {
+      entries_.erase(key);
+    } else {
+      entries_[key].assign(entry->value);
+    }
+  }
+  version_ = header->version;
+  tick_ = header->tick;
+  return true;
+}
+
+StateVersion StateReplica::Version() const { return version_; }
+
+std::uint32_t StateReplica::Tick() const { return tick_; }
+
+const std::map<StateKey, std::string>& StateReplica::Entries() const {
+  return entries_;
+}
+
+bool EncodeStateSet(std::uint16_t key, std::string_view value, bool remove,
+                    std::span<char> out, std::size_t& offset) {
+  if (remove) {
+    return WriteEntry({NO_CLIENT, key, STATE_REMOVED_SIZE}, {}, out, offset);
+  }
+  if (value.size() > ReplicatedState::kMaxValueSize) return false;
+  return WriteEntry({NO_CLIENT, key, static_cast<std::uint16_t>(value.size())},
+                    value, out, offset);
+}
@@ -0,0 +1,70 @@
+/**
+ * @file reuse_port_listener.cpp
+ * @brief Implementation of the SO_REUSEPORT listener.
+ */
+
+#include "reuse_port_listener.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+
+bool ReusePortListener::IsSupported() {
+#if !defined(_WIN32) && defined(SO_REUSEPORT)
+  return true;
+#else
+  return false;
+#endif
+}
+
+sf::Socket::Status ReusePortListener::ListenShared(unsigned short port) {
+#if !defined(_WIN32) && defined(SO_REUSEPORT)
+  close();
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    LOG_ERROR("socket() failed: {}", std::strerror(errno));
+    return sf::Socket::Status::Error;
+  }
+  const int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+    LOG_ERROR("SO_REUSEPORT failed: {}", std::strerror(errno));
+    ::close(fd);
+    return sf::Socket::Status::Error;
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0) {
+    LOG_ERROR("Failed to listen on port {}: {}", port,
+               std::strerror(errno));
+    ::close(fd);
+    return sf::Socket::Status::Error;
+  }
+
+  // Hand the descriptor over to SFML, which from now on owns and closes it.
+  // create() resets the blocking mode to the one chosen with setBlocking().
+  create(fd);
+  return sf::Socket::Status::Done;
+#else
+  static_cast<void>(port);
+  return sf::Socket::Status::Error;
+#endif
+}
+
+void ReusePortListener::Adopt(sf::SocketHandle handle) {
+  close();
+  create(handle);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file room_index.cpp
+ * @brief Implementation of the room subscription index.
+ */
+
+#include "room_index.h"
+
+bool RoomIndex::Join(RoomId room, SlotHandle member) {
+  auto& entry = rooms_[room];
+  const bool added =
+      entry.positions.try_emplace(member.Pack(), entry.members.size()).second;
+  if (!added) return false;
+  entry.members.push_back(member);
+  return true;
+}
+
+bool RoomIndex::Leave(RoomId room, SlotHandle member) {
+  const auto roomIt = rooms_.find(room);
+  if (roomIt == rooms_.end()) return false;
+  auto& entry = roomIt->second;
+  const auto positionIt = entry.positions.find(member.Pack());
+  if (positionIt == entry.positions.end()) return false;
+  // Delivery order does not matter, so move the last member into the hole.
+  const auto position = positionIt->second;
+  entry.positions.erase(positionIt);
+  const auto last = entry.members.back();
+  entry.members.pop_back();
+  if (position < entry.members.size()) {
+    entry.members[position] = last;
+    entry.positions[last.Pack()] = position;
+  }
+  if (entry.members.empty()) {
+    rooms_.erase(roomIt);
+  }
+  return true;
+}
+
+std::span<const SlotHandle> RoomIndex::Members(RoomId room) const {
+  const auto it = rooms_.find(room);
+  if (it == rooms_.end()) return {};
+  return it->second.members;
+}
+
+bool RoomIndex::IsMember(RoomId room, SlotHandle member) const {
+  const auto it = rooms_.find(room);
+  return it != rooms_.end() && it->second.positions.contains(member.Pack());
+}
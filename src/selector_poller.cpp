@@ -0,0 +1,69 @@
+/**
+ * @file selector_poller.cpp
+ * @brief Implementation of the sf::SocketSelector poller.
+ */
+
+#include "selector_poller.h"
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+#include <algorithm>
+
+#include "logger.h"
+
+bool SelectorPoller::Add(sf::Socket& socket, std::uint64_t token) {
+#ifndef _WIN32
+  // select() cannot watch descriptors at or above FD_SETSIZE, and SFML only
+  // logs an error when asked to, so refuse them explicitly.
+  if (socket.getNativeHandle() >= FD_SETSIZE) {
+    LOG_ERROR("Socket {} exceeds FD_SETSIZE ({})",
+               socket.getNativeHandle(), FD_SETSIZE);
+    return false;
+  }
+#endif
+  selector_.add(socket);
+  registrations_.push_back({&socket, token});
+  return true;
+}
+
+void SelectorPoller::Remove(sf::Socket& socket) {
+  selector_.remove(socket);
+  const auto it =
+      std::ranges::find(registrations_, &socket, &Registration::socket);
+  if (it != registrations_.end()) {
+    // Order does not matter, so swap with the last entry and pop.
+    *it = registrations_.back();
+    registrations_.pop_back();
+  }
+}
+
+std::span<const PollEvent> SelectorPoller::Wait(
+    std::chrono::milliseconds timeout) {
+  events_.clear();
+  // sf::SocketSelector treats a zero timeout as "wait forever", so a
+  // non-blocking poll is expressed as the smallest non-zero timeout.
+  const auto selectorTimeout =
+      timeout.count() > 0
+          ? sf::milliseconds(static_cast<std::int32_t>(timeout.count()))
+          : sf::microseconds(1);
+  ++systemCalls_;
+  if (!selector_.wait(selectorTimeout)) {
+    return events_;  // Nothing became ready within the timeout.
+  }
+  // select() only tells us *that* something is ready, so we have to ask
+  // every registered socket.
+  for (const auto& registration : registrations_) {
+    if (selector_.isReady(*registration.socket)) {
+      events_.push_back({registration.token});
+    }
+  }
+  return events_;
+}
+
+bool SelectorPoller::IsEdgeTriggered() const { return false; }
+
+bool SelectorPoller::ReportsWritable() const { return false; }
+
+std::uint64_t SelectorPoller::SystemCalls() const { return systemCalls_; }
@@ -0,0 +1,245 @@
+/**
+ * @file server_metrics.cpp
+ * @brief Aggregation and Prometheus rendering of the server metrics.
+ */
+
+#include "server_metrics.h"
+
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <string_view>
+
+void ServerMetrics::Merge(const ServerMetrics& other) {
+  connectionsAccepted += other.connectionsAccepted;
+  connectionsClosed += other.connectionsClosed;
+  messagesIn += other.messagesIn;
+  bytesIn += other.bytesIn;
+  messagesOut += other.messagesOut;
+  bytesOut += other.bytesOut;
+  sendPartials += other.sendPartials;
+  sendFailures += other.sendFailures;
+  slowConsumerEvents += other.slowConsumerEvents;
+  framesDropped += other.framesDropped;
+  slowConsumerDisconnects += other.slowConsumerDisconnects;
+  pingsSent += other.pingsSent;
+  handshakeTimeouts += other.handshakeTimeouts;
+  idleTimeouts += other.idleTimeouts;
+  datagramsIn += other.datagramsIn;
+  datagramsOut += other.datagramsOut;
+  simulationTicks += other.simulationTicks;
+  simulationTicksSkipped += other.simulationTicksSkipped;
+  stateDeltas += other.stateDeltas;
+  stateDeltaBytes += other.stateDeltaBytes;
+  forwardsDropped += other.forwardsDropped;
+  logRecordsDropped += other.logRecordsDropped;
+  systemCalls += other.systemCalls;
+  waitTimeNs += other.waitTimeNs;
+  workTimeNs += other.workTimeNs;
+  sessions += other.sessions;
+  outboundBytes += other.outboundBytes;
+  congestedSessions += other.congestedSessions;
+  pausedSessions += other.pausedSessions;
+  largestOutboundBytes =
+      std::max(largestOutboundBytes, other.largestOutboundBytes);
+  tickDurationNs.Merge(other.tickDurationNs);
+  waitDurationNs.Merge(other.waitDurationNs);
+  outboundDepth.Merge(other.outboundDepth);
+  flushDelayNs.Merge(other.flushDelayNs);
+}
+
+namespace {
+
+constexpr std::string_view kPrefix = "simplechat_";
+
+/// Histogram buckets written: le = 2^n - 1 for n in [minBits, maxBits].
+/// Each is the end of a Histogram bucket, so the counts are exact.
+struct BucketRange {
+  unsigned minBits = 0;
+  unsigned maxBits = 0;
+};
+
+/// For durations in nanoseconds: about 1 us to 69 s.
+constexpr BucketRange kDurationBuckets{10, 36};
+/// For queue depths: 0 to about a million frames.
+constexpr BucketRange kDepthBuckets{0, 20};
+
+void AppendHeader(std::string& out, std::string_view name,
+                  std::string_view type, std::string_view help) {
+  std::format_to(std::back_inserter(out), "# HELP {}{} {}\n# TYPE {}{} {}\n",
+                 kPrefix, name, help, kPrefix, name, type);
+}
+
+/// One counter or gauge, one sample per shard.
+template <typename Getter>
+void AppendScalar(std::string& out, std::span<const ServerMetrics> shards,
+                  std::string_view name, std::string_view type,
+                  std::string_view help, Getter get) {
+  AppendHeader(out, name, type, help);
+  for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+    std::format_to(std::back_inserter(out), "{}{}{{shard=\"{}\"}} {}\n",
+                   kPrefix, name, shard, get(shards[shard]));
+  }
+}
+
+/**
+ * One histogram per shard.  Values are divided by @p scale (e.g. ns to
+ * seconds).  Every bucket of @p range is written at every scrape, empty or
+ * not: a series that only appeared once it was hit would have no earlier
+ * sample, and rate() or histogram_quantile() over it would undercount.
+ * Values above the range only count in +Inf.
+ */
+template <typename Getter>
+void AppendHistogram(std::string& out, std::span<const ServerMetrics> shards,
+                     std::string_view name, std::string_view help,
+                     double scale, BucketRange range, Getter get) {
+  AppendHeader(out, name, "histogram", help);
+  for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+    const Histogram& histogram = get(shards[shard]);
+    std::uint64_t cumulative = 0;
+    std::size_t next = 0;  // First Histogram bucket not counted yet.
+    for (auto bits = range.minBits; bits <= range.maxBits; ++bits) {
+      const auto bound = (std::uint64_t{1} << bits) - 1;
+      for (const auto last = Histogram::BucketOf(bound); next <= last;
+           ++next) {
+        cumulative += histogram.BucketCount(next);
+      }
+      std::format_to(
+          std::back_inserter(out), "{}{}_bucket{{shard=\"{}\",le=\"{}\"}} {}\n",
+          kPrefix, name, shard, static_cast<double>(bound) / scale,
+          cumulative);
+    }
+    std::format_to(std::back_inserter(out),
+                   "{}{}_bucket{{shard=\"{}\",le=\"+Inf\"}} {}\n"
+                   "{}{}_sum{{shard=\"{}\"}} {}\n"
+                   "{}{}_count{{shard=\"{}\"}} {}\n",
+                   kPrefix, name, shard, histogram.Count(), kPrefix, name,
+                   shard, static_cast<double>(histogram.Sum()) / scale,
+                   kPrefix, name, shard, histogram.Count());
+  }
+}
+
+}  // namespace
+
+std::string FormatPrometheus(std::span<const ServerMetrics> shards) {
+  constexpr double kNsPerSecond = 1e9;
+  std::string out;
+  AppendScalar(out, shards, "connections_accepted_total", "counter",
+               "Client connections accepted.",
+               [](const auto& m) { return m.connectionsAccepted; });
+  AppendScalar(out, shards, "connections_closed_total", "counter",
+               "Client connections closed.",
+               [](const auto& m) { return m.connectionsClosed; });
+  AppendScalar(out, shards, "messages_in_total", "counter",
+               "Frames received from clients.",
+               [](const auto& m) { return m.messagesIn; });
+  AppendScalar(out, shards, "bytes_in_total", "counter",
+               "Bytes of the frames received from clients.",
+               [](const auto& m) { return m.bytesIn; });
+  AppendScalar(out, shards, "messages_out_total", "counter",
+               "Frames queued for clients.",
+               [](const auto& m) { return m.messagesOut; });
+  AppendScalar(out, shards, "bytes_out_total", "counter",
+               "Bytes written to client sockets.",
+               [](const auto& m) { return m.bytesOut; });
+  AppendScalar(out, shards, "send_partials_total", "counter",
+               "Flushes cut short by a full socket buffer.",
+               [](const auto& m) { return m.sendPartials; });
+  AppendScalar(out, shards, "send_failures_total", "counter",
+               "Flushes that failed and closed the connection.",
+               [](const auto& m) { return m.sendFailures; });
+  AppendScalar(out, shards, "slow_consumer_events_total", "counter",
+               "Times a client queue went over the high watermark.",
+               [](const auto& m) { return m.slowConsumerEvents; });
+  AppendScalar(out, shards, "frames_dropped_total", "counter",
+               "Frames discarded because their client was too slow.",
+               [](const auto& m) { return m.framesDropped; });
+  AppendScalar(out, shards, "slow_consumer_disconnects_total", "counter",
+               "Clients closed because they were too slow.",
+               [](const auto& m) { return m.slowConsumerDisconnects; });
+  AppendScalar(out, shards, "pings_sent_total", "counter",
+               "Heartbeats sent to silent clients.",
+               [](const auto& m) { return m.pingsSent; });
+  AppendScalar(out, shards, "handshake_timeouts_total", "counter",
+               "Clients closed for sending no message after connecting.",
+               [](const auto& m) { return m.handshakeTimeouts; });
+  AppendScalar(out, shards, "idle_timeouts_total", "counter",
+               "Clients closed for staying silent despite a heartbeat.",
+               [](const auto& m) { return m.idleTimeouts; });
+  AppendScalar(out, shards, "datagrams_in_total", "counter",
+               "Datagrams received on the UDP channels of clients.",
+               [](const auto& m) { return m.datagramsIn; });
+  AppendScalar(out, shards, "datagrams_out_total", "counter",
+               "Datagrams sent on the UDP channels, including resent ones.",
+               [](const auto& m) { return m.datagramsOut; });
+  AppendScalar(out, shards, "simulation_ticks_total", "counter",
+               "Simulation ticks run.",
+               [](const auto& m) { return m.simulationTicks; });
+  AppendScalar(out, shards, "simulation_ticks_skipped_total", "counter",
+               "Simulation ticks skipped because the loop ran late.",
+               [](const auto& m) { return m.simulationTicksSkipped; });
+  AppendScalar(out, shards, "state_deltas_total", "counter",
+               "Shared state deltas sent to clients.",
+               [](const auto& m) { return m.stateDeltas; });
+  AppendScalar(out, shards, "state_delta_bytes_total", "counter",
+               "Bytes of the shared state deltas, message headers included.",
+               [](const auto& m) { return m.stateDeltaBytes; });
+  AppendScalar(out, shards, "forwards_dropped_total", "counter",
+               "Frames another shard never got, its inbox staying full.",
+               [](const auto& m) { return m.forwardsDropped; });
+  AppendScalar(out, shards, "log_records_dropped_total", "counter",
+               "Chat messages left out of the message log, its queue full.",
+               [](const auto& m) { return m.logRecordsDropped; });
+  AppendScalar(out, shards, "system_calls_total", "counter",
+               "System calls made to wait for sockets and for TCP I/O.",
+               [](const auto& m) { return m.systemCalls; });
+  AppendScalar(out, shards, "wait_seconds_total", "counter",
+               "Time the loop spent waiting for socket readiness.",
+               [](const auto& m) {
+                 return static_cast<double>(m.waitTimeNs) / kNsPerSecond;
+               });
+  AppendScalar(out, shards, "work_seconds_total", "counter",
+               "Time the loop spent handling sockets.",
+               [](const auto& m) {
+                 return static_cast<double>(m.workTimeNs) / kNsPerSecond;
+               });
+  AppendScalar(out, shards, "sessions", "gauge", "Connected clients.",
+               [](const auto& m) { return m.sessions; });
+  AppendScalar(out, shards, "outbound_bytes", "gauge",
+               "Bytes queued for clients and not sent yet.",
+               [](const auto& m) { return m.outboundBytes; });
+  AppendScalar(out, shards, "congested_sessions", "gauge",
+               "Clients whose queue is over the high watermark.",
+               [](const auto& m) { return m.congestedSessions; });
+  AppendScalar(out, shards, "paused_sessions", "gauge",
+               "Clients not read until their queue drains.",
+               [](const auto& m) { return m.pausedSessions; });
+  AppendScalar(out, shards, "largest_outbound_bytes", "gauge",
+               "Bytes queued for the client furthest behind.",
+               [](const auto& m) { return m.largestOutboundBytes; });
+  AppendHistogram(out, shards, "tick_duration_seconds",
+                  "Duration of one server tick.", kNsPerSecond,
+                  kDurationBuckets,
+                  [](const auto& m) -> const Histogram& {
+                    return m.tickDurationNs;
+                  });
+  AppendHistogram(out, shards, "wait_duration_seconds",
+                  "Time one tick spent waiting for socket readiness.",
+                  kNsPerSecond, kDurationBuckets,
+                  [](const auto& m) -> const Histogram& {
+                    return m.waitDurationNs;
+                  });
+  AppendHistogram(out, shards, "outbound_queue_depth",
+                  "Frames waiting in a client queue when it is flushed.", 1.0,
+                  kDepthBuckets,
+                  [](const auto& m) -> const Histogram& {
+                    return m.outboundDepth;
+                  });
+  AppendHistogram(out, shards, "flush_delay_seconds",
+                  "Time frames were held back to be sent together.",
+                  kNsPerSecond, kDurationBuckets,
+                  [](const auto& m) -> const Histogram& {
+                    return m.flushDelayNs;
+                  });
+  return out;
+}
@@ -0,0 +1,413 @@
+/**
+ * @file session_handoff.cpp
+ * @brief Implementation of the server handoff over a Unix socket.
+ */
+
+#include "session_handoff.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+#include "logger.h"
+#include "wire_schema.h"
+
+#ifndef _WIN32
+namespace {
+
+/// Starts the state, so that a stray connection is not taken for one.
+constexpr std::uint32_t kMagic = 0x53434831;  // "SCH1"
+/// Descriptors per SCM_RIGHTS message (the kernel allows up to 253).
+constexpr std::size_t kDescriptorsPerMessage = 128;
+constexpr std::uint64_t kMaxStateBytes = std::uint64_t{1} << 32;
+constexpr char kAcknowledgement = 1;
+
+struct StateRecord {
+  std::uint32_t magic = kMagic;
+  ClientId nextClientId = NO_CLIENT;
+  std::uint32_t sessionCount = 0;
+};
+using StateSchema =
+    WireSchema<&StateRecord::magic, &StateRecord::nextClientId,
+               &StateRecord::sessionCount>;
+
+/// Followed by the rooms, then the received and unsent bytes.
+struct SessionRecord {
+  ClientId clientId = NO_CLIENT;
+  std::uint8_t flags = 0;
+  std::uint32_t roomCount = 0;
+  std::uint32_t receivedSize = 0;
+  std::uint32_t unsentSize = 0;
+};
+using SessionSchema =
+    WireSchema<&SessionRecord::clientId, &SessionRecord::flags,
+               &SessionRecord::roomCount, &SessionRecord::receivedSize,
+               &SessionRecord::unsentSize>;
+
+constexpr std::uint8_t kDeflateFlag = 1;
+constexpr std::uint8_t kGreetedFlag = 2;
+
+/// Append the fixed-size @p record encoded by @p Schema to @p out.
+template <typename Schema>
+void AppendRecord(std::string& out, const typename Schema::Message& record) {
+  std::array<char, Schema::kFixedSize> buffer;
+  static_cast<void>(Schema::Encode(record, buffer));
+  out.append(buffer.data(), buffer.size());
+}
+
+/// Read a fixed-size record from the front of @p in.
+template <typename Schema>
+std::optional<typename Schema::Message> TakeRecord(std::string_view& in) {
+  if (in.size() < Schema::kFixedSize) return std::nullopt;
+  const auto record = Schema::Decode(in.substr(0, Schema::kFixedSize));
+  in.remove_prefix(Schema::kFixedSize);
+  return record;
+}
+
+/// Everything but the descriptors, which travel separately.
+std::string Serialize(const HandoffState& state) {
+  std::string out;
+  AppendRecord<StateSchema>(
+      out, {kMagic, state.nextClientId,
+            static_cast<std::uint32_t>(state.sessions.size())});
+  for (const auto& session : state.sessions) {
+    SessionRecord record;
+    record.clientId = session.clientId;
+    record.flags = static_cast<std::uint8_t>(
+        (session.deflate ? kDeflateFlag : 0) |
+        (session.greeted ? kGreetedFlag : 0));
+    record.roomCount = static_cast<std::uint32_t>(session.rooms.size());
+    record.receivedSize = static_cast<std::uint32_t>(session.received.size());
+    record.unsentSize = static_cast<std::uint32_t>(session.unsent.size());
+    AppendRecord<SessionSchema>(out, record);
+    for (const auto room : session.rooms) {
+      std::array<char, WireCodec<RoomId>::kSize> buffer;
+      WireCodec<RoomId>::Write(buffer.data(), room);
+      out.append(buffer.data(), buffer.size());
+    }
+    out += session.received;
+    out += session.unsent;
+  }
+  return out;
+}
+
+/// The reverse of Serialize().  @return false if @p in is malformed.
+bool Deserialize(std::string_view in, HandoffState& state) {
+  const auto header = TakeRecord<StateSchema>(in);
+  if (!header || header->magic != kMagic) return false;
+  state.nextClientId = header->nextClientId;
+  // Every session takes at least a record: a damaged count must not make
+  // us allocate billions of them.
+  if (std::uint64_t{header->sessionCount} * SessionSchema::kFixedSize >
+      in.size()) {
+    return false;
+  }
+  state.sessions.resize(header->sessionCount);
+  for (auto& session : state.sessions) {
+    const auto record = TakeRecord<SessionSchema>(in);
+    if (!record) return false;
+    session.clientId = record->clientId;
+    session.deflate = (record->flags & kDeflateFlag) != 0;
+    session.greeted = (record->flags & kGreetedFlag) != 0;
+    const auto roomBytes =
+        std::uint64_t{record->roomCount} * WireCodec<RoomId>::kSize;
+    if (in.size() <
+        roomBytes + record->receivedSize + record->unsentSize) {
+      return false;
+    }
+    session.rooms.resize(record->roomCount);
+    for (auto& room : session.rooms) {
+      room = WireCodec<RoomId>::Read(in.data());
+      in.remove_prefix(WireCodec<RoomId>::kSize);
+    }
+    session.received = in.substr(0, record->receivedSize);
+    in.remove_prefix(record->receivedSize);
+    session.unsent = in.substr(0, record->unsentSize);
+    in.remove_prefix(record->unsentSize);
+  }
+  return in.empty();
+}
+
+/// Make blocking calls on @p fd give up after HandoffListener::kTimeout.
+void SetTimeouts(int fd) {
+  timeval timeout{};
+  timeout.tv_sec = std::chrono::seconds(HandoffListener::kTimeout).count();
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/// @return false if @p path does not fit in a Unix socket address.
+bool MakeAddress(const std::filesystem::path& path, sockaddr_un& address) {
+  const auto& native = path.native();
+  if (native.size() >= sizeof(address.sun_path)) {
+    LOG_ERROR("Handoff socket path too long: {}", native);
+    return false;
+  }
+  address = {};
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, native.c_str(), native.size() + 1);
+  return true;
+}
+
+bool SendAll(int fd, std::string_view bytes) {
+  while (!bytes.empty()) {
+    const auto sent = send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes.remove_prefix(static_cast<std::size_t>(sent));
+  }
+  return true;
+}
+
+bool ReceiveAll(int fd, std::span<char> out) {
+  while (!out.empty()) {
+    const auto received = recv(fd, out.data(), out.size(), 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return false;
+    out = out.subspan(static_cast<std::size_t>(received));
+  }
+  return true;
+}
+
+/// Send @p descriptors, kDescriptorsPerMessage per message.
+bool SendDescriptors(int fd, std::span<const int> descriptors) {
+  while (!descriptors.empty()) {
+    const auto count = std::min(descriptors.size(), kDescriptorsPerMessage);
+    // Ancillary data needs at least one byte of ordinary data to travel.
+    char byte = 0;
+    iovec iov{&byte, 1};
+    std::array<char, CMSG_SPACE(sizeof(int) * kDescriptorsPerMessage)>
+        control{};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(header), descriptors.data(), sizeof(int) * count);
+    ssize_t sent = 0;
+    do {
+      sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != 1) return false;
+    descriptors = descriptors.subspan(count);
+  }
+  return true;
+}
+
+/// Receive descriptors sent by SendDescriptors() until @p out is full.
+/// @return The number received, which the caller owns.
+std::size_t ReceiveDescriptors(int fd, std::span<int> out) {
+  std::size_t total = 0;
+  while (total < out.size()) {
+    // One byte per message, so that recvmsg() never merges two of them.
+    char byte = 0;
+    iovec iov{&byte, 1};
+    std::array<char, CMSG_SPACE(sizeof(int) * kDescriptorsPerMessage)>
+        control{};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    ssize_t received = 0;
+    do {
+      received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received != 1) break;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+         header = CMSG_NXTHDR(&message, header)) {
+      if (header->cmsg_level != SOL_SOCKET ||
+          header->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      const auto count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (std::size_t i = 0; i < count; ++i) {
+        int descriptor = -1;
+        std::memcpy(&descriptor, CMSG_DATA(header) + i * sizeof(int),
+                    sizeof(int));
+        if (total < out.size()) {
+          out[total++] = descriptor;
+        } else {
+          close(descriptor);
+        }
+      }
+    }
+    if ((message.msg_flags & MSG_CTRUNC) != 0) break;
+  }
+  return total;
+}
+
+}  // namespace
+#endif
+
+HandoffListener::~HandoffListener() {
+#ifndef _WIN32
+  // Stop the thread before closing the socket it polls.
+  if (thread_.joinable()) {
+    thread_.request_stop();
+    thread_.join();
+  }
+  if (successorFd_ >= 0) close(successorFd_);
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+    // After a handoff the file belongs to the successor.
+    if (!handedOver_) {
+      std::error_code error;
+      std::filesystem::remove(path_, error);
+    }
+  }
+#endif
+}
+
+bool HandoffListener::Start(const std::filesystem::path& path) {
+#ifndef _WIN32
+  sockaddr_un address{};
+  if (!MakeAddress(path, address)) return false;
+  listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    LOG_ERROR("Handoff: socket() failed: {}", std::strerror(errno));
+    return false;
+  }
+  // The file of a predecessor (or of a crashed server) is in the way.
+  std::error_code error;
+  std::filesystem::remove(path, error);
+  if (bind(listenFd_, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listenFd_, 1) != 0) {
+    LOG_ERROR("Handoff: cannot listen on {}: {}", path.string(),
+              std::strerror(errno));
+    return false;
+  }
+  path_ = path;
+  thread_ = std::jthread([this](std::stop_token stopToken) { Run(stopToken); });
+  return true;
+#else
+  static_cast<void>(path);
+  return false;
+#endif
+}
+
+bool HandoffListener::Requested() const {
+  return requested_.load(std::memory_order_acquire);
+}
+
+bool HandoffListener::Complete(const HandoffState& state) {
+#ifndef _WIN32
+  if (!Requested()) return false;
+  std::vector<int> descriptors;
+  descriptors.reserve(state.sessions.size() + 1);
+  descriptors.push_back(state.listener);
+  for (const auto& session : state.sessions) {
+    descriptors.push_back(session.socket);
+  }
+  const auto body = Serialize(state);
+  std::array<char, WireCodec<std::uint64_t>::kSize> size;
+  WireCodec<std::uint64_t>::Write(size.data(), body.size());
+  char reply = 0;
+  const bool done =
+      SendAll(successorFd_, std::string_view(size.data(), size.size())) &&
+      SendAll(successorFd_, body) &&
+      SendDescriptors(successorFd_, descriptors) &&
+      ReceiveAll(successorFd_, std::span<char>(&reply, 1)) &&
+      reply == kAcknowledgement;
+  close(successorFd_);
+  successorFd_ = -1;
+  if (done) {
+    LOG_INFO("Handed {} sessions over to the successor", state.sessions.size());
+    handedOver_ = true;
+  } else {
+    LOG_ERROR("Handoff failed, still serving");
+    requested_.store(false, std::memory_order_release);
+  }
+  return done;
+#else
+  static_cast<void>(state);
+  return false;
+#endif
+}
+
+void HandoffListener::Run(std::stop_token stopToken) {
+#ifndef _WIN32
+  while (!stopToken.stop_requested()) {
+    // Short waits so that a stop is noticed quickly.  One successor at a
+    // time: the next is only accepted if this one failed.
+    if (Requested()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    pollfd entry{listenFd_, POLLIN, 0};
+    if (poll(&entry, 1, 100) <= 0) continue;
+    const int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    LOG_INFO("Successor connected, handing over");
+    SetTimeouts(fd);
+    successorFd_ = fd;
+    requested_.store(true, std::memory_order_release);
+  }
+#else
+  static_cast<void>(stopToken);
+#endif
+}
+
+std::optional<HandoffState> RequestHandoff(const std::filesystem::path& path) {
+#ifndef _WIN32
+  sockaddr_un address{};
+  if (!MakeAddress(path, address)) return std::nullopt;
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return std::nullopt;
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&address),
+              sizeof(address)) != 0) {
+    close(fd);
+    return std::nullopt;  // Nobody to take over from.
+  }
+  SetTimeouts(fd);
+
+  HandoffState state;
+  std::array<char, WireCodec<std::uint64_t>::kSize> size;
+  std::string body;
+  bool ok = ReceiveAll(fd, size);
+  const auto bodySize = WireCodec<std::uint64_t>::Read(size.data());
+  ok = ok && bodySize <= kMaxStateBytes;
+  if (ok) {
+    body.resize(bodySize);
+    ok = ReceiveAll(fd, body) && Deserialize(body, state);
+  }
+  std::vector<int> descriptors(ok ? state.sessions.size() + 1 : 0);
+  const auto received = ReceiveDescriptors(fd, descriptors);
+  ok = ok && received == descriptors.size() &&
+       SendAll(fd, std::string_view(&kAcknowledgement, 1));
+  close(fd);
+  if (!ok) {
+    for (std::size_t i = 0; i < received; ++i) {
+      close(descriptors[i]);
+    }
+    LOG_ERROR("Handoff from {} failed", path.string());
+    return std::nullopt;
+  }
+  state.listener = descriptors[0];
+  for (std::size_t i = 0; i < state.sessions.size(); ++i) {
+    state.sessions[i].socket = descriptors[i + 1];
+  }
+  return state;
+#else
+  static_cast<void>(path);
+  return std::nullopt;
+#endif
+}
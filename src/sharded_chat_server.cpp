@@ -0,0 +1,132 @@
+/**
+ * @file sharded_chat_server.cpp
+ * @brief Implementation of the multi-threaded, sharded server.
+ */
+
+#include "sharded_chat_server.h"
+
+#include <algorithm>
+
+#include "logger.h"
+#include "reuse_port_listener.h"
+
+ShardedChatServer::ShardedChatServer(std::size_t shardCount,
+                                     PollerBackend backend) {
+  if (shardCount > 1 && !ReusePortListener::IsSupported()) {
+    LOG_WARNING("SO_REUSEPORT unsupported, running a single shard");
+    shardCount = 1;
+  }
+  shardCount = std::max<std::size_t>(shardCount, 1);
+  // One pool per shard, so that making a frame never contends with the
+  // other threads.
+  for (std::size_t i = 0; i < shardCount; ++i) {
+    framePools_.push_back(std::make_shared<FramePool>());
+    shards_.push_back(
+        std::make_unique<ChatServer>(backend, framePools_.back()));
+  }
+}
+
+bool ShardedChatServer::Start(unsigned short port) {
+  if (shards_.size() == 1) {
+    return shards_.front()->Start(port);
+  }
+  for (auto& shard : shards_) {
+    if (!shard->Start(port, true)) {
+      return false;
+    }
+  }
+  std::vector<ChatServer*> peers;
+  for (auto& shard : shards_) {
+    peers.clear();
+    for (auto& other : shards_) {
+      if (other != shard) peers.push_back(other.get());
+    }
+    if (!shard->ConnectShards(peers)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ShardedChatServer::StartUdp(unsigned short port) {
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    // Port 0 lets the system choose a port for every shard.
+    const auto shardPort =
+        port == 0 ? port : static_cast<unsigned short>(port + i);
+    if (!shards_[i]->StartUdp(shardPort)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ShardedChatServer::SetFlushInterval(std::chrono::microseconds interval) {
+  for (auto& shard : shards_) {
+    shard->SetFlushInterval(interval);
+  }
+}
+
+void ShardedChatServer::SetCompression(bool enabled) {
+  for (auto& shard : shards_) {
+    shard->SetCompression(enabled);
+  }
+}
+
+void ShardedChatServer::SetMessageLog(const std::shared_ptr<MessageLog>& log) {
+  for (auto& shard : shards_) {
+    shard->SetMessageLog(log);
+  }
+}
+
+void ShardedChatServer::SetBackpressure(const BackpressureConfig& config) {
+  for (auto& shard : shards_) {
+    shard->SetBackpressure(config);
+  }
+}
+
+void ShardedChatServer::SetTimeouts(const TimeoutConfig& config) {
+  for (auto& shard : shards_) {
+    shard->SetTimeouts(config);
+  }
+}
+
+void ShardedChatServer::SetTickRate(unsigned hz) {
+  for (auto& shard : shards_) {
+    shard->SetTickRate(hz);
+  }
+}
+
+void ShardedChatServer::Run() {
+  // jthreads join when they go out of scope, i.e. once Stop() was called
+  // and shard 0 has left its loop below.
+  std::vector<std::jthread> threads;
+  for (std::size_t i = 1; i < shards_.size(); ++i) {
+    threads.emplace_back([this, shard = shards_[i].get()] {
+      while (running_.load(std::memory_order_relaxed)) {
+        shard->Update();
+      }
+    });
+  }
+  while (running_.load(std::memory_order_relaxed)) {
+    shards_.front()->Update();
+  }
+}
+
+void ShardedChatServer::Stop() {
+  running_.store(false, std::memory_order_relaxed);
+}
+
+std::size_t ShardedChatServer::ShardCount() const { return shards_.size(); }
+
+PollerBackend ShardedChatServer::Backend() const {
+  return shards_.front()->Backend();
+}
+
+std::vector<ServerMetrics> ShardedChatServer::MetricsSnapshots() const {
+  std::vector<ServerMetrics> snapshots;
+  snapshots.reserve(shards_.size());
+  for (const auto& shard : shards_) {
+    snapshots.push_back(shard->MetricsSnapshot());
+  }
+  return snapshots;
+}
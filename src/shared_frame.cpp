@@ -0,0 +1,143 @@
+/**
+ * @file shared_frame.cpp
+ * @brief Implementation of pooled, reference-counted frames.
+ */
+
+#include "shared_frame.h"
+
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <utility>
+
+char* SharedFrame::Block::Data() { return reinterpret_cast<char*>(this + 1); }
+
+SharedFrame::SharedFrame(Block* block) : block_(block) {}
+
+SharedFrame::SharedFrame(const SharedFrame& other) : block_(other.block_) {
+  if (block_ != nullptr) {
+    block_->refCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+SharedFrame& SharedFrame::operator=(const SharedFrame& other) {
+  if (this != &other) {
+    SharedFrame copy(other);
+    std::swap(block_, copy.block_);
+  }
+  return *this;
+}
+
+SharedFrame::SharedFrame(SharedFrame&& other) noexcept
+    : block_(std::exchange(other.block_, nullptr)) {}
+
+SharedFrame& SharedFrame::operator=(SharedFrame&& other) noexcept {
+  if (this != &other) {
+    Release();
+    block_ = std::exchange(other.block_, nullptr);
+  }
+  return *this;
+}
+
+SharedFrame::~SharedFrame() { Release(); }
+
+std::span<const char> SharedFrame::Bytes() const {
+  if (block_ == nullptr) return {};
+  return {block_->Data(), block_->size};
+}
+
+std::string_view SharedFrame::Payload() const {
+  const auto bytes = Bytes();
+  if (bytes.empty()) return {};
+  return {bytes.data() + FRAME_HEADER_SIZE, bytes.size() - FRAME_HEADER_SIZE};
+}
+
+bool SharedFrame::Empty() const { return block_ == nullptr; }
+
+void SharedFrame::Release() {
+  if (block_ == nullptr) return;
+  // acq_rel: the thread that frees the block must see every write made
+  // through the other references before it hands the block out again.
+  if (block_->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    block_->pool->Recycle(block_);
+  }
+  block_ = nullptr;
+}
+
+FramePool::~FramePool() {
+  assert(LiveCount() == 0 && "FramePool destroyed while frames are alive");
+  TakeReturned();
+  for (auto* head : freeLists_) {
+    while (head != nullptr) {
+      auto* next = head->nextFree;
+      head->~Block();
+      ::operator delete(head);
+      head = next;
+    }
+  }
+}
+
+SharedFrame FramePool::Make(std::string_view payload) {
+  if (payload.size() > MAX_FRAME_PAYLOAD) return {};
+  Block* block = Allocate(FRAME_HEADER_SIZE + payload.size());
+  block->size = static_cast<std::uint32_t>(EncodeFrame(
+      payload,
+      std::span<char>(block->Data(), kBlockSizes[block->sizeClass])));
+  return SharedFrame(block);
+}
+
+SharedFrame FramePool::MakeRaw(std::string_view bytes) {
+  if (bytes.size() > MAX_FRAME_SIZE) return {};
+  Block* block = Allocate(bytes.size());
+  std::memcpy(block->Data(), bytes.data(), bytes.size());
+  block->size = static_cast<std::uint32_t>(bytes.size());
+  return SharedFrame(block);
+}
+
+FramePool::Block* FramePool::Allocate(std::size_t frameSize) {
+  std::size_t sizeClass = 0;
+  while (kBlockSizes[sizeClass] < frameSize) ++sizeClass;
+
+  if (freeLists_[sizeClass] == nullptr) {
+    TakeReturned();
+  }
+  Block* block = freeLists_[sizeClass];
+  if (block != nullptr) {
+    freeLists_[sizeClass] = block->nextFree;
+  } else {
+    // Pool is empty for this class: grow it.  The frame bytes live right
+    // after the Block header in the same allocation.
+    void* memory = ::operator new(sizeof(Block) + kBlockSizes[sizeClass]);
+    block = new (memory) Block{};
+    block->sizeClass = sizeClass;
+    block->pool = this;
+  }
+
+  block->refCount.store(1, std::memory_order_relaxed);
+  liveCount_.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+std::size_t FramePool::LiveCount() const {
+  return liveCount_.load(std::memory_order_relaxed);
+}
+
+void FramePool::Recycle(Block* block) {
+  liveCount_.fetch_sub(1, std::memory_order_relaxed);
+  // release: the owner must see nextFree once it takes the list.
+  block->nextFree = returned_.load(std::memory_order_relaxed);
+  while (!returned_.compare_exchange_weak(block->nextFree, block,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+void FramePool::TakeReturned() {
+  auto* block = returned_.exchange(nullptr, std::memory_order_acquire);
+  while (block != nullptr) {
+    auto* next = block->nextFree;
+    block->nextFree = freeLists_[block->sizeClass];
+    freeLists_[block->sizeClass] = block;
+    block = next;
+  }
+}
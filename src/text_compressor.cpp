@@ -0,0 +1,105 @@
+/**
+ * @file text_compressor.cpp
+ * @brief Implementation of the chat text compressor.
+ */
+
+#include "text_compressor.h"
+
+// Makes z_stream::next_in a pointer to const.
+#define ZLIB_CONST
+#include <zlib.h>
+
+#include <algorithm>
+#include <string_view>
+
+#include "logger.h"
+
+namespace {
+
+/// Raw deflate (no zlib header or checksum: frames are already delimited
+/// and TCP checks the bytes), with a 4 KiB window, as large as a frame.
+constexpr int kWindowBits = -12;
+constexpr int kMemoryLevel = 8;
+
+/**
+ * Text that both sides expect to see often.  Deflate finds matches at a
+ * short distance more cheaply, so the most frequent strings come last.
+ * Changing it breaks compatibility: bump PROTOCOL_VERSION.
+ */
+constexpr std::string_view kDictionary =
+    "{\"type\":\"state\",\"board\":[[0,0,0],[0,0,0],[0,0,0]],\"players\":[{\""
+    "id\":1,\"name\":\"\",\"score\":0,\"ready\":false},{\"id\":2}],\"turn\":"
+    "1,\"position\":{\"x\":0,\"y\":0},\"move\":true,null}"
+    "Hello everyone! How are you? I'm fine, thanks. What about you? "
+    "Does anyone want to play a game? Yes, let's go. No, not now, sorry. "
+    "Good game, well played! See you later. Thank you, good luck, have fun. "
+    "I think that this is a good idea, but we should wait for the others. "
+    "the and you that have for not with this but are was what can just ";
+
+const Bytef* DictionaryData() {
+  return reinterpret_cast<const Bytef*>(kDictionary.data());
+}
+
+}  // namespace
+
+TextCompressor::TextCompressor()
+    : deflate_(std::make_unique<z_stream>()),
+      inflate_(std::make_unique<z_stream>()) {
+  if (deflateInit2(deflate_.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                   kWindowBits, kMemoryLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+    LOG_ERROR("deflateInit2 failed, messages will not be compressed");
+    deflate_.reset();
+  }
+  if (inflateInit2(inflate_.get(), kWindowBits) != Z_OK) {
+    LOG_ERROR("inflateInit2 failed, compressed messages will be rejected");
+    inflate_.reset();
+  }
+}
+
+TextCompressor::~TextCompressor() {
+  if (deflate_ != nullptr) deflateEnd(deflate_.get());
+  if (inflate_ != nullptr) inflateEnd(inflate_.get());
+}
+
+std::size_t TextCompressor::Compress(std::string_view text,
+                                     std::span<char> out) {
+  if (deflate_ == nullptr || text.empty()) return 0;
+  auto& stream = *deflate_;
+  // Reset keeps the allocated state: no allocation per message.
+  if (deflateReset(&stream) != Z_OK ||
+      deflateSetDictionary(&stream, DictionaryData(),
+                           static_cast<uInt>(kDictionary.size())) != Z_OK) {
+    return 0;
+  }
+  stream.next_in = reinterpret_cast<const Bytef*>(text.data());
+  stream.avail_in = static_cast<uInt>(text.size());
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  // Give deflate one byte less than the text: if it does not finish within
+  // that, compression is not worth it.
+  stream.avail_out =
+      static_cast<uInt>(std::min(out.size(), text.size() - 1));
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END) return 0;
+  return stream.total_out;
+}
+
+std::optional<std::size_t> TextCompressor::Decompress(std::string_view data,
+                                                      std::span<char> out) {
+  if (inflate_ == nullptr) return std::nullopt;
+  auto& stream = *inflate_;
+  // Raw inflate takes the dictionary up front.
+  if (inflateReset(&stream) != Z_OK ||
+      inflateSetDictionary(&stream, DictionaryData(),
+                           static_cast<uInt>(kDictionary.size())) != Z_OK) {
+    return std::nullopt;
+  }
+  stream.next_in = reinterpret_cast<const Bytef*>(data.data());
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+  // Anything but a complete stream that used all the input is rejected,
+  // including text that would overflow @p out.
+  if (inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.avail_in != 0) {
+    return std::nullopt;
+  }
+  return stream.total_out;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file timing_wheel.cpp
+ * @brief Implementation of the hierarchical timing wheel.
+ */
+
+#include "timing_wheel.h"
+
+#include <algorithm>
+
+TimingWheel::TimingWheel(Clock::duration resolution, Clock::time_point start)
+    : resolution_(std::max(resolution, Clock::duration(1))), start_(start) {}
+
+void TimingWheel::Arm(std::uint64_t token, Clock::time_point deadline) {
+  // Due timers wait for the next tick.
+  Insert({token, deadline}, std::max(TickOf(deadline), currentTick_ + 1));
+  ++size_;
+}
+
+void TimingWheel::Advance(Clock::time_point now,
+                          std::vector<Timer>& expired) {
+  const auto target = now <= start_ ? 0 : (now - start_) / resolution_;
+  const auto targetTick = static_cast<std::uint64_t>(target);
+  if (size_ == 0) {
+    // Nothing to cascade on the way.
+    currentTick_ = std::max(currentTick_, targetTick);
+    return;
+  }
+  while (currentTick_ < targetTick) {
+    ++currentTick_;
+    // Entering a new slot of a level empties it into the levels below.
+    // Highest level first, since its timers may land in the slot of the
+    // level below that is entered at the same tick.
+    for (std::size_t level = kLevels - 1; level > 0; --level) {
+      const auto shift = level * kSlotBits;
+      if ((currentTick_ & ((std::uint64_t{1} << shift) - 1)) != 0) continue;
+      auto& slot = slots_[level * kSlots + ((currentTick_ >> shift) % kSlots)];
+      scratch_.swap(slot);
+      for (const auto& timer : scratch_) {
+        Insert(timer, std::max(TickOf(timer.deadline), currentTick_));
+      }
+      scratch_.clear();
+    }
+    auto& slot = slots_[currentTick_ % kSlots];
+    scratch_.swap(slot);
+    for (const auto& timer : scratch_) {
+      const auto tick = TickOf(timer.deadline);
+      if (tick <= currentTick_) {
+        expired.push_back(timer);
+        --size_;
+      } else {
+        Insert(timer, tick);  // Beyond the range of the wheel: another round.
+      }
+    }
+    scratch_.clear();
+  }
+}
+
+std::size_t TimingWheel::Size() const { return size_; }
+
+std::uint64_t TimingWheel::TickOf(Clock::time_point time) const {
+  if (time <= start_) return 0;
+  // Rounded up, so that a timer never expires before its deadline.
+  return static_cast<std::uint64_t>((time - start_ + resolution_ -
+                                     Clock::duration(1)) /
+                                    resolution_);
+}
+
+void TimingWheel::Insert(const Timer& timer, std::uint64_t tick) {
+  // The level is given by the highest bits where the tick differs from the
+  // current one: below them, both are in the same slot of that level.
+  auto differing = (tick ^ currentTick_) >> kSlotBits;
+  std::size_t level = 0;
+  while (differing != 0 && level < kLevels - 1) {
+    differing >>= kSlotBits;
+    ++level;
+  }
+  slots_[level * kSlots + ((tick >> (level * kSlotBits)) % kSlots)].push_back(
+      timer);
+}
@@ -0,0 +1,249 @@
+/**
+ * @file udp_channel.cpp
+ * @brief Implementation of the UDP delivery classes.
+ */
+
+#include "udp_channel.h"
+
+#include <algorithm>
+#include <utility>
+
+UdpChannel::UdpChannel(std::uint64_t token, bool probe)
+    : token_(token), probe_(probe) {}
+
+std::optional<std::uint64_t> UdpChannel::PeekToken(std::string_view datagram) {
+  const auto view = DatagramSchema::Decode(datagram);
+  if (!view || view->version != PROTOCOL_VERSION) return std::nullopt;
+  return view->token;
+}
+
+bool UdpChannel::Send(Delivery delivery, std::string_view message) {
+  if (message.size() > MAX_DATAGRAM_MESSAGE) return false;
+  switch (delivery) {
+    case Delivery::UNRELIABLE:
+      queue_.push_back({DatagramKind::UNRELIABLE, 0, std::string(message)});
+      return true;
+    case Delivery::SEQUENCED:
+      queue_.push_back(
+          {DatagramKind::SEQUENCED, nextSequenced_++, std::string(message)});
+      return true;
+    case Delivery::RELIABLE:
+      if (sendNext_ - sendBase_ < kWindow) {
+        auto& slot = sendWindow_[sendNext_ % kWindow];
+        slot.message.assign(message);
+        slot.sends = 0;
+        slot.acked = false;
+        ++sendNext_;
+        return true;
+      }
+      if (backlog_.size() >= kMaxBacklog) return false;
+      backlog_.emplace_back(message);
+      return true;
+  }
+  return false;
+}
+
+bool UdpChannel::Receive(std::string_view datagram, Clock::time_point now) {
+  const auto view = DatagramSchema::Decode(datagram);
+  if (!view || view->version != PROTOCOL_VERSION || view->token != token_ ||
+      view->message.size() > MAX_DATAGRAM_MESSAGE) {
+    return false;
+  }
+  switch (view->kind) {
+    case DatagramKind::ACK:
+      break;
+    case DatagramKind::PROBE:
+      ackDue_ = true;
+      break;
+    case DatagramKind::UNRELIABLE:
+      current_ = view->message;
+      currentPending_ = true;
+      break;
+    case DatagramKind::SEQUENCED:
+      if (!sequencedReceived_ || After(view->sequence, lastSequenced_)) {
+        sequencedReceived_ = true;
+        lastSequenced_ = view->sequence;
+        current_ = view->message;
+        currentPending_ = true;
+      }
+      break;
+    case DatagramKind::RELIABLE: {
+      // Acknowledge even duplicates: the sender did not get our last ack.
+      ackDue_ = true;
+      // Older messages wrap around to a large offset.
+      const auto offset = view->sequence - receiveNext_;
+      if (offset == 0) {
+        current_ = view->message;
+        currentPending_ = true;
+        ++receiveNext_;
+      } else if (offset < kWindow) {
+        auto& early = receiveWindow_[view->sequence % kWindow];
+        if (!early.present) {
+          early.message.assign(view->message);
+          early.present = true;
+        }
+      }
+      break;
+    }
+    default:
+      return false;
+  }
+  // The first datagram of the other end asks for an answer, whatever it
+  // carries, so that it knows the channel works.
+  if (!received_) {
+    received_ = true;
+    ackDue_ = true;
+  }
+  lastReceived_ = now;
+  OnAck(view->ack, view->ackBits, now);
+  return true;
+}
+
+std::optional<std::string_view> UdpChannel::NextMessage() {
+  if (currentPending_) {
+    currentPending_ = false;
+    return current_;
+  }
+  // Reliable messages that waited for the one just delivered.
+  auto& early = receiveWindow_[receiveNext_ % kWindow];
+  if (!early.present) return std::nullopt;
+  early.present = false;
+  delivered_.swap(early.message);  // Both keep their capacity.
+  ++receiveNext_;
+  return delivered_;
+}
+
+std::optional<std::string_view> UdpChannel::NextDatagram(
+    Clock::time_point now) {
+  if (!queue_.empty()) {
+    const auto queued = std::move(queue_.front());
+    queue_.pop_front();
+    return Encode(queued.kind, queued.sequence, queued.message, now);
+  }
+  for (auto sequence = sendBase_; sequence != sendNext_; ++sequence) {
+    auto& slot = sendWindow_[sequence % kWindow];
+    if (!Due(sequence, slot, now)) continue;
+    if (slot.sends > 0) ++resends_;
+    ++slot.sends;
+    slot.sentAt = now;
+    return Encode(DatagramKind::RELIABLE, sequence, slot.message, now);
+  }
+  if (ackDue_) {
+    return Encode(DatagramKind::ACK, 0, {}, now);
+  }
+  if (probe_ && now - lastSent_ >= (received_ ? Clock::duration(kKeepAlive)
+                                              : kProbeInterval)) {
+    return Encode(DatagramKind::PROBE, 0, {}, now);
+  }
+  return std::nullopt;
+}
+
+bool UdpChannel::Busy() const {
+  return !queue_.empty() || sendBase_ != sendNext_ || ackDue_;
+}
+
+bool UdpChannel::Connected(Clock::time_point now) const {
+  return received_ && now - lastReceived_ < kTimeout;
+}
+
+std::uint64_t UdpChannel::Resends() const { return resends_; }
+
+bool UdpChannel::After(std::uint32_t a, std::uint32_t b) {
+  return static_cast<std::int32_t>(a - b) > 0;
+}
+
+void UdpChannel::OnAck(std::uint32_t ack, std::uint32_t ackBits,
+                       Clock::time_point now) {
+  // An ack beyond what we sent is forged or corrupt.
+  if (After(ack, sendNext_)) return;
+  const auto release = [&](std::uint32_t sequence) {
+    auto& slot = sendWindow_[sequence % kWindow];
+    // Karn's rule: a message sent twice tells nothing about the round trip.
+    if (!slot.acked && slot.sends == 1) {
+      OnRoundTrip(now - slot.sentAt);
+    }
+    slot.acked = true;
+    if (After(sequence + 1, ackedEnd_)) {
+      ackedEnd_ = sequence + 1;
+    }
+  };
+  while (After(ack, sendBase_)) {
+    release(sendBase_);
+    sendWindow_[sendBase_ % kWindow].message.clear();
+    ++sendBase_;
+  }
+  for (std::uint32_t i = 0; i + 1 < kWindow; ++i) {
+    const auto sequence = ack + 1 + i;
+    if ((ackBits & (std::uint32_t{1} << i)) != 0 &&
+        sequence - sendBase_ < sendNext_ - sendBase_) {
+      release(sequence);
+    }
+  }
+  // Move the waiting messages into the room made.
+  while (sendNext_ - sendBase_ < kWindow && !backlog_.empty()) {
+    auto& slot = sendWindow_[sendNext_ % kWindow];
+    slot.message.swap(backlog_.front());
+    slot.sends = 0;
+    slot.acked = false;
+    backlog_.pop_front();
+    ++sendNext_;
+  }
+}
+
+void UdpChannel::OnRoundTrip(Clock::duration sample) {
+  if (!rttMeasured_) {
+    smoothedRtt_ = sample;
+    rttVariance_ = sample / 2;
+    rttMeasured_ = true;
+    return;
+  }
+  const auto error =
+      smoothedRtt_ > sample ? smoothedRtt_ - sample : sample - smoothedRtt_;
+  rttVariance_ = (3 * rttVariance_ + error) / 4;
+  smoothedRtt_ = (7 * smoothedRtt_ + sample) / 8;
+}
+
+bool UdpChannel::Due(std::uint32_t sequence, const Outgoing& slot,
+                     Clock::time_point now) const {
+  if (slot.acked) return false;
+  if (slot.sends == 0) return true;
+  const auto elapsed = now - slot.sentAt;
+  // A later message arrived, so this one was probably lost, unless the
+  // link reordered them: wait for about a round trip to tell.
+  if (slot.sends == 1 && rttMeasured_ && After(ackedEnd_, sequence + 1) &&
+      elapsed >= smoothedRtt_ + rttVariance_) {
+    return true;
+  }
+  return elapsed >= ResendTimeout(slot.sends);
+}
+
+UdpChannel::Clock::duration UdpChannel::ResendTimeout(
+    std::uint32_t sends) const {
+  const Clock::duration base =
+      rttMeasured_ ? smoothedRtt_ + std::max<Clock::duration>(
+                                        4 * rttVariance_, kMinResendMargin)
+                   : kInitialResend;
+  // Doubled on each retry, in case the path got slower.
+  return std::min<Clock::duration>(
+      base * (1 << std::min<std::uint32_t>(sends - 1, 4)), kMaxResend);
+}
+
+std::string_view UdpChannel::Encode(DatagramKind kind, std::uint32_t sequence,
+                                    std::string_view message,
+                                    Clock::time_point now) {
+  DatagramView view;
+  view.kind = kind;
+  view.token = token_;
+  view.sequence = sequence;
+  view.ack = receiveNext_;
+  for (std::uint32_t i = 0; i + 1 < kWindow; ++i) {
+    if (receiveWindow_[(receiveNext_ + 1 + i) % kWindow].present) {
+      view.ackBits |= std::uint32_t{1} << i;
+    }
+  }
+  view.message = message;
+  ackDue_ = false;  // Every datagram carries the acknowledgements.
+  lastSent_ = now;
+  const auto size = DatagramSchema::Encode(view, datagram_);
+  return std::string_view(datagram_.data(), size);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file waker.cpp
+ * @brief Implementation of the loopback socket-pair waker.
+ */
+
+#include "waker.h"
+
+#include <SFML/Network/TcpListener.hpp>
+#include <array>
+
+#include "logger.h"
+
+bool Waker::Init() {
+  // Listen on an ephemeral loopback port just long enough to connect the
+  // two ends together.
+  sf::TcpListener listener;
+  if (listener.listen(sf::Socket::AnyPort, sf::IpAddress::LocalHost) !=
+      sf::Socket::Status::Done) {
+    LOG_ERROR("Waker: cannot listen on loopback");
+    return false;
+  }
+  if (writeEnd_.connect(sf::IpAddress::LocalHost, listener.getLocalPort()) !=
+          sf::Socket::Status::Done ||
+      listener.accept(readEnd_) != sf::Socket::Status::Done) {
+    LOG_ERROR("Waker: cannot connect socket pair");
+    return false;
+  }
+  readEnd_.setBlocking(false);
+  writeEnd_.setBlocking(false);
+  return true;
+}
+
+sf::TcpSocket& Waker::ReadSocket() { return readEnd_; }
+
+void Waker::Wake() {
+  // Only the thread that flips the flag writes: one byte per Drain() cycle.
+  if (!pending_.exchange(true, std::memory_order_acq_rel)) {
+    const char byte = 0;
+    static_cast<void>(writeEnd_.send(&byte, 1));
+  }
+}
+
+void Waker::Drain() {
+  std::array<char, 64> buffer{};
+  std::size_t received = 0;
+  while (readEnd_.receive(buffer.data(), buffer.size(), received) ==
+         sf::Socket::Status::Done) {
+  }
+  // Clearing the flag *after* reading means a Wake() racing with us either
+  // sees the flag still set (and its work will be picked up by the caller
+  // right after this) or writes a new byte that wakes the poller again.
+  pending_.store(false, std::memory_order_release);
+}
@@ -0,0 +1,265 @@
+/**
+ * @file backpressure_test.cpp
+ * @brief A room member that never reads is handled by its slow consumer
+ *        policy, while the other members of the room keep receiving.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "chat_protocol.h"
+#include "chat_server.h"
+#include "frame.h"
+#include "poller_interface.h"
+#include "server_metrics.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+constexpr RoomId kRoom = 1;
+constexpr std::size_t kHighWatermark = 128 * 1024;
+constexpr std::size_t kLowWatermark = 32 * 1024;
+/// Far above what the tests queue: only the policy closes clients.
+constexpr std::size_t kHardLimit = 64 * 1024 * 1024;
+constexpr auto kGracePeriod = 300ms;
+/// Any wait below fails after this, rather than hanging.
+constexpr auto kTimeout = 10s;
+/// Chat messages sent per Chat() call.
+constexpr int kBurst = 4;
+/// Size of the talker's messages, which tells them from the greetings.
+constexpr std::size_t kTextSize = 2000;
+constexpr std::string_view kGreeting = "hello";
+
+/// A test client, reading without blocking.
+struct Client {
+  sf::TcpSocket socket;
+  FrameReader reader;
+  std::uint64_t received = 0;   ///< The talker's messages.
+  std::uint64_t greetings = 0;  ///< kGreeting messages.
+  bool closed = false;          ///< The server closed the connection.
+};
+
+/// Send one message in kRoom from @p client.  @return false on an error.
+bool Send(Client& client, MessageType type, std::string_view text) {
+  std::array<char, MAX_FRAME_PAYLOAD> payload{};
+  std::array<char, MAX_FRAME_SIZE> frame{};
+  MessageView message;
+  message.type = type;
+  message.room = kRoom;
+  message.text = text;
+  const auto payloadSize = EncodeMessage(message, payload);
+  const auto frameSize =
+      EncodeFrame(std::string_view(payload.data(), payloadSize), frame);
+  std::size_t offset = 0;
+  while (offset < frameSize) {
+    std::size_t sent = 0;
+    const auto status =
+        client.socket.send(frame.data() + offset, frameSize - offset, sent);
+    offset += sent;
+    if (status == sf::Socket::Status::Disconnected ||
+        status == sf::Socket::Status::Error) {
+      return false;
+    }
+    if (status == sf::Socket::Status::NotReady) {
+      std::this_thread::yield();
+    }
+  }
+  return true;
+}
+
+/// Read and count everything the server sent to @p client so far.
+void Drain(Client& client) {
+  while (!client.closed) {
+    const auto status = client.reader.ReceiveFrom(client.socket);
+    if (status == sf::Socket::Status::NotReady) return;
+    if (status != sf::Socket::Status::Done) {
+      client.closed = true;
+      return;
+    }
+    while (const auto payload = client.reader.NextFrame()) {
+      const auto message = DecodeMessage(*payload);
+      if (!message || message->type != MessageType::CHAT) continue;
+      if (message->text.size() == kTextSize) {
+        ++client.received;
+      } else if (message->text == kGreeting) {
+        ++client.greetings;
+      }
+    }
+  }
+}
+
+/// Poll @p condition until it holds.  @return false if it never did.
+template <typename Condition>
+bool Until(Condition condition) {
+  const auto deadline = Clock::now() + kTimeout;
+  while (!condition()) {
+    if (Clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+/**
+ * A server updated on its own thread, and a room where @c talker_ keeps
+ * sending, @c listener_ reads everything and @c slow_ reads nothing once
+ * it joined.  Run with each poller backend, since they pause reading in
+ * their own way (a backend that is not available falls back to another).
+ */
+class BackpressureTest : public ::testing::TestWithParam<PollerBackend> {
+ protected:
+  /// Start the server with @p policy, then connect and join the clients.
+  void Start(SlowConsumerPolicy policy) {
+    BackpressureConfig config;
+    config.highWatermark = kHighWatermark;
+    config.lowWatermark = kLowWatermark;
+    config.hardLimit = kHardLimit;
+    config.policy = policy;
+    config.gracePeriod = kGracePeriod;
+    server_.SetBackpressure(config);
+    ASSERT_TRUE(server_.Start(sf::Socket::AnyPort));
+    port_ = server_.Port();
+    thread_ = std::jthread([this](std::stop_token stop) {
+      while (!stop.stop_requested()) {
+        server_.Update();
+      }
+    });
+    ASSERT_NO_FATAL_FAILURE(Join(slow_));
+    ASSERT_NO_FATAL_FAILURE(Join(talker_));
+    ASSERT_NO_FATAL_FAILURE(Join(listener_));
+  }
+
+  /// Connect @p client and wait until it is a member of kRoom.
+  void Join(Client& client) {
+    ASSERT_EQ(client.socket.connect(sf::IpAddress::LocalHost, port_),
+              sf::Socket::Status::Done);
+    client.socket.setBlocking(false);
+    ASSERT_TRUE(Send(client, MessageType::JOIN_ROOM, {}));
+    ASSERT_TRUE(Send(client, MessageType::CHAT, kGreeting));
+    // Any greeting back, its own or one from the room's backlog, means the
+    // server handled the join.
+    ASSERT_TRUE(Until([&] {
+      Drain(client);
+      return client.greetings > 0;
+    }));
+  }
+
+  /// The talker sends a few messages, the two other members read theirs.
+  void Chat() {
+    const std::string text(kTextSize, 'x');
+    for (int i = 0; i < kBurst; ++i) {
+      ASSERT_TRUE(Send(talker_, MessageType::CHAT, text));
+      ++sent_;
+    }
+    Drain(talker_);
+    Drain(listener_);
+  }
+
+  /// Keep chatting until @p done holds for the published metrics.
+  template <typename Predicate>
+  bool ChatUntil(Predicate done) {
+    return Until([&] {
+      Chat();
+      return !HasFatalFailure() && done(server_.MetricsSnapshot());
+    });
+  }
+
+  /// The members that read got every message, whatever the slow one did.
+  void ExpectEverythingDelivered() {
+    EXPECT_TRUE(Until([&] {
+      Drain(talker_);
+      Drain(listener_);
+      return talker_.received == sent_ && listener_.received == sent_;
+    })) << "sent " << sent_ << ", talker got " << talker_.received
+        << ", listener got " << listener_.received;
+    EXPECT_FALSE(talker_.closed);
+    EXPECT_FALSE(listener_.closed);
+  }
+
+  ChatServer server_{GetParam()};
+  unsigned short port_ = 0;
+  Client slow_;
+  Client talker_;
+  Client listener_;
+  std::uint64_t sent_ = 0;  ///< Messages sent by the talker.
+  std::jthread thread_;  ///< Last: stopped before the rest goes away.
+};
+
+TEST_P(BackpressureTest, DropOldestKeepsTheQueueUnderTheHighWatermark) {
+  ASSERT_NO_FATAL_FAILURE(Start(SlowConsumerPolicy::DROP_OLDEST));
+  std::uint64_t largest = 0;
+  // Over the high watermark, trimmed, and over it again, a few times.
+  ASSERT_TRUE(ChatUntil([&](const ServerMetrics& metrics) {
+    largest = std::max(largest, metrics.largestOutboundBytes);
+    return metrics.slowConsumerEvents >= 3;
+  }));
+  EXPECT_LE(largest, kHighWatermark);
+  const auto metrics = server_.MetricsSnapshot();
+  EXPECT_GT(metrics.framesDropped, 0U);
+  EXPECT_EQ(metrics.slowConsumerDisconnects, 0U);
+  ExpectEverythingDelivered();
+}
+
+TEST_P(BackpressureTest, PauseReadingResumesOnceTheQueueDrains) {
+  ASSERT_NO_FATAL_FAILURE(Start(SlowConsumerPolicy::PAUSE_READING));
+  ASSERT_TRUE(ChatUntil([](const ServerMetrics& metrics) {
+    return metrics.pausedSessions == 1;
+  }));
+  // Not read while paused: it reaches the room once reading resumes.
+  ASSERT_TRUE(Send(slow_, MessageType::CHAT, kGreeting));
+  const auto greetings = listener_.greetings;
+  ExpectEverythingDelivered();
+
+  // The slow client catches up, so its queue goes under the low watermark.
+  EXPECT_TRUE(Until([&] {
+    Drain(slow_);
+    const auto metrics = server_.MetricsSnapshot();
+    return metrics.pausedSessions == 0 && metrics.congestedSessions == 0;
+  }));
+  EXPECT_TRUE(Until([&] {
+    Drain(slow_);
+    Drain(listener_);
+    return listener_.greetings > greetings && slow_.received == sent_;
+  }));
+  const auto metrics = server_.MetricsSnapshot();
+  EXPECT_EQ(metrics.framesDropped, 0U);
+  EXPECT_EQ(metrics.slowConsumerDisconnects, 0U);
+  EXPECT_FALSE(slow_.closed);
+}
+
+TEST_P(BackpressureTest, DisconnectClosesTheClientAfterTheGracePeriod) {
+  ASSERT_NO_FATAL_FAILURE(Start(SlowConsumerPolicy::DISCONNECT));
+  const auto start = Clock::now();
+  ASSERT_TRUE(ChatUntil([](const ServerMetrics& metrics) {
+    return metrics.slowConsumerDisconnects == 1;
+  }));
+  EXPECT_GE(Clock::now() - start, kGracePeriod);
+  // The client sees the end of the stream after the frames already sent.
+  EXPECT_TRUE(Until([&] {
+    Drain(slow_);
+    return slow_.closed;
+  }));
+  EXPECT_EQ(server_.MetricsSnapshot().framesDropped, 0U);
+  ExpectEverythingDelivered();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Backends, BackpressureTest,
+    ::testing::Values(PollerBackend::SELECTOR, PollerBackend::EPOLL,
+                      PollerBackend::IO_URING),
+    [](const ::testing::TestParamInfo<PollerBackend>& paramInfo) {
+      return std::string(PollerBackendName(paramInfo.param));
+    });
+
+}  // namespace
@@ -0,0 +1,227 @@
+/**
+ * @file message_log_test.cpp
+ * @brief Records appended to the log can be read back by offset and by
+ *        time, survive a torn write and outlive retention while read.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "message_log.h"
+#include "shared_frame.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+constexpr auto kTimeout = 10s;
+
+std::uint64_t NowUs() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+/// A payload that tells record @p i from the others.
+std::string Payload(std::uint64_t i, std::size_t size = 0) {
+  auto payload = std::format("record {}", i);
+  if (payload.size() < size) payload.resize(size, '.');
+  return payload;
+}
+
+/// Every record from @p offset on.
+std::vector<LogRecord> ReadAll(const MessageLog& log, std::uint64_t offset,
+                               std::vector<std::string>& payloads) {
+  std::vector<LogRecord> records;
+  static_cast<void>(log.Read(offset, SIZE_MAX, [&](const LogRecord& record) {
+    // The view is only valid in here.
+    payloads.emplace_back(record.payload);
+    records.push_back(record);
+  }));
+  return records;
+}
+
+class MessageLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const auto* test = ::testing::UnitTest::GetInstance()->current_test_info();
+    config_.directory = std::filesystem::temp_directory_path() /
+                        std::format("message_log_test_{}_{}", test->name(),
+                                    std::chrono::system_clock::now()
+                                        .time_since_epoch()
+                                        .count());
+    config_.segmentBytes = MessageLog::kMinSegmentBytes;
+    config_.fsyncPolicy = FsyncPolicy::NONE;
+  }
+
+  void TearDown() override {
+    std::error_code error;
+    std::filesystem::remove_all(config_.directory, error);
+  }
+
+  /// Append records [@p first, @p first + @p count) to @p log.
+  void Append(MessageLog& log, std::uint64_t first, std::uint64_t count,
+              std::size_t size = 0) {
+    for (auto i = first; i < first + count; ++i) {
+      ASSERT_TRUE(log.Append(pool_.Make(Payload(i, size))));
+    }
+  }
+
+  /// Wait until the writer thread has written every record before @p end.
+  static void WaitForEnd(const MessageLog& log, std::uint64_t end) {
+    const auto deadline = Clock::now() + kTimeout;
+    while (log.EndOffset() < end) {
+      ASSERT_LT(Clock::now(), deadline);
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  /// The segment files in the log directory.
+  std::vector<std::filesystem::path> Segments() const {
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(config_.directory)) {
+      files.push_back(entry.path());
+    }
+    return files;
+  }
+
+  FramePool pool_;
+  MessageLogConfig config_;
+};
+
+TEST_F(MessageLogTest, ReadsByOffsetAndByTime) {
+  MessageLog log(config_);
+  ASSERT_TRUE(log.Open());
+  // Enough records for several sparse index entries.
+  constexpr std::uint64_t kBefore = 200;
+  constexpr std::uint64_t kAfter = 100;
+  ASSERT_NO_FATAL_FAILURE(Append(log, 0, kBefore, 100));
+  ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kBefore));
+  std::this_thread::sleep_for(2ms);
+  const auto middleUs = NowUs();
+  ASSERT_NO_FATAL_FAILURE(Append(log, kBefore, kAfter, 100));
+  ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kBefore + kAfter));
+
+  EXPECT_EQ(log.FirstOffset(), 0U);
+  EXPECT_EQ(log.EndOffset(), kBefore + kAfter);
+  std::vector<std::string> payloads;
+  EXPECT_EQ(log.Read(150, 3,
+                     [&](const LogRecord& record) {
+                       EXPECT_EQ(record.offset, 150 + payloads.size());
+                       payloads.emplace_back(record.payload);
+                     }),
+            3U);
+  EXPECT_EQ(payloads, (std::vector<std::string>{
+                          Payload(150, 100), Payload(151, 100),
+                          Payload(152, 100)}));
+
+  EXPECT_EQ(log.OffsetForTime(0), 0U);
+  EXPECT_EQ(log.OffsetForTime(middleUs), kBefore);
+  EXPECT_EQ(log.OffsetForTime(NowUs() + 1'000'000), std::nullopt);
+  payloads.clear();
+  const auto records = ReadAll(log, *log.OffsetForTime(middleUs), payloads);
+  ASSERT_EQ(records.size(), kAfter);
+  EXPECT_GE(records.front().timestampUs, middleUs);
+  EXPECT_EQ(payloads.back(), Payload(kBefore + kAfter - 1, 100));
+}
+
+TEST_F(MessageLogTest, ReopenDropsATornRecordAndGoesOn) {
+  constexpr std::uint64_t kCount = 10;
+  {
+    MessageLog log(config_);
+    ASSERT_TRUE(log.Open());
+    ASSERT_NO_FATAL_FAILURE(Append(log, 0, kCount));
+    ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kCount));
+  }
+  // A crash in the middle of the last record: its payload is not all there.
+  const auto files = Segments();
+  ASSERT_EQ(files.size(), 1U);
+  std::string bytes;
+  {
+    std::ifstream in(files.front(), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  const auto torn = bytes.find(Payload(kCount - 1));
+  ASSERT_NE(torn, std::string::npos);
+  bytes[torn] = '\0';
+  {
+    std::ofstream out(files.front(), std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  MessageLog log(config_);
+  ASSERT_TRUE(log.Open());
+  EXPECT_EQ(log.EndOffset(), kCount - 1);
+  // The next record takes the torn one's place, and nothing of it is left.
+  ASSERT_NO_FATAL_FAILURE(Append(log, kCount, 1));
+  ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kCount));
+  std::vector<std::string> payloads;
+  const auto records = ReadAll(log, 0, payloads);
+  ASSERT_EQ(records.size(), kCount);
+  EXPECT_EQ(records.back().offset, kCount - 1);
+  EXPECT_EQ(payloads.back(), Payload(kCount));
+  EXPECT_EQ(payloads[kCount - 2], Payload(kCount - 2));
+}
+
+TEST_F(MessageLogTest, SegmentDeletedByRetentionStaysReadableWhileRead) {
+  config_.retentionBytes = 2 * MessageLog::kMinSegmentBytes;
+  MessageLog log(config_);
+  ASSERT_TRUE(log.Open());
+  // About 60 records per segment.
+  constexpr std::size_t kSize = 1000;
+  constexpr std::uint64_t kFirst = 100;
+  constexpr std::uint64_t kMore = 400;
+  ASSERT_NO_FATAL_FAILURE(Append(log, 0, kFirst, kSize));
+  ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kFirst));
+  const auto oldest = Segments();
+
+  bool visited = false;
+  static_cast<void>(log.Read(0, 1, [&](const LogRecord& record) {
+    visited = true;
+    // Meanwhile the log rotates, and retention deletes this segment.
+    ASSERT_NO_FATAL_FAILURE(Append(log, kFirst, kMore, kSize));
+    ASSERT_NO_FATAL_FAILURE(WaitForEnd(log, kFirst + kMore));
+    EXPECT_GT(log.FirstOffset(), record.offset);
+    for (const auto& path : oldest) {
+      EXPECT_FALSE(std::filesystem::exists(path)) << path;
+    }
+    // Still mapped: the reader holds it.
+    EXPECT_EQ(record.payload, Payload(0, kSize));
+  }));
+  EXPECT_TRUE(visited);
+
+  // Deleted records are skipped.
+  std::vector<std::string> payloads;
+  const auto records = ReadAll(log, 0, payloads);
+  ASSERT_FALSE(records.empty());
+  EXPECT_EQ(records.front().offset, log.FirstOffset());
+  EXPECT_EQ(records.back().offset, kFirst + kMore - 1);
+  EXPECT_EQ(payloads.front(), Payload(log.FirstOffset(), kSize));
+}
+
+TEST_F(MessageLogTest, FullQueueDropsAndCounts) {
+  // Not opened: nothing drains the queue.
+  MessageLog log(config_);
+  for (std::size_t i = 0; i < MessageLog::kQueueCapacity; ++i) {
+    ASSERT_TRUE(log.Append(pool_.Make("queued")));
+  }
+  EXPECT_FALSE(log.Append(pool_.Make("dropped")));
+  EXPECT_EQ(log.DroppedCount(), 1U);
+}
+
+}  // namespace
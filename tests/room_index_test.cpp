@@ -0,0 +1,72 @@
+/**
+ * @file room_index_test.cpp
+ * @brief Joining and leaving keep the members of each room exact, whatever
+ *        the order.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "room_index.h"
+
+namespace {
+
+constexpr RoomId kRoom = 7;
+
+SlotHandle Handle(std::uint32_t index) { return {index, 1}; }
+
+/// The members of @p room, sorted by index.
+std::vector<std::uint32_t> Members(const RoomIndex& index, RoomId room) {
+  std::vector<std::uint32_t> members;
+  for (const auto handle : index.Members(room)) {
+    members.push_back(handle.index);
+  }
+  std::ranges::sort(members);
+  return members;
+}
+
+TEST(RoomIndexTest, JoinTwiceIsRefused) {
+  RoomIndex index;
+  EXPECT_TRUE(index.Join(kRoom, Handle(1)));
+  EXPECT_FALSE(index.Join(kRoom, Handle(1)));
+  EXPECT_TRUE(index.Join(LOBBY_ROOM, Handle(1)));
+  EXPECT_EQ(index.Members(kRoom).size(), 1U);
+}
+
+TEST(RoomIndexTest, LeaveMovesTheLastMemberIntoTheHole) {
+  RoomIndex index;
+  for (std::uint32_t i = 0; i < 5; ++i) {
+    ASSERT_TRUE(index.Join(kRoom, Handle(i)));
+  }
+  EXPECT_TRUE(index.Leave(kRoom, Handle(1)));
+  EXPECT_EQ(Members(index, kRoom), (std::vector<std::uint32_t>{0, 2, 3, 4}));
+  // The member that was moved can still leave, and come back.
+  EXPECT_TRUE(index.Leave(kRoom, Handle(4)));
+  EXPECT_FALSE(index.Leave(kRoom, Handle(4)));
+  EXPECT_FALSE(index.IsMember(kRoom, Handle(4)));
+  EXPECT_TRUE(index.Join(kRoom, Handle(4)));
+  EXPECT_EQ(Members(index, kRoom), (std::vector<std::uint32_t>{0, 2, 3, 4}));
+  EXPECT_TRUE(index.IsMember(kRoom, Handle(3)));
+}
+
+TEST(RoomIndexTest, SameIndexOfAnotherGenerationIsAnotherMember) {
+  RoomIndex index;
+  EXPECT_TRUE(index.Join(kRoom, {3, 1}));
+  EXPECT_FALSE(index.Leave(kRoom, {3, 2}));
+  EXPECT_TRUE(index.IsMember(kRoom, {3, 1}));
+}
+
+TEST(RoomIndexTest, EmptyRoomIsForgotten) {
+  RoomIndex index;
+  ASSERT_TRUE(index.Join(kRoom, Handle(1)));
+  ASSERT_TRUE(index.Join(kRoom, Handle(2)));
+  EXPECT_TRUE(index.Leave(kRoom, Handle(2)));
+  EXPECT_TRUE(index.Leave(kRoom, Handle(1)));
+  EXPECT_TRUE(index.Members(kRoom).empty());
+  EXPECT_FALSE(index.Leave(kRoom, Handle(1)));
+}
+
+}  // namespace
@@ -0,0 +1,96 @@
+/**
+ * @file server_metrics_test.cpp
+ * @brief The Prometheus rendering of the histograms has a fixed set of
+ *        series, however the values fall.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server_metrics.h"
+
+namespace {
+
+/// The lines of @p text that start with @p prefix.
+std::vector<std::string> Lines(const std::string& text,
+                               std::string_view prefix) {
+  std::vector<std::string> lines;
+  std::size_t start = 0;
+  while (start < text.size()) {
+    auto end = text.find('\n', start);
+    if (end == std::string::npos) end = text.size();
+    const std::string_view line(text.data() + start, end - start);
+    if (line.starts_with(prefix)) lines.emplace_back(line);
+    start = end + 1;
+  }
+  return lines;
+}
+
+/// The value at the end of a sample line.
+std::string Value(const std::string& line) {
+  return line.substr(line.rfind(' ') + 1);
+}
+
+constexpr std::string_view kDepthBucket =
+    "simplechat_outbound_queue_depth_bucket";
+
+TEST(ServerMetricsTest, EmptyHistogramHasEveryBucket) {
+  const ServerMetrics empty;
+  const ServerMetrics busy = [] {
+    ServerMetrics metrics;
+    metrics.outboundDepth.Record(5);
+    return metrics;
+  }();
+  const auto emptyBuckets = Lines(FormatPrometheus({&empty, 1}), kDepthBucket);
+  const auto busyBuckets = Lines(FormatPrometheus({&busy, 1}), kDepthBucket);
+  ASSERT_EQ(emptyBuckets.size(), busyBuckets.size());
+  ASSERT_GT(emptyBuckets.size(), 2U);
+  for (std::size_t i = 0; i < emptyBuckets.size(); ++i) {
+    // Same series, in the same order.
+    EXPECT_EQ(emptyBuckets[i].substr(0, emptyBuckets[i].rfind(' ')),
+              busyBuckets[i].substr(0, busyBuckets[i].rfind(' ')));
+    EXPECT_EQ(Value(emptyBuckets[i]), "0");
+  }
+}
+
+TEST(ServerMetricsTest, BucketsAreCumulative) {
+  ServerMetrics metrics;
+  metrics.outboundDepth.Record(0);
+  metrics.outboundDepth.Record(2);
+  metrics.outboundDepth.Record(3);
+  metrics.outboundDepth.Record(100);
+  const auto buckets = Lines(FormatPrometheus({&metrics, 1}), kDepthBucket);
+  const std::vector<std::string> expected = {
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="0"} 1)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="1"} 1)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="3"} 3)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="7"} 3)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="15"} 3)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="31"} 3)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="63"} 3)",
+      R"(simplechat_outbound_queue_depth_bucket{shard="0",le="127"} 4)",
+  };
+  ASSERT_GE(buckets.size(), expected.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(buckets[i], expected[i]);
+  }
+  EXPECT_EQ(buckets.back(),
+            R"(simplechat_outbound_queue_depth_bucket{shard="0",le="+Inf"} 4)");
+}
+
+TEST(ServerMetricsTest, ValuesAboveTheBucketsOnlyCountInInf) {
+  ServerMetrics metrics;
+  metrics.flushDelayNs.Record(std::uint64_t{1} << 40);  // About 18 minutes.
+  const auto buckets = Lines(FormatPrometheus({&metrics, 1}),
+                             "simplechat_flush_delay_seconds_bucket");
+  ASSERT_GE(buckets.size(), 2U);
+  EXPECT_EQ(Value(buckets[buckets.size() - 2]), "0");
+  EXPECT_EQ(Value(buckets.back()), "1");
+}
+
+}  // namespace
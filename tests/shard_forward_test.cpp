@@ -0,0 +1,167 @@
+/**
+ * @file shard_forward_test.cpp
+ * @brief Frames forwarded to a shard whose inbox is full reach it later,
+ *        in the order they were sent.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "chat_protocol.h"
+#include "chat_server.h"
+#include "frame.h"
+#include "shared_frame.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+constexpr RoomId kRoom = 1;
+/// Well over what a shard's inbox holds.
+constexpr std::uint32_t kMessages = 10000;
+/// Messages sent between two updates of the sending shard.
+constexpr std::uint32_t kBurst = 500;
+constexpr auto kTimeout = 10s;
+constexpr std::string_view kGreeting = "hello";
+constexpr std::string_view kText = "in order";
+
+/// A test client, sending and reading without blocking.
+struct Client {
+  sf::TcpSocket socket;
+  FrameReader reader;
+  std::string unsent;  ///< Bytes the socket did not take yet.
+  std::uint32_t nextSequence = 0;
+  std::uint32_t received = 0;  ///< kText messages, in sequence.
+  std::uint32_t misordered = 0;  ///< kText messages out of sequence.
+  bool greeted = false;  ///< Got a kGreeting back, so it joined kRoom.
+};
+
+/// Send what @p client could not send yet.  @return false on an error.
+bool Flush(Client& client) {
+  while (!client.unsent.empty()) {
+    std::size_t sent = 0;
+    const auto status =
+        client.socket.send(client.unsent.data(), client.unsent.size(), sent);
+    client.unsent.erase(0, sent);
+    if (status == sf::Socket::Status::NotReady) return true;
+    if (status == sf::Socket::Status::Disconnected ||
+        status == sf::Socket::Status::Error) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Queue one message in kRoom from @p client and try to send it.
+bool Send(Client& client, MessageType type, std::string_view text) {
+  std::array<char, MAX_FRAME_PAYLOAD> payload{};
+  std::array<char, MAX_FRAME_SIZE> frame{};
+  MessageView message;
+  message.type = type;
+  message.room = kRoom;
+  message.sequence = client.nextSequence++;
+  message.text = text;
+  const auto payloadSize = EncodeMessage(message, payload);
+  const auto frameSize =
+      EncodeFrame(std::string_view(payload.data(), payloadSize), frame);
+  client.unsent.append(frame.data(), frameSize);
+  return Flush(client);
+}
+
+/// Read what the server sent to @p client so far.
+void Drain(Client& client) {
+  while (client.reader.ReceiveFrom(client.socket) ==
+         sf::Socket::Status::Done) {
+    while (const auto payload = client.reader.NextFrame()) {
+      const auto message = DecodeMessage(*payload);
+      if (!message || message->type != MessageType::CHAT) continue;
+      if (message->text == kGreeting) {
+        client.greeted = true;
+      } else if (message->text == kText) {
+        // The sender numbered them from 2, after its JOIN_ROOM and greeting.
+        if (message->sequence == client.received + 2) {
+          ++client.received;
+        } else {
+          ++client.misordered;
+        }
+      }
+    }
+  }
+}
+
+class ShardForwardTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (auto* server : {&first_, &second_}) {
+      // Short waits: both shards are updated in turn by this thread.
+      server->SetTickRate(1000);
+      ASSERT_TRUE(server->Start(sf::Socket::AnyPort));
+    }
+    ChatServer* const firstPeers[] = {&second_};
+    ChatServer* const secondPeers[] = {&first_};
+    ASSERT_TRUE(first_.ConnectShards(firstPeers));
+    ASSERT_TRUE(second_.ConnectShards(secondPeers));
+    ASSERT_NO_FATAL_FAILURE(Join(writer_, first_));
+    ASSERT_NO_FATAL_FAILURE(Join(reader_, second_));
+  }
+
+  /// Connect @p client to @p server and wait until it is in kRoom.
+  void Join(Client& client, ChatServer& server) {
+    ASSERT_EQ(client.socket.connect(sf::IpAddress::LocalHost, server.Port()),
+              sf::Socket::Status::Done);
+    client.socket.setBlocking(false);
+    ASSERT_TRUE(Send(client, MessageType::JOIN_ROOM, {}));
+    ASSERT_TRUE(Send(client, MessageType::CHAT, kGreeting));
+    const auto deadline = Clock::now() + kTimeout;
+    while (!client.greeted) {
+      ASSERT_LT(Clock::now(), deadline);
+      first_.Update();
+      second_.Update();
+      Drain(client);
+    }
+  }
+
+  // The pools outlive the frames the shards pass each other.
+  std::shared_ptr<FramePool> firstPool_ = std::make_shared<FramePool>();
+  std::shared_ptr<FramePool> secondPool_ = std::make_shared<FramePool>();
+  ChatServer first_{DefaultPollerBackend(), firstPool_};
+  ChatServer second_{DefaultPollerBackend(), secondPool_};
+  Client writer_;  ///< On the first shard.
+  Client reader_;  ///< On the second shard.
+};
+
+TEST_F(ShardForwardTest, FramesParkedForAFullInboxKeepTheirOrder) {
+  const auto deadline = Clock::now() + kTimeout;
+  std::uint32_t sent = 0;
+  for (int turn = 0; reader_.received + reader_.misordered < kMessages;
+       ++turn) {
+    ASSERT_LT(Clock::now(), deadline);
+    for (std::uint32_t i = 0; i < kBurst && sent < kMessages; ++i, ++sent) {
+      ASSERT_TRUE(Send(writer_, MessageType::CHAT, kText));
+    }
+    first_.Update();
+    // The second shard falls behind, so its inbox fills up, then empties
+    // while the first shard still has frames waiting for it.
+    if (turn % 16 == 15 || sent == kMessages) {
+      second_.Update();
+    }
+    Drain(writer_);
+    Drain(reader_);
+  }
+  EXPECT_EQ(reader_.misordered, 0U);
+  EXPECT_EQ(reader_.received, kMessages);
+}
+
+}  // namespace
@@ -0,0 +1,223 @@
+/**
+ * @file shared_frame_test.cpp
+ * @brief A broadcast frame stays in its pool block until the last queue
+ *        holding it has sent it, dropped it or gone away.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "outbound_queue.h"
+#include "shared_frame.h"
+
+namespace {
+
+constexpr std::size_t kRecipients = 4;
+
+/// Pretend the kernel took everything Gather() offered.
+sf::Socket::Status WriteAll(OutboundQueue& queue) {
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> buffers;
+  const auto count = queue.Gather(buffers);
+  std::int64_t bytes = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    bytes += static_cast<std::int64_t>(buffers[i].size());
+  }
+  return queue.Complete(bytes);
+}
+
+TEST(SharedFrameTest, OneBlockWhateverTheRecipients) {
+  FramePool pool;
+  std::vector<OutboundQueue> queues(kRecipients);
+  {
+    const auto frame = pool.Make("hello room");
+    for (auto& queue : queues) {
+      queue.Push(frame);
+    }
+  }
+  EXPECT_EQ(pool.LiveCount(), 1U);
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> first;
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> last;
+  ASSERT_EQ(queues.front().Gather(first), 1U);
+  ASSERT_EQ(queues.back().Gather(last), 1U);
+  EXPECT_EQ(first[0].data(), last[0].data());
+}
+
+TEST(SharedFrameTest, ReleasedOnceLastQueueCompletes) {
+  FramePool pool;
+  std::vector<OutboundQueue> queues(kRecipients);
+  {
+    const auto frame = pool.Make("hello room");
+    for (auto& queue : queues) {
+      queue.Push(frame);
+    }
+  }
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    EXPECT_EQ(pool.LiveCount(), 1U) << "after " << i << " recipients";
+    EXPECT_EQ(WriteAll(queues[i]), sf::Socket::Status::Done);
+    EXPECT_TRUE(queues[i].Empty());
+  }
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, PartialWriteKeepsTheFrame) {
+  FramePool pool;
+  OutboundQueue queue;
+  queue.Push(pool.Make("a frame written in two parts"));
+  const auto size = static_cast<std::int64_t>(queue.SizeBytes());
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> buffers;
+  ASSERT_EQ(queue.Gather(buffers), 1U);
+  EXPECT_EQ(queue.Complete(size / 2), sf::Socket::Status::NotReady);
+  EXPECT_EQ(pool.LiveCount(), 1U);
+  ASSERT_EQ(queue.Gather(buffers), 1U);
+  EXPECT_EQ(queue.Complete(size - size / 2), sf::Socket::Status::Done);
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, ReleasedWhenRecipientsGoAway) {
+  FramePool pool;
+  std::vector<std::optional<OutboundQueue>> queues(kRecipients);
+  {
+    const auto frame = pool.Make("hello room");
+    for (auto& queue : queues) {
+      queue.emplace();
+      queue->Push(frame);
+    }
+  }
+  // E.g. the sessions are removed, one after the other.
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    EXPECT_EQ(pool.LiveCount(), 1U);
+    queues[i].reset();
+  }
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, ReleasedOnceLastQueueFlushes) {
+  sf::TcpListener listener;
+  ASSERT_EQ(listener.listen(sf::Socket::AnyPort, sf::IpAddress::LocalHost),
+            sf::Socket::Status::Done);
+  std::array<sf::TcpSocket, kRecipients> clients;
+  std::array<sf::TcpSocket, kRecipients> accepted;
+  for (std::size_t i = 0; i < kRecipients; ++i) {
+    ASSERT_EQ(clients[i].connect(sf::IpAddress::LocalHost,
+                                 listener.getLocalPort()),
+              sf::Socket::Status::Done);
+    ASSERT_EQ(listener.accept(accepted[i]), sf::Socket::Status::Done);
+    accepted[i].setBlocking(false);
+  }
+
+  FramePool pool;
+  std::array<OutboundQueue, kRecipients> queues;
+  {
+    const auto frame = pool.Make("hello room");
+    for (auto& queue : queues) {
+      queue.Push(frame);
+    }
+  }
+  for (std::size_t i = 0; i < kRecipients; ++i) {
+    EXPECT_EQ(pool.LiveCount(), 1U);
+    EXPECT_EQ(queues[i].Flush(accepted[i]), sf::Socket::Status::Done);
+  }
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, DropOldestReleasesDroppedFrames) {
+  FramePool pool;
+  std::vector<OutboundQueue> queues(2);
+  {
+    const auto old = pool.Make("an old message");
+    const auto recent = pool.Make("a recent message");
+    for (auto& queue : queues) {
+      queue.Push(old);
+      queue.Push(recent);
+    }
+  }
+  ASSERT_EQ(pool.LiveCount(), 2U);
+  const auto recentSize = queues[0].SizeBytes() / 2 + 1;
+  // One recipient falls behind: its old frame goes, the other still has it.
+  EXPECT_EQ(queues[0].DropOldest(recentSize), 1U);
+  EXPECT_EQ(pool.LiveCount(), 2U);
+  EXPECT_EQ(queues[1].DropOldest(recentSize), 1U);
+  EXPECT_EQ(pool.LiveCount(), 1U);
+  EXPECT_EQ(queues[0].DropOldest(0), 1U);
+  EXPECT_EQ(queues[1].DropOldest(0), 1U);
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, DropOldestKeepsFramesThatAreNotDroppable) {
+  FramePool pool;
+  OutboundQueue queue;
+  queue.Push(pool.Make("HELLO reply"), false);
+  queue.Push(pool.Make("chat"));
+  queue.Push(pool.Make("more chat"));
+  EXPECT_EQ(queue.DropOldest(0), 2U);
+  EXPECT_EQ(queue.Size(), 1U);
+  EXPECT_EQ(pool.LiveCount(), 1U);
+  EXPECT_EQ(WriteAll(queue), sf::Socket::Status::Done);
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(SharedFrameTest, DropOldestKeepsThePartlySentFrame) {
+  FramePool pool;
+  OutboundQueue queue;
+  queue.Push(pool.Make("half sent"));
+  queue.Push(pool.Make("not sent"));
+  std::array<std::span<const char>, OutboundQueue::kMaxBatch> buffers;
+  ASSERT_EQ(queue.Gather(buffers), 2U);
+  ASSERT_EQ(queue.Complete(3), sf::Socket::Status::NotReady);
+  // Cutting the first frame would corrupt the stream.
+  EXPECT_EQ(queue.DropOldest(0), 1U);
+  EXPECT_EQ(pool.LiveCount(), 1U);
+  EXPECT_EQ(WriteAll(queue), sf::Socket::Status::Done);
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+TEST(FramePoolTest, FrameReleasedOnAnotherThreadGoesBackToItsPool) {
+  FramePool pool;
+  auto frame = pool.Make("forwarded to another shard");
+  const char* const block = frame.Bytes().data();
+  std::thread([&frame] { frame = SharedFrame{}; }).join();
+  EXPECT_EQ(pool.LiveCount(), 0U);
+  EXPECT_EQ(pool.Make("the next message").Bytes().data(), block);
+}
+
+TEST(FramePoolTest, ReleasesFromManyThreadsWhileMaking) {
+  constexpr std::size_t kThreads = 4;
+  constexpr std::size_t kFrames = 256;
+  constexpr int kRounds = 50;
+  const std::string large(1000, 'x');  // The other size class.
+  FramePool pool;
+  for (int round = 0; round < kRounds; ++round) {
+    std::vector<SharedFrame> frames;
+    for (std::size_t i = 0; i < kFrames; ++i) {
+      frames.push_back(
+          pool.Make(i % 2 == 0 ? std::string_view("short") : large));
+    }
+    // Every thread holds a reference on every frame, like the queues of
+    // the other shards.
+    std::vector<std::jthread> threads;
+    for (std::size_t t = 0; t < kThreads; ++t) {
+      threads.emplace_back([copies = frames]() mutable { copies.clear(); });
+    }
+    frames.clear();
+    // Meanwhile the owner keeps making frames from the blocks coming back.
+    for (std::size_t i = 0; i < kFrames; ++i) {
+      frames.push_back(pool.Make("made while others release"));
+    }
+    frames.clear();
+  }
+  EXPECT_EQ(pool.LiveCount(), 0U);
+}
+
+}  // namespace
@@ -0,0 +1,199 @@
+/**
+ * @file shared_state_test.cpp
+ * @brief Clients on two shards filling the shared state of a room past its
+ *        budget leave both shards with the same copy.
+ */
+
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "chat_protocol.h"
+#include "chat_server.h"
+#include "frame.h"
+#include "replicated_state.h"
+#include "shared_frame.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+constexpr auto kTimeout = 10s;
+constexpr std::string_view kGreeting = "hello";
+/// Entries each client sets: either client alone would go over the budget.
+constexpr std::uint16_t kEntries = 24;
+/// Entries each client sets between two updates of the shards.
+constexpr std::uint16_t kBurst = 2;
+constexpr std::size_t kValueSize = 200;
+constexpr std::size_t kEntrySize = StateEntrySchema::kFixedSize + kValueSize;
+static_assert(kEntries * kEntrySize > ReplicatedState::kMaxSnapshotBytes);
+
+/// A test client, sending and reading without blocking.
+struct Client {
+  sf::TcpSocket socket;
+  FrameReader reader;
+  std::string unsent;  ///< Bytes the socket did not take yet.
+  StateReplica replica;  ///< Of the room, as its shard sends it.
+  bool greeted = false;  ///< Got a kGreeting back, so it joined the room.
+};
+
+/// Send what @p client could not send yet.  @return false on an error.
+bool Flush(Client& client) {
+  while (!client.unsent.empty()) {
+    std::size_t sent = 0;
+    const auto status =
+        client.socket.send(client.unsent.data(), client.unsent.size(), sent);
+    client.unsent.erase(0, sent);
+    if (status == sf::Socket::Status::NotReady) return true;
+    if (status == sf::Socket::Status::Disconnected ||
+        status == sf::Socket::Status::Error) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Queue one message in @p room from @p client and try to send it.
+bool Send(Client& client, RoomId room, MessageType type,
+          std::string_view text) {
+  std::array<char, MAX_FRAME_PAYLOAD> payload{};
+  std::array<char, MAX_FRAME_SIZE> frame{};
+  MessageView message;
+  message.type = type;
+  message.room = room;
+  message.text = text;
+  const auto payloadSize = EncodeMessage(message, payload);
+  const auto frameSize =
+      EncodeFrame(std::string_view(payload.data(), payloadSize), frame);
+  client.unsent.append(frame.data(), frameSize);
+  return Flush(client);
+}
+
+/// Read what the server sent to @p client so far.
+void Drain(Client& client) {
+  while (client.reader.ReceiveFrom(client.socket) ==
+         sf::Socket::Status::Done) {
+    while (const auto payload = client.reader.NextFrame()) {
+      const auto message = DecodeMessage(*payload);
+      if (!message) continue;
+      if (message->type == MessageType::CHAT && message->text == kGreeting) {
+        client.greeted = true;
+      } else if (message->type == MessageType::STATE_DELTA) {
+        EXPECT_TRUE(client.replica.Apply(message->text));
+      }
+    }
+  }
+}
+
+/// Encoded size of the entries of @p replica.
+std::size_t StateBytes(const StateReplica& replica) {
+  std::size_t bytes = 0;
+  for (const auto& [key, value] : replica.Entries()) {
+    bytes += StateEntrySchema::kFixedSize + value.size();
+  }
+  return bytes;
+}
+
+/**
+ * Two shards updated in turn by this thread, each with a client in the
+ * room.  Run with two rooms, whose states are decided by different shards.
+ */
+class SharedStateTest : public ::testing::TestWithParam<RoomId> {
+ protected:
+  void SetUp() override {
+    for (auto* server : {&first_, &second_}) {
+      server->SetTickRate(1000);
+      ASSERT_TRUE(server->Start(sf::Socket::AnyPort));
+    }
+    ChatServer* const firstPeers[] = {&second_};
+    ChatServer* const secondPeers[] = {&first_};
+    ASSERT_TRUE(first_.ConnectShards(firstPeers));
+    ASSERT_TRUE(second_.ConnectShards(secondPeers));
+    ASSERT_NO_FATAL_FAILURE(Join(firstClient_, first_));
+    ASSERT_NO_FATAL_FAILURE(Join(secondClient_, second_));
+  }
+
+  /// Connect @p client to @p server and wait until it is in the room.
+  void Join(Client& client, ChatServer& server) {
+    ASSERT_EQ(client.socket.connect(sf::IpAddress::LocalHost, server.Port()),
+              sf::Socket::Status::Done);
+    client.socket.setBlocking(false);
+    ASSERT_TRUE(Send(client, GetParam(), MessageType::JOIN_ROOM, {}));
+    ASSERT_TRUE(Send(client, GetParam(), MessageType::CHAT, kGreeting));
+    const auto deadline = Clock::now() + kTimeout;
+    while (!client.greeted) {
+      ASSERT_LT(Clock::now(), deadline);
+      Update();
+      Drain(client);
+    }
+  }
+
+  /// Set entry @p key of @p client to a value of kValueSize bytes.
+  void Set(Client& client, std::uint16_t key) {
+    std::array<char, MAX_FRAME_PAYLOAD> entries{};
+    std::size_t size = 0;
+    ASSERT_TRUE(EncodeStateSet(key, std::string(kValueSize, 'v'), false,
+                               entries, size));
+    ASSERT_TRUE(Send(client, GetParam(), MessageType::STATE_SET,
+                     std::string_view(entries.data(), size)));
+  }
+
+  void Update() {
+    first_.Update();
+    second_.Update();
+  }
+
+  // The pools outlive the frames the shards pass each other.
+  std::shared_ptr<FramePool> firstPool_ = std::make_shared<FramePool>();
+  std::shared_ptr<FramePool> secondPool_ = std::make_shared<FramePool>();
+  ChatServer first_{DefaultPollerBackend(), firstPool_};
+  ChatServer second_{DefaultPollerBackend(), secondPool_};
+  Client firstClient_;   ///< On the first shard.
+  Client secondClient_;  ///< On the second shard.
+};
+
+TEST_P(SharedStateTest, ShardsRefuseTheSameEntriesOverTheBudget) {
+  // Each shard gets its own client's entries before the other's.
+  for (std::uint16_t key = 0; key < kEntries; key += kBurst) {
+    for (std::uint16_t i = key; i < key + kBurst; ++i) {
+      ASSERT_NO_FATAL_FAILURE(Set(firstClient_, i));
+      ASSERT_NO_FATAL_FAILURE(Set(secondClient_, i));
+    }
+    Update();
+  }
+  // Once no entry of kValueSize fits any more, every later one is refused:
+  // both copies are final.
+  const auto full = [](const Client& client) {
+    return StateBytes(client.replica) + kEntrySize >
+           ReplicatedState::kMaxSnapshotBytes;
+  };
+  const auto deadline = Clock::now() + kTimeout;
+  while (!full(firstClient_) || !full(secondClient_) ||
+         firstClient_.replica.Entries() != secondClient_.replica.Entries()) {
+    ASSERT_LT(Clock::now(), deadline)
+        << "first shard: " << firstClient_.replica.Entries().size()
+        << " entries, second shard: "
+        << secondClient_.replica.Entries().size();
+    ASSERT_TRUE(Flush(firstClient_));
+    ASSERT_TRUE(Flush(secondClient_));
+    Update();
+    Drain(firstClient_);
+    Drain(secondClient_);
+  }
+  EXPECT_EQ(firstClient_.replica.Version(), secondClient_.replica.Version());
+}
+
+INSTANTIATE_TEST_SUITE_P(Owners, SharedStateTest, ::testing::Values(RoomId{1}, RoomId{2}));
+
+}  // namespace